@@ -0,0 +1,216 @@
+"""Runs the .puh programs in bench/ and compares them with a stored baseline.
+
+    python3 bench/run.py [--puhuc PATH] [--runs N] [--threshold 0.1] [--update] [name ...]
+
+Every program runs N times. The report has the median and p95 wall time, the compile and run split,
+the instructions executed (when 'perf' is installed) and the peak RSS, sampled every few ms. The
+compile time comes from '-norun', which stops after code generation. A program is a regression when its median time is
+more than 'threshold' over the baseline or its output changed. The exit code is 1 if any program
+regressed. '--update' writes the current numbers as the new baseline instead. Baselines only
+compare on the machine they were made on, so bench/baseline.json is not committed: make it once
+with '--update' on a known good build of the machine that runs the comparison. Without a baseline,
+or without an entry for a program, the run fails instead of passing unchecked.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_PUHUC = os.path.join(BENCH_DIR, "..", "bin", "puhuc")
+BASELINE = os.path.join(BENCH_DIR, "baseline.json")
+
+# Size of the generated compile benchmark. Functions are globals, whose slots are a byte in the
+# bytecode, so it grows by the statements in each function instead.
+LARGE_FUNCTIONS = 200
+LARGE_STATEMENTS = 12
+
+
+def generate_large(path):
+    """Writes a program that takes long to compile and little to run."""
+    with open(path, "w") as out:
+        for i in range(LARGE_FUNCTIONS):
+            out.write("int f%d(int x)\n{\n" % i)
+            out.write("    int a = x * %d + 3;\n" % (i % 13))
+            for k in range(LARGE_STATEMENTS):
+                out.write("    for (int j = 0; j < 4; j += 1)\n")
+                out.write("        a = a + j * %d - (a / 7);\n" % ((i + k) % 7))
+                out.write("    if (a > 1000)\n        a = a %% %d;\n" % (1000 - k))
+            if i > 0:
+                out.write("    return a + f%d(x);\n}\n\n" % (i - 1))
+            else:
+                out.write("    return a;\n}\n\n")
+        out.write("void main()\n{\n    print(\"large %%i\\n\", f%d(1));\n}\n" % (LARGE_FUNCTIONS - 1))
+
+
+def programs(tmp):
+    found = {}
+    for name in sorted(os.listdir(BENCH_DIR)):
+        if name.endswith(".puh"):
+            found[name[:-4]] = os.path.join(BENCH_DIR, name)
+    found["large"] = os.path.join(tmp, "large.puh")
+    generate_large(found["large"])
+    return found
+
+
+# How often the peak RSS of a running program is sampled, in seconds.
+RSS_INTERVAL = 0.002
+
+
+def high_water_mark(pid):
+    """VmHWM of a live process in KiB, or None once it has exited."""
+    try:
+        with open("/proc/%d/status" % pid) as status:
+            for line in status:
+                if line.startswith("VmHWM:"):
+                    return int(line.split()[1])
+    except OSError:
+        pass
+    return None
+
+
+def timed(cmd):
+    """Runs a command, returns its wall time, peak RSS in KiB and output.
+
+    The rusage of the child would include the memory the forked runner had before the exec, so
+    the peak is sampled from the program itself while it runs."""
+    start = time.perf_counter()
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    peak = [0]
+    done = threading.Event()
+
+    def sample():
+        while True:
+            hwm = high_water_mark(proc.pid)
+            if hwm is not None:
+                peak[0] = max(peak[0], hwm)
+            if done.wait(RSS_INTERVAL):
+                return
+
+    sampler = threading.Thread(target=sample)
+    sampler.start()
+    output = proc.stdout.read()
+    done.set()
+    sampler.join()
+    proc.wait()
+    wall = time.perf_counter() - start
+    if proc.returncode != 0:
+        raise RuntimeError("%s exited with %d" % (" ".join(cmd), proc.returncode))
+    return wall, peak[0], output
+
+
+def instructions(cmd):
+    """Instructions the command retired in user space, or None without perf."""
+    if not shutil.which("perf"):
+        return None
+    with tempfile.NamedTemporaryFile("r", suffix=".csv") as stats:
+        subprocess.run(["perf", "stat", "-x,", "-e", "instructions:u", "-o", stats.name, "--"] + cmd,
+                       stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        for line in stats.read().splitlines():
+            fields = line.split(",")
+            if len(fields) > 2 and fields[2].startswith("instructions") and fields[0].isdigit():
+                return int(fields[0])
+    return None
+
+
+def percentile(values, p):
+    values = sorted(values)
+    index = min(len(values) - 1, max(0, int(round(p * (len(values) - 1)))))
+    return values[index]
+
+
+def measure(puhuc, path, runs):
+    walls, rss, output = [], 0, b""
+    for _ in range(runs):
+        wall, peak, output = timed([puhuc, path])
+        walls.append(wall)
+        rss = max(rss, peak)
+    compiles = [timed([puhuc, "-norun", path])[0] for _ in range(runs)]
+
+    median = percentile(walls, 0.5)
+    compile_time = percentile(compiles, 0.5)
+    return {
+        "median": median,
+        "p95": percentile(walls, 0.95),
+        "compile": compile_time,
+        "run": max(0.0, median - compile_time),
+        "instructions": instructions([puhuc, path]),
+        "peak_rss_kb": rss,
+        "output": hashlib.sha1(output).hexdigest(),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Puhu benchmark runner")
+    parser.add_argument("--puhuc", default=DEFAULT_PUHUC, help="compiler binary to measure")
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("--threshold", type=float, default=0.10, help="allowed slowdown of the median")
+    parser.add_argument("--baseline", default=BASELINE)
+    parser.add_argument("--update", action="store_true", help="store the results as the baseline")
+    parser.add_argument("names", nargs="*", help="benchmarks to run, all of them by default")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.puhuc):
+        sys.exit("no compiler at %s, pass --puhuc" % args.puhuc)
+
+    baseline = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    elif not args.update:
+        sys.exit("no baseline at %s, make one with --update on a known good build" % args.baseline)
+
+    results = {}
+    regressions = []
+    with tempfile.TemporaryDirectory() as tmp:
+        found = programs(tmp)
+        names = args.names or list(found)
+        print("%-10s %9s %9s %9s %9s %14s %9s  %s" % ("name", "median", "p95", "compile", "run", "instructions", "rss KiB", "vs baseline"))
+        for name in names:
+            if name not in found:
+                sys.exit("unknown benchmark '%s'" % name)
+            result = measure(args.puhuc, found[name], args.runs)
+            results[name] = result
+
+            note = ""
+            base = baseline.get(name)
+            if not base and not args.update:
+                regressions.append(name)
+                note = "NO BASELINE"
+            elif base:
+                change = result["median"] / base["median"] - 1.0
+                note = "%+.1f%%" % (100.0 * change)
+                if change > args.threshold:
+                    regressions.append(name)
+                    note += " SLOWER"
+                if result["output"] != base["output"]:
+                    regressions.append(name)
+                    note += " OUTPUT CHANGED"
+            count = result["instructions"]
+            print("%-10s %9.4f %9.4f %9.4f %9.4f %14s %9d  %s" % (
+                name, result["median"], result["p95"], result["compile"], result["run"],
+                "n/a" if count is None else count, result["peak_rss_kb"], note))
+
+    if args.update:
+        baseline.update(results)
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=4, sort_keys=True)
+            f.write("\n")
+        print("baseline written to %s" % args.baseline)
+        return 0
+
+    if regressions:
+        print("regressions: %s" % ", ".join(sorted(set(regressions))))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
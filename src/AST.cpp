@@ -90,6 +90,16 @@ void ExprAddr::accept(AstVisitor* visitor)
     visitor->visit(this);
 }
 
+void ExprSpawn::accept(AstVisitor* visitor)
+{
+    visitor->visit(this);
+}
+
+void ExprJoin::accept(AstVisitor* visitor)
+{
+    visitor->visit(this);
+}
+
 void StmtBlock::accept(AstVisitor* visitor)
 {
     visitor->visit(this);
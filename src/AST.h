@@ -24,7 +24,9 @@ enum class ExprType
     Take,
     Get,
     Set,
-    Addr
+    Addr,
+    Spawn,
+    Join
 };
 
 class AstVisitor;
@@ -33,9 +35,9 @@ class Expr
 {
 public:
     const ExprType instance;
-    std::shared_ptr<Type> type;
+    Type* type;
 
-    Expr(ExprType instance, std::shared_ptr<Type> type)
+    Expr(ExprType instance, Type* type)
         : instance(instance), type(type)
     {
     }
@@ -51,9 +53,10 @@ public:
     Expr* callee;
     Expr* index;
     Token bracket;
+    bool checkIndex;
 
     ExprArrGet(Expr* callee, Expr* index, Token bracket)
-        : Expr(ExprType::ArrGet, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), callee(callee), index(index), bracket(bracket)
+        : Expr(ExprType::ArrGet, TypeContext::primitive(TypeTag::NULL_TYPE)), callee(callee), index(index), bracket(bracket), checkIndex(false)
     {
     }
 
@@ -73,9 +76,10 @@ public:
     Expr* index;
     Expr* assignment;
     Token bracket;
+    bool checkIndex;
 
     ExprArrSet(Expr* callee, Expr* index, Expr* assignment, Token bracket)
-        : Expr(ExprType::ArrSet, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), callee(callee), index(index), assignment(assignment), bracket(bracket)
+        : Expr(ExprType::ArrSet, TypeContext::primitive(TypeTag::NULL_TYPE)), callee(callee), index(index), assignment(assignment), bracket(bracket), checkIndex(false)
     {
     }
 
@@ -95,7 +99,7 @@ public:
     Expr* assignment;
 
     ExprAssignment(Token name, Expr* assignment)
-        : Expr(ExprType::Assignment, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), name(name), assignment(assignment)
+        : Expr(ExprType::Assignment, TypeContext::primitive(TypeTag::NULL_TYPE)), name(name), assignment(assignment)
     {
     }
 
@@ -115,7 +119,7 @@ public:
     Token op;
 
     ExprBinary(Expr* left, Expr* right, Token op)
-        : Expr(ExprType::Binary, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), left(left), right(right), op(op)
+        : Expr(ExprType::Binary, TypeContext::primitive(TypeTag::NULL_TYPE)), left(left), right(right), op(op)
     {
     }
 
@@ -153,12 +157,12 @@ public:
 class ExprCast : public Expr
 {
 public:
-    std::shared_ptr<Type> from;
-    std::shared_ptr<Type> to;
+    Type* from;
+    Type* to;
     Expr* expr;
 
-    ExprCast(std::shared_ptr<Type> to, Expr* expr)
-        : Expr(ExprType::Cast, to), from(std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), to(to), expr(expr)
+    ExprCast(Type* to, Expr* expr)
+        : Expr(ExprType::Cast, to), from(TypeContext::primitive(TypeTag::NULL_TYPE)), to(to), expr(expr)
     {
     }
 
@@ -177,7 +181,7 @@ public:
     Token op;
 
     ExprUnary(Expr* expr, Token op)
-        : Expr(ExprType::Unary, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), expr(expr), op(op)
+        : Expr(ExprType::Unary, TypeContext::primitive(TypeTag::NULL_TYPE)), expr(expr), op(op)
     {
     }
 
@@ -195,7 +199,7 @@ public:
     Token name;
 
     ExprVariable(Token name)
-        : Expr(ExprType::Variable, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), name(name)
+        : Expr(ExprType::Variable, TypeContext::primitive(TypeTag::NULL_TYPE)), name(name)
     {
     }
 
@@ -222,7 +226,7 @@ public:
     Token op;
 
     ExprLogic(Expr* left, Expr* right, Token op)
-        : Expr(ExprType::Logic, std::make_shared<TypePrimitive>(TypeTag::BOOL)), left(left), right(right), op(op)
+        : Expr(ExprType::Logic, TypeContext::primitive(TypeTag::BOOL)), left(left), right(right), op(op)
     {
     }
 
@@ -238,11 +242,11 @@ public:
 class ExprHeap : public Expr
 {
 public:
-    std::shared_ptr<Type> constructType;
+    Type* constructType;
     Token token;
 
-    ExprHeap(std::shared_ptr<Type> constructType, Token token)
-        : Expr(ExprType::Heap, std::make_shared<TypePointer>(true, constructType)), constructType(constructType), token(token)
+    ExprHeap(Type* constructType, Token token)
+        : Expr(ExprType::Heap, TypeContext::pointer(true, constructType)), constructType(constructType), token(token)
     {
     }
 
@@ -260,7 +264,7 @@ public:
     Token token;
 
     ExprGetDeref(Expr* callee, Token token)
-        : Expr(ExprType::GetDeref, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), callee(callee), token(token) {}
+        : Expr(ExprType::GetDeref, TypeContext::primitive(TypeTag::NULL_TYPE)), callee(callee), token(token) {}
 
     ~ExprGetDeref()
     {
@@ -279,7 +283,7 @@ public:
     Token equal;
 
     ExprSetDeref(Expr* callee, Expr* asgn, Token token, Token equal)
-        : Expr(ExprType::SetDeref, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), callee(callee), asgn(asgn), token(token), equal(equal) {}
+        : Expr(ExprType::SetDeref, TypeContext::primitive(TypeTag::NULL_TYPE)), callee(callee), asgn(asgn), token(token), equal(equal) {}
 
     ~ExprSetDeref()
     {
@@ -296,7 +300,7 @@ public:
     Token token;
 
     ExprRef(Expr* callee, Token token)
-        : Expr(ExprType::Ref, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), callee(callee), token(token)
+        : Expr(ExprType::Ref, TypeContext::primitive(TypeTag::NULL_TYPE)), callee(callee), token(token)
     {
     }
 
@@ -315,7 +319,7 @@ public:
     Token token;
 
     ExprTake(Expr* source, Token token)
-        : Expr(ExprType::Ref, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), source(source), token(token) {}
+        : Expr(ExprType::Ref, TypeContext::primitive(TypeTag::NULL_TYPE)), source(source), token(token) {}
 
     ~ExprTake()
     {
@@ -332,7 +336,7 @@ public:
     Token get;
 
     ExprGet(Expr* callee, Token get)
-        : Expr(ExprType::Get, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), callee(callee), get(get) {}
+        : Expr(ExprType::Get, TypeContext::primitive(TypeTag::NULL_TYPE)), callee(callee), get(get) {}
 
     ~ExprGet()
     {
@@ -350,7 +354,7 @@ public:
     Token get;
 
     ExprSet(Expr* callee, Expr* asgn, Token get)
-        : Expr(ExprType::Set, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), callee(callee), asgn(asgn), get(get) {}
+        : Expr(ExprType::Set, TypeContext::primitive(TypeTag::NULL_TYPE)), callee(callee), asgn(asgn), get(get) {}
 
     ~ExprSet()
     {
@@ -368,7 +372,7 @@ public:
     Token token;
 
     ExprAddr(Expr* callee, Token token)
-        : Expr(ExprType::Addr, std::make_shared<TypePrimitive>(TypeTag::NULL_TYPE)), callee(callee), token(token)
+        : Expr(ExprType::Addr, TypeContext::primitive(TypeTag::NULL_TYPE)), callee(callee), token(token)
     {
     }
 
@@ -380,6 +384,46 @@ public:
     void accept(AstVisitor* visitor);
 };
 
+// Runs the call on the task pool and gives a handle to its result.
+class ExprSpawn : public Expr
+{
+public:
+    ExprCall* call;
+    Token token;
+
+    ExprSpawn(ExprCall* call, Token token)
+        : Expr(ExprType::Spawn, TypeContext::primitive(TypeTag::NULL_TYPE)), call(call), token(token)
+    {
+    }
+
+    ~ExprSpawn()
+    {
+        delete call;
+    }
+
+    void accept(AstVisitor* visitor);
+};
+
+// Waits for a spawned call and gives its result. The handle can not be joined again.
+class ExprJoin : public Expr
+{
+public:
+    Expr* handle;
+    Token token;
+
+    ExprJoin(Expr* handle, Token token)
+        : Expr(ExprType::Join, TypeContext::primitive(TypeTag::NULL_TYPE)), handle(handle), token(token)
+    {
+    }
+
+    ~ExprJoin()
+    {
+        delete handle;
+    }
+
+    void accept(AstVisitor* visitor);
+};
+
 class Stmt
 {
 public:
@@ -429,10 +473,10 @@ class StmtFunc : public Stmt
 public:
     Token name;
     StmtBlock* body;
-    std::shared_ptr<TypeFunction> func_type;
+    TypeFunction* func_type;
     std::vector<Token> args;
 
-    StmtFunc(Token name, StmtBlock* body, std::shared_ptr<TypeFunction> func_type, std::vector<Token> args)
+    StmtFunc(Token name, StmtBlock* body, TypeFunction* func_type, std::vector<Token> args)
         : name(name), func_type(func_type), body(body), args(args)
     {
     }
@@ -448,12 +492,13 @@ public:
 class StmtVarDecleration : public Stmt
 {
 public:
-    std::shared_ptr<Type> varType;
+    Type* varType;
     Token name;
     Expr* initializer;
+    bool inFrame; // a 'heap' initializer that never escapes, it is placed in the frame
 
-    StmtVarDecleration(std::shared_ptr<Type> varType, Token name, Expr* initializer)
-        : varType(varType), name(name), initializer(initializer)
+    StmtVarDecleration(Type* varType, Token name, Expr* initializer)
+        : varType(varType), name(name), initializer(initializer), inFrame(false)
     {
     }
 
@@ -508,6 +553,14 @@ public:
     void accept(AstVisitor* visitor);
 };
 
+// Index check hoisted in front of a loop: 'bound + offset' must not exceed 'size'.
+struct BoundCheck
+{
+    Expr* bound;
+    int offset;
+    size_t size;
+};
+
 class StmtFor : public Stmt
 {
 public:
@@ -516,6 +569,7 @@ public:
     Expr* inc;
     Stmt* loop;
     Token paren;
+    std::vector<BoundCheck> boundChecks;
 
     StmtFor(Stmt* decl, Expr* cond, Expr* inc, Stmt* loop, Token paren)
         : decl(decl), cond(cond), inc(inc), loop(loop), paren(paren)
@@ -559,11 +613,11 @@ public:
 class StmtStruct : public Stmt
 {
 public:
-    std::shared_ptr<TypeStruct> type;
+    TypeStruct* type;
     std::unordered_map<std::string, StmtFunc*> methodes;
     Token token;
 
-    StmtStruct(std::shared_ptr<TypeStruct> type, Token token)
+    StmtStruct(TypeStruct* type, Token token)
         : type(type), token(token)
     {
     }
@@ -0,0 +1,600 @@
+#include "ArrayKernels.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define ARRAY_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// Scalar kernels, used on their own when there is no SIMD support and for the tails of the vector loops.
+// Integer arithmetic is done unsigned so it wraps the same way the vector lanes do.
+
+template <typename T, typename Acc>
+static T scalarSum(const T* src, size_t count)
+{
+    Acc sum = 0;
+    for (size_t i = 0; i < count; i++)
+        sum += (Acc)src[i];
+    return (T)sum;
+}
+
+template <typename T, typename Acc>
+static T scalarDot(const T* a, const T* b, size_t count)
+{
+    Acc sum = 0;
+    for (size_t i = 0; i < count; i++)
+        sum += (Acc)a[i] * (Acc)b[i];
+    return (T)sum;
+}
+
+template <typename T>
+static T scalarMin(const T* src, size_t count)
+{
+    if (count == 0)
+        return 0;
+    T min = src[0];
+    for (size_t i = 1; i < count; i++)
+        min = src[i] < min ? src[i] : min;
+    return min;
+}
+
+template <typename T>
+static T scalarMax(const T* src, size_t count)
+{
+    if (count == 0)
+        return 0;
+    T max = src[0];
+    for (size_t i = 1; i < count; i++)
+        max = src[i] > max ? src[i] : max;
+    return max;
+}
+
+template <typename T>
+static size_t scalarCompare(const T* a, const T* b, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        if (a[i] != b[i])
+            return i;
+    return count;
+}
+
+template <typename T>
+static void scalarFill(T* dst, T value, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        dst[i] = value;
+}
+
+static int32_t scalarSumInt(const int32_t* src, size_t count) { return scalarSum<int32_t, uint32_t>(src, count); }
+static float scalarSumFloat(const float* src, size_t count) { return scalarSum<float, float>(src, count); }
+static double scalarSumDouble(const double* src, size_t count) { return scalarSum<double, double>(src, count); }
+static int32_t scalarDotInt(const int32_t* a, const int32_t* b, size_t count) { return scalarDot<int32_t, uint32_t>(a, b, count); }
+static float scalarDotFloat(const float* a, const float* b, size_t count) { return scalarDot<float, float>(a, b, count); }
+static double scalarDotDouble(const double* a, const double* b, size_t count) { return scalarDot<double, double>(a, b, count); }
+
+static const ArrayKernels scalarKernels = {
+    scalarFill<uint32_t>, scalarFill<uint64_t>,
+    scalarSumInt, scalarSumFloat, scalarSumDouble,
+    scalarMin<int32_t>, scalarMax<int32_t>, scalarMin<float>, scalarMax<float>, scalarMin<double>, scalarMax<double>,
+    scalarDotInt, scalarDotFloat, scalarDotDouble,
+    scalarCompare<int32_t>, scalarCompare<float>, scalarCompare<double>,
+    "scalar"};
+
+#ifdef ARRAY_KERNELS_X86
+
+// SSE2 kernels. SSE2 is part of x86-64 so these need no target attribute.
+
+static inline int32_t hsumEpi32(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+static inline float hsumPs(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline double hsumPd(__m128d v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+// SSE2 has no 32-bit integer min/max or low multiply, those came with SSE4.1.
+static inline __m128i minEpi32(__m128i a, __m128i b)
+{
+    __m128i less = _mm_cmplt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(less, a), _mm_andnot_si128(less, b));
+}
+
+static inline __m128i maxEpi32(__m128i a, __m128i b)
+{
+    __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+}
+
+static inline __m128i mulloEpi32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline int32_t hminEpi32(__m128i v)
+{
+    v = minEpi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = minEpi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+static inline int32_t hmaxEpi32(__m128i v)
+{
+    v = maxEpi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = maxEpi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+static inline float hminPs(__m128 v)
+{
+    v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_min_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline float hmaxPs(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_max_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline double hminPd(__m128d v)
+{
+    return _mm_cvtsd_f64(_mm_min_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static inline double hmaxPd(__m128d v)
+{
+    return _mm_cvtsd_f64(_mm_max_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static inline int firstZeroBit(unsigned mask)
+{
+    return __builtin_ctz(~mask);
+}
+
+static void sse2Fill32(uint32_t* dst, uint32_t value, size_t count)
+{
+    __m128i v = _mm_set1_epi32((int)value);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    scalarFill(dst + i, value, count - i);
+}
+
+static void sse2Fill64(uint64_t* dst, uint64_t value, size_t count)
+{
+    __m128i v = _mm_set1_epi64x((long long)value);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    scalarFill(dst + i, value, count - i);
+}
+
+static int32_t sse2SumInt(const int32_t* src, size_t count)
+{
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        acc = _mm_add_epi32(acc, _mm_loadu_si128((const __m128i*)(src + i)));
+    return (int32_t)((uint32_t)hsumEpi32(acc) + (uint32_t)scalarSumInt(src + i, count - i));
+}
+
+static float sse2SumFloat(const float* src, size_t count)
+{
+    __m128 acc = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        acc = _mm_add_ps(acc, _mm_loadu_ps(src + i));
+    return hsumPs(acc) + scalarSumFloat(src + i, count - i);
+}
+
+static double sse2SumDouble(const double* src, size_t count)
+{
+    __m128d acc = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+        acc = _mm_add_pd(acc, _mm_loadu_pd(src + i));
+    return hsumPd(acc) + scalarSumDouble(src + i, count - i);
+}
+
+static int32_t sse2MinInt(const int32_t* src, size_t count)
+{
+    if (count < 4)
+        return scalarMin(src, count);
+    __m128i acc = _mm_loadu_si128((const __m128i*)src);
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4)
+        acc = minEpi32(acc, _mm_loadu_si128((const __m128i*)(src + i)));
+    int32_t min = hminEpi32(acc);
+    for (; i < count; i++)
+        min = src[i] < min ? src[i] : min;
+    return min;
+}
+
+static int32_t sse2MaxInt(const int32_t* src, size_t count)
+{
+    if (count < 4)
+        return scalarMax(src, count);
+    __m128i acc = _mm_loadu_si128((const __m128i*)src);
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4)
+        acc = maxEpi32(acc, _mm_loadu_si128((const __m128i*)(src + i)));
+    int32_t max = hmaxEpi32(acc);
+    for (; i < count; i++)
+        max = src[i] > max ? src[i] : max;
+    return max;
+}
+
+static float sse2MinFloat(const float* src, size_t count)
+{
+    if (count < 4)
+        return scalarMin(src, count);
+    __m128 acc = _mm_loadu_ps(src);
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4)
+        acc = _mm_min_ps(acc, _mm_loadu_ps(src + i));
+    float min = hminPs(acc);
+    for (; i < count; i++)
+        min = src[i] < min ? src[i] : min;
+    return min;
+}
+
+static float sse2MaxFloat(const float* src, size_t count)
+{
+    if (count < 4)
+        return scalarMax(src, count);
+    __m128 acc = _mm_loadu_ps(src);
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4)
+        acc = _mm_max_ps(acc, _mm_loadu_ps(src + i));
+    float max = hmaxPs(acc);
+    for (; i < count; i++)
+        max = src[i] > max ? src[i] : max;
+    return max;
+}
+
+static double sse2MinDouble(const double* src, size_t count)
+{
+    if (count < 2)
+        return scalarMin(src, count);
+    __m128d acc = _mm_loadu_pd(src);
+    size_t i = 2;
+    for (; i + 2 <= count; i += 2)
+        acc = _mm_min_pd(acc, _mm_loadu_pd(src + i));
+    double min = hminPd(acc);
+    for (; i < count; i++)
+        min = src[i] < min ? src[i] : min;
+    return min;
+}
+
+static double sse2MaxDouble(const double* src, size_t count)
+{
+    if (count < 2)
+        return scalarMax(src, count);
+    __m128d acc = _mm_loadu_pd(src);
+    size_t i = 2;
+    for (; i + 2 <= count; i += 2)
+        acc = _mm_max_pd(acc, _mm_loadu_pd(src + i));
+    double max = hmaxPd(acc);
+    for (; i < count; i++)
+        max = src[i] > max ? src[i] : max;
+    return max;
+}
+
+static int32_t sse2DotInt(const int32_t* a, const int32_t* b, size_t count)
+{
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        acc = _mm_add_epi32(acc, mulloEpi32(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+    return (int32_t)((uint32_t)hsumEpi32(acc) + (uint32_t)scalarDotInt(a + i, b + i, count - i));
+}
+
+static float sse2DotFloat(const float* a, const float* b, size_t count)
+{
+    __m128 acc = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    return hsumPs(acc) + scalarDotFloat(a + i, b + i, count - i);
+}
+
+static double sse2DotDouble(const double* a, const double* b, size_t count)
+{
+    __m128d acc = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+        acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    return hsumPd(acc) + scalarDotDouble(a + i, b + i, count - i);
+}
+
+static size_t sse2CompareInt(const int32_t* a, const int32_t* b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+        unsigned mask = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(eq));
+        if (mask != 0xF)
+            return i + firstZeroBit(mask);
+    }
+    return i + scalarCompare(a + i, b + i, count - i);
+}
+
+static size_t sse2CompareFloat(const float* a, const float* b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        unsigned mask = (unsigned)_mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        if (mask != 0xF)
+            return i + firstZeroBit(mask);
+    }
+    return i + scalarCompare(a + i, b + i, count - i);
+}
+
+static size_t sse2CompareDouble(const double* a, const double* b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        unsigned mask = (unsigned)_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        if (mask != 0x3)
+            return i + firstZeroBit(mask);
+    }
+    return i + scalarCompare(a + i, b + i, count - i);
+}
+
+static const ArrayKernels sse2Kernels = {
+    sse2Fill32, sse2Fill64,
+    sse2SumInt, sse2SumFloat, sse2SumDouble,
+    sse2MinInt, sse2MaxInt, sse2MinFloat, sse2MaxFloat, sse2MinDouble, sse2MaxDouble,
+    sse2DotInt, sse2DotFloat, sse2DotDouble,
+    sse2CompareInt, sse2CompareFloat, sse2CompareDouble,
+    "sse2"};
+
+// AVX2 kernels, only called after the cpu has been checked for AVX2 support.
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void avx2Fill32(uint32_t* dst, uint32_t value, size_t count)
+{
+    __m256i v = _mm256_set1_epi32((int)value);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_si256((__m256i*)(dst + i), v);
+    scalarFill(dst + i, value, count - i);
+}
+
+AVX2 static void avx2Fill64(uint64_t* dst, uint64_t value, size_t count)
+{
+    __m256i v = _mm256_set1_epi64x((long long)value);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm256_storeu_si256((__m256i*)(dst + i), v);
+    scalarFill(dst + i, value, count - i);
+}
+
+AVX2 static int32_t avx2SumInt(const int32_t* src, size_t count)
+{
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        acc = _mm256_add_epi32(acc, _mm256_loadu_si256((const __m256i*)(src + i)));
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    return (int32_t)((uint32_t)hsumEpi32(half) + (uint32_t)scalarSumInt(src + i, count - i));
+}
+
+AVX2 static float avx2SumFloat(const float* src, size_t count)
+{
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        acc = _mm256_add_ps(acc, _mm256_loadu_ps(src + i));
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    return hsumPs(half) + scalarSumFloat(src + i, count - i);
+}
+
+AVX2 static double avx2SumDouble(const double* src, size_t count)
+{
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        acc = _mm256_add_pd(acc, _mm256_loadu_pd(src + i));
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    return hsumPd(half) + scalarSumDouble(src + i, count - i);
+}
+
+AVX2 static int32_t avx2MinInt(const int32_t* src, size_t count)
+{
+    if (count < 8)
+        return sse2MinInt(src, count);
+    __m256i acc = _mm256_loadu_si256((const __m256i*)src);
+    size_t i = 8;
+    for (; i + 8 <= count; i += 8)
+        acc = _mm256_min_epi32(acc, _mm256_loadu_si256((const __m256i*)(src + i)));
+    int32_t min = hminEpi32(_mm_min_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+    for (; i < count; i++)
+        min = src[i] < min ? src[i] : min;
+    return min;
+}
+
+AVX2 static int32_t avx2MaxInt(const int32_t* src, size_t count)
+{
+    if (count < 8)
+        return sse2MaxInt(src, count);
+    __m256i acc = _mm256_loadu_si256((const __m256i*)src);
+    size_t i = 8;
+    for (; i + 8 <= count; i += 8)
+        acc = _mm256_max_epi32(acc, _mm256_loadu_si256((const __m256i*)(src + i)));
+    int32_t max = hmaxEpi32(_mm_max_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+    for (; i < count; i++)
+        max = src[i] > max ? src[i] : max;
+    return max;
+}
+
+AVX2 static float avx2MinFloat(const float* src, size_t count)
+{
+    if (count < 8)
+        return sse2MinFloat(src, count);
+    __m256 acc = _mm256_loadu_ps(src);
+    size_t i = 8;
+    for (; i + 8 <= count; i += 8)
+        acc = _mm256_min_ps(acc, _mm256_loadu_ps(src + i));
+    float min = hminPs(_mm_min_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+    for (; i < count; i++)
+        min = src[i] < min ? src[i] : min;
+    return min;
+}
+
+AVX2 static float avx2MaxFloat(const float* src, size_t count)
+{
+    if (count < 8)
+        return sse2MaxFloat(src, count);
+    __m256 acc = _mm256_loadu_ps(src);
+    size_t i = 8;
+    for (; i + 8 <= count; i += 8)
+        acc = _mm256_max_ps(acc, _mm256_loadu_ps(src + i));
+    float max = hmaxPs(_mm_max_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+    for (; i < count; i++)
+        max = src[i] > max ? src[i] : max;
+    return max;
+}
+
+AVX2 static double avx2MinDouble(const double* src, size_t count)
+{
+    if (count < 4)
+        return sse2MinDouble(src, count);
+    __m256d acc = _mm256_loadu_pd(src);
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4)
+        acc = _mm256_min_pd(acc, _mm256_loadu_pd(src + i));
+    double min = hminPd(_mm_min_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1)));
+    for (; i < count; i++)
+        min = src[i] < min ? src[i] : min;
+    return min;
+}
+
+AVX2 static double avx2MaxDouble(const double* src, size_t count)
+{
+    if (count < 4)
+        return sse2MaxDouble(src, count);
+    __m256d acc = _mm256_loadu_pd(src);
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4)
+        acc = _mm256_max_pd(acc, _mm256_loadu_pd(src + i));
+    double max = hmaxPd(_mm_max_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1)));
+    for (; i < count; i++)
+        max = src[i] > max ? src[i] : max;
+    return max;
+}
+
+AVX2 static int32_t avx2DotInt(const int32_t* a, const int32_t* b, size_t count)
+{
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i))));
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    return (int32_t)((uint32_t)hsumEpi32(half) + (uint32_t)scalarDotInt(a + i, b + i, count - i));
+}
+
+AVX2 static float avx2DotFloat(const float* a, const float* b, size_t count)
+{
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    return hsumPs(half) + scalarDotFloat(a + i, b + i, count - i);
+}
+
+AVX2 static double avx2DotDouble(const double* a, const double* b, size_t count)
+{
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    return hsumPd(half) + scalarDotDouble(a + i, b + i, count - i);
+}
+
+AVX2 static size_t avx2CompareInt(const int32_t* a, const int32_t* b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+        unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(eq));
+        if (mask != 0xFF)
+            return i + firstZeroBit(mask);
+    }
+    return i + scalarCompare(a + i, b + i, count - i);
+}
+
+AVX2 static size_t avx2CompareFloat(const float* a, const float* b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), _CMP_EQ_OQ));
+        if (mask != 0xFF)
+            return i + firstZeroBit(mask);
+    }
+    return i + scalarCompare(a + i, b + i, count - i);
+}
+
+AVX2 static size_t avx2CompareDouble(const double* a, const double* b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        unsigned mask = (unsigned)_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), _CMP_EQ_OQ));
+        if (mask != 0xF)
+            return i + firstZeroBit(mask);
+    }
+    return i + scalarCompare(a + i, b + i, count - i);
+}
+
+#undef AVX2
+
+static const ArrayKernels avx2Kernels = {
+    avx2Fill32, avx2Fill64,
+    avx2SumInt, avx2SumFloat, avx2SumDouble,
+    avx2MinInt, avx2MaxInt, avx2MinFloat, avx2MaxFloat, avx2MinDouble, avx2MaxDouble,
+    avx2DotInt, avx2DotFloat, avx2DotDouble,
+    avx2CompareInt, avx2CompareFloat, avx2CompareDouble,
+    "avx2"};
+
+#endif // ARRAY_KERNELS_X86
+
+static const ArrayKernels* selectKernels()
+{
+#ifdef ARRAY_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &avx2Kernels;
+    return &sse2Kernels;
+#else
+    return &scalarKernels;
+#endif
+}
+
+const ArrayKernels& getArrayKernels()
+{
+    static const ArrayKernels* kernels = selectKernels();
+    return *kernels;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Bulk array kernels behind the array natives. The table is filled once with the widest
+// implementation the running CPU supports (AVX2, SSE2 or plain scalar code).
+struct ArrayKernels
+{
+    void (*fill32)(uint32_t* dst, uint32_t value, size_t count);
+    void (*fill64)(uint64_t* dst, uint64_t value, size_t count);
+
+    int32_t (*sumInt)(const int32_t* src, size_t count);
+    float (*sumFloat)(const float* src, size_t count);
+    double (*sumDouble)(const double* src, size_t count);
+
+    int32_t (*minInt)(const int32_t* src, size_t count);
+    int32_t (*maxInt)(const int32_t* src, size_t count);
+    float (*minFloat)(const float* src, size_t count);
+    float (*maxFloat)(const float* src, size_t count);
+    double (*minDouble)(const double* src, size_t count);
+    double (*maxDouble)(const double* src, size_t count);
+
+    int32_t (*dotInt)(const int32_t* a, const int32_t* b, size_t count);
+    float (*dotFloat)(const float* a, const float* b, size_t count);
+    double (*dotDouble)(const double* a, const double* b, size_t count);
+
+    // Index of the first element that differs, count if the ranges are equal.
+    size_t (*compareInt)(const int32_t* a, const int32_t* b, size_t count);
+    size_t (*compareFloat)(const float* a, const float* b, size_t count);
+    size_t (*compareDouble)(const double* a, const double* b, size_t count);
+
+    const char* name;
+};
+
+const ArrayKernels& getArrayKernels();
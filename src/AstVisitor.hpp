@@ -22,6 +22,8 @@ public:
     virtual void visit(ExprGet* expr) = 0;
     virtual void visit(ExprSet* expr) = 0;
     virtual void visit(ExprAddr* expr) = 0;
+    virtual void visit(ExprSpawn* expr) = 0;
+    virtual void visit(ExprJoin* expr) = 0;
 
     virtual void visit(StmtBlock* stmt) = 0;
     virtual void visit(StmtExpr* stmt) = 0;
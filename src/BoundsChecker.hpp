@@ -0,0 +1,447 @@
+#pragma once
+
+#include "AstVisitor.hpp"
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Runs on the typed AST of a '-checked' build and marks the array accesses that need a runtime index check.
+// Constant indices are checked here. An index 'i + c' inside 'for (int i = A; i < B; i += step)' is left
+// unchecked when literal A and B keep it in range. When B is a local the loop never writes, the check is
+// replaced with a single 'B + c <= size' check in front of the loop.
+class BoundsChecker : public AstVisitor
+{
+private:
+    struct Loop
+    {
+        StmtFor* stmt;
+        std::string var;
+        int start;
+        int last;          // last value of var, when the bound is a literal
+        std::string bound; // the bound, when it is a local
+        int depth;
+        bool invariant;    // neither var nor bound is written inside the loop
+        bool exits;        // the body may return before finishing an iteration
+        std::vector<bool*> removed;
+        std::vector<bool*> hoisted;
+        std::vector<BoundCheck> checks;
+    };
+
+    std::vector<std::unordered_set<std::string>> scopes;
+    std::unordered_set<std::string> addressTaken;
+    std::vector<Loop*> activeLoops;
+    std::vector<Loop*> functionLoops;
+    int depth;
+
+public:
+    bool cont;
+    size_t kept;
+    size_t removed;
+    size_t hoisted;
+
+    BoundsChecker(std::vector<Stmt*>& root)
+        : depth(0), cont(true), kept(0), removed(0), hoisted(0)
+    {
+        for (auto& stmt : root)
+            stmt->accept(this);
+    }
+
+    void error(const std::string& message, Token token)
+    {
+        this->cont = false;
+        std::cout << "[Line " << token.line << ", " << token.getString() << "] " << message << std::endl;
+    }
+
+    static bool intLiteral(Expr* expr, int& value)
+    {
+        if (expr->instance != ExprType::Literal || ((ExprLiteral*)expr)->val->type->tag != TypeTag::INTEGER)
+            return false;
+        value = ((ExprLiteral*)expr)->val->data.valInt;
+        return true;
+    }
+
+    static bool isVariable(Expr* expr, const std::string& name)
+    {
+        return expr->instance == ExprType::Variable && ((ExprVariable*)expr)->name.getString() == name;
+    }
+
+    bool isLocal(const std::string& name)
+    {
+        for (auto& scope : scopes)
+            if (scope.count(name))
+                return true;
+        return false;
+    }
+
+    void written(const std::string& name)
+    {
+        for (auto& loop : activeLoops)
+            if (loop->var == name || loop->bound == name)
+                loop->invariant = false;
+    }
+
+    // Splits 'var', 'var + c', 'c + var' and 'var - c' into the variable and c.
+    static bool splitIndex(Expr* index, std::string& var, int& offset)
+    {
+        if (index->instance == ExprType::Variable)
+        {
+            var = ((ExprVariable*)index)->name.getString();
+            offset = 0;
+            return true;
+        }
+        if (index->instance != ExprType::Binary)
+            return false;
+
+        ExprBinary* bin = (ExprBinary*)index;
+        if (bin->op.type == TokenType::PLUS && bin->left->instance == ExprType::Variable && intLiteral(bin->right, offset))
+            var = ((ExprVariable*)bin->left)->name.getString();
+        else if (bin->op.type == TokenType::PLUS && bin->right->instance == ExprType::Variable && intLiteral(bin->left, offset))
+            var = ((ExprVariable*)bin->right)->name.getString();
+        else if (bin->op.type == TokenType::MINUS && bin->left->instance == ExprType::Variable && intLiteral(bin->right, offset))
+        {
+            var = ((ExprVariable*)bin->left)->name.getString();
+            offset = -offset;
+        }
+        else
+            return false;
+        return true;
+    }
+
+    // Recognizes 'for (int i = A; i < B; i += step)' with literal A and step, and a literal or local B.
+    Loop* matchLoop(StmtFor* stmt)
+    {
+        StmtVarDecleration* decl = dynamic_cast<StmtVarDecleration*>(stmt->decl);
+        if (!decl || !decl->initializer || !stmt->inc || decl->varType->tag != TypeTag::INTEGER)
+            return nullptr;
+
+        Loop loop;
+        loop.stmt = stmt;
+        loop.var = decl->name.getString();
+        loop.last = 0;
+        loop.invariant = true;
+        loop.exits = false;
+        if (!intLiteral(decl->initializer, loop.start))
+            return nullptr;
+
+        if (stmt->cond->instance != ExprType::Binary)
+            return nullptr;
+        ExprBinary* cond = (ExprBinary*)stmt->cond;
+        if (!isVariable(cond->left, loop.var) || (cond->op.type != TokenType::LESS && cond->op.type != TokenType::LESS_EQUAL))
+            return nullptr;
+
+        if (stmt->inc->instance != ExprType::Assignment || ((ExprAssignment*)stmt->inc)->name.getString() != loop.var)
+            return nullptr;
+        Expr* step = ((ExprAssignment*)stmt->inc)->assignment;
+        int stepSize;
+        if (step->instance != ExprType::Binary || ((ExprBinary*)step)->op.type != TokenType::PLUS ||
+            !isVariable(((ExprBinary*)step)->left, loop.var) || !intLiteral(((ExprBinary*)step)->right, stepSize) || stepSize <= 0)
+            return nullptr;
+
+        int end;
+        if (intLiteral(cond->right, end))
+        {
+            if (cond->op.type == TokenType::LESS_EQUAL)
+                end++;
+            if (end <= loop.start)
+                return nullptr;
+            loop.last = loop.start + (end - 1 - loop.start) / stepSize * stepSize;
+        }
+        else if (cond->right->instance == ExprType::Variable && cond->op.type == TokenType::LESS && stepSize == 1)
+        {
+            loop.bound = ((ExprVariable*)cond->right)->name.getString();
+            if (!isLocal(loop.bound))
+                return nullptr;
+        }
+        else
+            return nullptr;
+
+        return new Loop(loop);
+    }
+
+    void checkIndex(Expr* callee, Expr* index, bool& check, Token bracket)
+    {
+        size_t size = ((TypeArray*)callee->type)->size;
+        check = true;
+
+        int value;
+        if (intLiteral(index, value))
+        {
+            if (value < 0 || value >= (int)size)
+                error("Array index " + std::to_string(value) + " is out of bounds for size " + std::to_string(size) + ".", bracket);
+            check = false;
+            removed++;
+            return;
+        }
+
+        std::string var;
+        int offset;
+        if (!splitIndex(index, var, offset))
+        {
+            kept++;
+            return;
+        }
+
+        for (auto it = activeLoops.rbegin(); it != activeLoops.rend(); ++it)
+        {
+            Loop* loop = *it;
+            if (loop->var != var)
+                continue;
+
+            if (loop->bound.empty())
+            {
+                if (loop->start + offset >= 0 && loop->last + offset < (int)size)
+                {
+                    loop->removed.push_back(&check);
+                    check = false;
+                    removed++;
+                    return;
+                }
+            }
+            else if (depth == loop->depth && loop->start + offset >= 0 && loop->start + offset <= (int)size)
+            {
+                // The access runs on every iteration, so a bound that fails the hoisted check would fail here too.
+                loop->hoisted.push_back(&check);
+                bool found = false;
+                for (auto& c : loop->checks)
+                    found |= c.offset == offset && c.size == size;
+                if (!found)
+                    loop->checks.push_back({((ExprBinary*)loop->stmt->cond)->right, offset, size});
+                check = false;
+                hoisted++;
+                return;
+            }
+            break;
+        }
+        kept++;
+    }
+
+    // Drops the conclusions of loops that turned out to write their induction variable or bound.
+    void finishFunction()
+    {
+        for (auto& loop : functionLoops)
+        {
+            bool valid = loop->invariant && !addressTaken.count(loop->var) && !addressTaken.count(loop->bound);
+            if (!valid)
+            {
+                for (auto& check : loop->removed)
+                    *check = true;
+                removed -= loop->removed.size();
+                kept += loop->removed.size();
+            }
+            if (!valid || loop->exits)
+            {
+                for (auto& check : loop->hoisted)
+                    *check = true;
+                hoisted -= loop->hoisted.size();
+                kept += loop->hoisted.size();
+            }
+            else
+                loop->stmt->boundChecks = loop->checks;
+            delete loop;
+        }
+        functionLoops.clear();
+        addressTaken.clear();
+    }
+
+    void visit(ExprArrGet* expr)
+    {
+        expr->callee->accept(this);
+        expr->index->accept(this);
+        checkIndex(expr->callee, expr->index, expr->checkIndex, expr->bracket);
+    }
+    void visit(ExprArrSet* expr)
+    {
+        expr->callee->accept(this);
+        expr->index->accept(this);
+        expr->assignment->accept(this);
+        checkIndex(expr->callee, expr->index, expr->checkIndex, expr->bracket);
+    }
+    void visit(ExprAssignment* expr)
+    {
+        expr->assignment->accept(this);
+        written(expr->name.getString());
+    }
+    void visit(ExprBinary* expr)
+    {
+        expr->left->accept(this);
+        expr->right->accept(this);
+    }
+    void visit(ExprCall* expr)
+    {
+        for (auto& arg : expr->args)
+            arg->accept(this);
+        expr->callee->accept(this);
+    }
+    void visit(ExprCast* expr)
+    {
+        expr->expr->accept(this);
+    }
+    void visit(ExprLiteral* expr)
+    {
+    }
+    void visit(ExprLogic* expr)
+    {
+        expr->left->accept(this);
+        depth++;
+        expr->right->accept(this);
+        depth--;
+    }
+    void visit(ExprUnary* expr)
+    {
+        expr->expr->accept(this);
+        if ((expr->op.type == TokenType::PLUS_PLUS || expr->op.type == TokenType::MINUS_MINUS) && expr->expr->instance == ExprType::Variable)
+            written(((ExprVariable*)expr->expr)->name.getString());
+    }
+    void visit(ExprVariable* expr)
+    {
+    }
+    void visit(ExprHeap* expr)
+    {
+    }
+    void visit(ExprGetDeref* expr)
+    {
+        expr->callee->accept(this);
+    }
+    void visit(ExprSetDeref* expr)
+    {
+        expr->asgn->accept(this);
+        expr->callee->accept(this);
+    }
+    void visit(ExprRef* expr)
+    {
+        expr->callee->accept(this);
+    }
+    void visit(ExprTake* expr)
+    {
+        expr->source->accept(this);
+        if (expr->source->instance == ExprType::Variable)
+            written(((ExprVariable*)expr->source)->name.getString());
+    }
+    void visit(ExprGet* expr)
+    {
+        expr->callee->accept(this);
+    }
+    void visit(ExprSet* expr)
+    {
+        expr->asgn->accept(this);
+        expr->callee->accept(this);
+    }
+    void visit(ExprAddr* expr)
+    {
+        if (expr->callee->instance == ExprType::Variable)
+            addressTaken.insert(((ExprVariable*)expr->callee)->name.getString());
+        else
+            expr->callee->accept(this);
+    }
+
+    void visit(ExprSpawn* expr)
+    {
+        expr->call->accept(this);
+    }
+
+    void visit(ExprJoin* expr)
+    {
+        expr->handle->accept(this);
+    }
+
+    void visit(StmtBlock* stmt)
+    {
+        scopes.emplace_back();
+        for (auto& s : stmt->statements)
+            s->accept(this);
+        scopes.pop_back();
+    }
+    void visit(StmtExpr* stmt)
+    {
+        stmt->expr->accept(this);
+    }
+    void visit(StmtFunc* stmt)
+    {
+        scopes.emplace_back();
+        for (auto& arg : stmt->args)
+            scopes.back().insert(arg.getString());
+
+        for (auto& s : stmt->body->statements)
+            s->accept(this);
+
+        scopes.pop_back();
+        finishFunction();
+    }
+    void visit(StmtVarDecleration* stmt)
+    {
+        if (stmt->initializer)
+            stmt->initializer->accept(this);
+        if (!scopes.empty())
+        {
+            scopes.back().insert(stmt->name.getString());
+            written(stmt->name.getString());
+        }
+    }
+    void visit(StmtReturn* stmt)
+    {
+        if (stmt->retVal)
+            stmt->retVal->accept(this);
+        for (auto& loop : activeLoops)
+            loop->exits = true;
+    }
+    void visit(StmtIf* stmt)
+    {
+        stmt->condition->accept(this);
+        depth++;
+        stmt->then->accept(this);
+        if (stmt->els)
+            stmt->els->accept(this);
+        depth--;
+    }
+    void visit(StmtFor* stmt)
+    {
+        scopes.emplace_back();
+        Loop* loop = matchLoop(stmt);
+
+        if (stmt->decl)
+            stmt->decl->accept(this);
+        if (stmt->cond)
+            stmt->cond->accept(this);
+
+        depth++;
+        if (loop)
+        {
+            loop->depth = depth;
+            activeLoops.push_back(loop);
+            functionLoops.push_back(loop);
+            stmt->loop->accept(this);
+            activeLoops.pop_back();
+        }
+        else
+        {
+            stmt->loop->accept(this);
+            if (stmt->inc)
+                stmt->inc->accept(this);
+        }
+        depth--;
+        scopes.pop_back();
+    }
+    void visit(StmtWhile* stmt)
+    {
+        depth++;
+        stmt->condition->accept(this);
+        stmt->loop->accept(this);
+        depth--;
+    }
+    void visit(StmtStruct* stmt)
+    {
+        for (auto& m : stmt->methodes)
+            m.second->accept(this);
+    }
+    void visit(StmtNamespace* stmt)
+    {
+        for (auto& s : stmt->stmts)
+            s->accept(this);
+    }
+    void visit(StmtCompUnit* stmt)
+    {
+        for (auto& s : stmt->stmts)
+            s->accept(this);
+    }
+};
@@ -0,0 +1,915 @@
+#include "CBackend.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+const char* PRELUDE = R"(#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef union Data Data;
+typedef void (*Function)(Data* io);
+typedef void (*Native)(int argc, Data* io);
+
+union Data
+{
+    bool valBool;
+    char valChar;
+    int32_t valInt;
+    float valFloat;
+    double valDouble;
+    char* valString;
+    Function valFn;
+    Native valNative;
+    Data* valPtr;
+    struct Task* valTask;
+    uint64_t bits;
+};
+
+/* Integer arithmetic wraps like the VM's, without relying on signed overflow. */
+static inline int32_t wrapAdd(int32_t a, int32_t b) { return (int32_t)((uint32_t)a + (uint32_t)b); }
+static inline int32_t wrapSub(int32_t a, int32_t b) { return (int32_t)((uint32_t)a - (uint32_t)b); }
+static inline int32_t wrapMul(int32_t a, int32_t b) { return (int32_t)((uint32_t)a * (uint32_t)b); }
+static inline int32_t wrapShl(int32_t a, int32_t b) { return (int32_t)((uint32_t)a << (b & 31)); }
+static inline int32_t wrapShr(int32_t a, int32_t b) { return a >> (b & 31); }
+
+static inline Data load(const void* address, size_t width)
+{
+    Data value;
+    value.bits = 0;
+    memcpy(&value, address, width);
+    return value;
+}
+
+static void indexError(int32_t index, int size)
+{
+    printf("[Runtime Error] Array index %d is out of bounds for size %d.\n", index, size);
+    exit(0);
+}
+
+static void limitError(int32_t limit, int size)
+{
+    printf("[Runtime Error] Loop reaches array index %d, out of bounds for size %d.\n", limit - 1, size);
+    exit(0);
+}
+)";
+
+// Spawned calls run on a thread each, without the VM's pool. The io of a task holds the arguments and
+// then the results.
+const char* TASKS = R"(
+#include <pthread.h>
+
+typedef struct Task
+{
+    pthread_t thread;
+    bool threaded;
+    bool joined;
+    Function fn;
+    Data io[];
+} Task;
+
+static void* runTask(void* task)
+{
+    ((Task*)task)->fn(((Task*)task)->io);
+    return NULL;
+}
+
+static Task* spawnTask(Function fn, const Data* args, size_t argSize, size_t size)
+{
+    Task* task = malloc(sizeof(Task) + (size > argSize ? size : argSize) * sizeof(Data));
+    task->fn = fn;
+    task->joined = false;
+    memcpy(task->io, args, argSize * sizeof(Data));
+    task->threaded = pthread_create(&task->thread, NULL, runTask, task) == 0;
+    if (!task->threaded)
+        fn(task->io);
+    return task;
+}
+
+// A joined task is not freed, a copy of its handle may still be joined and has to be caught.
+static void joinTask(Task* task, Data* out, size_t size)
+{
+    if (!task || task->joined)
+    {
+        printf("[Runtime Error] Joined a task handle that is null or was already joined.\n");
+        exit(0);
+    }
+    task->joined = true;
+    if (task->threaded)
+        pthread_join(task->thread, NULL);
+    memcpy(out, task->io, size * sizeof(Data));
+}
+)";
+
+// Natives write their results over their arguments, starting at io[0].
+const char* NATIVE_PRINT = R"(
+static void n_print(int argc, Data* io)
+{
+    const char* str = io[0].valString;
+    int arg = 1;
+    for (size_t i = 0; str[i] != 0; i++)
+    {
+        if (str[i] != '%')
+        {
+            putchar(str[i]);
+            continue;
+        }
+        switch (str[++i])
+        {
+        case 'i':
+            printf("%d", io[arg].valInt);
+            break;
+        case 'f':
+            printf("%g", io[arg].valFloat);
+            break;
+        case 'd':
+            printf("%g", io[arg].valDouble);
+            break;
+        case 'c':
+            putchar(io[arg].valChar);
+            break;
+        case 's':
+            fputs(io[arg].valString, stdout);
+            break;
+        default:
+            printf("%p", (void*)io[arg].valPtr);
+            break;
+        }
+        arg++;
+        if (str[i] == 0)
+            break;
+    }
+}
+)";
+
+const char* NATIVE_INPUT = R"(
+static void n_input(int argc, Data* io)
+{
+    size_t size = 0, capacity = 16;
+    char* str = malloc(capacity);
+    int c;
+    while ((c = getchar()) != EOF && c != '\n')
+    {
+        if (size + 1 == capacity)
+            str = realloc(str, capacity *= 2);
+        str[size++] = (char)c;
+    }
+    str[size] = 0;
+    io[0].valString = str;
+}
+)";
+
+const char* NATIVE_INPUT_INT = R"(
+static void n_inputInt(int argc, Data* io)
+{
+    io[0].valInt = 0;
+    if (scanf("%d", &io[0].valInt) != 1)
+        io[0].valInt = 0;
+}
+)";
+
+const char* NATIVE_CLOCK = R"(
+static void n_clock(int argc, Data* io)
+{
+    io[0].valDouble = (double)clock() / CLOCKS_PER_SEC;
+}
+)";
+
+// Without a scheduler a fiber runs to its end when it starts, so there is nothing to yield to.
+const char* NATIVE_YIELD = R"(
+static void n_yield(int argc, Data* io)
+{
+}
+)";
+
+const char* NATIVE_SLEEP = R"(
+static void n_sleep(int argc, Data* io)
+{
+    double seconds = io[0].valDouble;
+    if (seconds <= 0)
+        return;
+    struct timespec t;
+    t.tv_sec = (time_t)seconds;
+    t.tv_nsec = (long)((seconds - (double)t.tv_sec) * 1e9);
+    nanosleep(&t, NULL);
+}
+)";
+
+const char* NATIVE_RAND = R"(
+static void n_rand(int argc, Data* io)
+{
+    io[0].valFloat = (float)rand() / (float)RAND_MAX;
+}
+)";
+
+struct ArrayElement
+{
+    const char* suffix;
+    const char* type;
+    const char* acc; // type sums and dot products are kept in
+    const char* field;
+};
+
+const ArrayElement ARRAY_ELEMENTS[] = {
+    {"Int", "int32_t", "uint32_t", "valInt"},
+    {"Float", "float", "float", "valFloat"},
+    {"Double", "double", "double", "valDouble"},
+};
+
+void replaceAll(std::string& str, const std::string& from, const std::string& to)
+{
+    for (size_t at = str.find(from); at != std::string::npos; at = str.find(from, at + to.size()))
+        str.replace(at, from.size(), to);
+}
+
+// The array natives as plain loops, the scalar kernels of ArrayKernels.cpp. $N, $T, $A and $F stand for
+// the name suffix, the element type, the accumulator type and the Data field of an element.
+std::string arrayNative(const std::string& name)
+{
+    static const std::pair<const char*, const char*> templates[] = {
+        {"fill", R"(
+static void n_fill$N(int argc, Data* io)
+{
+    $T* dst = ($T*)io[0].valPtr;
+    $T value = io[2].$F;
+    for (int32_t i = 0; i < io[1].valInt; i++)
+        dst[i] = value;
+}
+)"},
+        {"copy", R"(
+static void n_copy$N(int argc, Data* io)
+{
+    if (io[2].valInt > 0)
+        memmove(io[0].valPtr, io[1].valPtr, (size_t)io[2].valInt * sizeof($T));
+}
+)"},
+        {"sum", R"(
+static void n_sum$N(int argc, Data* io)
+{
+    const $T* src = (const $T*)io[0].valPtr;
+    $A sum = 0;
+    for (int32_t i = 0; i < io[1].valInt; i++)
+        sum += ($A)src[i];
+    io[0].$F = ($T)sum;
+}
+)"},
+        {"min", R"(
+static void n_min$N(int argc, Data* io)
+{
+    const $T* src = (const $T*)io[0].valPtr;
+    int32_t count = io[1].valInt;
+    $T min = count > 0 ? src[0] : 0;
+    for (int32_t i = 1; i < count; i++)
+        min = src[i] < min ? src[i] : min;
+    io[0].$F = min;
+}
+)"},
+        {"max", R"(
+static void n_max$N(int argc, Data* io)
+{
+    const $T* src = (const $T*)io[0].valPtr;
+    int32_t count = io[1].valInt;
+    $T max = count > 0 ? src[0] : 0;
+    for (int32_t i = 1; i < count; i++)
+        max = src[i] > max ? src[i] : max;
+    io[0].$F = max;
+}
+)"},
+        {"dot", R"(
+static void n_dot$N(int argc, Data* io)
+{
+    const $T* a = (const $T*)io[0].valPtr;
+    const $T* b = (const $T*)io[1].valPtr;
+    $A sum = 0;
+    for (int32_t i = 0; i < io[2].valInt; i++)
+        sum += ($A)a[i] * ($A)b[i];
+    io[0].$F = ($T)sum;
+}
+)"},
+        {"compare", R"(
+static void n_compare$N(int argc, Data* io)
+{
+    const $T* a = (const $T*)io[0].valPtr;
+    const $T* b = (const $T*)io[1].valPtr;
+    int32_t count = io[2].valInt, i = 0;
+    while (i < count && a[i] == b[i])
+        i++;
+    io[0].valInt = i;
+}
+)"},
+    };
+
+    for (auto& elem : ARRAY_ELEMENTS)
+    {
+        for (auto& t : templates)
+        {
+            if (name != std::string(t.first) + elem.suffix)
+                continue;
+            std::string code = t.second;
+            replaceAll(code, "$N", elem.suffix);
+            replaceAll(code, "$T", elem.type);
+            replaceAll(code, "$A", elem.acc);
+            replaceAll(code, "$F", elem.field);
+            return code;
+        }
+    }
+    return "";
+}
+
+std::string nativeSource(const std::string& name)
+{
+    if (name == "print")
+        return NATIVE_PRINT;
+    if (name == "input")
+        return NATIVE_INPUT;
+    if (name == "inputInt")
+        return NATIVE_INPUT_INT;
+    if (name == "clock")
+        return NATIVE_CLOCK;
+    if (name == "rand")
+        return NATIVE_RAND;
+    if (name == "yield")
+        return NATIVE_YIELD;
+    if (name == "sleep")
+        return NATIVE_SLEEP;
+    return arrayNative(name);
+}
+
+std::string slot(int i)
+{
+    return "s[" + std::to_string(i) + "]";
+}
+
+std::string field(TypeTag tag)
+{
+    switch (tag)
+    {
+    case TypeTag::BOOL:
+        return "valBool";
+    case TypeTag::CHAR:
+        return "valChar";
+    case TypeTag::INTEGER:
+        return "valInt";
+    case TypeTag::FLOAT:
+        return "valFloat";
+    default:
+        return "valDouble";
+    }
+}
+
+std::string cType(TypeTag tag)
+{
+    switch (tag)
+    {
+    case TypeTag::BOOL:
+        return "bool";
+    case TypeTag::CHAR:
+        return "char";
+    case TypeTag::INTEGER:
+        return "int32_t";
+    case TypeTag::FLOAT:
+        return "float";
+    default:
+        return "double";
+    }
+}
+
+std::string quote(const char* str)
+{
+    std::string out = "\"";
+    for (; *str; str++)
+    {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\' || c == '?')
+            out += std::string("\\") + (char)c;
+        else if (c == '\n')
+            out += "\\n";
+        else if (c < 32 || c >= 127)
+        {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\%03o", c);
+            out += buf;
+        }
+        else
+            out += c;
+    }
+    return out + "\"";
+}
+
+std::string cName(const std::string& name)
+{
+    std::string out;
+    for (auto c : name)
+        out += isalnum((unsigned char)c) ? c : '_';
+    return out;
+}
+
+size_t typeSize(std::vector<Type*>& types)
+{
+    size_t size = 0;
+    for (auto& type : types)
+        size += type->getSize();
+    return size;
+}
+} // namespace
+
+CBackend::CBackend(std::unordered_map<std::string, EnvNamespace*>& allNamespaces, std::vector<IRChunk*>& irChunks)
+    : usesTasks(false), irChunk(nullptr), current(nullptr), height(0), cont(true)
+{
+    for (size_t i = 0; i < irChunks.size(); i++)
+    {
+        std::string name = "f" + std::to_string(i) + "_" + cName(irChunks[i]->name);
+        functionNames[irChunks[i]->chunk] = name;
+        prototypes << "static void " << name << "(Data* io);\n";
+    }
+    if (!irChunks.empty())
+        entry = functionNames[irChunks[0]->chunk];
+
+    // A global can be called directly when it holds a function and no code writes it or takes its address.
+    std::set<std::string> written;
+    for (auto& irc : irChunks)
+    {
+        for (auto& inst : irc->getCode())
+        {
+            if (auto set = dynamic_cast<InstSetGlobal*>(inst))
+                written.insert(set->name);
+            else if (auto addr = dynamic_cast<InstAddrGlobal*>(inst))
+                written.insert(addr->name);
+            else if (auto store = dynamic_cast<InstStore*>(inst))
+                written.insert(store->name);
+        }
+    }
+
+    globalInits.resize(allNamespaces.at("")->globalSlots());
+    for (auto& ns : allNamespaces)
+    {
+        for (auto& var : ns.second->vars)
+        {
+            GlobalVar& global = var.second;
+            globalAddr[global.fullName] = global.position;
+            // Globals wider than a slot hold a single zero value.
+            if (global.type->getSize() != 1)
+                continue;
+            std::string name = global.fullName.substr(global.fullName.rfind(':') + 1);
+            globalInits[global.position] = literal(*global.val, name);
+
+            if (global.type->tag == TypeTag::FUNCTION && !written.count(global.fullName) && functionNames.count(global.val->data.valChunk))
+                constFunctions[global.position] = functionNames[global.val->data.valChunk];
+        }
+    }
+}
+
+void CBackend::error(const std::string& message)
+{
+    cont = false;
+    std::cout << "[ERROR] " << message << std::endl;
+}
+
+void CBackend::line(const std::string& code)
+{
+    bodies << "    " << code << "\n";
+}
+
+std::string CBackend::literal(Value& value, const std::string& name)
+{
+    switch (value.type->tag)
+    {
+    case TypeTag::STRING:
+        return value.data.valString ? "{.valString = (char*)" + quote(value.data.valString->chars) + "}" : "";
+    case TypeTag::NATIVE:
+        if (nativeSource(name).empty())
+        {
+            error("Native '" + name + "' has no C implementation.");
+            return "";
+        }
+        natives.insert(name);
+        return "{.valNative = n_" + name + "}";
+    case TypeTag::FUNCTION:
+        if (functionNames.count(value.data.valChunk) == 0)
+            return "";
+        return "{.valFn = " + functionNames[value.data.valChunk] + "}";
+    default:
+        break;
+    }
+
+    // Other values are copied bit for bit, only the bytes the type uses.
+    uint64_t bits = 0;
+    size_t width = value.type->getPackedWidth();
+    memcpy(&bits, &value.data, width ? width : sizeof(Data));
+    if (bits == 0)
+        return "";
+    char buf[32];
+    snprintf(buf, sizeof(buf), "{.bits = 0x%llxull}", (unsigned long long)bits);
+    return buf;
+}
+
+size_t CBackend::global(const std::string& name)
+{
+    auto it = globalAddr.find(name);
+    if (it == globalAddr.end())
+    {
+        error("Unknown global '" + name + "'.");
+        return 0;
+    }
+    return it->second;
+}
+
+void CBackend::copy(const std::string& to, const std::string& from, size_t size)
+{
+    if (size == 1)
+        line(to + " = " + from + ";");
+    else if (size > 1)
+        line("memmove(&" + to + ", &" + from + ", " + std::to_string(size) + " * sizeof(Data));");
+}
+
+void CBackend::generateFunction(MirFunction* func, IRChunk* irChunk)
+{
+    this->irChunk = irChunk;
+    bodies << "\n/* " << irChunk->name << " */\n";
+    bodies << "static void " << functionNames[irChunk->chunk] << "(Data* io)\n{\n";
+    line("Data s[" + std::to_string(std::max<size_t>(func->maxHeight, 1)) + "];");
+    if (irChunk->argSize > 0)
+        line("memcpy(s, io, " + std::to_string(irChunk->argSize) + " * sizeof(Data));");
+
+    for (auto& block : func->blocks)
+    {
+        for (auto& label : block->labels)
+            bodies << "L" << label->id << ":;\n";
+        for (auto& value : block->insts)
+        {
+            current = value;
+            height = value->height;
+            value->inst->accept(this);
+        }
+    }
+    bodies << "}\n";
+    current = nullptr;
+}
+
+bool CBackend::write(const std::string& path)
+{
+    std::ofstream file(path);
+    if (file.fail())
+    {
+        std::cout << "[Error] Unable to open file: " << path << std::endl;
+        return false;
+    }
+
+    file << PRELUDE;
+    if (usesTasks)
+        file << TASKS;
+    for (auto& name : natives)
+        file << nativeSource(name);
+    file << "\n" << prototypes.str();
+
+    file << "\nstatic Data g[" << std::max<size_t>(globalInits.size(), 1) << "] = {\n";
+    for (size_t i = 0; i < globalInits.size(); i++)
+        if (!globalInits[i].empty())
+            file << "    [" << i << "] = " << globalInits[i] << ",\n";
+    file << "};\n";
+
+    file << bodies.str();
+    file << "\nint main(void)\n{\n";
+    if (natives.count("rand"))
+        file << "    srand(time(NULL));\n";
+    file << "    Data io[1];\n";
+    file << "    " << entry << "(io);\n";
+    file << "    return 0;\n}\n";
+    return true;
+}
+
+void CBackend::visit(InstConst* inst)
+{
+    std::string value = literal(*irChunk->getConstant(inst->id), "");
+    line(slot(height) + " = (Data)" + (value.empty() ? "{.bits = 0}" : value) + ";");
+}
+
+void CBackend::visit(InstCast* inst)
+{
+    std::string top = slot(height - 1);
+    line(top + "." + field(inst->to) + " = (" + cType(inst->to) + ")" + top + "." + field(inst->from) + ";");
+}
+
+void CBackend::arith(const char* op, TypeTag type)
+{
+    std::string a = slot(height - 2);
+    std::string b = slot(height - 1);
+    if (type == TypeTag::INTEGER)
+    {
+        std::string name = op;
+        if (name == "+" || name == "-" || name == "*")
+        {
+            const char* fn = name == "+" ? "wrapAdd" : name == "-" ? "wrapSub" : "wrapMul";
+            line(a + ".valInt = " + fn + "(" + a + ".valInt, " + b + ".valInt);");
+        }
+        else
+            line(a + ".valInt = " + a + ".valInt " + op + " " + b + ".valInt;");
+        return;
+    }
+    std::string f = field(type);
+    line(a + "." + f + " = " + a + "." + f + " " + op + " " + b + "." + f + ";");
+}
+
+void CBackend::compare(const char* op, TypeTag type)
+{
+    std::string a = slot(height - 2);
+    std::string b = slot(height - 1);
+    std::string f = type == TypeTag::INTEGER ? "valInt" : "valDouble";
+    line(a + ".valBool = " + a + "." + f + " " + op + " " + b + "." + f + ";");
+}
+
+void CBackend::visit(InstAdd* inst) { arith("+", inst->type); }
+void CBackend::visit(InstSub* inst) { arith("-", inst->type); }
+void CBackend::visit(InstMul* inst) { arith("*", inst->type); }
+void CBackend::visit(InstDiv* inst) { arith("/", inst->type); }
+void CBackend::visit(InstMod* inst) { arith("%", TypeTag::INTEGER); }
+
+void CBackend::visit(InstNeg* inst)
+{
+    std::string top = slot(height - 1);
+    if (inst->type == TypeTag::INTEGER)
+        line(top + ".valInt = wrapSub(0, " + top + ".valInt);");
+    else
+        line(top + "." + field(inst->type) + " = -" + top + "." + field(inst->type) + ";");
+}
+
+void CBackend::visit(InstBit* inst)
+{
+    std::string a = slot(height - 2);
+    std::string b = slot(height - 1);
+    switch (inst->op_type)
+    {
+    case TokenType::TILDE:
+        line(b + ".valInt = ~" + b + ".valInt;");
+        break;
+    case TokenType::BIT_AND:
+        arith("&", TypeTag::INTEGER);
+        break;
+    case TokenType::BIT_OR:
+        arith("|", TypeTag::INTEGER);
+        break;
+    case TokenType::BIT_XOR:
+        arith("^", TypeTag::INTEGER);
+        break;
+    case TokenType::BITSHIFT_LEFT:
+        line(a + ".valInt = wrapShl(" + a + ".valInt, " + b + ".valInt);");
+        break;
+    case TokenType::BITSHIFT_RIGHT:
+        line(a + ".valInt = wrapShr(" + a + ".valInt, " + b + ".valInt);");
+        break;
+    default:
+        break;
+    }
+}
+
+void CBackend::visit(InstNot* inst)
+{
+    std::string top = slot(height - 1);
+    line(top + ".valBool = !" + top + ".valBool;");
+}
+
+void CBackend::visit(InstInc* inst)
+{
+    std::string top = slot(height - 1);
+    if (inst->type == TypeTag::INTEGER)
+        line(top + ".valInt = " + (inst->inc == 1 ? "wrapAdd(" : "wrapSub(") + top + ".valInt, 1);");
+    else
+        line(top + "." + field(inst->type) + (inst->inc == 1 ? " += 1;" : " -= 1;"));
+}
+
+void CBackend::visit(InstLess* inst) { compare("<", inst->type); }
+void CBackend::visit(InstLte* inst) { compare("<=", inst->type); }
+void CBackend::visit(InstGreat* inst) { compare(">", inst->type); }
+void CBackend::visit(InstGte* inst) { compare(">=", inst->type); }
+void CBackend::visit(InstEq* inst) { compare("==", inst->type); }
+void CBackend::visit(InstNeq* inst) { compare("!=", inst->type); }
+
+void CBackend::visit(InstGetGlobal* inst)
+{
+    std::string addr = std::to_string(global(inst->name));
+    size_t size = inst->type->getSize();
+    if (inst->offset)
+        copy(slot(height - 1), "g[" + addr + " + " + slot(height - 1) + ".valInt]", size);
+    else
+        copy(slot(height), "g[" + addr + "]", size);
+}
+
+void CBackend::visit(InstSetGlobal* inst)
+{
+    std::string addr = std::to_string(global(inst->name));
+    size_t size = inst->type->getSize();
+    if (inst->offset)
+        copy("g[" + addr + " + " + slot(height - 1) + ".valInt]", slot(height - 1 - size), size);
+    else
+        copy("g[" + addr + "]", slot(height - size), size);
+}
+
+void CBackend::visit(InstGetLocal* inst)
+{
+    size_t size = inst->type->getSize();
+    if (inst->offset)
+        copy(slot(height - 1), "s[" + std::to_string(inst->var.position) + " + " + slot(height - 1) + ".valInt]", size);
+    else
+        copy(slot(height), slot(inst->var.position), size);
+}
+
+void CBackend::visit(InstSetLocal* inst)
+{
+    size_t size = inst->type->getSize();
+    if (inst->offset)
+        copy("s[" + std::to_string(inst->var.position) + " + " + slot(height - 1) + ".valInt]", slot(height - 1 - size), size);
+    else
+        copy(slot(inst->var.position), slot(height - size), size);
+}
+
+void CBackend::visit(InstAlloc* inst)
+{
+    line(slot(height) + ".valPtr = malloc(" + std::to_string(inst->type->getSize()) + " * sizeof(Data));");
+}
+
+void CBackend::visit(InstFree* inst)
+{
+    line("free(" + slot(height - 1) + ".valPtr);");
+}
+
+void CBackend::visit(InstGetDeref* inst)
+{
+    std::string top = slot(height - 1);
+    size_t width = inst->type->getPackedWidth();
+    if (width != 0)
+        line(top + " = load(" + top + ".valPtr, " + std::to_string(width) + ");");
+    else
+        copy(top, top + ".valPtr[0]", inst->type->getSize());
+}
+
+void CBackend::visit(InstSetDeref* inst)
+{
+    std::string ptr = slot(height - 1);
+    size_t width = inst->type->getPackedWidth();
+    if (width != 0)
+        line("memcpy(" + ptr + ".valPtr, &" + slot(height - 2) + ", " + std::to_string(width) + ");");
+    else
+        copy(ptr + ".valPtr[0]", slot(height - 1 - inst->type->getSize()), inst->type->getSize());
+}
+
+void CBackend::visit(InstGetDerefOff* inst)
+{
+    std::string ptr = slot(height - 2);
+    copy(ptr, ptr + ".valPtr[" + slot(height - 1) + ".valInt]", inst->type->getSize());
+}
+
+void CBackend::visit(InstSetDerefOff* inst)
+{
+    size_t size = inst->type->getSize();
+    copy(slot(height - 2) + ".valPtr[" + slot(height - 1) + ".valInt]", slot(height - 2 - size), size);
+}
+
+void CBackend::visit(InstAddrLocal* inst)
+{
+    std::string pos = std::to_string(inst->var.position);
+    if (inst->offset)
+        line(slot(height - 1) + ".valPtr = &s[" + pos + " + " + slot(height - 1) + ".valInt];");
+    else
+        line(slot(height) + ".valPtr = &s[" + pos + "];");
+}
+
+void CBackend::visit(InstAddrGlobal* inst)
+{
+    std::string addr = std::to_string(global(inst->name));
+    if (inst->offset)
+        line(slot(height - 1) + ".valPtr = &g[" + addr + " + " + slot(height - 1) + ".valInt];");
+    else
+        line(slot(height) + ".valPtr = &g[" + addr + "];");
+}
+
+// Address of a packed element and the slot the access leaves its value in, or reads it from for stores.
+static std::string elementAddress(InstLoad* load, InstStore* store, int height, const std::string& globalSlot, int& valueSlot)
+{
+    MemBase base = load ? load->base : store->base;
+    size_t width = (load ? load->type : store->type)->getPackedWidth();
+    size_t s = load ? load->slot : store->slot;
+    std::string index = "(ptrdiff_t)" + slot(height - 1) + ".valInt * " + std::to_string(width);
+
+    valueSlot = height - 1;
+    switch (base)
+    {
+    case MemBase::DEREF:
+        return "(uint8_t*)" + slot(height - 1) + ".valPtr";
+    case MemBase::LOCAL:
+        return "(uint8_t*)&s[" + std::to_string((load ? load->var : store->var).position + s) + "] + " + index;
+    case MemBase::GLOBAL:
+        return "(uint8_t*)&g[" + globalSlot + "] + " + index;
+    case MemBase::DEREF_OFF:
+    default:
+        valueSlot = height - 2;
+        return "(uint8_t*)(" + slot(height - 2) + ".valPtr + " + std::to_string(s) + ") + " + index;
+    }
+}
+
+void CBackend::visit(InstLoad* inst)
+{
+    int to;
+    std::string globalSlot = inst->base == MemBase::GLOBAL ? std::to_string(global(inst->name) + inst->slot) : "";
+    std::string address = elementAddress(inst, nullptr, height, globalSlot, to);
+    line(slot(to) + " = load(" + address + ", " + std::to_string(inst->type->getPackedWidth()) + ");");
+}
+
+void CBackend::visit(InstStore* inst)
+{
+    int base;
+    std::string globalSlot = inst->base == MemBase::GLOBAL ? std::to_string(global(inst->name) + inst->slot) : "";
+    std::string address = elementAddress(nullptr, inst, height, globalSlot, base);
+    line("memcpy(" + address + ", &" + slot(base - 1) + ", " + std::to_string(inst->type->getPackedWidth()) + ");");
+}
+
+void CBackend::visit(InstCheckIndex* inst)
+{
+    std::string top = slot(height - 1) + ".valInt";
+    std::string size = std::to_string(inst->size);
+    if (inst->hoisted)
+        line("if (" + top + " > " + size + ") limitError(" + top + ", " + size + ");");
+    else
+        line("if ((uint32_t)" + top + " >= " + size + "u) indexError(" + top + ", " + size + ");");
+}
+
+void CBackend::visit(InstCall* inst)
+{
+    size_t argSize = typeSize(inst->args);
+    std::string callee = slot(height - 1);
+    std::string io = "&" + slot(height - 1 - argSize);
+    if (inst->callType == TypeTag::NATIVE)
+    {
+        line(callee + ".valNative(" + std::to_string(argSize) + ", " + io + ");");
+        return;
+    }
+    if (inst->callType == TypeTag::TASK)
+    {
+        usesTasks = true;
+        line("joinTask(" + callee + ".valTask, &" + callee + ", " + std::to_string(inst->ret->getSize()) + ");");
+        return;
+    }
+
+    // Calls of a function global that never changes go straight to the C function.
+    std::string fn = callee + ".valFn";
+    MirValue* def = current->operands.empty() ? nullptr : current->operands.back();
+    InstGetGlobal* get = def && def->op == MirOp::Inst ? dynamic_cast<InstGetGlobal*>(def->inst) : nullptr;
+    if (get && !get->offset)
+    {
+        auto it = constFunctions.find(global(get->name));
+        if (it != constFunctions.end())
+            fn = it->second;
+    }
+
+    if (inst->mode == CallMode::SPAWN)
+    {
+        usesTasks = true;
+        std::string size = std::to_string(inst->ret->intrinsicType->getSize());
+        line(slot(height - 1 - argSize) + ".valTask = spawnTask(" + fn + ", " + io + ", " + std::to_string(argSize) + ", " + size + ");");
+    }
+    else
+        line(fn + "(" + io + ");");
+}
+
+void CBackend::visit(InstPop* inst)
+{
+}
+
+void CBackend::visit(InstPush* inst)
+{
+    size_t size = typeSize(inst->types);
+    if (size > 0)
+        line("memset(&" + slot(height) + ", 0, " + std::to_string(size) + " * sizeof(Data));");
+}
+
+void CBackend::visit(InstReturn* inst)
+{
+    size_t size = inst->type->getSize();
+    if (size == 1)
+        line("io[0] = " + slot(height - 1) + ";");
+    else if (size > 1)
+        line("memcpy(io, &" + slot(height - size) + ", " + std::to_string(size) + " * sizeof(Data));");
+    line("return;");
+}
+
+void CBackend::visit(InstLabel* inst)
+{
+    bodies << "L" << inst->id << ":;\n";
+}
+
+void CBackend::visit(InstJump* inst)
+{
+    std::string target = "goto L" + std::to_string(inst->label->id) + ";";
+    if (inst->type == 0)
+        line(target);
+    else
+        line("if (!" + slot(height - 1) + ".valBool) " + target);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Enviroment.hpp"
+#include "IRChunk.hpp"
+#include "InstVisitor.hpp"
+#include "Mir.h"
+
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Ahead-of-time backend that writes the whole program as one self-contained C file. Every chunk
+// becomes a C function whose stack slots are a local array of the Data union, indexed by the
+// heights the MIR builder computed, so a C compiler sees plain loads, stores and gotos. Arguments
+// come in and results go out through the caller's slots, the same frame layout the VM uses.
+class CBackend final : public InstVisitor
+{
+private:
+    std::vector<std::string> globalInits;
+    std::unordered_map<std::string, size_t> globalAddr;
+    std::unordered_map<Chunk*, std::string> functionNames;
+    std::unordered_map<size_t, std::string> constFunctions; // globals that always hold the same function
+    std::set<std::string> natives;
+    std::stringstream prototypes;
+    std::stringstream bodies;
+    std::string entry;
+    bool usesTasks;
+
+    // Function in generation.
+    IRChunk* irChunk;
+    MirValue* current;
+    int height;
+
+public:
+    bool cont;
+
+    CBackend(std::unordered_map<std::string, EnvNamespace*>& allNamespaces, std::vector<IRChunk*>& irChunks);
+
+    void generateFunction(MirFunction* func, IRChunk* irChunk);
+    // Writes the runtime, the globals and the generated functions. Returns false when the file cannot be written.
+    bool write(const std::string& path);
+
+    void visit(InstConst* inst);
+    void visit(InstCast* inst);
+    void visit(InstAdd* inst);
+    void visit(InstSub* inst);
+    void visit(InstMul* inst);
+    void visit(InstDiv* inst);
+    void visit(InstNeg* inst);
+    void visit(InstMod* inst);
+    void visit(InstBit* inst);
+    void visit(InstNot* inst);
+    void visit(InstInc* inst);
+    void visit(InstLess* inst);
+    void visit(InstLte* inst);
+    void visit(InstGreat* inst);
+    void visit(InstGte* inst);
+    void visit(InstEq* inst);
+    void visit(InstNeq* inst);
+    void visit(InstGetGlobal* inst);
+    void visit(InstSetGlobal* inst);
+    void visit(InstGetLocal* inst);
+    void visit(InstSetLocal* inst);
+    void visit(InstAlloc* inst);
+    void visit(InstFree* inst);
+    void visit(InstGetDeref* inst);
+    void visit(InstSetDeref* inst);
+    void visit(InstGetDerefOff* inst);
+    void visit(InstSetDerefOff* inst);
+    void visit(InstAddrLocal* inst);
+    void visit(InstAddrGlobal* inst);
+    void visit(InstLoad* inst);
+    void visit(InstStore* inst);
+    void visit(InstCheckIndex* inst);
+    void visit(InstCall* inst);
+    void visit(InstPop* inst);
+    void visit(InstPush* inst);
+    void visit(InstReturn* inst);
+    void visit(InstLabel* inst);
+    void visit(InstJump* inst);
+
+private:
+    void error(const std::string& message);
+    void line(const std::string& code);
+    std::string literal(Value& value, const std::string& name);
+    size_t global(const std::string& name);
+
+    // Copies 'size' slots between two places, as one assignment when it is a single slot.
+    void copy(const std::string& to, const std::string& from, size_t size);
+    void arith(const char* op, TypeTag type);
+    void compare(const char* op, TypeTag type);
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <vector>
 #include "Value.hpp"
@@ -33,25 +34,68 @@ enum class OpCode
 	SET_GLOBAL_OFF, GET_GLOBAL_OFF, SET_LOCAL_OFF, GET_LOCAL_OFF,
 	SET_GLOBAL_OFFN, GET_GLOBAL_OFFN, SET_LOCAL_OFFN, GET_LOCAL_OFFN,
 	SET_GLOBAL_POP, SET_LOCAL_POP,
+	IADD_LOCAL, // local += constant, made by the optimizing tier
 
 	ALLOC, FREE, 
 	SET_DEREF, GET_DEREF, SET_DEREF_OFF, GET_DEREF_OFF,
 	ADDR_LOCAL, ADDR_GLOBAL, ADDR_LOCAL_OFF, ADDR_GLOBAL_OFF,
+	LOAD_I8, LOAD_I32, STORE_I8, STORE_I32,
+	CHECK_INDEX, CHECK_LIMIT,
 
 	JUMP, JUMP_NT_POP, LOOP,
 	JUMP_NT,
 
 	CALL, NATIVE_CALL,
+	SPAWN, JOIN, FIBER,
 	RETURN
 };
 
+// Where a packed load/store finds its element.
+// LOCAL/GLOBAL: slot operand + index from the stack, DEREF_OFF: pointer + slot operand + index, DEREF: pointer only.
+enum class MemBase
+{
+	LOCAL,
+	GLOBAL,
+	DEREF_OFF,
+	DEREF
+};
+
+class JitCode;
+
 class Chunk
 {
 public:
 	std::vector<uint8_t> code;
 	std::vector<Data> constants;
+	size_t maxStack; // slots the frame needs above its base
+	uint8_t argSize; // slots of the arguments, the frame starts with them
+	int16_t results; // slots RETURN leaves, -1 for the entry code, which runs off its end
+	// Set once the verifier accepted the code. It then runs without stack checks, and maxStack is
+	// the one the verifier counted.
+	std::atomic<bool> verified;
+
+	// Hotness counters and the machine code the JIT made once they crossed the threshold. Tasks
+	// run the same chunks on several threads.
+	std::atomic<uint32_t> calls;
+	std::atomic<uint32_t> loops;
+	std::atomic<JitCode*> jit;
+	std::atomic<bool> jitFailed;
+
+	// The optimizing tier's copy of this chunk, published from a background thread. Calls switch to
+	// it as soon as it is there. The first VM to queue the chunk claims it, root VMs of one program
+	// run on several threads too.
+	std::atomic<Chunk*> tiered;
+	std::atomic<bool> tierQueued;
+	uint8_t tier;
 	
-    Chunk() {}
+    Chunk()
+		: maxStack(0), argSize(0), results(-1), verified(false), calls(0), loops(0), jit(nullptr), jitFailed(false), tiered(nullptr), tierQueued(false), tier(0) {}
+
+	inline Chunk* latest()
+	{
+		Chunk* next = tiered.load(std::memory_order_acquire);
+		return next ? next : this;
+	}
 
 	inline size_t addConstant(Data value)
     {
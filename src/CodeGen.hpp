@@ -37,7 +37,7 @@ public:
     CodeGen(std::unordered_map<std::string, EnvNamespace*>& allNamespaces)
         : hadError(false)
     {
-        m_globals.resize(EnvNamespace::currentPos);
+        m_globals.resize(allNamespaces.at("")->globalSlots());
         for (auto& ns : allNamespaces)
         {
             for (auto& var : ns.second->vars)
@@ -54,6 +54,8 @@ public:
     {
         pos = 0;
         chunk = irChunk->chunk;
+        chunk->maxStack = irChunk->maxStack;
+        chunk->argSize = irChunk->argSize;
         constPositions.clear();
         for (auto& val : irChunk->getConstants())
         {
@@ -79,6 +81,25 @@ public:
         std::cout << msg << std::endl;
     }
 
+    size_t memSlot(std::string& name, Variable& var, MemBase base, size_t slot)
+    {
+        if (base == MemBase::LOCAL)
+            slot += var.position;
+        else if (base == MemBase::GLOBAL)
+        {
+            for (auto v : globalInfo)
+                if (v.first == name)
+                {
+                    slot += v.second.addr;
+                    break;
+                }
+        }
+
+        if (slot > 255)
+            error("[ERROR] Packed element slot is out of bounds[255].");
+        return slot;
+    }
+
     void visit(InstConst* inst)
     {
         valInfo& c = constPositions[inst->id];
@@ -429,11 +450,27 @@ public:
     }
     void visit(InstGetDeref* inst)
     {
+        size_t width = inst->type->getPackedWidth();
+        if (width != 0)
+        {
+            chunk->addCode(width == 1 ? OpCode::LOAD_I8 : OpCode::LOAD_I32, (uint8_t)MemBase::DEREF, 0);
+            pos += 3;
+            return;
+        }
+
         chunk->addCode(OpCode::GET_DEREF, inst->type->getSize());
         pos += 2;
     }
     void visit(InstSetDeref* inst)
     {
+        size_t width = inst->type->getPackedWidth();
+        if (width != 0)
+        {
+            chunk->addCode(width == 1 ? OpCode::STORE_I8 : OpCode::STORE_I32, (uint8_t)MemBase::DEREF, 0);
+            pos += 3;
+            return;
+        }
+
         chunk->addCode(OpCode::SET_DEREF, inst->type->getSize());
         pos += 2;
     }
@@ -472,12 +509,31 @@ public:
         size_t size = inst->type->getSize();
 
         if (inst->offset)
-            chunk->addCode(OpCode::ADDR_GLOBAL, var.addr);
-        else
             chunk->addCode(OpCode::ADDR_GLOBAL_OFF, var.addr);
+        else
+            chunk->addCode(OpCode::ADDR_GLOBAL, var.addr);
 
         pos += 2;
     }
+    void visit(InstLoad* inst)
+    {
+        OpCode code = inst->type->getPackedWidth() == 1 ? OpCode::LOAD_I8 : OpCode::LOAD_I32;
+        chunk->addCode(code, (uint8_t)inst->base, memSlot(inst->name, inst->var, inst->base, inst->slot));
+        pos += 3;
+    }
+    void visit(InstStore* inst)
+    {
+        OpCode code = inst->type->getPackedWidth() == 1 ? OpCode::STORE_I8 : OpCode::STORE_I32;
+        chunk->addCode(code, (uint8_t)inst->base, memSlot(inst->name, inst->var, inst->base, inst->slot));
+        pos += 3;
+    }
+    void visit(InstCheckIndex* inst)
+    {
+        if (inst->size > UINT16_MAX)
+            error("[ERROR] Array is too large for an index check.");
+        chunk->addCode(inst->hoisted ? OpCode::CHECK_LIMIT : OpCode::CHECK_INDEX, inst->size & 0xff, (inst->size >> 8) & 0xff);
+        pos += 3;
+    }
     void visit(InstCall* inst)
     {
         size_t size = 0;
@@ -487,10 +543,19 @@ public:
         if (size > 255)
             error("[ERROR] Too much data for call.");
 
-        if (inst->callType == TypeTag::FUNCTION)
-            chunk->addCode(OpCode::CALL, size);
-        else if (inst->callType == TypeTag::NATIVE)
-            chunk->addCode(OpCode::NATIVE_CALL, size);
+        if (inst->mode == CallMode::SPAWN)
+            chunk->addCode(OpCode::SPAWN, size);
+        else if (inst->mode == CallMode::FIBER)
+            chunk->addCode(OpCode::FIBER, size);
+        else if (inst->callType == TypeTag::TASK)
+            chunk->addCode(OpCode::JOIN, inst->ret->getSize());
+        else
+        {
+            // Calls also state what they leave, for the verifier.
+            OpCode code = inst->callType == TypeTag::FUNCTION ? OpCode::CALL : OpCode::NATIVE_CALL;
+            chunk->addCode(code, size, inst->ret->getSize());
+            pos++;
+        }
         pos += 2;
     }
     void visit(InstPop* inst)
@@ -532,10 +597,11 @@ public:
         inst->pos = pos;
         for (auto& jmp : inst->patches)
         {
-            int diff = pos - jmp->pos - 2;
-            if (diff > 255)
+            int diff = pos - jmp->pos - 3;
+            if (diff > UINT16_MAX)
                 error("Jump is too long.");
-            chunk->code[jmp->pos + 1] = diff;
+            chunk->code[jmp->pos + 1] = diff & 0xff;
+            chunk->code[jmp->pos + 2] = (diff >> 8) & 0xff;
         }
         pos += 0;
     }
@@ -544,25 +610,28 @@ public:
         inst->pos = pos;
         if (inst->type == 0)
         {
-            if (inst->label->pos > 0)
+            if (inst->label->pos >= 0)
             {
-                chunk->addCode(OpCode::LOOP, pos + 2 - inst->label->pos);
+                int diff = pos + 3 - inst->label->pos;
+                if (diff > UINT16_MAX)
+                    error("Loop is too long.");
+                chunk->addCode(OpCode::LOOP, diff & 0xff, (diff >> 8) & 0xff);
             }
             else
             {
                 inst->label->patches.push_back(inst);
-                chunk->addCode(OpCode::JUMP, 0);
+                chunk->addCode(OpCode::JUMP, 0, 0);
             }
         }
         else
         {
             inst->label->patches.push_back(inst);
             if (inst->type == 1)
-                chunk->addCode(OpCode::JUMP_NT, 0);
+                chunk->addCode(OpCode::JUMP_NT, 0, 0);
             else
-                chunk->addCode(OpCode::JUMP_NT_POP, 0);
+                chunk->addCode(OpCode::JUMP_NT_POP, 0, 0);
         }
 
-        pos += 2;
+        pos += 3;
     }
 };
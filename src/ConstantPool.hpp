@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Value.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// The constants of a whole program. Equal constants are one entry, so a literal is stored once
+// however many chunks use it. Strings are interned already and count as equal by address. The chunks
+// still number the entries they use themselves, as their bytecode addresses a constant with one byte.
+class ConstantPool
+{
+private:
+    struct Key
+    {
+        Type* type;
+        uint64_t bits;
+
+        bool operator==(const Key& other) const
+        {
+            return type == other.type && bits == other.bits;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            return std::hash<Type*>()(key.type) ^ (key.bits * 0x9e3779b97f4a7c15ull);
+        }
+    };
+
+    std::unordered_map<Key, Value*, KeyHash> entries;
+    std::vector<Value*> values;
+    size_t textBytes = 0;
+
+    // Only the member of the type counts, the rest of the union is not set by every constructor.
+    static Data canonical(const Value& value)
+    {
+        Data data;
+        memset(&data, 0, sizeof(Data));
+        switch (value.type->tag)
+        {
+        case TypeTag::BOOL:
+            data.valBool = value.data.valBool;
+            break;
+        case TypeTag::CHAR:
+            data.valChar = value.data.valChar;
+            break;
+        case TypeTag::INTEGER:
+            data.valInt = value.data.valInt;
+            break;
+        case TypeTag::FLOAT:
+            data.valFloat = value.data.valFloat;
+            break;
+        default:
+            data = value.data;
+            break;
+        }
+        return data;
+    }
+
+public:
+    ConstantPool() {}
+    ConstantPool(const ConstantPool&) = delete;
+    ConstantPool& operator=(const ConstantPool&) = delete;
+
+    ~ConstantPool()
+    {
+        for (Value* value : values)
+            delete value;
+    }
+
+    // Returns the entry equal to 'value', made from a copy of it the first time. The pool owns the
+    // entries, 'value' stays with the caller.
+    Value* intern(const Value& value)
+    {
+        Data data = canonical(value);
+        Key key{value.type, 0};
+        memcpy(&key.bits, &data, sizeof(key.bits));
+
+        auto it = entries.find(key);
+        if (it != entries.end())
+            return it->second;
+
+        Value* entry = new Value(value.type);
+        entry->data = data;
+        if (value.type->tag == TypeTag::STRING)
+            textBytes += data.valString->length;
+        entries.emplace(key, entry);
+        values.push_back(entry);
+        return entry;
+    }
+
+    inline const std::vector<Value*>& getValues() const { return values; }
+    inline size_t size() const { return values.size(); }
+    inline size_t getTextBytes() const { return textBytes; }
+};
@@ -23,10 +23,83 @@ void debugInstructions(IRChunk* irChunk)
     std::cout << std::endl;
 }
 
-void printStack(std::vector<Data>& stack)
+static void printBlocks(const char* name, std::vector<MirBlock*>& blocks)
+{
+    if (blocks.empty())
+        return;
+    std::cout << "  " << name;
+    for (auto& block : blocks)
+        std::cout << " bb" << block->id;
+}
+
+static void printValue(MirValue* value)
+{
+    switch (value->op)
+    {
+    case MirOp::Undef:
+        std::cout << "undef";
+        break;
+    case MirOp::Memory:
+        std::cout << "memory";
+        break;
+    default:
+        std::cout << "%" << value->id;
+    }
+}
+
+void debugMir(MirFunction* func, IRChunk* irChunk)
+{
+    InstDebugger debugger(irChunk);
+    for (auto& block : func->blocks)
+    {
+        std::cout << "bb" << block->id << ":";
+        for (auto& label : block->labels)
+            std::cout << " L." << label->id;
+        std::cout << "\t[" << block->entryHeight << " -> " << block->exitHeight << "]";
+        printBlocks("preds", block->preds);
+        printBlocks("succs", block->succs);
+        if (block->idom)
+            std::cout << "  idom bb" << block->idom->id;
+        std::cout << "\n";
+
+        if (block == func->blocks[0])
+            for (auto& arg : func->args)
+                std::cout << "\t%" << arg->id << " = arg @" << arg->slot << "\n";
+        for (auto& phi : block->phis)
+        {
+            std::cout << "\t%" << phi->id << " = phi @" << phi->slot;
+            for (size_t i = 0; i < phi->operands.size(); i++)
+            {
+                std::cout << " [bb" << block->preds[i]->id << ": ";
+                printValue(phi->operands[i]);
+                std::cout << "]";
+            }
+            std::cout << "\n";
+        }
+        for (auto& value : block->insts)
+        {
+            if (value->slot >= 0)
+                std::cout << "\t%" << value->id << " =";
+            value->inst->accept(&debugger);
+            if (!value->operands.empty())
+            {
+                std::cout << "\t\t<-";
+                for (auto& op : value->operands)
+                {
+                    std::cout << " ";
+                    printValue(op);
+                }
+            }
+            std::cout << "\n";
+        }
+    }
+    std::cout << std::endl;
+}
+
+void printStack(const Data* stack, size_t size)
 {
     std::cout << "\t";
-    for (int i = 0; i < stack.size(); i++)
+    for (size_t i = 0; i < size; i++)
     {
         printf("[%.16X]", stack[i]);
     }
@@ -67,19 +140,27 @@ size_t printLocalNInstruction(const char* name, Chunk* chunk, size_t offset)
 
 size_t printJumpInstruction(const char* name, Chunk* chunk, size_t offset, int dir)
 {
-    std::cout << offset << "\t" << std::setw(10) << std::left << name << "\t" << dir * (int)(chunk->code[++offset]) + offset + 1 << std::endl;
-    return offset;
+    int jump = chunk->code[offset + 1] | (chunk->code[offset + 2] << 8);
+    std::cout << offset << "\t" << std::setw(10) << std::left << name << "\t" << dir * jump + offset + 3 << std::endl;
+    return offset + 2;
+}
+
+size_t printCheckInstruction(const char* name, Chunk* chunk, size_t offset)
+{
+    int size = chunk->code[offset + 1] | (chunk->code[offset + 2] << 8);
+    std::cout << offset << "\t" << std::setw(10) << std::left << name << "\t" << size << std::endl;
+    return offset + 2;
 }
 
 size_t printCastInstruction(Chunk* chunk, size_t offset)
 {
     std::cout << offset << "\t" << std::setw(10) << std::left << "CAST"
               << "      ";
-    TypePrimitive t1((TypeTag)(chunk->code[++offset]));
-    TypePrimitive t2((TypeTag)(chunk->code[++offset]));
-    t1.print();
+    TypePrimitive* t1 = TypeContext::primitive((TypeTag)(chunk->code[++offset]));
+    TypePrimitive* t2 = TypeContext::primitive((TypeTag)(chunk->code[++offset]));
+    t1->print();
     std::cout << "->";
-    t2.print();
+    t2->print();
     std::cout << std::endl;
     return offset;
 }
@@ -216,6 +297,8 @@ size_t dissambleInstruction(Chunk* chunk, size_t offset)
         return printLocalInstruction("SET_GLOBAL_POP", chunk, offset);
     case OpCode::SET_LOCAL_POP:
         return printLocalInstruction("SET_LOCAL_POP", chunk, offset);
+    case OpCode::IADD_LOCAL:
+        return printLocalNInstruction("IADD_LOCAL", chunk, offset);
     case OpCode::ALLOC:
         return printPopInstruction("ALLOC", chunk, offset);
     case OpCode::FREE:
@@ -236,6 +319,18 @@ size_t dissambleInstruction(Chunk* chunk, size_t offset)
         return printLocalInstruction("ADDR_GLOBAL", chunk, offset);
     case OpCode::ADDR_GLOBAL_OFF:
         return printLocalInstruction("ADDR_GLOBAL_OFF", chunk, offset);
+    case OpCode::LOAD_I8:
+        return printLocalNInstruction("LOAD_I8", chunk, offset);
+    case OpCode::LOAD_I32:
+        return printLocalNInstruction("LOAD_I32", chunk, offset);
+    case OpCode::STORE_I8:
+        return printLocalNInstruction("STORE_I8", chunk, offset);
+    case OpCode::STORE_I32:
+        return printLocalNInstruction("STORE_I32", chunk, offset);
+    case OpCode::CHECK_INDEX:
+        return printCheckInstruction("CHECK_INDEX", chunk, offset);
+    case OpCode::CHECK_LIMIT:
+        return printCheckInstruction("CHECK_LIMIT", chunk, offset);
     case OpCode::JUMP:
         return printJumpInstruction("JUMP", chunk, offset, 1);
     case OpCode::JUMP_NT_POP:
@@ -245,9 +340,15 @@ size_t dissambleInstruction(Chunk* chunk, size_t offset)
     case OpCode::JUMP_NT:
         return printJumpInstruction("JUMP_NT", chunk, offset, 1);
     case OpCode::CALL:
-        return printPopInstruction("CALL", chunk, offset);
+        return printLocalNInstruction("CALL", chunk, offset);
+    case OpCode::SPAWN:
+        return printPopInstruction("SPAWN", chunk, offset);
+    case OpCode::JOIN:
+        return printPopInstruction("JOIN", chunk, offset);
+    case OpCode::FIBER:
+        return printPopInstruction("FIBER", chunk, offset);
     case OpCode::NATIVE_CALL:
-        return printPopInstruction("NATIVE", chunk, offset);
+        return printLocalNInstruction("NATIVE", chunk, offset);
     case OpCode::RETURN:
         return printPopInstruction("RETURN", chunk, offset);
     default:
@@ -4,6 +4,7 @@
 #include "Chunk.hpp"
 #include "IRChunk.hpp"
 #include "InstVisitor.hpp"
+#include "Mir.h"
 #include "Scanner.h"
 #include "Value.hpp"
 
@@ -171,6 +172,20 @@ public:
         std::cout << ")";
     }
 
+    void visit(ExprSpawn* expr)
+    {
+        std::cout << (expr->token.type == TokenType::FIBER ? "(fiber " : "(spawn ");
+        expr->call->accept(this);
+        std::cout << ")";
+    }
+
+    void visit(ExprJoin* expr)
+    {
+        std::cout << "(join ";
+        expr->handle->accept(this);
+        std::cout << ")";
+    }
+
     void visit(StmtBlock* stmt)
     {
         indentCode();
@@ -337,8 +352,7 @@ public:
 
     void printTag(TypeTag tag)
     {
-        TypePrimitive t(tag);
-        t.print();
+        TypeContext::primitive(tag)->print();
     }
 
     void debugAll()
@@ -615,10 +629,31 @@ public:
         else
             std::cout << "ADDR_GLOBAL\t\t" << inst->name;
     }
+    void visit(InstLoad* inst)
+    {
+        std::cout << "\t";
+        std::cout << (inst->type->getPackedWidth() == 1 ? "LOAD_I8" : "LOAD_I32") << "\t\t" << inst->name << "+" << inst->slot;
+    }
+    void visit(InstStore* inst)
+    {
+        std::cout << "\t";
+        std::cout << (inst->type->getPackedWidth() == 1 ? "STORE_I8" : "STORE_I32") << "\t\t" << inst->name << "+" << inst->slot;
+    }
+    void visit(InstCheckIndex* inst)
+    {
+        std::cout << "\t";
+        std::cout << (inst->hoisted ? "CHECK_LIMIT" : "CHECK_INDEX") << "\t\t" << inst->size;
+    }
     void visit(InstCall* inst)
     {
         std::cout << "\t";
-        if (inst->callType == TypeTag::NATIVE)
+        if (inst->mode == CallMode::SPAWN)
+            std::cout << "SPAWN\t\t\t";
+        else if (inst->mode == CallMode::FIBER)
+            std::cout << "FIBER\t\t\t";
+        else if (inst->callType == TypeTag::TASK)
+            std::cout << "JOIN\t\t\t";
+        else if (inst->callType == TypeTag::NATIVE)
             std::cout << "NATIVE_CALL\t\t";
         else
             std::cout << "CALL\t\t\t";
@@ -679,7 +714,9 @@ public:
 
 void debugInstructions(IRChunk* irChunk);
 
-void printStack(std::vector<Data>& stack);
+void debugMir(MirFunction* func, IRChunk* irChunk);
+
+void printStack(const Data* stack, size_t size);
 
 size_t dissambleInstruction(Chunk* chunk, size_t offset);
 
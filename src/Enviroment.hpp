@@ -12,12 +12,12 @@ public:
     int depth;
     int position;
     bool inited;
-    std::shared_ptr<Type> type;
+    Type* type;
 
     Variable()
         : depth(0), position(0), inited(false) {}
 
-    Variable(int depth, int position, bool inited, std::shared_ptr<Type> type)
+    Variable(int depth, int position, bool inited, Type* type)
         : depth(depth), position(position), inited(inited), type(type) {}
 };
 
@@ -49,7 +49,7 @@ public:
         return Variable();
     }
 
-    void define(Token& name, std::shared_ptr<Type> type, bool inited)
+    void define(Token& name, Type* type, bool inited)
     {
         if (values.find(name.getString()) == values.end())
         {
@@ -60,7 +60,7 @@ public:
             std::cout << "[ERROR] Variable '" << name.getString() << "' has already defined at this scope at line " << name.line << "\n";
     }
 
-    void define(std::string name, std::shared_ptr<Type> type, bool inited)
+    void define(std::string name, Type* type, bool inited)
     {
         if (values.find(name) == values.end())
         {
@@ -71,9 +71,9 @@ public:
             std::cout << "[ERROR] Variable '" << name << "' has already defined at this scope\n";
     }
 
-    std::vector<std::shared_ptr<Type>> getEnvTypes()
+    std::vector<Type*> getEnvTypes()
     {
-        std::vector<std::shared_ptr<Type>> types;
+        std::vector<Type*> types;
         for (auto& var : values)
             types.push_back(var.second.type);
         return types;
@@ -92,7 +92,7 @@ public:
 
 struct GlobalVar
 {
-    std::shared_ptr<Type> type;
+    Type* type;
     Value* val;
     int position;
     std::string fullName;
@@ -100,7 +100,7 @@ struct GlobalVar
     GlobalVar()
         : position(0) {}
 
-    GlobalVar(std::string fullName, int position, std::shared_ptr<Type> type, Value* val)
+    GlobalVar(std::string fullName, int position, Type* type, Value* val)
         : fullName(fullName), position(position), type(type), val(val) {}
 };
 
@@ -110,10 +110,15 @@ public:
     std::string name;
     EnvNamespace* closing;
     std::unordered_map<std::string, GlobalVar> vars;
-    static size_t currentPos;
 
     EnvNamespace(std::string name, EnvNamespace* closing)
-        : name(name), closing(closing) {}
+        : name(name), closing(closing), slots(0) {}
+
+    // Global slots handed out so far, counted on the outermost namespace so that every compile has its own.
+    size_t& globalSlots()
+    {
+        return closing ? closing->globalSlots() : slots;
+    }
 
     std::string getName()
     {
@@ -124,25 +129,25 @@ public:
         return ss.str();
     }
 
-    void define(Token& name, std::shared_ptr<Type> type, Value* val)
+    void define(Token& name, Type* type, Value* val)
     {
         if (vars.find(name.getString()) == vars.end())
         {
-            GlobalVar global(getName() + "::" + name.getString(), currentPos, type, val);
+            GlobalVar global(getName() + "::" + name.getString(), globalSlots(), type, val);
             vars.insert({name.getString(), global});
-            currentPos += type->getSize();
+            globalSlots() += type->getSize();
         }
         else
             std::cout << "[ERROR] Variable '" << name.getString() << "' has already defined at this namespace at line " << name.line << "\n";
     }
 
-    void define(std::string name, std::shared_ptr<Type> type, Value* val)
+    void define(std::string name, Type* type, Value* val)
     {
         if (vars.find(name) == vars.end())
         {
-            GlobalVar global(getName() + "::" + name, currentPos, type, val);
+            GlobalVar global(getName() + "::" + name, globalSlots(), type, val);
             vars.insert({name, global});
-            currentPos += type->getSize();
+            globalSlots() += type->getSize();
         }
         else
             std::cout << "[ERROR] Variable '" << name << "' has already defined at this scope\n";
@@ -161,4 +166,7 @@ public:
 
         return GlobalVar();
     }
+
+private:
+    size_t slots;
 };
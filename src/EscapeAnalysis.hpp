@@ -0,0 +1,282 @@
+#pragma once
+
+#include "AstVisitor.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Runs on the typed AST and finds the locals 'T& p = heap T;' whose object can live in the frame of
+// the function instead of the heap. The owner must only be dereferenced, or lent with 'ref' to a
+// native: returning it, taking it, assigning it, storing it anywhere or passing it to a function
+// lets it escape. A call to a function while the owner lives also keeps it on the heap, as the
+// frame of the callee can move the VM stack and the frame with it.
+class EscapeAnalysis : public AstVisitor
+{
+private:
+    // The frame holds the object next to the other locals, whose slots are addressed with a byte.
+    static const size_t MAX_SLOTS = 16;
+
+    struct Owner
+    {
+        StmtVarDecleration* stmt;
+        bool escapes;
+    };
+
+    // Every local by name, owners that may stay in the frame point to their entry, others are null.
+    std::vector<std::unordered_map<std::string, Owner*>> scopes;
+    std::vector<Owner*> functionOwners;
+
+public:
+    size_t inFrame;
+    size_t onHeap;
+
+    EscapeAnalysis(std::vector<Stmt*>& root)
+        : inFrame(0), onHeap(0)
+    {
+        for (auto& stmt : root)
+            stmt->accept(this);
+    }
+
+    Owner* owner(Expr* expr)
+    {
+        if (expr->instance != ExprType::Variable)
+            return nullptr;
+        const std::string& name = ((ExprVariable*)expr)->name.getString();
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it)
+        {
+            auto found = it->find(name);
+            if (found != it->end())
+                return found->second;
+        }
+        return nullptr;
+    }
+
+    void define(const std::string& name, Owner* owner)
+    {
+        if (!scopes.empty())
+            scopes.back()[name] = owner;
+    }
+
+    // The stack may move, none of the live owners can stay in the frame.
+    void stackMoves()
+    {
+        for (auto& scope : scopes)
+            for (auto& local : scope)
+                if (local.second)
+                    local.second->escapes = true;
+    }
+
+    void finishFunction()
+    {
+        for (auto& owner : functionOwners)
+        {
+            owner->stmt->inFrame = !owner->escapes;
+            if (owner->escapes)
+                onHeap++;
+            else
+                inFrame++;
+            delete owner;
+        }
+        functionOwners.clear();
+    }
+
+    void visit(ExprArrGet* expr)
+    {
+        expr->callee->accept(this);
+        expr->index->accept(this);
+    }
+    void visit(ExprArrSet* expr)
+    {
+        expr->callee->accept(this);
+        expr->index->accept(this);
+        expr->assignment->accept(this);
+    }
+    void visit(ExprAssignment* expr)
+    {
+        expr->assignment->accept(this);
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it)
+        {
+            auto found = it->find(expr->name.getString());
+            if (found != it->end())
+            {
+                if (found->second)
+                    found->second->escapes = true;
+                break;
+            }
+        }
+    }
+    void visit(ExprBinary* expr)
+    {
+        expr->left->accept(this);
+        expr->right->accept(this);
+    }
+    void visit(ExprCall* expr)
+    {
+        bool native = expr->callee->type->tag == TypeTag::NATIVE;
+        for (auto& arg : expr->args)
+        {
+            // A native borrows its arguments only for the call.
+            if (native && arg->instance == ExprType::Ref && owner(((ExprRef*)arg)->callee))
+                continue;
+            arg->accept(this);
+        }
+        expr->callee->accept(this);
+        if (!native)
+            stackMoves();
+    }
+    void visit(ExprCast* expr)
+    {
+        expr->expr->accept(this);
+    }
+    void visit(ExprLiteral* expr)
+    {
+    }
+    void visit(ExprLogic* expr)
+    {
+        expr->left->accept(this);
+        expr->right->accept(this);
+    }
+    void visit(ExprUnary* expr)
+    {
+        expr->expr->accept(this);
+    }
+    void visit(ExprVariable* expr)
+    {
+        // Any use that is not a dereference passes the pointer on.
+        if (Owner* o = owner(expr))
+            o->escapes = true;
+    }
+    void visit(ExprHeap* expr)
+    {
+    }
+    void visit(ExprGetDeref* expr)
+    {
+        if (!owner(expr->callee))
+            expr->callee->accept(this);
+    }
+    void visit(ExprSetDeref* expr)
+    {
+        expr->asgn->accept(this);
+        if (!owner(expr->callee))
+            expr->callee->accept(this);
+    }
+    void visit(ExprRef* expr)
+    {
+        expr->callee->accept(this);
+    }
+    void visit(ExprTake* expr)
+    {
+        expr->source->accept(this);
+    }
+    void visit(ExprGet* expr)
+    {
+        expr->callee->accept(this);
+    }
+    void visit(ExprSet* expr)
+    {
+        expr->asgn->accept(this);
+        expr->callee->accept(this);
+    }
+    void visit(ExprAddr* expr)
+    {
+        expr->callee->accept(this);
+    }
+    void visit(ExprSpawn* expr)
+    {
+        for (auto& arg : expr->call->args)
+            arg->accept(this);
+        expr->call->callee->accept(this);
+        stackMoves();
+    }
+    void visit(ExprJoin* expr)
+    {
+        expr->handle->accept(this);
+        stackMoves();
+    }
+
+    void visit(StmtBlock* stmt)
+    {
+        scopes.emplace_back();
+        for (auto& s : stmt->statements)
+            s->accept(this);
+        scopes.pop_back();
+    }
+    void visit(StmtExpr* stmt)
+    {
+        stmt->expr->accept(this);
+    }
+    void visit(StmtFunc* stmt)
+    {
+        scopes.emplace_back();
+        for (auto& arg : stmt->args)
+            define(arg.getString(), nullptr);
+
+        for (auto& s : stmt->body->statements)
+            s->accept(this);
+
+        scopes.pop_back();
+        finishFunction();
+    }
+    void visit(StmtVarDecleration* stmt)
+    {
+        if (stmt->initializer)
+            stmt->initializer->accept(this);
+        if (scopes.empty())
+            return;
+
+        Owner* o = nullptr;
+        if (stmt->initializer && stmt->initializer->instance == ExprType::Heap)
+        {
+            Type* constructType = ((ExprHeap*)stmt->initializer)->constructType;
+            size_t size = constructType->getSize();
+            o = new Owner{stmt, size == 0 || size > MAX_SLOTS};
+            functionOwners.push_back(o);
+        }
+        define(stmt->name.getString(), o);
+    }
+    void visit(StmtReturn* stmt)
+    {
+        if (stmt->retVal)
+            stmt->retVal->accept(this);
+    }
+    void visit(StmtIf* stmt)
+    {
+        stmt->condition->accept(this);
+        stmt->then->accept(this);
+        if (stmt->els)
+            stmt->els->accept(this);
+    }
+    void visit(StmtFor* stmt)
+    {
+        scopes.emplace_back();
+        if (stmt->decl)
+            stmt->decl->accept(this);
+        if (stmt->cond)
+            stmt->cond->accept(this);
+        stmt->loop->accept(this);
+        if (stmt->inc)
+            stmt->inc->accept(this);
+        scopes.pop_back();
+    }
+    void visit(StmtWhile* stmt)
+    {
+        stmt->condition->accept(this);
+        stmt->loop->accept(this);
+    }
+    void visit(StmtStruct* stmt)
+    {
+        for (auto& m : stmt->methodes)
+            m.second->accept(this);
+    }
+    void visit(StmtNamespace* stmt)
+    {
+        for (auto& s : stmt->stmts)
+            s->accept(this);
+    }
+    void visit(StmtCompUnit* stmt)
+    {
+        for (auto& s : stmt->stmts)
+            s->accept(this);
+    }
+};
@@ -0,0 +1,133 @@
+#include "Fiber.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <poll.h>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+// Filled once, by the first parser, before any script runs. Only read after that.
+std::unordered_map<NativeFn, WaitKind> blocking;
+}
+
+void defineBlocking(NativeFn native, WaitKind kind)
+{
+    blocking[native] = kind;
+}
+
+bool isBlocking(NativeFn native, WaitKind& kind)
+{
+    auto it = blocking.find(native);
+    if (it == blocking.end())
+        return false;
+    kind = it->second;
+    return true;
+}
+
+bool inputReady()
+{
+    // The streams share the buffer of stdin, which may hold input the descriptor no longer has.
+#ifdef __GLIBC__
+    if (stdin->_IO_read_ptr < stdin->_IO_read_end)
+        return true;
+#endif
+    pollfd fd = {0, POLLIN, 0};
+    return poll(&fd, 1, 0) > 0;
+}
+
+FiberQueue::~FiberQueue()
+{
+    clear();
+}
+
+void FiberQueue::clear()
+{
+    for (auto& fiber : ready)
+        delete fiber;
+    for (auto& fiber : parked)
+        delete fiber;
+    ready.clear();
+    parked.clear();
+}
+
+void FiberQueue::park(Fiber* fiber)
+{
+    if (fiber->wait == WaitKind::NONE)
+        ready.push_back(fiber);
+    else
+        parked.push_back(fiber);
+}
+
+Fiber* FiberQueue::next()
+{
+    while (true)
+    {
+        wake();
+        if (!ready.empty())
+        {
+            Fiber* fiber = ready.front();
+            ready.pop_front();
+            return fiber;
+        }
+        if (parked.empty())
+            return nullptr;
+        block();
+    }
+}
+
+void FiberQueue::wake()
+{
+    if (parked.empty())
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    bool input = false;
+    for (auto& fiber : parked)
+        input |= fiber->wait == WaitKind::INPUT;
+    input = input && inputReady();
+
+    // Ready input is for one reader, the first fiber that parked on it. The others would block the
+    // thread in the native, they wait for the next check.
+    size_t kept = 0;
+    for (auto& fiber : parked)
+    {
+        bool over = fiber->wait == WaitKind::TIME ? fiber->until <= now : input;
+        if (over && fiber->wait == WaitKind::INPUT)
+            input = false;
+        if (over)
+            ready.push_back(fiber);
+        else
+            parked[kept++] = fiber;
+    }
+    parked.resize(kept);
+}
+
+void FiberQueue::block()
+{
+    bool input = false;
+    auto until = std::chrono::steady_clock::time_point::max();
+    for (auto& fiber : parked)
+    {
+        if (fiber->wait == WaitKind::INPUT)
+            input = true;
+        else
+            until = std::min(until, fiber->until);
+    }
+
+    if (!input)
+    {
+        std::this_thread::sleep_until(until);
+        return;
+    }
+
+    int timeout = -1;
+    if (until != std::chrono::steady_clock::time_point::max())
+    {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(until - std::chrono::steady_clock::now());
+        timeout = std::max<int>(0, (int)left.count() + 1);
+    }
+    pollfd fd = {0, POLLIN, 0};
+    poll(&fd, 1, timeout);
+}
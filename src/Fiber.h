@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Chunk.hpp"
+#include "ValueStack.hpp"
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+struct Frame
+{
+	size_t ip;
+	Chunk* chunk;
+	size_t frameStart;
+
+	Frame()
+		:ip(0), chunk(nullptr), frameStart(0)
+	{}
+
+	Frame(size_t ip, Chunk* chunk, size_t frameStart)
+		:ip(ip), chunk(chunk), frameStart(frameStart)
+	{}
+};
+
+// What a blocking native waits for. A fiber that calls it parks until then instead of blocking the
+// thread. NONE and TIME waits stand in for the call itself, an INPUT wait calls the native once
+// there is something to read.
+enum class WaitKind
+{
+	NONE,
+	INPUT,
+	TIME
+};
+
+void defineBlocking(NativeFn native, WaitKind kind);
+bool isBlocking(NativeFn native, WaitKind& kind);
+// Whether reading the standard input would return without blocking.
+bool inputReady();
+
+// A script activity with a stack and frames of its own. The state of the running fiber lives in the
+// VM and is swapped in and out.
+struct Fiber
+{
+	ValueStack stack;
+	std::vector<Frame> frames;
+	Chunk* chunk;
+	size_t ip;
+	WaitKind wait;
+	std::chrono::steady_clock::time_point until;
+
+	Fiber()
+		: chunk(nullptr), ip(0), wait(WaitKind::NONE)
+	{}
+};
+
+// Cooperative run queue of one VM. Fibers run in the order they become ready, and when all of them
+// wait the thread sleeps until the first wait is over.
+class FiberQueue
+{
+private:
+	std::deque<Fiber*> ready;
+	std::vector<Fiber*> parked;
+
+public:
+	~FiberQueue();
+
+	void park(Fiber* fiber);
+	// Drops every fiber, used when the VM is reset.
+	void clear();
+	// Returns null when no fiber is left.
+	Fiber* next();
+
+private:
+	void wake();
+	void block();
+};
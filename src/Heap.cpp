@@ -0,0 +1,57 @@
+#include "Heap.h"
+#include "MemStats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+std::atomic<bool> recording(false);
+std::mutex mutex;
+std::unordered_map<Data*, size_t> blocks;
+}
+
+Data* heapAlloc(size_t size)
+{
+    MemStats::VMHeap heap;
+    Data* ptr = new Data[size];
+    if (recording.load(std::memory_order_relaxed))
+        adoptBlock(ptr, size);
+    return ptr;
+}
+
+void heapFree(Data* ptr)
+{
+    if (recording.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocks.erase(ptr);
+    }
+    delete[] ptr;
+}
+
+void recordHeap()
+{
+    recording = true;
+}
+
+void adoptBlock(Data* ptr, size_t size)
+{
+    if (!recording.load(std::memory_order_relaxed))
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    blocks[ptr] = size;
+}
+
+std::vector<std::pair<Data*, size_t>> recordedBlocks()
+{
+    std::vector<std::pair<Data*, size_t>> live;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        live.assign(blocks.begin(), blocks.end());
+    }
+    std::sort(live.begin(), live.end());
+    return live;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Value.hpp"
+
+#include <utility>
+#include <vector>
+
+// Blocks made by ALLOC in the interpreter and in compiled code. While the heap is recorded the live
+// blocks are kept, so a snapshot can copy them.
+Data* heapAlloc(size_t size);
+void heapFree(Data* ptr);
+
+void recordHeap();
+// Registers a block made outside of heapAlloc, as a restored snapshot does.
+void adoptBlock(Data* ptr, size_t size);
+// The live blocks and their sizes in slots, sorted by address. Empty unless the heap is recorded.
+std::vector<std::pair<Data*, size_t>> recordedBlocks();
@@ -3,6 +3,8 @@
 #include "Instruction.h"
 #include "Value.hpp"
 #include "Chunk.hpp"
+#include "ConstantPool.hpp"
+#include <unordered_map>
 #include <vector>
 #include <string>
 
@@ -10,23 +12,31 @@ class IRChunk
 {
 private:
     std::vector<Instruction*> code;
+    // The pool entries this chunk uses, by the ids its instructions know them by.
     std::vector<Value*> constants;
+    std::unordered_map<Value*, size_t> constantIds;
+    ConstantPool* pool;
 
 public:
     Chunk* chunk;
     std::string name;
+    size_t argSize;
+    size_t maxStack;
 
-    IRChunk(std::string name)
-        : chunk(new Chunk()), name(name) {}
+    IRChunk(std::string name, ConstantPool* pool)
+        : pool(pool), chunk(new Chunk()), name(name), argSize(0), maxStack(0) {}
     ~IRChunk() {}
 
-    inline size_t addConstant(Value* value)
+    // Equal constants get the same id.
+    inline size_t addConstant(const Value& value)
     {
-        for (size_t i = 0; i < constants.size(); i++)
-            if (*constants[i] == *value)
-                return i;
+        Value* entry = pool->intern(value);
+        auto it = constantIds.find(entry);
+        if (it != constantIds.end())
+            return it->second;
 
-        constants.push_back(value);
+        constantIds.emplace(entry, constants.size());
+        constants.push_back(entry);
         return constants.size() - 1;
     }
 
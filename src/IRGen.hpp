@@ -10,6 +10,7 @@ class IRGen : public AstVisitor
 {
 private:
     IRChunk* chunk;
+    ConstantPool& pool;
     std::vector<Stmt*>& root;
     std::unordered_map<std::string, EnvNamespace*>& allNamespaces;
     std::vector<IRChunk*> chunks;
@@ -19,17 +20,17 @@ private:
 
 public:
     bool cont;
-    IRGen(std::vector<Stmt*>& root, std::unordered_map<std::string, EnvNamespace*>& allNamespaces)
-        : chunk(new IRChunk("_start")), root(root), allNamespaces(allNamespaces), currentEnviroment(new Enviroment(nullptr, 0)), currentLabel(0), cont(true)
+    IRGen(std::vector<Stmt*>& root, std::unordered_map<std::string, EnvNamespace*>& allNamespaces, ConstantPool& pool)
+        : chunk(new IRChunk("_start", &pool)), pool(pool), root(root), allNamespaces(allNamespaces), currentEnviroment(new Enviroment(nullptr, 0)), currentLabel(0), cont(true)
     {
         currentNamespace = allNamespaces[""];
     }
 
-    std::vector<std::shared_ptr<Type>> makePrimTypeList(std::vector<TypeTag> tags)
+    std::vector<Type*> makePrimTypeList(std::vector<TypeTag> tags)
     {
-        std::vector<std::shared_ptr<Type>> types;
+        std::vector<Type*> types;
         for (auto& tag : tags)
-            types.push_back(std::make_shared<TypePrimitive>(tag));
+            types.push_back(TypeContext::primitive(tag));
         return types;
     }
 
@@ -40,7 +41,7 @@ public:
             stmt->accept(this);
 
         chunk->addCode(new InstGetGlobal("::main", allNamespaces[""]->vars["main"].type));
-        chunk->addCode(new InstCall(makePrimTypeList({TypeTag::VOID}), TypeTag::FUNCTION));
+        chunk->addCode(new InstCall(makePrimTypeList({TypeTag::VOID}), TypeTag::FUNCTION, TypeContext::primitive(TypeTag::VOID)));
 
         return chunks;
     }
@@ -50,11 +51,24 @@ public:
         currentEnviroment = new Enviroment(currentEnviroment, frameStart ? 0 : currentEnviroment->currentPos);
     }
 
+    // The slots of an owner's object that escape analysis placed in the frame.
+    static std::string frameObject(const std::string& owner)
+    {
+        return "heap " + owner;
+    }
+
+    // Owners free their object, unless it is in the frame.
+    bool ownsHeap(const std::string& name, const Variable& var)
+    {
+        return var.type->tag == TypeTag::POINTER && ((TypePointer*)(var.type))->is_owner &&
+               !currentEnviroment->values.count(frameObject(name));
+    }
+
     void endScope()
     {
         for (auto& var : currentEnviroment->values)
         {
-            if (var.second.type->tag == TypeTag::POINTER && ((TypePointer*)(var.second.type.get()))->is_owner)
+            if (ownsHeap(var.first, var.second))
             {
                 chunk->addCode(new InstGetLocal(var.first, var.second, var.second.type));
                 chunk->addCode(new InstFree());
@@ -72,37 +86,64 @@ public:
         return new InstLabel(-1, currentLabel++, {});
     }
 
-    void visit(ExprArrGet* expr)
+    // Pushes the flat index of callee[index] scaled by stride, outer dimensions first.
+    void arrayIndex(Expr* callee, Expr* index, bool checkIndex, size_t stride, size_t width)
     {
-        if (expr->type->getSize() != 1)
-            expr->index = new ExprBinary(expr->index, new ExprLiteral(new Value((int)expr->type->getSize())), Token(TokenType::STAR, expr->bracket.line, expr->bracket.start, expr->bracket.length));
-
-        while (expr->callee->instance == ExprType::ArrGet)
+        bool nested = callee->instance == ExprType::ArrGet;
+        if (nested)
         {
-            ExprArrGet* child = (ExprArrGet*)expr->callee;
-            expr->callee = child->callee;
+            ExprArrGet* outer = (ExprArrGet*)callee;
+            arrayIndex(outer->callee, outer->index, outer->checkIndex, ((TypeArray*)outer->type)->getPackedSize(width), width);
+        }
 
-            Token plus(TokenType::PLUS, expr->bracket.line, expr->bracket.start, expr->bracket.length);
-            child->index = new ExprBinary(child->index, new ExprLiteral(new Value((int)child->type->getSize())), Token(TokenType::STAR, child->bracket.line, child->bracket.start, child->bracket.length));
-            expr->index = new ExprBinary(expr->index, child->index, plus);
+        index->accept(this);
+        if (checkIndex)
+            chunk->addCode(new InstCheckIndex(((TypeArray*)callee->type)->size));
+
+        if (stride != 1)
+        {
+            chunk->addCode(new InstConst(chunk->addConstant(Value((int)stride))));
+            chunk->addCode(new InstMul(TypeTag::INTEGER));
         }
+        if (nested)
+            chunk->addCode(new InstAdd(TypeTag::INTEGER));
+    }
 
-        if (expr->callee->instance == ExprType::Variable)
+    Expr* arrayBase(Expr* callee)
+    {
+        while (callee->instance == ExprType::ArrGet)
+            callee = ((ExprArrGet*)callee)->callee;
+        return callee;
+    }
+
+    void visit(ExprArrGet* expr)
+    {
+        size_t width = expr->type->getPackedWidth();
+        size_t stride = width == 0 ? expr->type->getSize() : 1;
+        Expr* callee = arrayBase(expr->callee);
+
+        if (callee->instance == ExprType::Variable)
         {
-            ExprVariable* exprVar = (ExprVariable*)(expr->callee);
+            ExprVariable* exprVar = (ExprVariable*)callee;
             // Variable var = currentEnviroment->get(exprVar->name);
 
-            expr->index->accept(this);
+            arrayIndex(expr->callee, expr->index, expr->checkIndex, stride, width);
 
             if (currentEnviroment->has(exprVar->name))
             {
                 Variable var = currentEnviroment->get(exprVar->name);
-                chunk->addCode(new InstGetLocal(exprVar->name.getString(), currentEnviroment->get(exprVar->name), expr->type, true));
+                if (width != 0)
+                    chunk->addCode(new InstLoad(exprVar->name.getString(), var, expr->type, MemBase::LOCAL));
+                else
+                    chunk->addCode(new InstGetLocal(exprVar->name.getString(), var, expr->type, true));
             }
             else
             {
                 GlobalVar var = currentNamespace->get(exprVar->name);
-                chunk->addCode(new InstGetGlobal(var.fullName, expr->type, true));
+                if (width != 0)
+                    chunk->addCode(new InstLoad(var.fullName, Variable(), expr->type, MemBase::GLOBAL));
+                else
+                    chunk->addCode(new InstGetGlobal(var.fullName, expr->type, true));
             }
 
 
@@ -111,33 +152,43 @@ public:
             // else
             //     chunk->addCode(new InstGetLocal(exprVar->name.getString(), currentEnviroment->get(exprVar->name), expr->type, true));
         }
-        else if (expr->callee->instance == ExprType::Get)
+        else if (callee->instance == ExprType::Get)
         {
-            ExprGet* get = (ExprGet*)expr->callee;
+            ExprGet* get = (ExprGet*)callee;
 
             if (get->callee->instance == ExprType::Variable)
             {
-                expr->index->accept(this);
-                TypeStruct* type = (TypeStruct*)get->callee->type.get();
+                arrayIndex(expr->callee, expr->index, expr->checkIndex, stride, width);
+                TypeStruct* type = (TypeStruct*)get->callee->type;
                 std::string getName = get->get.getString();
                 ExprVariable* exprVar = (ExprVariable*)get->callee;
                 Variable var = currentEnviroment->get(exprVar->name);
                 structMember m = type->members[getName];
-                chunk->addCode(new InstConst(chunk->addConstant(new Value((int)m.offset))));
-                chunk->addCode(new InstAdd(TypeTag::INTEGER));
-                chunk->addCode(new InstGetLocal(exprVar->name.getString(), var, expr->type, true));
+                if (width != 0)
+                    chunk->addCode(new InstLoad(exprVar->name.getString(), var, expr->type, MemBase::LOCAL, m.offset));
+                else
+                {
+                    chunk->addCode(new InstConst(chunk->addConstant(Value((int)m.offset))));
+                    chunk->addCode(new InstAdd(TypeTag::INTEGER));
+                    chunk->addCode(new InstGetLocal(exprVar->name.getString(), var, expr->type, true));
+                }
             }
             else if (get->callee->instance == ExprType::GetDeref)
             {
                 ExprGetDeref* exprGet = (ExprGetDeref*)get->callee;
                 exprGet->callee->accept(this);
-                expr->index->accept(this);
-                TypeStruct* type = (TypeStruct*)exprGet->callee->type->intrinsicType.get();
+                arrayIndex(expr->callee, expr->index, expr->checkIndex, stride, width);
+                TypeStruct* type = (TypeStruct*)exprGet->callee->type->intrinsicType;
                 std::string getName = get->get.getString();
                 structMember m = type->members[getName];
-                chunk->addCode(new InstConst(chunk->addConstant(new Value((int)m.offset))));
-                chunk->addCode(new InstAdd(TypeTag::INTEGER));
-                chunk->addCode(new InstGetDerefOff(expr->type));
+                if (width != 0)
+                    chunk->addCode(new InstLoad("", Variable(), expr->type, MemBase::DEREF_OFF, m.offset));
+                else
+                {
+                    chunk->addCode(new InstConst(chunk->addConstant(Value((int)m.offset))));
+                    chunk->addCode(new InstAdd(TypeTag::INTEGER));
+                    chunk->addCode(new InstGetDerefOff(expr->type));
+                }
             }
         }
 
@@ -146,38 +197,35 @@ public:
 
     void visit(ExprArrSet* expr)
     {
-        if (expr->type->getSize() != 1)
-            expr->index = new ExprBinary(expr->index, new ExprLiteral(new Value((int)expr->type->getSize())), Token(TokenType::STAR, expr->bracket.line, expr->bracket.start, expr->bracket.length));
-
-        while (expr->callee->instance == ExprType::ArrGet)
-        {
-            ExprArrGet* child = (ExprArrGet*)expr->callee;
-            expr->callee = child->callee;
-
-            Token plus(TokenType::PLUS, expr->bracket.line, expr->bracket.start, expr->bracket.length);
-            child->index = new ExprBinary(child->index, new ExprLiteral(new Value((int)child->type->getSize())), Token(TokenType::STAR, child->bracket.line, child->bracket.start, child->bracket.length));
-            expr->index = new ExprBinary(expr->index, child->index, plus);
-        }
+        size_t width = expr->type->getPackedWidth();
+        size_t stride = width == 0 ? expr->type->getSize() : 1;
+        Expr* callee = arrayBase(expr->callee);
 
         expr->assignment->accept(this);
 
-        if (expr->callee->instance == ExprType::Variable)
+        if (callee->instance == ExprType::Variable)
         {
-            ExprVariable* exprVar = (ExprVariable*)(expr->callee);
+            ExprVariable* exprVar = (ExprVariable*)callee;
             // Variable var = currentEnviroment->get(exprVar->name);
 
-            expr->index->accept(this);
+            arrayIndex(expr->callee, expr->index, expr->checkIndex, stride, width);
 
 
             if (currentEnviroment->has(exprVar->name))
             {
                 Variable var = currentEnviroment->get(exprVar->name);
-                chunk->addCode(new InstSetLocal(exprVar->name.getString(), currentEnviroment->get(exprVar->name), expr->type, true));
+                if (width != 0)
+                    chunk->addCode(new InstStore(exprVar->name.getString(), var, expr->type, MemBase::LOCAL));
+                else
+                    chunk->addCode(new InstSetLocal(exprVar->name.getString(), var, expr->type, true));
             }
             else
             {
                 GlobalVar var = currentNamespace->get(exprVar->name);
-                chunk->addCode(new InstSetGlobal(var.fullName, expr->type, true));
+                if (width != 0)
+                    chunk->addCode(new InstStore(var.fullName, Variable(), expr->type, MemBase::GLOBAL));
+                else
+                    chunk->addCode(new InstSetGlobal(var.fullName, expr->type, true));
             }
 
             // if (var.depth == 0)
@@ -185,33 +233,43 @@ public:
             // else
             //     chunk->addCode(new InstSetLocal(exprVar->name.getString(), currentEnviroment->get(exprVar->name), expr->type, true));
         }
-        else if (expr->callee->instance == ExprType::Get)
+        else if (callee->instance == ExprType::Get)
         {
-            ExprGet* get = (ExprGet*)expr->callee;
+            ExprGet* get = (ExprGet*)callee;
 
             if (get->callee->instance == ExprType::Variable)
             {
-                expr->index->accept(this);
-                TypeStruct* type = (TypeStruct*)get->callee->type.get();
+                arrayIndex(expr->callee, expr->index, expr->checkIndex, stride, width);
+                TypeStruct* type = (TypeStruct*)get->callee->type;
                 std::string getName = get->get.getString();
                 ExprVariable* exprVar = (ExprVariable*)get->callee;
                 Variable var = currentEnviroment->get(exprVar->name);
                 structMember m = type->members[getName];
-                chunk->addCode(new InstConst(chunk->addConstant(new Value((int)m.offset))));
-                chunk->addCode(new InstAdd(TypeTag::INTEGER));
-                chunk->addCode(new InstSetLocal(exprVar->name.getString(), var, expr->type, true));
+                if (width != 0)
+                    chunk->addCode(new InstStore(exprVar->name.getString(), var, expr->type, MemBase::LOCAL, m.offset));
+                else
+                {
+                    chunk->addCode(new InstConst(chunk->addConstant(Value((int)m.offset))));
+                    chunk->addCode(new InstAdd(TypeTag::INTEGER));
+                    chunk->addCode(new InstSetLocal(exprVar->name.getString(), var, expr->type, true));
+                }
             }
             else if (get->callee->instance == ExprType::GetDeref)
             {
                 ExprGetDeref* exprGet = (ExprGetDeref*)get->callee;
                 exprGet->callee->accept(this);
-                expr->index->accept(this);
-                TypeStruct* type = (TypeStruct*)exprGet->callee->type->intrinsicType.get();
+                arrayIndex(expr->callee, expr->index, expr->checkIndex, stride, width);
+                TypeStruct* type = (TypeStruct*)exprGet->callee->type->intrinsicType;
                 std::string getName = get->get.getString();
                 structMember m = type->members[getName];
-                chunk->addCode(new InstConst(chunk->addConstant(new Value((int)m.offset))));
-                chunk->addCode(new InstAdd(TypeTag::INTEGER));
-                chunk->addCode(new InstSetDerefOff(expr->type));
+                if (width != 0)
+                    chunk->addCode(new InstStore("", Variable(), expr->type, MemBase::DEREF_OFF, m.offset));
+                else
+                {
+                    chunk->addCode(new InstConst(chunk->addConstant(Value((int)m.offset))));
+                    chunk->addCode(new InstAdd(TypeTag::INTEGER));
+                    chunk->addCode(new InstSetDerefOff(expr->type));
+                }
             }
         }
 
@@ -288,7 +346,7 @@ public:
     }
     void visit(ExprCall* expr)
     {
-        std::vector<std::shared_ptr<Type>> args;
+        std::vector<Type*> args;
         for (auto& arg : expr->args)
         {
             arg->accept(this);
@@ -296,7 +354,7 @@ public:
         }
 
         expr->callee->accept(this);
-        chunk->addCode(new InstCall(args, expr->callee->type->tag));
+        chunk->addCode(new InstCall(args, expr->callee->type->tag, expr->type));
     }
     void visit(ExprCast* expr)
     {
@@ -305,7 +363,7 @@ public:
     }
     void visit(ExprLiteral* expr)
     {
-        size_t pos = chunk->addConstant(expr->val);
+        size_t pos = chunk->addConstant(*expr->val);
         chunk->addCode(new InstConst(pos));
     }
     void visit(ExprLogic* expr)
@@ -395,22 +453,22 @@ public:
     {
         if (expr->callee->instance == ExprType::Variable)
         {
-            TypeStruct* type = (TypeStruct*)expr->callee->type.get();
+            TypeStruct* type = (TypeStruct*)expr->callee->type;
             std::string getName = expr->get.getString();
             ExprVariable* exprVar = (ExprVariable*)expr->callee;
             Variable var = currentEnviroment->get(exprVar->name);
             structMember m = type->members[getName];
-            chunk->addCode(new InstConst(chunk->addConstant(new Value((int)m.offset))));
+            chunk->addCode(new InstConst(chunk->addConstant(Value((int)m.offset))));
             chunk->addCode(new InstGetLocal(exprVar->name.getString(), var, m.type, true));
         }
         else if (expr->callee->instance == ExprType::GetDeref)
         {
             ExprGetDeref* exprGet = (ExprGetDeref*)expr->callee;
             exprGet->callee->accept(this);
-            TypeStruct* type = (TypeStruct*)exprGet->callee->type->intrinsicType.get();
+            TypeStruct* type = (TypeStruct*)exprGet->callee->type->intrinsicType;
             std::string getName = expr->get.getString();
             structMember m = type->members[getName];
-            chunk->addCode(new InstConst(chunk->addConstant(new Value((int)m.offset))));
+            chunk->addCode(new InstConst(chunk->addConstant(Value((int)m.offset))));
             chunk->addCode(new InstGetDerefOff(m.type));
         }
     }
@@ -420,22 +478,22 @@ public:
         expr->asgn->accept(this);
         if (expr->callee->instance == ExprType::Variable)
         {
-            TypeStruct* type = (TypeStruct*)expr->callee->type.get();
+            TypeStruct* type = (TypeStruct*)expr->callee->type;
             std::string getName = expr->get.getString();
             ExprVariable* exprVar = (ExprVariable*)expr->callee;
             Variable var = currentEnviroment->get(exprVar->name);
             structMember m = type->members[getName];
-            chunk->addCode(new InstConst(chunk->addConstant(new Value((int)m.offset))));
+            chunk->addCode(new InstConst(chunk->addConstant(Value((int)m.offset))));
             chunk->addCode(new InstSetLocal(exprVar->name.getString(), var, m.type, true));
         }
         else if (expr->callee->instance == ExprType::GetDeref)
         {
             ExprGetDeref* exprGet = (ExprGetDeref*)expr->callee;
             exprGet->callee->accept(this);
-            TypeStruct* type = (TypeStruct*)exprGet->callee->type->intrinsicType.get();
+            TypeStruct* type = (TypeStruct*)exprGet->callee->type->intrinsicType;
             std::string getName = expr->get.getString();
             structMember m = type->members[getName];
-            chunk->addCode(new InstConst(chunk->addConstant(new Value((int)m.offset))));
+            chunk->addCode(new InstConst(chunk->addConstant(Value((int)m.offset))));
             chunk->addCode(new InstSetDerefOff(m.type));
         }
     }
@@ -445,24 +503,30 @@ public:
         if (expr->callee->instance == ExprType::Variable)
         {
             ExprVariable* exprVar = (ExprVariable*)(expr->callee);
-            Variable var = currentEnviroment->get(exprVar->name);
 
-            if (var.depth == 0)
-                chunk->addCode(new InstAddrGlobal(exprVar->name.getString(), expr->type, false));
-            else
+            if (currentEnviroment->has(exprVar->name))
                 chunk->addCode(new InstAddrLocal(exprVar->name.getString(), currentEnviroment->get(exprVar->name), expr->type, false));
+            else
+            {
+                GlobalVar var = currentNamespace->get(exprVar->name);
+                chunk->addCode(new InstAddrGlobal(var.fullName, expr->type, false));
+            }
         }
         else if (expr->callee->instance == ExprType::ArrGet)
         {
             ExprArrGet* arrGet = (ExprArrGet*)expr->callee;
             ExprAddr* inner = new ExprAddr(arrGet->callee, expr->token);
             inner->accept(this);
-            chunk->addCode(new InstConst(chunk->addConstant(new Value((int)(sizeof(Data) * arrGet->type->getSize())))));
+            size_t width = arrGet->type->getPackedWidth();
+            size_t scale = width != 0 ? width : sizeof(Data) * arrGet->type->getSize();
+            chunk->addCode(new InstConst(chunk->addConstant(Value((int)scale))));
             arrGet->index->accept(this);
+            if (arrGet->checkIndex)
+                chunk->addCode(new InstCheckIndex(((TypeArray*)arrGet->callee->type)->size));
             chunk->addCode(new InstMul(TypeTag::INTEGER));
             chunk->addCode(new InstAdd(TypeTag::INTEGER));
-            // delete inner;
-            // TODO: there is a leak.
+            inner->callee = nullptr; // still owned by arrGet
+            delete inner;
         }
         else if (expr->callee->instance == ExprType::Get)
         {
@@ -472,22 +536,23 @@ public:
             {
                 ExprAddr* inner = new ExprAddr(get->callee, expr->token);
                 inner->accept(this);
-                TypeStruct* type = (TypeStruct*)get->callee->type.get();
+                TypeStruct* type = (TypeStruct*)get->callee->type;
                 std::string getName = get->get.getString();
                 ExprVariable* exprVar = (ExprVariable*)get->callee;
                 structMember m = type->members[getName];
-                chunk->addCode(new InstConst(chunk->addConstant(new Value((int)(sizeof(Data) * (int)m.offset)))));
+                chunk->addCode(new InstConst(chunk->addConstant(Value((int)(sizeof(Data) * (int)m.offset)))));
                 chunk->addCode(new InstAdd(TypeTag::INTEGER));
+                inner->callee = nullptr; // still owned by get
                 delete inner;
             }
             else if (get->callee->instance == ExprType::GetDeref)
             {
                 ExprGetDeref* exprGet = (ExprGetDeref*)get->callee;
                 exprGet->callee->accept(this);
-                TypeStruct* type = (TypeStruct*)exprGet->callee->type->intrinsicType.get();
+                TypeStruct* type = (TypeStruct*)exprGet->callee->type->intrinsicType;
                 std::string getName = get->get.getString();
                 structMember m = type->members[getName];
-                chunk->addCode(new InstConst(chunk->addConstant(new Value((int)m.offset))));
+                chunk->addCode(new InstConst(chunk->addConstant(Value((int)m.offset))));
                 chunk->addCode(new InstAdd(TypeTag::INTEGER));
             }
         }
@@ -497,6 +562,25 @@ public:
             cont = false;
         }
     }
+    void visit(ExprSpawn* expr)
+    {
+        std::vector<Type*> args;
+        for (auto& arg : expr->call->args)
+        {
+            arg->accept(this);
+            args.push_back(arg->type);
+        }
+
+        expr->call->callee->accept(this);
+        CallMode mode = expr->token.type == TokenType::FIBER ? CallMode::FIBER : CallMode::SPAWN;
+        chunk->addCode(new InstCall(args, TypeTag::FUNCTION, expr->type, mode));
+    }
+    void visit(ExprJoin* expr)
+    {
+        // Joining calls the handle, it takes the place of the callee and the results take its place.
+        expr->handle->accept(this);
+        chunk->addCode(new InstCall({}, TypeTag::TASK, expr->type));
+    }
 
     void visit(StmtBlock* stmt)
     {
@@ -515,7 +599,7 @@ public:
     void visit(StmtFunc* stmt)
     {
         IRChunk* enclosing = chunk;
-        chunk = new IRChunk(stmt->name.getString());
+        chunk = new IRChunk(stmt->name.getString(), &pool);
 
         FuncValue* func = (FuncValue*)currentNamespace->get(stmt->name).val;
         func->irChunk = chunk;
@@ -524,6 +608,7 @@ public:
         beginScope(true);
         for (int i = 0; i < stmt->args.size(); i++)
             currentEnviroment->define(stmt->args[i], stmt->func_type->argTypes[i], true);
+        chunk->argSize = currentEnviroment->currentPos;
 
         for (auto& s : stmt->body->statements)
             s->accept(this);
@@ -531,7 +616,7 @@ public:
         endScope();
 
         if (func->type->intrinsicType->tag == TypeTag::VOID)
-            chunk->addCode(new InstReturn(std::make_shared<TypePrimitive>(TypeTag::VOID)));
+            chunk->addCode(new InstReturn(TypeContext::primitive(TypeTag::VOID)));
 
         chunks.push_back(func->irChunk);
 
@@ -539,7 +624,16 @@ public:
     }
     void visit(StmtVarDecleration* stmt)
     {
-        if (stmt->initializer == nullptr)
+        if (stmt->inFrame)
+        {
+            // The object is a local of its own in front of the owner, which holds its address.
+            Type* constructType = ((ExprHeap*)stmt->initializer)->constructType;
+            std::string object = frameObject(stmt->name.getString());
+            chunk->addCode(new InstPush({constructType}));
+            currentEnviroment->define(object, constructType, true);
+            chunk->addCode(new InstAddrLocal(object, currentEnviroment->values[object], stmt->varType, false));
+        }
+        else if (stmt->initializer == nullptr)
             chunk->addCode(new InstPush({stmt->varType}));
         else
             stmt->initializer->accept(this);
@@ -561,7 +655,7 @@ public:
         {
             for (auto& var : vars)
             {
-                if (var.second.type->tag == TypeTag::POINTER && ((TypePointer*)(var.second.type.get()))->is_owner)
+                if (ownsHeap(var.first, var.second))
                 {
                     if (((ExprVariable*)stmt->retVal)->name.getString() != var.first)
                     {
@@ -575,7 +669,7 @@ public:
         {
             for (auto& var : vars)
             {
-                if (var.second.type->tag == TypeTag::POINTER && ((TypePointer*)(var.second.type.get()))->is_owner)
+                if (ownsHeap(var.first, var.second))
                 {
                     chunk->addCode(new InstGetLocal(var.first, var.second, var.second.type));
                     chunk->addCode(new InstFree());
@@ -590,7 +684,7 @@ public:
         }
         else
         {
-            chunk->addCode(new InstReturn(std::make_shared<TypePrimitive>(TypeTag::VOID)));
+            chunk->addCode(new InstReturn(TypeContext::primitive(TypeTag::VOID)));
         }
     }
     void visit(StmtIf* stmt)
@@ -619,6 +713,17 @@ public:
         if (stmt->decl)
             stmt->decl->accept(this);
 
+        for (auto& check : stmt->boundChecks)
+        {
+            check.bound->accept(this);
+            if (check.offset != 0)
+            {
+                chunk->addCode(new InstConst(chunk->addConstant(Value(check.offset))));
+                chunk->addCode(new InstAdd(TypeTag::INTEGER));
+            }
+            chunk->addCode(new InstCheckIndex(check.size, true));
+        }
+
         InstLabel* start = createLabel();
         InstLabel* out = createLabel();
         chunk->addCode(start);
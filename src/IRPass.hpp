@@ -0,0 +1,284 @@
+#pragma once
+
+#include "IRChunk.hpp"
+#include "InstVisitor.hpp"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Shared by the passes that rewrite the IR of one function. Visiting an instruction describes it
+// in the fields below, and new temporary locals are placed right after the arguments at the end.
+class IRPass : public InstVisitor
+{
+protected:
+    // Temporaries get positions from here on until the frame is laid out again at the end.
+    static const int TEMP_BASE = 1 << 20;
+
+    IRChunk* chunk;
+    std::vector<Type*> tempTypes;
+    std::vector<std::pair<int, int>> addressed;
+    int frameSize;
+
+    // Filled by visiting an instruction.
+    bool pure;
+    int pops;
+    TypeTag result;
+    std::string key;
+    int reads;
+    std::pair<int, int> writes;
+    bool addressOf;
+    InstLabel* label;
+    InstJump* jump;
+    Variable* local;
+    char op;
+    int value;
+    int sets;
+    bool popped;
+
+public:
+    IRPass(IRChunk* chunk)
+        : chunk(chunk), frameSize(0)
+    {
+    }
+
+    size_t temps() const { return tempTypes.size(); }
+
+    void classify(Instruction* inst)
+    {
+        pure = false;
+        pops = 0;
+        result = TypeTag::NULL_TYPE;
+        key.clear();
+        reads = -1;
+        writes = {0, 0};
+        addressOf = false;
+        label = nullptr;
+        jump = nullptr;
+        local = nullptr;
+        op = 0;
+        value = 0;
+        sets = -1;
+        popped = false;
+        inst->accept(this);
+    }
+
+protected:
+    // Finds the frame size and the locals whose address is taken.
+    void scanFrame()
+    {
+        for (auto& inst : chunk->getCode())
+        {
+            classify(inst);
+            if (addressOf)
+                addressed.push_back(writes);
+            if (local)
+                frameSize = std::max(frameSize, local->position + (int)local->type->getSize());
+        }
+    }
+
+    // Gives the temporaries their final positions and pushes them on function entry.
+    void layoutTemps()
+    {
+        auto& code = chunk->getCode();
+        if (tempTypes.empty())
+            return;
+
+        int count = tempTypes.size();
+        for (auto& inst : code)
+        {
+            classify(inst);
+            if (local)
+            {
+                if (local->position >= TEMP_BASE)
+                    local->position = chunk->argSize + local->position - TEMP_BASE;
+                else if (local->position >= (int)chunk->argSize)
+                    local->position += count;
+            }
+        }
+        code.insert(code.begin(), new InstPush(tempTypes));
+    }
+
+    bool isAddressed(int slot)
+    {
+        for (auto& range : addressed)
+            if (slot >= range.first && slot < range.second)
+                return true;
+        return false;
+    }
+
+    // Start of the pure expression that ends at 'end', if it starts at 'first' or later.
+    bool subtree(size_t first, size_t end, size_t& start)
+    {
+        auto& code = chunk->getCode();
+        int need = 1;
+        start = end;
+        while (true)
+        {
+            classify(code[start]);
+            if (!pure)
+                return false;
+            need += pops - 1;
+            if (need == 0)
+                return true;
+            if (start == first)
+                return false;
+            start--;
+        }
+    }
+
+    bool newTemp(Type* type, Variable& var, std::string& name)
+    {
+        if (frameSize + (int)tempTypes.size() >= 255)
+            return false;
+        name = "$t" + std::to_string(tempTypes.size());
+        var = Variable(1, TEMP_BASE + tempTypes.size(), true, type);
+        tempTypes.push_back(type);
+        return true;
+    }
+
+    Instruction* intConst(int val)
+    {
+        return new InstConst(chunk->addConstant(Value(val)));
+    }
+
+    void binary(TypeTag type, const char* name, char arith = 0)
+    {
+        pure = true;
+        pops = 2;
+        result = type;
+        key = std::string(name) + std::to_string((int)type);
+        if (type == TypeTag::INTEGER)
+            op = arith;
+    }
+
+    void compare(TypeTag type, const char* name)
+    {
+        binary(type, name);
+        result = TypeTag::BOOL;
+    }
+
+    static bool scalar(TypeTag tag)
+    {
+        return tag == TypeTag::INTEGER || tag == TypeTag::FLOAT || tag == TypeTag::DOUBLE || tag == TypeTag::BOOL || tag == TypeTag::CHAR;
+    }
+
+public:
+    void visit(InstConst* inst)
+    {
+        Value* val = chunk->getConstant(inst->id);
+        TypeTag tag = val->type->tag;
+        pure = scalar(tag);
+        result = tag;
+
+        // Equal constants have one id in the chunk.
+        key = "K" + std::to_string(inst->id);
+        if (tag == TypeTag::INTEGER)
+        {
+            op = 'c';
+            value = val->data.valInt;
+        }
+    }
+    void visit(InstCast* inst)
+    {
+        pure = true;
+        pops = 1;
+        result = inst->to;
+        key = "CAST" + std::to_string((int)inst->from) + ":" + std::to_string((int)inst->to);
+    }
+    void visit(InstAdd* inst) { binary(inst->type, "ADD", '+'); }
+    void visit(InstSub* inst) { binary(inst->type, "SUB", '-'); }
+    void visit(InstMul* inst) { binary(inst->type, "MUL", '*'); }
+    void visit(InstDiv* inst)
+    {
+        // Integer division can trap, and a loop that never runs must not trap in its preheader.
+        if (inst->type != TypeTag::INTEGER)
+            binary(inst->type, "DIV");
+    }
+    void visit(InstNeg* inst)
+    {
+        pure = true;
+        pops = 1;
+        result = inst->type;
+        key = "NEG" + std::to_string((int)inst->type);
+    }
+    void visit(InstMod* inst) {}
+    void visit(InstBit* inst)
+    {
+        binary(TypeTag::INTEGER, "BIT");
+        key += ":" + std::to_string((int)inst->op_type);
+        if (inst->op_type == TokenType::TILDE)
+            pops = 1;
+    }
+    void visit(InstNot* inst)
+    {
+        pure = true;
+        pops = 1;
+        result = TypeTag::BOOL;
+        key = "NOT";
+    }
+    void visit(InstInc* inst) {}
+    void visit(InstLess* inst) { compare(inst->type, "LT"); }
+    void visit(InstLte* inst) { compare(inst->type, "LE"); }
+    void visit(InstGreat* inst) { compare(inst->type, "GT"); }
+    void visit(InstGte* inst) { compare(inst->type, "GE"); }
+    void visit(InstEq* inst) { compare(inst->type, "EQ"); }
+    void visit(InstNeq* inst) { compare(inst->type, "NE"); }
+    void visit(InstGetGlobal* inst) {}
+    void visit(InstSetGlobal* inst) {}
+    void visit(InstGetLocal* inst)
+    {
+        local = &inst->var;
+        if (!inst->offset && inst->type->getSize() == 1 && scalar(inst->type->tag))
+        {
+            pure = true;
+            result = inst->type->tag;
+            reads = inst->var.position;
+            key = "L" + std::to_string(reads);
+            if (result == TypeTag::INTEGER)
+                op = 'l';
+        }
+    }
+    void visit(InstSetLocal* inst)
+    {
+        local = &inst->var;
+        int size = inst->offset ? inst->var.type->getSize() : inst->type->getSize();
+        writes = {inst->var.position, inst->var.position + size};
+        if (!inst->offset && size == 1)
+            sets = inst->var.position;
+    }
+    void visit(InstAlloc* inst) {}
+    void visit(InstFree* inst) {}
+    void visit(InstGetDeref* inst) {}
+    void visit(InstSetDeref* inst) {}
+    void visit(InstGetDerefOff* inst) {}
+    void visit(InstSetDerefOff* inst) {}
+    void visit(InstAddrLocal* inst)
+    {
+        local = &inst->var;
+        addressOf = true;
+        writes = {inst->var.position, inst->var.position + (int)inst->var.type->getSize()};
+    }
+    void visit(InstAddrGlobal* inst) {}
+    void visit(InstLoad* inst)
+    {
+        if (inst->base == MemBase::LOCAL)
+            local = &inst->var;
+    }
+    void visit(InstStore* inst)
+    {
+        if (inst->base == MemBase::LOCAL)
+        {
+            local = &inst->var;
+            writes = {inst->var.position, inst->var.position + (int)inst->var.type->getSize()};
+        }
+    }
+    void visit(InstCheckIndex* inst) {}
+    void visit(InstCall* inst) {}
+    void visit(InstPop* inst) { popped = inst->types.size() == 1; }
+    void visit(InstPush* inst) {}
+    void visit(InstReturn* inst) {}
+    void visit(InstLabel* inst) { label = inst; }
+    void visit(InstJump* inst) { jump = inst; }
+};
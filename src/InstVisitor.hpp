@@ -34,6 +34,9 @@ public:
     virtual void visit(InstSetDerefOff* inst) = 0;
     virtual void visit(InstAddrLocal* inst) = 0;
     virtual void visit(InstAddrGlobal* inst) = 0;
+    virtual void visit(InstLoad* inst) = 0;
+    virtual void visit(InstStore* inst) = 0;
+    virtual void visit(InstCheckIndex* inst) = 0;
     virtual void visit(InstCall* inst) = 0;
     virtual void visit(InstPop* inst) = 0;
     virtual void visit(InstPush* inst) = 0;
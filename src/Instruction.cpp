@@ -146,6 +146,21 @@ void InstSetDerefOff::accept(InstVisitor* visitor)
 	visitor->visit(this);
 }
 
+void InstLoad::accept(InstVisitor* visitor)
+{
+	visitor->visit(this);
+}
+
+void InstStore::accept(InstVisitor* visitor)
+{
+	visitor->visit(this);
+}
+
+void InstCheckIndex::accept(InstVisitor* visitor)
+{
+	visitor->visit(this);
+}
+
 void InstCall::accept(InstVisitor* visitor)
 {
 	visitor->visit(this);
@@ -1,10 +1,12 @@
 #pragma once
+#include "Chunk.hpp"
 #include "Enviroment.hpp"
 
 class InstVisitor;
 class Instruction
 {
 public:
+    virtual ~Instruction() {}
     virtual void accept(InstVisitor* visitor) = 0;
 };
 
@@ -199,10 +201,10 @@ class InstGetGlobal : public Instruction
 {
 public:
     std::string name;
-    std::shared_ptr<Type> type;
+    Type* type;
     bool offset;
 
-    InstGetGlobal(std::string name, std::shared_ptr<Type> type, bool offset = false)
+    InstGetGlobal(std::string name, Type* type, bool offset = false)
         : name(name), type(type), offset(offset) {}
 
     void accept(InstVisitor* visitor);
@@ -212,10 +214,10 @@ class InstSetGlobal : public Instruction
 {
 public:
     std::string name;
-    std::shared_ptr<Type> type;
+    Type* type;
     bool offset;
 
-    InstSetGlobal(std::string name, std::shared_ptr<Type> type, bool offset = false)
+    InstSetGlobal(std::string name, Type* type, bool offset = false)
         : name(name), type(type), offset(offset) {}
 
     void accept(InstVisitor* visitor);
@@ -226,10 +228,10 @@ class InstGetLocal : public Instruction
 public:
     std::string name;
     Variable var;
-    std::shared_ptr<Type> type;
+    Type* type;
     bool offset;
 
-    InstGetLocal(std::string name, Variable var, std::shared_ptr<Type> type, bool offset = false)
+    InstGetLocal(std::string name, Variable var, Type* type, bool offset = false)
         : name(name), var(var), type(type), offset(offset) {}
 
     void accept(InstVisitor* visitor);
@@ -240,10 +242,10 @@ class InstSetLocal : public Instruction
 public:
     std::string name;
     Variable var;
-    std::shared_ptr<Type> type;
+    Type* type;
     bool offset;
 
-    InstSetLocal(std::string name, Variable var, std::shared_ptr<Type> type, bool offset = false)
+    InstSetLocal(std::string name, Variable var, Type* type, bool offset = false)
         : name(name), var(var), type(type), offset(offset) {}
 
     void accept(InstVisitor* visitor);
@@ -252,9 +254,9 @@ public:
 class InstAlloc : public Instruction
 {
 public:
-    std::shared_ptr<Type> type;
+    Type* type;
 
-    InstAlloc(std::shared_ptr<Type> type)
+    InstAlloc(Type* type)
         : type(type) {}
 
     void accept(InstVisitor* visitor);
@@ -271,9 +273,9 @@ public:
 class InstGetDeref : public Instruction
 {
 public:
-    std::shared_ptr<Type> type;
+    Type* type;
 
-    InstGetDeref(std::shared_ptr<Type> type)
+    InstGetDeref(Type* type)
         : type(type) {}
 
     void accept(InstVisitor* visitor);
@@ -282,9 +284,9 @@ public:
 class InstSetDeref : public Instruction
 {
 public:
-    std::shared_ptr<Type> type;
+    Type* type;
 
-    InstSetDeref(std::shared_ptr<Type> type)
+    InstSetDeref(Type* type)
         : type(type) {}
 
     void accept(InstVisitor* visitor);
@@ -293,9 +295,9 @@ public:
 class InstGetDerefOff : public Instruction
 {
 public:
-    std::shared_ptr<Type> type;
+    Type* type;
 
-    InstGetDerefOff(std::shared_ptr<Type> type)
+    InstGetDerefOff(Type* type)
         : type(type) {}
 
     void accept(InstVisitor* visitor);
@@ -304,9 +306,9 @@ public:
 class InstSetDerefOff : public Instruction
 {
 public:
-    std::shared_ptr<Type> type;
+    Type* type;
 
-    InstSetDerefOff(std::shared_ptr<Type> type)
+    InstSetDerefOff(Type* type)
         : type(type) {}
 
     void accept(InstVisitor* visitor);
@@ -317,10 +319,10 @@ class InstAddrLocal : public Instruction
 public:
     std::string name;
     Variable var;
-    std::shared_ptr<Type> type;
+    Type* type;
     bool offset;
 
-    InstAddrLocal(std::string name, Variable var, std::shared_ptr<Type> type, bool offset = false)
+    InstAddrLocal(std::string name, Variable var, Type* type, bool offset = false)
         : name(name), var(var), type(type), offset(offset) {}
 
     void accept(InstVisitor* visitor);
@@ -330,23 +332,78 @@ class InstAddrGlobal : public Instruction
 {
 public:
     std::string name;
-    std::shared_ptr<Type> type;
+    Type* type;
     bool offset;
 
-    InstAddrGlobal(std::string name, std::shared_ptr<Type> type, bool offset = false)
+    InstAddrGlobal(std::string name, Type* type, bool offset = false)
         : name(name), type(type), offset(offset) {}
 
     void accept(InstVisitor* visitor);
 };
 
+class InstLoad : public Instruction
+{
+public:
+    std::string name;
+    Variable var;
+    Type* type;
+    MemBase base;
+    size_t slot;
+
+    InstLoad(std::string name, Variable var, Type* type, MemBase base, size_t slot = 0)
+        : name(name), var(var), type(type), base(base), slot(slot) {}
+
+    void accept(InstVisitor* visitor);
+};
+
+class InstStore : public Instruction
+{
+public:
+    std::string name;
+    Variable var;
+    Type* type;
+    MemBase base;
+    size_t slot;
+
+    InstStore(std::string name, Variable var, Type* type, MemBase base, size_t slot = 0)
+        : name(name), var(var), type(type), base(base), slot(slot) {}
+
+    void accept(InstVisitor* visitor);
+};
+
+// Checks the index on top of the stack against 'size'. Hoisted checks pop a loop bound
+// instead, which may reach 'size' but not exceed it.
+class InstCheckIndex : public Instruction
+{
+public:
+    size_t size;
+    bool hoisted;
+
+    InstCheckIndex(size_t size, bool hoisted = false)
+        : size(size), hoisted(hoisted) {}
+
+    void accept(InstVisitor* visitor);
+};
+
+enum class CallMode
+{
+    DIRECT,
+    SPAWN,
+    FIBER
+};
+
+// Calls the function, native or task handle under the arguments. A spawned call leaves a task
+// handle as its result, and calling a task handle joins it. A fiber call leaves nothing.
 class InstCall : public Instruction
 {
 public:
-    std::vector<std::shared_ptr<Type>> args;
+    std::vector<Type*> args;
     TypeTag callType;
+    Type* ret;
+    CallMode mode;
 
-    InstCall(std::vector<std::shared_ptr<Type>> args, TypeTag callType)
-        : args(args), callType(callType) {}
+    InstCall(std::vector<Type*> args, TypeTag callType, Type* ret, CallMode mode = CallMode::DIRECT)
+        : args(args), callType(callType), ret(ret), mode(mode) {}
 
     void accept(InstVisitor* visitor);
 };
@@ -354,9 +411,9 @@ public:
 class InstPop : public Instruction
 {
 public:
-    std::vector<std::shared_ptr<Type>> types;
+    std::vector<Type*> types;
 
-    InstPop(std::vector<std::shared_ptr<Type>> types)
+    InstPop(std::vector<Type*> types)
         : types(types) {}
 
     void accept(InstVisitor* visitor);
@@ -365,9 +422,9 @@ public:
 class InstPush : public Instruction
 {
 public:
-    std::vector<std::shared_ptr<Type>> types;
+    std::vector<Type*> types;
 
-    InstPush(std::vector<std::shared_ptr<Type>> types)
+    InstPush(std::vector<Type*> types)
         : types(types) {}
 
     void accept(InstVisitor* visitor);
@@ -376,9 +433,9 @@ public:
 class InstReturn : public Instruction
 {
 public:
-    std::shared_ptr<Type> type;
+    Type* type;
 
-    InstReturn(std::shared_ptr<Type> type)
+    InstReturn(Type* type)
         : type(type) {}
 
     void accept(InstVisitor* visitor);
@@ -0,0 +1,925 @@
+#include "Jit.h"
+#include "Heap.h"
+#include "VM.h"
+
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define JIT_SUPPORTED
+#endif
+
+namespace
+{
+enum Reg
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// Registers the generated code keeps its state in. All of them are callee saved.
+const int FRAME = RBX;
+const int SP = R12;
+const int VMREG = R13;
+const int GLOBALS = R14;
+const int REGS = R15;
+
+enum Cond
+{
+    C_AE = 0x3, C_E = 0x4, C_NE = 0x5, C_A = 0x7,
+    C_P = 0xA, C_NP = 0xB, C_L = 0xC, C_GE = 0xD, C_LE = 0xE, C_G = 0xF
+};
+
+struct Mem
+{
+    int base;
+    int index;
+    int scale;
+    int32_t disp;
+};
+
+Mem at(int base, int32_t disp)
+{
+    return {base, -1, 1, disp};
+}
+
+Mem at(int base, int index, int scale, int32_t disp)
+{
+    return {base, index, scale, disp};
+}
+
+const Mem TOP = at(SP, -8);
+const Mem SECOND = at(SP, -16);
+
+class Assembler
+{
+public:
+    std::vector<uint8_t> code;
+
+    void byte(uint8_t b)
+    {
+        code.push_back(b);
+    }
+
+    void dword(uint32_t d)
+    {
+        for (int i = 0; i < 4; i++)
+            byte(d >> (i * 8));
+    }
+
+    void qword(uint64_t q)
+    {
+        for (int i = 0; i < 8; i++)
+            byte(q >> (i * 8));
+    }
+
+    // [prefix] [REX] opcode ModRM [SIB] [disp] with a memory operand.
+    void op(uint8_t prefix, bool wide, std::initializer_list<uint8_t> opcode, int reg, Mem m)
+    {
+        if (prefix)
+            byte(prefix);
+        int index = m.index < 0 ? 0 : m.index;
+        uint8_t rex = 0x40 | (wide << 3) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((m.base & 8) >> 3);
+        if (rex != 0x40)
+            byte(rex);
+        for (auto b : opcode)
+            byte(b);
+
+        int mod = m.disp == 0 && (m.base & 7) != RBP ? 0 : (m.disp >= -128 && m.disp <= 127 ? 1 : 2);
+        if (m.index < 0 && (m.base & 7) != RSP)
+            byte(mod << 6 | (reg & 7) << 3 | (m.base & 7));
+        else
+        {
+            int scale = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+            byte(mod << 6 | (reg & 7) << 3 | RSP);
+            byte(scale << 6 | ((m.index < 0 ? RSP : m.index) & 7) << 3 | (m.base & 7));
+        }
+
+        if (mod == 1)
+            byte(m.disp);
+        else if (mod == 2)
+            dword(m.disp);
+    }
+
+    // The same with a register as the r/m operand.
+    void opReg(uint8_t prefix, bool wide, std::initializer_list<uint8_t> opcode, int reg, int rm)
+    {
+        if (prefix)
+            byte(prefix);
+        uint8_t rex = 0x40 | (wide << 3) | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+        if (rex != 0x40)
+            byte(rex);
+        for (auto b : opcode)
+            byte(b);
+        byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+    }
+
+    void load64(int reg, Mem m) { op(0, true, {0x8B}, reg, m); }
+    void load32(int reg, Mem m) { op(0, false, {0x8B}, reg, m); }
+    void loadSigned(int reg, Mem m) { op(0, true, {0x63}, reg, m); }
+    void store64(Mem m, int reg) { op(0, true, {0x89}, reg, m); }
+    void store32(Mem m, int reg) { op(0, false, {0x89}, reg, m); }
+    void store8(Mem m, int reg) { op(0, false, {0x88}, reg, m); }
+    void lea(int reg, Mem m) { op(0, true, {0x8D}, reg, m); }
+    void move(int to, int from) { opReg(0, true, {0x89}, from, to); }
+
+    void moveImm(int reg, uint64_t value)
+    {
+        if (reg >= 8)
+            byte(0x40 | (value > UINT32_MAX) << 3 | 1);
+        else if (value > UINT32_MAX)
+            byte(0x48);
+        byte(0xB8 + (reg & 7));
+        if (value > UINT32_MAX)
+            qword(value);
+        else
+            dword(value);
+    }
+
+    void addImm(int reg, int32_t value)
+    {
+        if (value == 0)
+            return;
+        if (value >= -128 && value <= 127)
+        {
+            opReg(0, true, {0x83}, 0, reg);
+            byte(value);
+        }
+        else
+        {
+            opReg(0, true, {0x81}, 0, reg);
+            dword(value);
+        }
+    }
+
+    void push(int reg)
+    {
+        if (reg >= 8)
+            byte(0x41);
+        byte(0x50 + (reg & 7));
+    }
+
+    void pop(int reg)
+    {
+        if (reg >= 8)
+            byte(0x41);
+        byte(0x58 + (reg & 7));
+    }
+
+    void setcc(Cond cc, int reg)
+    {
+        opReg(0, false, {0x0F, (uint8_t)(0x90 | cc)}, 0, reg);
+    }
+
+    void call(void* fn)
+    {
+        moveImm(RAX, (uint64_t)fn);
+        opReg(0, false, {0xFF}, 2, RAX);
+    }
+
+    // Emits a jump with a 32 bit displacement and returns where to patch it.
+    size_t jump()
+    {
+        byte(0xE9);
+        dword(0);
+        return code.size() - 4;
+    }
+
+    size_t jump(Cond cc)
+    {
+        byte(0x0F);
+        byte(0x80 | cc);
+        dword(0);
+        return code.size() - 4;
+    }
+
+    void patch(size_t at, size_t target)
+    {
+        int32_t rel = target - (at + 4);
+        memcpy(&code[at], &rel, 4);
+    }
+
+    // Shorthands for the stack in memory: the value in rax is pushed, the stack shrinks by 'slots'.
+    void pushRax()
+    {
+        store64(at(SP, 0), RAX);
+        addImm(SP, 8);
+    }
+
+    void drop(int slots)
+    {
+        addImm(SP, -8 * slots);
+    }
+};
+
+Data* jitAlloc(uint32_t size)
+{
+    return heapAlloc(size);
+}
+
+void jitFree(Data* ptr)
+{
+    heapFree(ptr);
+}
+
+void jitIndexError(int32_t index, uint32_t size)
+{
+    std::cout << "[Runtime Error] Array index " << index << " is out of bounds for size " << size << "." << std::endl;
+}
+
+void jitLimitError(int32_t limit, uint32_t size)
+{
+    std::cout << "[Runtime Error] Loop reaches array index " << limit - 1 << ", out of bounds for size " << size << "." << std::endl;
+}
+
+struct Check
+{
+    size_t patch;
+    uint16_t size;
+    bool limit;
+};
+
+// Loads the operand of a cast into eax (integral) or xmm0 (float kinds as double, or as float when
+// casting to float). Returns false for tags the interpreter does not cast.
+bool castSource(Assembler& a, TypeTag from, TypeTag to, bool& real)
+{
+    real = from == TypeTag::FLOAT || from == TypeTag::DOUBLE;
+    switch (from)
+    {
+    case TypeTag::INTEGER:
+        a.load32(RAX, TOP);
+        return true;
+    case TypeTag::BOOL:
+        a.op(0, false, {0x0F, 0xB6}, RAX, TOP);
+        return true;
+    case TypeTag::CHAR:
+        a.op(0, false, {0x0F, 0xBE}, RAX, TOP);
+        return true;
+    case TypeTag::FLOAT:
+        a.op(0xF3, false, {0x0F, 0x10}, 0, TOP);
+        if (to != TypeTag::FLOAT)
+            a.opReg(0xF3, false, {0x0F, 0x5A}, 0, 0);
+        return true;
+    case TypeTag::DOUBLE:
+        a.op(0xF2, false, {0x0F, 0x10}, 0, TOP);
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool emitCast(Assembler& a, TypeTag from, TypeTag to)
+{
+    bool real;
+    if (!castSource(a, from, to, real))
+        return false;
+
+    switch (to)
+    {
+    case TypeTag::INTEGER:
+    case TypeTag::CHAR:
+        if (real)
+            a.opReg(0xF2, false, {0x0F, 0x2C}, RAX, 0);
+        a.store64(TOP, RAX);
+        return true;
+    case TypeTag::FLOAT:
+        if (!real)
+            a.opReg(0xF3, false, {0x0F, 0x2A}, 0, RAX);
+        else if (from == TypeTag::DOUBLE)
+            a.opReg(0xF2, false, {0x0F, 0x5A}, 0, 0);
+        a.op(0xF3, false, {0x0F, 0x11}, 0, TOP);
+        return true;
+    case TypeTag::DOUBLE:
+        if (!real)
+            a.opReg(0xF2, false, {0x0F, 0x2A}, 0, RAX);
+        a.op(0xF2, false, {0x0F, 0x11}, 0, TOP);
+        return true;
+    case TypeTag::BOOL:
+        if (real)
+        {
+            a.opReg(0, false, {0x0F, 0x57}, 1, 1);
+            a.opReg(0x66, false, {0x0F, 0x2E}, 0, 1);
+            a.setcc(C_NE, RAX);
+            a.setcc(C_P, RCX);
+            a.opReg(0, false, {0x08}, RCX, RAX);
+        }
+        else
+        {
+            a.opReg(0, false, {0x85}, RAX, RAX);
+            a.setcc(C_NE, RAX);
+        }
+        a.opReg(0, false, {0x0F, 0xB6}, RAX, RAX);
+        a.store64(TOP, RAX);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Address of a packed element; pops the index and, for deref bases, the pointer.
+Mem element(Assembler& a, MemBase base, uint8_t slot, int width)
+{
+    switch (base)
+    {
+    case MemBase::DEREF:
+        a.load64(RDX, TOP);
+        a.drop(1);
+        return at(RDX, 0);
+    case MemBase::DEREF_OFF:
+        a.loadSigned(RCX, TOP);
+        a.load64(RDX, SECOND);
+        a.drop(2);
+        return at(RDX, RCX, width, 8 * slot);
+    default:
+        a.loadSigned(RCX, TOP);
+        a.drop(1);
+        return at(base == MemBase::LOCAL ? FRAME : GLOBALS, RCX, width, 8 * slot);
+    }
+}
+
+// Calls back into the VM and reloads the frame, which may have moved.
+void callVM(Assembler& a, void* fn, int operand, std::vector<size_t>& fails)
+{
+    a.move(RDI, VMREG);
+    a.move(RSI, SP);
+    a.moveImm(RDX, operand);
+    a.move(RCX, REGS);
+    a.call(fn);
+    a.opReg(0, true, {0x85}, RAX, RAX);
+    fails.push_back(a.jump(C_E));
+    a.move(SP, RAX);
+    a.load64(FRAME, at(REGS, offsetof(JitFrame, frame)));
+    a.load64(GLOBALS, at(REGS, offsetof(JitFrame, globals)));
+}
+} // namespace
+
+JitCode::JitCode(uint8_t* memory, size_t size, std::vector<uint32_t> offsets)
+    : entry((JitEntry)memory), memory(memory), size(size), offsets(offsets)
+{
+}
+
+JitCode::~JitCode()
+{
+#ifdef JIT_SUPPORTED
+    munmap(memory, size);
+#endif
+}
+
+JitCode* Jit::compile(Chunk* chunk)
+{
+#ifdef JIT_SUPPORTED
+    auto& bc = chunk->code;
+    Assembler a;
+
+    // entry(vm, sp, regs, target)
+    a.push(RBX);
+    a.push(RBP);
+    a.push(R12);
+    a.push(R13);
+    a.push(R14);
+    a.push(R15);
+    a.addImm(RSP, -8);
+    a.move(VMREG, RDI);
+    a.move(SP, RSI);
+    a.move(REGS, RDX);
+    a.load64(FRAME, at(REGS, offsetof(JitFrame, frame)));
+    a.load64(GLOBALS, at(REGS, offsetof(JitFrame, globals)));
+    a.opReg(0, false, {0xFF}, 4, RCX);
+
+    std::vector<uint32_t> offsets(bc.size() + 1, UINT32_MAX);
+    std::vector<std::pair<size_t, size_t>> jumps;
+    std::vector<size_t> exits;
+    std::vector<size_t> fails;
+    std::vector<Check> checks;
+
+    size_t ip = 0;
+    auto u8 = [&]() -> uint8_t { return ip < bc.size() ? bc[ip++] : 0; };
+    auto u16 = [&]() -> uint16_t { uint16_t lo = u8(); return lo | (u8() << 8); };
+
+    while (ip < bc.size())
+    {
+        offsets[ip] = a.code.size();
+        OpCode code = (OpCode)u8();
+        switch (code)
+        {
+        case OpCode::NOP:
+            break;
+        case OpCode::CONSTANT:
+        {
+            uint8_t id = u8();
+            if (id >= chunk->constants.size())
+                return nullptr;
+            uint64_t bits;
+            memcpy(&bits, &chunk->constants[id], sizeof(bits));
+            a.moveImm(RAX, bits);
+            a.pushRax();
+            break;
+        }
+
+        case OpCode::IADD:
+        case OpCode::ISUB:
+        case OpCode::BIT_AND:
+        case OpCode::BIT_OR:
+        case OpCode::BIT_XOR:
+        {
+            static const uint8_t ops[] = {0x01, 0x29, 0x21, 0x09, 0x31};
+            uint8_t op = code == OpCode::IADD ? ops[0] : code == OpCode::ISUB ? ops[1] : code == OpCode::BIT_AND ? ops[2] : code == OpCode::BIT_OR ? ops[3] : ops[4];
+            a.load32(RAX, TOP);
+            a.op(0, false, {op}, RAX, SECOND);
+            a.drop(1);
+            break;
+        }
+        case OpCode::IMUL:
+            a.load32(RAX, SECOND);
+            a.op(0, false, {0x0F, 0xAF}, RAX, TOP);
+            a.store32(SECOND, RAX);
+            a.drop(1);
+            break;
+        case OpCode::IDIV:
+        case OpCode::MOD:
+            a.load32(RAX, SECOND);
+            a.byte(0x99);
+            a.op(0, false, {0xF7}, 7, TOP);
+            a.store32(SECOND, code == OpCode::IDIV ? RAX : RDX);
+            a.drop(1);
+            break;
+        case OpCode::INEG:
+            a.op(0, false, {0xF7}, 3, TOP);
+            break;
+        case OpCode::BIT_NOT:
+            a.op(0, false, {0xF7}, 2, TOP);
+            break;
+        case OpCode::BITSHIFT_LEFT:
+        case OpCode::BITSHIFT_RIGHT:
+            a.load32(RCX, TOP);
+            a.op(0, false, {0xD3}, code == OpCode::BITSHIFT_LEFT ? 4 : 7, SECOND);
+            a.drop(1);
+            break;
+        case OpCode::IINC:
+            a.op(0, false, {0xFF}, 0, TOP);
+            break;
+        case OpCode::IDEC:
+            a.op(0, false, {0xFF}, 1, TOP);
+            break;
+
+        case OpCode::FADD:
+        case OpCode::FSUB:
+        case OpCode::FMUL:
+        case OpCode::FDIV:
+        case OpCode::DADD:
+        case OpCode::DSUB:
+        case OpCode::DMUL:
+        case OpCode::DDIV:
+        {
+            bool dbl = code >= OpCode::DADD;
+            uint8_t prefix = dbl ? 0xF2 : 0xF3;
+            int kind = (int)code - (int)(dbl ? OpCode::DADD : OpCode::FADD);
+            static const uint8_t ops[] = {0x58, 0x5C, 0x59, 0x5E};
+            a.op(prefix, false, {0x0F, 0x10}, 0, SECOND);
+            a.op(prefix, false, {0x0F, ops[kind]}, 0, TOP);
+            a.op(prefix, false, {0x0F, 0x11}, 0, SECOND);
+            a.drop(1);
+            break;
+        }
+        case OpCode::FNEG:
+            a.op(0, false, {0x81}, 6, TOP);
+            a.dword(0x80000000);
+            break;
+        case OpCode::DNEG:
+            a.op(0, true, {0x0F, 0xBA}, 7, TOP);
+            a.byte(63);
+            break;
+        case OpCode::FINC:
+        case OpCode::FDEC:
+        {
+            float one = 1;
+            uint32_t bits;
+            memcpy(&bits, &one, 4);
+            a.moveImm(RAX, bits);
+            a.opReg(0x66, false, {0x0F, 0x6E}, 1, RAX);
+            a.op(0xF3, false, {0x0F, 0x10}, 0, TOP);
+            a.opReg(0xF3, false, {0x0F, (uint8_t)(code == OpCode::FINC ? 0x58 : 0x5C)}, 0, 1);
+            a.op(0xF3, false, {0x0F, 0x11}, 0, TOP);
+            break;
+        }
+        case OpCode::DINC:
+        case OpCode::DDEC:
+        {
+            double one = 1;
+            uint64_t bits;
+            memcpy(&bits, &one, 8);
+            a.moveImm(RAX, bits);
+            a.opReg(0x66, true, {0x0F, 0x6E}, 1, RAX);
+            a.op(0xF2, false, {0x0F, 0x10}, 0, TOP);
+            a.opReg(0xF2, false, {0x0F, (uint8_t)(code == OpCode::DINC ? 0x58 : 0x5C)}, 0, 1);
+            a.op(0xF2, false, {0x0F, 0x11}, 0, TOP);
+            break;
+        }
+
+        case OpCode::LOGIC_NOT:
+            a.op(0, false, {0x80}, 7, TOP);
+            a.byte(0);
+            a.setcc(C_E, RAX);
+            a.store8(TOP, RAX);
+            break;
+        case OpCode::ILESS:
+        case OpCode::IGREAT:
+        case OpCode::ILESS_EQUAL:
+        case OpCode::IGREAT_EQUAL:
+        case OpCode::IIS_EQUAL:
+        case OpCode::INOT_EQUAL:
+        {
+            Cond cc = code == OpCode::ILESS ? C_L : code == OpCode::IGREAT ? C_G : code == OpCode::ILESS_EQUAL ? C_LE : code == OpCode::IGREAT_EQUAL ? C_GE : code == OpCode::IIS_EQUAL ? C_E : C_NE;
+            a.load32(RAX, SECOND);
+            a.op(0, false, {0x3B}, RAX, TOP);
+            a.setcc(cc, RAX);
+            a.opReg(0, false, {0x0F, 0xB6}, RAX, RAX);
+            a.store64(SECOND, RAX);
+            a.drop(1);
+            break;
+        }
+        case OpCode::DLESS:
+        case OpCode::DGREAT:
+        case OpCode::DLESS_EQUAL:
+        case OpCode::DGREAT_EQUAL:
+        case OpCode::DIS_EQUAL:
+        case OpCode::DNOT_EQUAL:
+        {
+            // Unordered operands compare false, except for not equal.
+            a.op(0xF2, false, {0x0F, 0x10}, 0, SECOND);
+            a.op(0xF2, false, {0x0F, 0x10}, 1, TOP);
+            if (code == OpCode::DLESS || code == OpCode::DLESS_EQUAL)
+                a.opReg(0x66, false, {0x0F, 0x2E}, 1, 0);
+            else
+                a.opReg(0x66, false, {0x0F, 0x2E}, 0, 1);
+            if (code == OpCode::DLESS || code == OpCode::DGREAT)
+                a.setcc(C_A, RAX);
+            else if (code == OpCode::DLESS_EQUAL || code == OpCode::DGREAT_EQUAL)
+                a.setcc(C_AE, RAX);
+            else if (code == OpCode::DIS_EQUAL)
+            {
+                a.setcc(C_E, RAX);
+                a.setcc(C_NP, RCX);
+                a.opReg(0, false, {0x20}, RCX, RAX);
+            }
+            else
+            {
+                a.setcc(C_NE, RAX);
+                a.setcc(C_P, RCX);
+                a.opReg(0, false, {0x08}, RCX, RAX);
+            }
+            a.opReg(0, false, {0x0F, 0xB6}, RAX, RAX);
+            a.store64(SECOND, RAX);
+            a.drop(1);
+            break;
+        }
+        case OpCode::CAST:
+        {
+            TypeTag from = (TypeTag)u8();
+            TypeTag to = (TypeTag)u8();
+            if (!emitCast(a, from, to))
+                return nullptr;
+            break;
+        }
+
+        case OpCode::POPN:
+            a.drop(u8());
+            break;
+        case OpCode::PUSHN:
+        {
+            // The interpreter's resize zeroes new slots, and uninitialized locals rely on it.
+            uint8_t size = u8();
+            a.opReg(0, false, {0x31}, RAX, RAX);
+            for (int i = 0; i < size; i++)
+                a.store64(at(SP, 8 * i), RAX);
+            a.addImm(SP, 8 * size);
+            break;
+        }
+        case OpCode::SET_GLOBAL:
+        case OpCode::SET_LOCAL:
+        {
+            int base = code == OpCode::SET_GLOBAL ? GLOBALS : FRAME;
+            a.load64(RAX, TOP);
+            a.store64(at(base, 8 * u8()), RAX);
+            break;
+        }
+        case OpCode::GET_GLOBAL:
+        case OpCode::GET_LOCAL:
+        {
+            int base = code == OpCode::GET_GLOBAL ? GLOBALS : FRAME;
+            a.load64(RAX, at(base, 8 * u8()));
+            a.pushRax();
+            break;
+        }
+        case OpCode::SET_GLOBALN:
+        case OpCode::SET_LOCALN:
+        {
+            int base = code == OpCode::SET_GLOBALN ? GLOBALS : FRAME;
+            uint8_t slot = u8();
+            uint8_t size = u8();
+            for (int i = 0; i < size; i++)
+            {
+                a.load64(RAX, at(SP, 8 * (i - size)));
+                a.store64(at(base, 8 * (slot + i)), RAX);
+            }
+            break;
+        }
+        case OpCode::GET_GLOBALN:
+        case OpCode::GET_LOCALN:
+        {
+            int base = code == OpCode::GET_GLOBALN ? GLOBALS : FRAME;
+            uint8_t slot = u8();
+            uint8_t size = u8();
+            for (int i = 0; i < size; i++)
+            {
+                a.load64(RAX, at(base, 8 * (slot + i)));
+                a.store64(at(SP, 8 * i), RAX);
+            }
+            a.addImm(SP, 8 * size);
+            break;
+        }
+        case OpCode::SET_GLOBAL_OFF:
+        case OpCode::SET_LOCAL_OFF:
+        {
+            int base = code == OpCode::SET_GLOBAL_OFF ? GLOBALS : FRAME;
+            a.loadSigned(RCX, TOP);
+            a.drop(1);
+            a.load64(RAX, TOP);
+            a.store64(at(base, RCX, 8, 8 * u8()), RAX);
+            break;
+        }
+        case OpCode::GET_GLOBAL_OFF:
+        case OpCode::GET_LOCAL_OFF:
+        {
+            int base = code == OpCode::GET_GLOBAL_OFF ? GLOBALS : FRAME;
+            a.loadSigned(RCX, TOP);
+            a.load64(RAX, at(base, RCX, 8, 8 * u8()));
+            a.store64(TOP, RAX);
+            break;
+        }
+        case OpCode::SET_GLOBAL_OFFN:
+        case OpCode::SET_LOCAL_OFFN:
+        {
+            int base = code == OpCode::SET_GLOBAL_OFFN ? GLOBALS : FRAME;
+            uint8_t slot = u8();
+            uint8_t size = u8();
+            a.loadSigned(RCX, TOP);
+            a.drop(1);
+            for (int i = 0; i < size; i++)
+            {
+                a.load64(RAX, at(SP, 8 * (i - size)));
+                a.store64(at(base, RCX, 8, 8 * (slot + i)), RAX);
+            }
+            break;
+        }
+        case OpCode::GET_LOCAL_OFFN:
+        {
+            uint8_t slot = u8();
+            uint8_t size = u8();
+            a.loadSigned(RCX, TOP);
+            a.drop(1);
+            for (int i = 0; i < size; i++)
+            {
+                a.load64(RAX, at(FRAME, RCX, 8, 8 * (slot + i)));
+                a.store64(at(SP, 8 * i), RAX);
+            }
+            a.addImm(SP, 8 * size);
+            break;
+        }
+        case OpCode::SET_LOCAL_POP:
+            a.load64(RAX, TOP);
+            a.store64(at(FRAME, 8 * u8()), RAX);
+            a.drop(1);
+            break;
+        case OpCode::IADD_LOCAL:
+        {
+            uint8_t slot = u8();
+            uint8_t id = u8();
+            if (id >= chunk->constants.size())
+                return nullptr;
+            a.op(0, false, {0x81}, 0, at(FRAME, 8 * slot));
+            a.dword(chunk->constants[id].valInt);
+            break;
+        }
+
+        case OpCode::ALLOC:
+            a.moveImm(RDI, u8());
+            a.call((void*)&jitAlloc);
+            a.pushRax();
+            break;
+        case OpCode::FREE:
+            a.load64(RDI, TOP);
+            a.drop(1);
+            a.call((void*)&jitFree);
+            break;
+        case OpCode::SET_DEREF:
+        case OpCode::SET_DEREF_OFF:
+        {
+            // Like the interpreter, every slot of the target gets the top value.
+            bool offset = code == OpCode::SET_DEREF_OFF;
+            uint8_t size = u8();
+            if (offset)
+            {
+                a.loadSigned(RCX, TOP);
+                a.drop(1);
+            }
+            a.load64(RDX, TOP);
+            a.drop(1);
+            a.load64(RAX, TOP);
+            for (int i = 0; i < size; i++)
+                a.store64(offset ? at(RDX, RCX, 8, 8 * i) : at(RDX, 8 * i), RAX);
+            break;
+        }
+        case OpCode::GET_DEREF:
+        case OpCode::GET_DEREF_OFF:
+        {
+            bool offset = code == OpCode::GET_DEREF_OFF;
+            uint8_t size = u8();
+            if (offset)
+            {
+                a.loadSigned(RCX, TOP);
+                a.drop(1);
+            }
+            a.load64(RDX, TOP);
+            a.drop(1);
+            for (int i = 0; i < size; i++)
+            {
+                a.load64(RAX, offset ? at(RDX, RCX, 8, 8 * i) : at(RDX, 8 * i));
+                a.store64(at(SP, 8 * i), RAX);
+            }
+            a.addImm(SP, 8 * size);
+            break;
+        }
+        case OpCode::ADDR_LOCAL:
+        case OpCode::ADDR_GLOBAL:
+        {
+            int base = code == OpCode::ADDR_GLOBAL ? GLOBALS : FRAME;
+            a.lea(RAX, at(base, 8 * u8()));
+            a.pushRax();
+            break;
+        }
+        case OpCode::ADDR_LOCAL_OFF:
+        case OpCode::ADDR_GLOBAL_OFF:
+        {
+            int base = code == OpCode::ADDR_GLOBAL_OFF ? GLOBALS : FRAME;
+            a.loadSigned(RCX, TOP);
+            a.lea(RAX, at(base, RCX, 8, 8 * u8()));
+            a.store64(TOP, RAX);
+            break;
+        }
+        case OpCode::LOAD_I8:
+        case OpCode::LOAD_I32:
+        {
+            int width = code == OpCode::LOAD_I8 ? 1 : 4;
+            MemBase base = (MemBase)u8();
+            Mem m = element(a, base, u8(), width);
+            if (width == 1)
+                a.op(0, false, {0x0F, 0xB6}, RAX, m);
+            else
+                a.load32(RAX, m);
+            a.pushRax();
+            break;
+        }
+        case OpCode::STORE_I8:
+        case OpCode::STORE_I32:
+        {
+            int width = code == OpCode::STORE_I8 ? 1 : 4;
+            MemBase base = (MemBase)u8();
+            Mem m = element(a, base, u8(), width);
+            a.load32(RAX, TOP);
+            if (width == 1)
+                a.store8(m, RAX);
+            else
+                a.store32(m, RAX);
+            break;
+        }
+        case OpCode::CHECK_INDEX:
+        case OpCode::CHECK_LIMIT:
+        {
+            bool limit = code == OpCode::CHECK_LIMIT;
+            uint16_t size = u16();
+            a.load32(RAX, TOP);
+            if (limit)
+                a.drop(1);
+            a.opReg(0, false, {0x81}, 7, RAX);
+            a.dword(size);
+            checks.push_back({a.jump(limit ? C_G : C_AE), size, limit});
+            break;
+        }
+
+        case OpCode::JUMP:
+        {
+            uint16_t offset = u16();
+            jumps.push_back({a.jump(), ip + offset});
+            break;
+        }
+        case OpCode::LOOP:
+        {
+            uint16_t offset = u16();
+            jumps.push_back({a.jump(), ip - offset});
+            break;
+        }
+        case OpCode::JUMP_NT_POP:
+        {
+            uint16_t offset = u16();
+            a.op(0, false, {0x0F, 0xB6}, RAX, TOP);
+            a.drop(1);
+            a.opReg(0, false, {0x84}, RAX, RAX);
+            jumps.push_back({a.jump(C_E), ip + offset});
+            break;
+        }
+        case OpCode::JUMP_NT:
+        {
+            uint16_t offset = u16();
+            a.op(0, false, {0x80}, 7, TOP);
+            a.byte(0);
+            jumps.push_back({a.jump(C_E), ip + offset});
+            break;
+        }
+        case OpCode::CALL:
+        case OpCode::NATIVE_CALL:
+        {
+            int argSize = u8();
+            int results = u8();
+            void* fn = code == OpCode::CALL ? (void*)&VM::jitCall : (void*)&VM::jitNativeCall;
+            callVM(a, fn, argSize | results << 8, fails);
+            break;
+        }
+        case OpCode::SPAWN:
+            callVM(a, (void*)&VM::jitSpawn, u8(), fails);
+            break;
+        case OpCode::JOIN:
+            callVM(a, (void*)&VM::jitJoin, u8(), fails);
+            break;
+        case OpCode::RETURN:
+        {
+            uint8_t size = u8();
+            for (int i = 0; i < size; i++)
+            {
+                a.load64(RAX, at(SP, 8 * (i - size)));
+                a.store64(at(FRAME, 8 * i), RAX);
+            }
+            a.lea(RAX, at(FRAME, 8 * size));
+            exits.push_back(a.jump());
+            break;
+        }
+
+        default:
+            // SET_GLOBAL_POP and GET_GLOBAL_OFFN stay interpreted.
+            return nullptr;
+        }
+    }
+
+    // Falling off the end leaves the stack as it is, as in the interpreter.
+    offsets[bc.size()] = a.code.size();
+    a.move(RAX, SP);
+    size_t exit = a.code.size();
+    a.addImm(RSP, 8);
+    a.pop(R15);
+    a.pop(R14);
+    a.pop(R13);
+    a.pop(R12);
+    a.pop(RBP);
+    a.pop(RBX);
+    a.byte(0xC3);
+
+    size_t fail = a.code.size();
+    a.opReg(0, false, {0x31}, RAX, RAX);
+    exits.push_back(a.jump());
+
+    for (auto& check : checks)
+    {
+        a.patch(check.patch, a.code.size());
+        a.opReg(0, false, {0x89}, RAX, RDI);
+        a.moveImm(RSI, check.size);
+        a.call(check.limit ? (void*)&jitLimitError : (void*)&jitIndexError);
+        fails.push_back(a.jump());
+    }
+
+    for (auto& jmp : jumps)
+    {
+        if (jmp.second > bc.size() || offsets[jmp.second] == UINT32_MAX)
+            return nullptr;
+        a.patch(jmp.first, offsets[jmp.second]);
+    }
+    for (auto& at : exits)
+        a.patch(at, exit);
+    for (auto& at : fails)
+        a.patch(at, fail);
+
+    void* memory = mmap(nullptr, a.code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return nullptr;
+    memcpy(memory, a.code.data(), a.code.size());
+    if (mprotect(memory, a.code.size(), PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, a.code.size());
+        return nullptr;
+    }
+    return new JitCode((uint8_t*)memory, a.code.size(), offsets);
+#else
+    return nullptr;
+#endif
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Chunk.hpp"
+
+#include <cstddef>
+#include <vector>
+
+class VM;
+
+// A chunk is compiled once it has been called or has looped back this many times.
+constexpr uint32_t JIT_HOT_CALLS = 16;
+constexpr uint32_t JIT_HOT_LOOPS = 1024;
+// Compiled chunks and the runs nested in them keep their frames on the C stack. Calls deeper than
+// this stay interpreted, on the VM's own frames.
+constexpr size_t JIT_MAX_DEPTH = 1000;
+
+// Where compiled code keeps its frame. The VM stack can move while a call runs, so the code reloads
+// the pointers from here after calling back into the VM.
+struct JitFrame
+{
+    Data* frame;
+    Data* globals;
+    size_t frameStart;
+    size_t top; // stack size the frame needs
+};
+
+// Runs compiled code from 'target' with the stack top at 'sp'. Returns the new stack top, or null
+// after a runtime error.
+typedef Data* (*JitEntry)(VM* vm, Data* sp, JitFrame* regs, void* target);
+
+// Machine code of one chunk. Every bytecode offset maps to native code, so the interpreter can
+// enter at a loop header as well as at the start.
+class JitCode
+{
+public:
+    JitEntry entry;
+    uint8_t* memory;
+    size_t size;
+    std::vector<uint32_t> offsets;
+
+    JitCode(uint8_t* memory, size_t size, std::vector<uint32_t> offsets);
+    ~JitCode();
+
+    inline void* target(size_t ip)
+    {
+        return memory + offsets[ip];
+    }
+};
+
+// Baseline compiler from bytecode to x86-64. Each opcode becomes a fixed template that works on the
+// VM stack in memory, so the state between opcodes is the same as in the interpreter.
+class Jit
+{
+public:
+    // Returns null when the platform is not x86-64 or the chunk uses an opcode the JIT leaves to the
+    // interpreter.
+    static JitCode* compile(Chunk* chunk);
+};
@@ -0,0 +1,419 @@
+#pragma once
+
+#include "IRPass.hpp"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Loop-invariant code motion on the IR of one function.
+// Loops are found from backward jumps to an earlier label. Pure expressions in a loop that only read
+// constants and locals the loop never writes are computed once in front of the loop into a temporary
+// local, and the loop reads the temporary instead.
+// Before that, integer expressions that are affine in a loop's induction variables (array indices
+// like i*16 + j + 1) are strength reduced: the loop keeps a running offset that is bumped next to
+// each induction variable update, and the expressions become that offset plus a constant.
+class LoopOptimizer : public IRPass
+{
+private:
+    // Integer expression sum(coefficient * local) + constant.
+    struct Affine
+    {
+        std::map<int, int> terms;
+        int constant = 0;
+    };
+
+public:
+    size_t loops;
+    size_t hoisted;
+    size_t reduced;
+    size_t offsets;
+
+    LoopOptimizer(IRChunk* chunk)
+        : IRPass(chunk), loops(0), hoisted(0), reduced(0), offsets(0)
+    {
+    }
+
+    void optimize()
+    {
+        scanFrame();
+
+        auto& code = chunk->getCode();
+        std::vector<InstLabel*> headers;
+        std::unordered_map<InstLabel*, size_t> seen;
+        for (size_t i = 0; i < code.size(); i++)
+        {
+            classify(code[i]);
+            if (label)
+                seen[label] = i;
+            else if (jump && jump->type == 0 && seen.count(jump->label))
+            {
+                bool known = false;
+                for (auto& h : headers)
+                    known |= h == jump->label;
+                if (!known)
+                    headers.push_back(jump->label);
+            }
+        }
+
+        // Outer loops go first, so whatever they hoist leaves the loops they contain too.
+        std::sort(headers.begin(), headers.end(), [&](InstLabel* a, InstLabel* b) { return seen[a] < seen[b]; });
+        for (auto& header : headers)
+            reduceLoop(header);
+        for (auto& header : headers)
+            hoistLoop(header);
+
+        layoutTemps();
+    }
+
+private:
+    bool invariant(int slot, const std::vector<std::pair<int, int>>& written)
+    {
+        for (auto& range : written)
+            if (slot >= range.first && slot < range.second)
+                return false;
+        return !isAddressed(slot);
+    }
+
+    // Only loops entered through their header can have a preheader.
+    bool singleEntry(size_t head, size_t tail)
+    {
+        auto& code = chunk->getCode();
+        std::vector<InstLabel*> inside;
+        for (size_t i = head; i <= tail; i++)
+        {
+            classify(code[i]);
+            if (label)
+                inside.push_back(label);
+        }
+
+        for (size_t i = 0; i < code.size(); i++)
+        {
+            if (i >= head && i <= tail)
+                continue;
+            classify(code[i]);
+            if (!jump)
+                continue;
+            for (auto& l : inside)
+                if (jump->label == l)
+                    return false;
+        }
+        return true;
+    }
+
+    bool findLoop(InstLabel* header, size_t& head, size_t& tail)
+    {
+        auto& code = chunk->getCode();
+        head = 0;
+        tail = 0;
+        for (size_t i = 0; i < code.size(); i++)
+        {
+            classify(code[i]);
+            if (label == header)
+                head = i;
+            else if (jump && jump->label == header && jump->type == 0 && i > head)
+                tail = i;
+        }
+        return tail != 0 && singleEntry(head, tail);
+    }
+
+    std::vector<std::pair<int, int>> writtenIn(size_t head, size_t tail)
+    {
+        auto& code = chunk->getCode();
+        std::vector<std::pair<int, int>> written;
+        for (size_t i = head + 1; i < tail; i++)
+        {
+            classify(code[i]);
+            if (writes.second > writes.first && !addressOf)
+                written.push_back(writes);
+        }
+        return written;
+    }
+
+    static int wrap(int64_t val) { return (int)(uint32_t)val; }
+
+    bool affine(size_t start, size_t end, Affine& form)
+    {
+        auto& code = chunk->getCode();
+        std::vector<Affine> stack;
+        for (size_t i = start; i <= end; i++)
+        {
+            classify(code[i]);
+            Affine a;
+            switch (op)
+            {
+            case 'c':
+                a.constant = value;
+                stack.push_back(a);
+                continue;
+            case 'l':
+                a.terms[reads] = 1;
+                stack.push_back(a);
+                continue;
+            case '+':
+            case '-':
+            case '*':
+                break;
+            default:
+                return false;
+            }
+
+            Affine b = stack.back();
+            stack.pop_back();
+            a = stack.back();
+            stack.pop_back();
+            if (op == '*')
+            {
+                if (!a.terms.empty() && !b.terms.empty())
+                    return false;
+                if (a.terms.empty())
+                    std::swap(a, b);
+                for (auto& t : a.terms)
+                    t.second = wrap((int64_t)t.second * b.constant);
+                a.constant = wrap((int64_t)a.constant * b.constant);
+            }
+            else
+            {
+                int sign = op == '+' ? 1 : -1;
+                for (auto& t : b.terms)
+                    a.terms[t.first] = wrap(a.terms[t.first] + (int64_t)sign * t.second);
+                a.constant = wrap(a.constant + (int64_t)sign * b.constant);
+            }
+            for (auto it = a.terms.begin(); it != a.terms.end();)
+                it = it->second == 0 ? a.terms.erase(it) : std::next(it);
+            stack.push_back(a);
+        }
+        if (stack.size() != 1)
+            return false;
+        form = stack.back();
+        return true;
+    }
+
+    void reduceLoop(InstLabel* header)
+    {
+        size_t head, tail;
+        if (!findLoop(header, head, tail))
+            return;
+        auto& code = chunk->getCode();
+        auto written = writtenIn(head, tail);
+
+        // Induction variables: 'x = x + c' or 'x = x - c' is the only write to x in the loop.
+        std::map<int, std::pair<int, Instruction*>> ivs;
+        for (size_t k = head + 1; k + 5 <= tail; k++)
+        {
+            classify(code[k]);
+            if (op != 'l')
+                continue;
+            int x = reads;
+            classify(code[k + 1]);
+            if (op != 'c')
+                continue;
+            int step = value;
+            classify(code[k + 2]);
+            if (op != '+' && op != '-')
+                continue;
+            if (op == '-')
+                step = wrap(-(int64_t)step);
+            classify(code[k + 3]);
+            if (sets != x)
+                continue;
+            classify(code[k + 4]);
+            if (!popped)
+                continue;
+
+            int count = 0;
+            for (auto& range : written)
+                count += x >= range.first && x < range.second;
+            if (count == 1 && !isAddressed(x))
+                ivs[x] = {step, code[k + 4]};
+        }
+        if (ivs.empty())
+            return;
+
+        // Largest affine integer expressions of induction variables and invariant locals.
+        std::vector<std::pair<size_t, size_t>> ranges;
+        std::vector<Affine> forms;
+        std::map<int, InstGetLocal*> getters;
+        for (size_t end = tail - 1; end > head; end--)
+        {
+            classify(code[end]);
+            size_t start;
+            Affine form;
+            if (!pure || result != TypeTag::INTEGER || !subtree(head + 1, end, start) || start == end || !affine(start, end, form))
+                continue;
+
+            bool induced = false, ok = true;
+            for (auto& t : form.terms)
+            {
+                if (ivs.count(t.first))
+                    induced = true;
+                else
+                    ok &= invariant(t.first, written);
+            }
+            if (!ok || !induced || (form.terms.size() == 1 && form.terms.begin()->second == 1))
+                continue;
+
+            for (size_t i = start; i <= end; i++)
+            {
+                classify(code[i]);
+                if (op == 'l')
+                    getters[reads] = (InstGetLocal*)code[i];
+            }
+            ranges.push_back({start, end});
+            forms.push_back(form);
+            end = start;
+        }
+
+        // Expressions with the same variable part share one running offset, if that saves work.
+        std::map<std::map<int, int>, std::vector<size_t>> groups;
+        for (size_t n = 0; n < forms.size(); n++)
+            groups[forms[n].terms].push_back(n);
+
+        auto type = TypeContext::primitive(TypeTag::INTEGER);
+        std::vector<Instruction*> preheader;
+        std::vector<std::pair<size_t, Instruction*>> replaced;
+        std::vector<std::pair<Instruction*, std::vector<Instruction*>>> updates;
+        for (auto& group : groups)
+        {
+            int saved = 0, cost = 0;
+            for (auto n : group.second)
+                saved += ranges[n].second - ranges[n].first + 1 - (forms[n].constant ? 3 : 1);
+            for (auto& t : group.first)
+                cost += ivs.count(t.first) ? 5 : 0;
+
+            Variable var;
+            std::string name;
+            if (saved <= cost || !newTemp(type, var, name))
+                continue;
+            offsets++;
+
+            bool first = true;
+            for (auto& t : group.first)
+            {
+                InstGetLocal* get = getters[t.first];
+                preheader.push_back(new InstGetLocal(get->name, get->var, get->type));
+                if (t.second != 1)
+                {
+                    preheader.push_back(intConst(t.second));
+                    preheader.push_back(new InstMul(TypeTag::INTEGER));
+                }
+                if (!first)
+                    preheader.push_back(new InstAdd(TypeTag::INTEGER));
+                first = false;
+
+                if (ivs.count(t.first))
+                    updates.push_back({ivs[t.first].second,
+                                       {new InstGetLocal(name, var, type), intConst(wrap((int64_t)t.second * ivs[t.first].first)),
+                                        new InstAdd(TypeTag::INTEGER), new InstSetLocal(name, var, type), new InstPop({type})}});
+            }
+            preheader.push_back(new InstSetLocal(name, var, type));
+            preheader.push_back(new InstPop({type}));
+
+            for (auto n : group.second)
+            {
+                replaced.push_back({n, new InstGetLocal(name, var, type)});
+                reduced++;
+            }
+        }
+
+        // Ranges were collected back to front, so earlier positions stay valid while replacing.
+        std::sort(replaced.begin(), replaced.end());
+        for (auto& r : replaced)
+        {
+            auto range = ranges[r.first];
+            int constant = forms[r.first].constant;
+            for (size_t i = range.first; i <= range.second; i++)
+                delete code[i];
+            code.erase(code.begin() + range.first, code.begin() + range.second + 1);
+
+            std::vector<Instruction*> value = {r.second};
+            if (constant)
+            {
+                value.push_back(intConst(constant));
+                value.push_back(new InstAdd(TypeTag::INTEGER));
+            }
+            code.insert(code.begin() + range.first, value.begin(), value.end());
+        }
+
+        for (auto& update : updates)
+        {
+            auto at = std::find(code.begin(), code.end(), update.first);
+            code.insert(at + 1, update.second.begin(), update.second.end());
+        }
+        code.insert(code.begin() + head, preheader.begin(), preheader.end());
+    }
+
+    void hoistLoop(InstLabel* header)
+    {
+        size_t head, tail;
+        if (!findLoop(header, head, tail))
+            return;
+        loops++;
+        auto& code = chunk->getCode();
+        auto written = writtenIn(head, tail);
+
+        // Largest invariant expressions, found from the back of the loop.
+        std::vector<std::pair<size_t, size_t>> ranges;
+        for (size_t end = tail - 1; end > head; end--)
+        {
+            classify(code[end]);
+            size_t start;
+            if (!pure || !scalar(result) || !subtree(head + 1, end, start) || start == end)
+                continue;
+
+            bool ok = true;
+            for (size_t i = start; i <= end; i++)
+            {
+                classify(code[i]);
+                ok &= reads < 0 || invariant(reads, written);
+            }
+            if (ok)
+            {
+                ranges.push_back({start, end});
+                end = start;
+            }
+        }
+
+        std::vector<Instruction*> preheader;
+        std::unordered_map<std::string, std::pair<Variable, std::string>> values;
+        for (auto& range : ranges)
+        {
+            std::string expr;
+            for (size_t i = range.first; i <= range.second; i++)
+            {
+                classify(code[i]);
+                expr += key + " ";
+            }
+            classify(code[range.second]);
+            auto type = TypeContext::primitive(result);
+
+            auto it = values.find(expr);
+            if (it == values.end())
+            {
+                Variable var;
+                std::string name;
+                if (!newTemp(type, var, name))
+                    continue;
+
+                values[expr] = {var, name};
+                preheader.insert(preheader.end(), code.begin() + range.first, code.begin() + range.second + 1);
+                preheader.push_back(new InstSetLocal(name, var, type));
+                preheader.push_back(new InstPop({type}));
+            }
+            else
+            {
+                for (size_t i = range.first; i <= range.second; i++)
+                    delete code[i];
+            }
+
+            hoisted += range.second - range.first + 1;
+            code.erase(code.begin() + range.first, code.begin() + range.second + 1);
+            code.insert(code.begin() + range.first, new InstGetLocal(values[expr].second, values[expr].first, type));
+        }
+
+        code.insert(code.begin() + head, preheader.begin(), preheader.end());
+    }
+};
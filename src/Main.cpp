@@ -1,38 +1,38 @@
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <new>
 #include <sstream>
 #include <string>
 
-#include "CodeGen.hpp"
-#include "IRGen.hpp"
-#include "Parser.h"
-#include "Scanner.h"
-#include "TypeChecker.hpp"
+#include "Heap.h"
+#include "MemStats.h"
+#include "Program.h"
+#include "Snapshot.h"
 #include "VM.h"
 
-#include "Debug.h"
-
-size_t EnvNamespace::currentPos = 0;
-
 enum class TargetPlatform
 {
     Interpret,
     VMOutput,
     M0Stack,
-    M0Register
+    M0Register,
+    C
 };
 
-struct BuildMode
+struct BuildMode : ProgramOptions
 {
-    std::vector<std::string> files;
     std::string targetPath;
     TargetPlatform target;
 
-    bool debug_tokens = false;
-    bool debug_ast_bare = false;
-    bool debug_ast = false;
-    bool debug_ir = false;
-    bool debug_code = false;
+    bool nojit = false;
+    bool notier = false;
+    bool norun = false;
+
+    // Snapshot taken after the entry code ran, and the function a restore resumes from.
+    std::string savePath;
+    std::string restorePath;
+    std::string resumeEntry = "main";
 };
 
 BuildMode parseArgs(int argc, char** argv);
@@ -43,8 +43,11 @@ int main(int argc, char* argv[])
     if (argc >= 2)
     {
         BuildMode buildMode = parseArgs(argc, argv);
-        if (buildMode.target == TargetPlatform::Interpret)
+        if (buildMode.target == TargetPlatform::Interpret || buildMode.target == TargetPlatform::C)
+        {
             run(buildMode);
+            MemStats::print();
+        }
         else
         {
             std::cout << "[ERROR] Invalid build target." << std::endl;
@@ -77,8 +80,32 @@ BuildMode parseArgs(int argc, char** argv)
                 buildMode.debug_ast = true;
             else if (strcmp(argv[i], "-debug_ir") == 0)
                 buildMode.debug_ir = true;
+            else if (strcmp(argv[i], "-debug_stack") == 0)
+                buildMode.debug_stack = true;
             else if (strcmp(argv[i], "-debug_code") == 0)
                 buildMode.debug_code = true;
+            else if (strcmp(argv[i], "-debug_opt") == 0)
+                buildMode.debug_opt = true;
+            else if (strcmp(argv[i], "-checked") == 0)
+                buildMode.checked = true;
+            else if (strcmp(argv[i], "-nojit") == 0)
+                buildMode.nojit = true;
+            else if (strcmp(argv[i], "-notier") == 0)
+                buildMode.notier = true;
+            else if (strcmp(argv[i], "-norun") == 0)
+                buildMode.norun = true;
+            else if (strcmp(argv[i], "-time-passes") == 0)
+                buildMode.time_passes = true;
+            else if (strcmp(argv[i], "-stats") == 0)
+                buildMode.stats = true;
+            else if (strcmp(argv[i], "-memstats") == 0)
+                MemStats::enable();
+            else if (strcmp(argv[i], "-save") == 0 && i + 1 < argc)
+                buildMode.savePath = argv[++i];
+            else if (strcmp(argv[i], "-restore") == 0 && i + 1 < argc)
+                buildMode.restorePath = argv[++i];
+            else if (strcmp(argv[i], "-entry") == 0 && i + 1 < argc)
+                buildMode.resumeEntry = argv[++i];
             else if (strcmp(argv[i], "-interpret") == 0)
                 buildMode.target = TargetPlatform::Interpret;
             else if (strcmp(argv[i], "-vmcode") == 0)
@@ -87,6 +114,8 @@ BuildMode parseArgs(int argc, char** argv)
                 buildMode.target = TargetPlatform::M0Stack;
             else if (strcmp(argv[i], "-m0register") == 0)
                 buildMode.target = TargetPlatform::M0Register;
+            else if (strcmp(argv[i], "-ccode") == 0)
+                buildMode.target = TargetPlatform::C;
             else
                 parse_mode++;
         }
@@ -116,11 +145,27 @@ BuildMode parseArgs(int argc, char** argv)
 
 void run(BuildMode buildMode)
 {
+    if (!buildMode.restorePath.empty())
+    {
+        Program program;
+        VM vm(std::vector<Data>{});
+        vm.jitEnabled = !buildMode.nojit;
+        vm.tierEnabled = !buildMode.notier;
+        program.timer.enabled = buildMode.time_passes;
+        program.timer.start("restore");
+        Chunk* entry = Snapshot::restore(buildMode.restorePath, program, vm);
+        program.timer.stop();
+        std::vector<Data> results;
+        program.timer.start("run");
+        if (entry)
+            vm.invoke(entry, {}, results);
+        program.timer.stop();
+        program.timer.print();
+        return;
+    }
+
     int n = buildMode.files.size();
-    Parser parser;
-    std::vector<Stmt*> root;
     std::vector<std::string> ss;
-    std::vector<std::vector<Token>> tokenList;
     ss.resize(n);
     for (int i = 0; i < n; i++)
     {
@@ -134,77 +179,79 @@ void run(BuildMode buildMode)
         std::stringstream sourceStream;
         sourceStream << file.rdbuf();
         ss[i] = sourceStream.str();
-
-        Scanner scanner(ss[i]);
-        tokenList.push_back(scanner.scanTokens());
         file.close();
-
-        if (buildMode.debug_tokens)
-            debugTokens(tokenList[i]);
-
-        parser.parseUserDefinedTypes(tokenList[i]);
     }
 
-    for (int i = 0; i < n; i++)
+    if (buildMode.target == TargetPlatform::C)
+        buildMode.cPath = buildMode.targetPath.empty() ? "out.c" : buildMode.targetPath;
+
+    if (!buildMode.savePath.empty())
     {
-        root.push_back(parser.parseUnit(tokenList[i]));
+        buildMode.exports.push_back(buildMode.resumeEntry);
+        recordHeap();
     }
-    if (!parser.cont)
-        return;
 
-    if (buildMode.debug_ast_bare)
-        debugAST(root);
-
-    TypeChecker typeChecker(root, parser.allNamespaces);
-
-    if (!typeChecker.cont)
+    Program program;
+    if (!program.compile(ss, buildMode) || buildMode.target == TargetPlatform::C || buildMode.norun)
+    {
+        program.timer.print();
         return;
+    }
 
-    if (buildMode.debug_ast)
-        debugAST(root);
+    VM vm(program.getGlobals());
+    vm.jitEnabled = !buildMode.nojit;
+    vm.tierEnabled = !buildMode.notier;
+    program.timer.start("run");
+    bool ran = vm.interpret(program.entry());
+    program.timer.stop();
+    program.timer.print();
+    if (ran && !buildMode.savePath.empty())
+        Snapshot::save(buildMode.savePath, program, vm, buildMode.resumeEntry);
+}
 
-    IRGen irGen(root, parser.allNamespaces);
-    std::vector<IRChunk*> irChunks = irGen.generateIR();
+// -memstats counts through these, they are kept out of the library so hosts keep their allocator.
+void* operator new(size_t size)
+{
+    void* ptr = MemStats::allocate(size, __builtin_return_address(0));
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
 
-    for (auto& stmt : root)
-        delete stmt;
-    root.clear();
+void* operator new[](size_t size)
+{
+    void* ptr = MemStats::allocate(size, __builtin_return_address(0));
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
 
-    if (!irGen.cont)
-        return;
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return MemStats::allocate(size, __builtin_return_address(0));
+}
 
-    if (buildMode.debug_ir)
-    {
-        for (auto& irc : irChunks)
-        {
-            std::cout << irc->name << ":\n";
-            debugInstructions(irc);
-            std::cout << std::endl;
-        }
-    }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return MemStats::allocate(size, __builtin_return_address(0));
+}
 
-    CodeGen codegen(parser.allNamespaces);
-    for (auto& irc : irChunks)
-        codegen.generateCode(irc);
+void operator delete(void* ptr) noexcept
+{
+    MemStats::release(ptr);
+}
 
-    if (buildMode.debug_code)
-    {
-        for (auto& irc : irChunks)
-        {
-            std::cout << irc->name << "@" << irc->chunk << ":\n";
-            dissambleChunk(irc->chunk);
-            std::cout << std::endl;
-        }
-    }
+void operator delete[](void* ptr) noexcept
+{
+    MemStats::release(ptr);
+}
 
-    std::vector<Chunk*> chunks;
-    for (auto& irc : irChunks)
-    {
-        chunks.push_back(irc->chunk);
-        delete irc;
-    }
-    irChunks.clear();
+void operator delete(void* ptr, size_t) noexcept
+{
+    MemStats::release(ptr);
+}
 
-    VM vm(codegen.getGlobals());
-    vm.interpret(chunks[0]);
-}
\ No newline at end of file
+void operator delete[](void* ptr, size_t) noexcept
+{
+    MemStats::release(ptr);
+}
@@ -0,0 +1,222 @@
+#include "MemStats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+std::atomic<bool> MemStats::active(false);
+
+namespace
+{
+struct Counter
+{
+    size_t allocs = 0;
+    size_t frees = 0;
+    size_t bytes = 0;
+    size_t live = 0;
+    size_t peak = 0;
+
+    void add(size_t size)
+    {
+        allocs++;
+        bytes += size;
+        live += size;
+        peak = std::max(peak, live);
+    }
+
+    void remove(size_t size)
+    {
+        frees++;
+        live -= size;
+    }
+};
+
+struct Block
+{
+    size_t size;
+    size_t phase;
+    void* site;
+};
+
+// Phase 0 is for what happens outside of the marked phases, 1 is the VM heap.
+const size_t OTHER = 0;
+const size_t HEAP = 1;
+
+struct State
+{
+    std::mutex mutex;
+    std::vector<std::pair<std::string, Counter>> phases{{"other", {}}, {"VM heap", {}}};
+    size_t current = OTHER;
+    std::unordered_map<void*, Block> blocks;
+    std::unordered_map<void*, Counter> sites;
+    Counter total;
+};
+
+// Never destroyed, the containers are still needed by the frees after main.
+State& state()
+{
+    alignas(State) static char storage[sizeof(State)];
+    static State* s = new (storage) State;
+    return *s;
+}
+
+// The tables allocate too, those blocks are not counted.
+thread_local bool inside = false;
+thread_local int heapDepth = 0;
+
+std::string siteName(void* site)
+{
+    Dl_info info;
+    if (!dladdr(site, &info))
+        return "?";
+    if (info.dli_sname)
+    {
+        int status;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = status == 0 ? demangled : info.dli_sname;
+        std::free(demangled);
+        return name;
+    }
+    const char* file = info.dli_fname ? std::strrchr(info.dli_fname, '/') : nullptr;
+    char offset[32];
+    std::snprintf(offset, sizeof(offset), "+0x%zx", (size_t)((char*)site - (char*)info.dli_fbase));
+    return std::string(file ? file + 1 : info.dli_fname ? info.dli_fname : "?") + offset;
+}
+
+void printCounter(const Counter& counter)
+{
+    std::cout << std::setw(12) << counter.allocs << std::setw(12) << counter.frees << std::setw(14) << counter.bytes
+              << std::setw(14) << counter.peak << std::setw(14) << counter.live;
+}
+} // namespace
+
+void MemStats::enable()
+{
+    state();
+    active = true;
+}
+
+void MemStats::enter(const std::string& name)
+{
+    if (!active.load(std::memory_order_relaxed))
+        return;
+    State& s = state();
+    inside = true;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        size_t i = 0;
+        while (i < s.phases.size() && s.phases[i].first != name)
+            i++;
+        if (i == s.phases.size())
+            s.phases.push_back({name, {}});
+        s.current = i;
+    }
+    inside = false;
+}
+
+void MemStats::leave()
+{
+    if (!active.load(std::memory_order_relaxed))
+        return;
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.current = OTHER;
+}
+
+void MemStats::print()
+{
+    if (!active.exchange(false))
+        return;
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    std::cout << "===== Memory by phase =====\n";
+    std::cout << std::setw(12) << "allocs" << std::setw(12) << "frees" << std::setw(14) << "bytes" << std::setw(14) << "peak live"
+              << std::setw(14) << "live" << "  phase\n";
+    for (auto& phase : s.phases)
+    {
+        if (phase.second.allocs == 0)
+            continue;
+        printCounter(phase.second);
+        std::cout << "  " << phase.first << "\n";
+    }
+    printCounter(s.total);
+    std::cout << "  total\n";
+
+    // The sites that allocated the most bytes, live is what they leaked.
+    const size_t shown = 20;
+    std::vector<std::pair<void*, Counter>> sites(s.sites.begin(), s.sites.end());
+    std::sort(sites.begin(), sites.end(), [](auto& a, auto& b) { return a.second.bytes > b.second.bytes; });
+    std::cout << "===== Memory by allocation site =====\n";
+    std::cout << std::setw(12) << "allocs" << std::setw(12) << "frees" << std::setw(14) << "bytes" << std::setw(14) << "peak live"
+              << std::setw(14) << "live" << "  site\n";
+    for (size_t i = 0; i < sites.size() && i < shown; i++)
+    {
+        printCounter(sites[i].second);
+        std::cout << "  " << siteName(sites[i].first) << "\n";
+    }
+    if (sites.size() > shown)
+        std::cout << sites.size() - shown << " more sites\n";
+}
+
+void* MemStats::allocate(size_t size, void* site)
+{
+    void* ptr = std::malloc(size ? size : 1);
+    if (!ptr || !active.load(std::memory_order_relaxed) || inside)
+        return ptr;
+
+    State& s = state();
+    inside = true;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        size_t phase = heapDepth > 0 ? HEAP : s.current;
+        s.blocks[ptr] = {size, phase, site};
+        s.phases[phase].second.add(size);
+        s.sites[site].add(size);
+        s.total.add(size);
+    }
+    inside = false;
+    return ptr;
+}
+
+void MemStats::release(void* ptr)
+{
+    if (ptr && active.load(std::memory_order_relaxed) && !inside)
+    {
+        State& s = state();
+        inside = true;
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.blocks.find(ptr);
+            if (it != s.blocks.end())
+            {
+                Block& block = it->second;
+                s.phases[block.phase].second.remove(block.size);
+                s.sites[block.site].remove(block.size);
+                s.total.remove(block.size);
+                s.blocks.erase(it);
+            }
+        }
+        inside = false;
+    }
+    std::free(ptr);
+}
+
+MemStats::VMHeap::VMHeap()
+{
+    heapDepth++;
+}
+
+MemStats::VMHeap::~VMHeap()
+{
+    heapDepth--;
+}
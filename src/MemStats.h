@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+// Counts what operator new hands out while -memstats is on, per phase and per allocation site. The
+// phases are the ones PassTimer marks, the blocks ALLOC makes are counted as the VM heap on their
+// own. A site is the code that called new, it is printed as a symbol when the binary exports them
+// (-rdynamic) and as an offset for addr2line otherwise. Blocks made before it was turned on are not
+// counted, also when they are freed. The library only keeps the counts, the executable replaces the
+// global operator new and delete with ones that go through allocate() and release(), so that hosts
+// keep their own allocator.
+class MemStats
+{
+public:
+    static std::atomic<bool> active;
+
+    static void enable();
+    // Later allocations count for the phase, until leave().
+    static void enter(const std::string& name);
+    static void leave();
+    // Prints the phases and the sites that allocated the most. What is live then was not freed.
+    static void print();
+
+    // Called by the replaced operator new and delete. 'site' is the code that called new.
+    static void* allocate(size_t size, void* site);
+    static void release(void* ptr);
+
+    // While one is alive the allocations of its thread count for the VM heap.
+    struct VMHeap
+    {
+        VMHeap();
+        ~VMHeap();
+    };
+};
@@ -0,0 +1,188 @@
+#include "Mir.h"
+
+#include <algorithm>
+#include <functional>
+
+void MirValue::addOperand(MirValue* value)
+{
+    operands.push_back(value);
+    value->users.push_back(this);
+}
+
+void MirValue::replaceOperand(MirValue* from, MirValue* to)
+{
+    for (auto& op : operands)
+    {
+        if (op == from)
+        {
+            op = to;
+            to->users.push_back(this);
+        }
+    }
+    from->users.erase(std::remove(from->users.begin(), from->users.end(), this), from->users.end());
+}
+
+bool MirValue::isTerminator()
+{
+    return op == MirOp::Inst && (dynamic_cast<InstJump*>(inst) || dynamic_cast<InstReturn*>(inst));
+}
+
+MirValue* MirBlock::terminator()
+{
+    if (insts.empty() || !insts.back()->isTerminator())
+        return nullptr;
+    return insts.back();
+}
+
+MirFunction::MirFunction(std::string name, size_t argSize)
+    : name(name), argSize(argSize), maxHeight(argSize)
+{
+    undef = newValue(MirOp::Undef, nullptr, nullptr);
+    memory = newValue(MirOp::Memory, nullptr, nullptr);
+}
+
+MirFunction::~MirFunction()
+{
+    for (auto& value : values)
+        delete value;
+    for (auto& block : blocks)
+        delete block;
+}
+
+MirValue* MirFunction::newValue(MirOp op, Instruction* inst, MirBlock* block)
+{
+    MirValue* value = new MirValue(values.size(), op, inst, block);
+    values.push_back(value);
+    return value;
+}
+
+MirBlock* MirFunction::newBlock()
+{
+    MirBlock* block = new MirBlock(blocks.size());
+    blocks.push_back(block);
+    return block;
+}
+
+void MirFunction::renumber()
+{
+    std::vector<MirValue*> live = args;
+    for (auto& block : blocks)
+    {
+        live.insert(live.end(), block->phis.begin(), block->phis.end());
+        live.insert(live.end(), block->insts.begin(), block->insts.end());
+    }
+
+    std::vector<bool> keep(values.size());
+    for (auto& value : live)
+        keep[value->id] = true;
+    keep[undef->id] = keep[memory->id] = true;
+    for (auto& value : values)
+        if (!keep[value->id])
+            delete value;
+
+    for (size_t i = 0; i < live.size(); i++)
+        live[i]->id = i;
+    undef->id = live.size();
+    memory->id = live.size() + 1;
+    live.push_back(undef);
+    live.push_back(memory);
+    values = live;
+}
+
+std::vector<MirBlock*> MirFunction::reversePostorder()
+{
+    std::vector<MirBlock*> order;
+    std::vector<bool> visited(blocks.size());
+    std::function<void(MirBlock*)> walk = [&](MirBlock* block) {
+        visited[block->id] = true;
+        for (auto& succ : block->succs)
+            if (!visited[succ->id])
+                walk(succ);
+        order.push_back(block);
+    };
+    if (!blocks.empty())
+        walk(blocks[0]);
+    std::reverse(order.begin(), order.end());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i]->order = i;
+    return order;
+}
+
+// Cooper, Harvey and Kennedy's iterative algorithm over the reverse postorder.
+void MirFunction::computeDominators()
+{
+    std::vector<MirBlock*> order = reversePostorder();
+    for (auto& block : blocks)
+    {
+        block->idom = nullptr;
+        block->dominated.clear();
+    }
+    if (order.empty())
+        return;
+
+    MirBlock* entry = order[0];
+    entry->idom = entry;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 1; i < order.size(); i++)
+        {
+            MirBlock* block = order[i];
+            MirBlock* idom = nullptr;
+            for (auto& pred : block->preds)
+            {
+                if (!pred->idom)
+                    continue;
+                if (!idom)
+                {
+                    idom = pred;
+                    continue;
+                }
+                MirBlock* a = pred;
+                MirBlock* b = idom;
+                while (a != b)
+                {
+                    while (a->order > b->order)
+                        a = a->idom;
+                    while (b->order > a->order)
+                        b = b->idom;
+                }
+                idom = a;
+            }
+            if (idom != block->idom)
+            {
+                block->idom = idom;
+                changed = true;
+            }
+        }
+    }
+
+    entry->idom = nullptr;
+    for (size_t i = 1; i < order.size(); i++)
+        order[i]->idom->dominated.push_back(order[i]);
+}
+
+bool MirFunction::dominates(MirBlock* a, MirBlock* b)
+{
+    for (; b; b = b->idom)
+        if (a == b)
+            return true;
+    return false;
+}
+
+void MirFunction::lower(IRChunk* chunk)
+{
+    auto& code = chunk->getCode();
+    code.clear();
+    chunk->maxStack = maxHeight;
+    for (auto& block : blocks)
+    {
+        code.insert(code.end(), block->labels.begin(), block->labels.end());
+        for (auto& value : block->insts)
+        {
+            code.push_back(value->inst);
+            value->inst = nullptr;
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "IRChunk.hpp"
+
+#include <string>
+#include <vector>
+
+// Mid-level IR: the stack code of one function split into basic blocks, with every stack slot
+// (locals and temporaries alike) renamed into SSA values.
+
+enum class MirOp
+{
+    Arg,    // argument slot on function entry
+    Phi,    // merge of a slot's values at a block with several predecessors
+    Undef,  // a slot that no path writes
+    Memory, // a slot that is also reached through pointers or holds part of a bigger value
+    Inst    // a stack instruction
+};
+
+class MirBlock;
+
+class MirValue
+{
+public:
+    size_t id;
+    MirOp op;
+    Instruction* inst;
+    MirBlock* block;
+    std::vector<MirValue*> operands;
+    std::vector<MirValue*> users;
+    int slot; // first stack slot the value is kept in, -1 when it has none
+    int size; // slots it takes
+    int height; // stack height before the instruction runs
+
+    MirValue(size_t id, MirOp op, Instruction* inst, MirBlock* block)
+        : id(id), op(op), inst(inst), block(block), slot(-1), size(0), height(0) {}
+
+    void addOperand(MirValue* value);
+    void replaceOperand(MirValue* from, MirValue* to);
+    bool isTerminator();
+};
+
+class MirBlock
+{
+public:
+    size_t id;
+    std::vector<InstLabel*> labels;
+    std::vector<MirValue*> phis;
+    std::vector<MirValue*> insts;
+    std::vector<MirBlock*> preds;
+    std::vector<MirBlock*> succs;
+    MirBlock* idom;
+    std::vector<MirBlock*> dominated;
+    int entryHeight;
+    int exitHeight;
+    size_t order; // position in reverse postorder
+
+    MirBlock(size_t id)
+        : id(id), idom(nullptr), entryHeight(-1), exitHeight(-1), order(0) {}
+
+    MirValue* terminator();
+};
+
+class MirFunction
+{
+public:
+    std::string name;
+    size_t argSize;
+    std::vector<MirBlock*> blocks; // layout order, entry block first
+    std::vector<MirValue*> values;
+    std::vector<MirValue*> args;
+    MirValue* undef;
+    MirValue* memory;
+    size_t maxHeight; // highest the stack gets, counted from the frame base
+
+    MirFunction(std::string name, size_t argSize);
+    ~MirFunction();
+
+    MirValue* newValue(MirOp op, Instruction* inst, MirBlock* block);
+    MirBlock* newBlock();
+    // Deletes the values no block holds anymore and numbers the rest in block order.
+    void renumber();
+
+    std::vector<MirBlock*> reversePostorder();
+    void computeDominators();
+    bool dominates(MirBlock* a, MirBlock* b);
+
+    // Writes the blocks back as stack code. Phis are not emitted: all values of a phi live in its slot.
+    void lower(IRChunk* chunk);
+};
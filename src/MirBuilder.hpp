@@ -0,0 +1,534 @@
+#pragma once
+
+#include "InstVisitor.hpp"
+#include "Mir.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Builds the MIR of one function from its stack code. The stack is simulated slot by slot, and slot
+// values are renamed into SSA form with Braun et al.'s on-the-fly construction, visiting blocks in
+// reverse postorder. Slots that belong to a local wider than one slot or whose address is taken are
+// not renamed, since pointers or offset accesses can change them behind the stack's back.
+class MirBuilder : public InstVisitor
+{
+private:
+    IRChunk* chunk;
+    MirFunction* func;
+    std::vector<bool> untracked;
+
+    // Blocks in construction.
+    MirBlock* current;
+    std::vector<MirValue*> state;
+    std::vector<std::vector<MirValue*>> exitStates;
+    std::vector<std::unordered_map<int, MirValue*>> entryDefs;
+    std::vector<std::vector<MirValue*>> incomplete;
+    std::vector<bool> filled;
+    std::vector<bool> sealed;
+
+    // Filled by visiting an instruction.
+    int pops;
+    int peeks;
+    int pushes;
+    Variable* frameRead;
+    Variable* frameWrite;
+    Variable* frameAddress;
+    InstLabel* label;
+    InstJump* jump;
+    bool ends;
+
+public:
+    bool cont;
+
+    MirBuilder(IRChunk* chunk)
+        : chunk(chunk), func(nullptr), current(nullptr), cont(true)
+    {
+    }
+
+    MirFunction* build()
+    {
+        func = new MirFunction(chunk->name, chunk->argSize);
+        findUntracked();
+        splitBlocks();
+        removeUnreachable();
+
+        size_t count = func->blocks.size();
+        exitStates.resize(count);
+        entryDefs.resize(count);
+        incomplete.resize(count);
+        filled.assign(count, false);
+        sealed.assign(count, false);
+
+        std::vector<MirBlock*> order = func->reversePostorder();
+        for (auto& block : order)
+        {
+            if (block != order[0] && !enterHeight(block))
+                break;
+            sealReady();
+            fill(block);
+            sealReady();
+        }
+
+        for (auto& block : func->blocks)
+        {
+            for (auto& succ : block->succs)
+                if (succ->entryHeight != block->exitHeight)
+                    error("Stack height " + std::to_string(block->exitHeight) + " at the end of bb" + std::to_string(block->id) +
+                          " does not match " + std::to_string(succ->entryHeight) + " at bb" + std::to_string(succ->id) + ".");
+        }
+
+        func->renumber();
+        func->computeDominators();
+        return func;
+    }
+
+    void error(const std::string& message)
+    {
+        cont = false;
+        std::cout << "[IR Error] " << func->name << ": " << message << std::endl;
+    }
+
+private:
+    void describe(Instruction* inst)
+    {
+        pops = 0;
+        peeks = 0;
+        pushes = 0;
+        frameRead = nullptr;
+        frameWrite = nullptr;
+        frameAddress = nullptr;
+        label = nullptr;
+        jump = nullptr;
+        ends = false;
+        inst->accept(this);
+    }
+
+    void mark(Variable& var, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            if (var.position + i >= untracked.size())
+                untracked.resize(var.position + i + 1);
+            untracked[var.position + i] = true;
+        }
+    }
+
+    bool isTracked(int slot)
+    {
+        return slot >= (int)untracked.size() || !untracked[slot];
+    }
+
+    void findUntracked()
+    {
+        for (auto& inst : chunk->getCode())
+        {
+            describe(inst);
+            for (Variable* var : {frameRead, frameWrite, frameAddress})
+                if (var && (var == frameAddress || var->type->getSize() > 1))
+                    mark(*var, var->type->getSize());
+        }
+    }
+
+    void splitBlocks()
+    {
+        MirBlock* block = nullptr;
+        std::unordered_map<InstLabel*, MirBlock*> targets;
+        std::vector<std::pair<MirBlock*, InstJump*>> jumps;
+        for (auto& inst : chunk->getCode())
+        {
+            describe(inst);
+            if (label)
+            {
+                if (!block || !block->insts.empty())
+                    block = func->newBlock();
+                block->labels.push_back(label);
+                targets[label] = block;
+                continue;
+            }
+
+            if (!block)
+                block = func->newBlock();
+            block->insts.push_back(func->newValue(MirOp::Inst, inst, block));
+            if (jump)
+                jumps.push_back({block, jump});
+            if (ends)
+                block = nullptr;
+        }
+        if (func->blocks.empty())
+            func->newBlock();
+
+        for (size_t i = 0; i < func->blocks.size(); i++)
+        {
+            MirBlock* b = func->blocks[i];
+            MirValue* term = b->terminator();
+            InstJump* j = term ? dynamic_cast<InstJump*>(term->inst) : nullptr;
+            if ((!term || (j && j->type != 0)) && i + 1 < func->blocks.size())
+                link(b, func->blocks[i + 1]);
+            if (j)
+                link(b, targets[j->label]);
+        }
+    }
+
+    void link(MirBlock* from, MirBlock* to)
+    {
+        from->succs.push_back(to);
+        to->preds.push_back(from);
+    }
+
+    void removeUnreachable()
+    {
+        std::vector<MirBlock*> order = func->reversePostorder();
+        std::vector<bool> reachable(func->blocks.size());
+        for (auto& block : order)
+            reachable[block->id] = true;
+
+        std::vector<MirBlock*> kept;
+        for (auto& block : func->blocks)
+        {
+            if (reachable[block->id])
+            {
+                kept.push_back(block);
+                continue;
+            }
+            for (auto& succ : block->succs)
+                succ->preds.erase(std::find(succ->preds.begin(), succ->preds.end(), block));
+            for (auto& l : block->labels)
+                delete l;
+            for (auto& value : block->insts)
+            {
+                delete value->inst;
+                value->inst = nullptr;
+                value->block = nullptr;
+            }
+            delete block;
+        }
+
+        func->blocks = kept;
+        for (size_t i = 0; i < kept.size(); i++)
+            kept[i]->id = i;
+    }
+
+    // A block is entered with the stack height its first filled predecessor left.
+    bool enterHeight(MirBlock* block)
+    {
+        for (auto& pred : block->preds)
+        {
+            if (filled[pred->id])
+            {
+                block->entryHeight = pred->exitHeight;
+                return true;
+            }
+        }
+        error("bb" + std::to_string(block->id) + " is entered before any of its predecessors.");
+        return false;
+    }
+
+    void sealReady()
+    {
+        for (auto& block : func->blocks)
+        {
+            if (sealed[block->id] || !std::all_of(block->preds.begin(), block->preds.end(), [&](MirBlock* p) { return filled[p->id]; }))
+                continue;
+            sealed[block->id] = true;
+            for (auto& phi : incomplete[block->id])
+                addPhiOperands(phi);
+            incomplete[block->id].clear();
+        }
+    }
+
+    void fill(MirBlock* block)
+    {
+        current = block;
+        if (block == func->blocks[0])
+        {
+            block->entryHeight = func->argSize;
+            state.clear();
+            for (size_t i = 0; i < func->argSize; i++)
+            {
+                MirValue* arg = func->newValue(MirOp::Arg, nullptr, block);
+                arg->slot = i;
+                arg->size = 1;
+                func->args.push_back(arg);
+                state.push_back(arg);
+            }
+        }
+        else
+            state.assign(block->entryHeight, nullptr);
+
+        for (auto& value : block->insts)
+        {
+            describe(value->inst);
+            int height = state.size();
+            if (pops + peeks > height)
+            {
+                error("Stack underflow in bb" + std::to_string(block->id) + ".");
+                state.assign(pops + peeks, func->undef);
+                height = state.size();
+            }
+            value->height = height;
+
+            MirValue* last = nullptr;
+            for (int slot = height - pops - peeks; slot < height; slot++)
+            {
+                MirValue* operand = get(slot);
+                if (operand != last)
+                    value->addOperand(operand);
+                last = operand;
+            }
+            if (frameRead && isTracked(frameRead->position))
+                value->addOperand(get(frameRead->position));
+
+            state.resize(height - pops);
+            if (pushes > 0)
+            {
+                value->slot = state.size();
+                value->size = pushes;
+                state.insert(state.end(), pushes, value);
+                func->maxHeight = std::max(func->maxHeight, state.size());
+            }
+            if (frameWrite && isTracked(frameWrite->position))
+            {
+                if (frameWrite->position >= (int)state.size())
+                    error("Store to slot " + std::to_string(frameWrite->position) + " above the stack in bb" + std::to_string(block->id) + ".");
+                else
+                {
+                    value->slot = frameWrite->position;
+                    value->size = 1;
+                    state[frameWrite->position] = value;
+                }
+            }
+        }
+
+        block->exitHeight = state.size();
+        exitStates[block->id] = state;
+        filled[block->id] = true;
+        current = nullptr;
+    }
+
+    MirValue* get(int slot)
+    {
+        if (!state[slot])
+            state[slot] = readEntry(slot, current);
+        return state[slot];
+    }
+
+    MirValue* read(int slot, MirBlock* block)
+    {
+        auto& exit = exitStates[block->id];
+        if (filled[block->id] && slot < (int)exit.size() && exit[slot])
+            return exit[slot];
+        return readEntry(slot, block);
+    }
+
+    MirValue* readEntry(int slot, MirBlock* block)
+    {
+        auto it = entryDefs[block->id].find(slot);
+        if (it != entryDefs[block->id].end())
+            return it->second;
+        if (!isTracked(slot))
+            return func->memory;
+        if (block->preds.empty())
+            return func->undef;
+
+        MirValue* value;
+        if (!sealed[block->id])
+        {
+            value = newPhi(slot, block);
+            incomplete[block->id].push_back(value);
+            entryDefs[block->id][slot] = value;
+        }
+        else if (block->preds.size() == 1)
+        {
+            value = read(slot, block->preds[0]);
+            entryDefs[block->id][slot] = value;
+        }
+        else
+        {
+            MirValue* phi = newPhi(slot, block);
+            entryDefs[block->id][slot] = phi;
+            value = addPhiOperands(phi);
+            entryDefs[block->id][slot] = value;
+        }
+        return value;
+    }
+
+    MirValue* newPhi(int slot, MirBlock* block)
+    {
+        MirValue* phi = func->newValue(MirOp::Phi, nullptr, block);
+        phi->slot = slot;
+        phi->size = 1;
+        block->phis.push_back(phi);
+        return phi;
+    }
+
+    MirValue* addPhiOperands(MirValue* phi)
+    {
+        for (auto& pred : phi->block->preds)
+            phi->addOperand(read(phi->slot, pred));
+        return removeTrivialPhi(phi);
+    }
+
+    MirValue* removeTrivialPhi(MirValue* phi)
+    {
+        MirValue* same = nullptr;
+        for (auto& op : phi->operands)
+        {
+            if (op == same || op == phi)
+                continue;
+            if (same)
+                return phi;
+            same = op;
+        }
+        if (!same)
+            same = func->undef;
+
+        std::vector<MirValue*> users;
+        for (auto& user : phi->users)
+            if (user != phi && std::find(users.begin(), users.end(), user) == users.end())
+                users.push_back(user);
+        for (auto& user : users)
+            user->replaceOperand(phi, same);
+        for (auto& op : phi->operands)
+            op->users.erase(std::remove(op->users.begin(), op->users.end(), phi), op->users.end());
+        phi->operands.clear();
+        phi->users.clear();
+
+        auto& phis = phi->block->phis;
+        phis.erase(std::remove(phis.begin(), phis.end(), phi), phis.end());
+        for (auto& exit : exitStates)
+            std::replace(exit.begin(), exit.end(), phi, same);
+        for (auto& defs : entryDefs)
+            for (auto& def : defs)
+                if (def.second == phi)
+                    def.second = same;
+        std::replace(state.begin(), state.end(), phi, same);
+        phi->block = nullptr;
+
+        for (auto& user : users)
+            if (user->op == MirOp::Phi && user->block)
+                removeTrivialPhi(user);
+        return same;
+    }
+
+    void effect(int popped, int pushed)
+    {
+        pops = popped;
+        pushes = pushed;
+    }
+
+public:
+    void visit(InstConst* inst) { effect(0, chunk->getConstant(inst->id)->type->getSize()); }
+    void visit(InstCast* inst) { effect(1, 1); }
+    void visit(InstAdd* inst) { effect(2, 1); }
+    void visit(InstSub* inst) { effect(2, 1); }
+    void visit(InstMul* inst) { effect(2, 1); }
+    void visit(InstDiv* inst) { effect(2, 1); }
+    void visit(InstNeg* inst) { effect(1, 1); }
+    void visit(InstMod* inst) { effect(2, 1); }
+    void visit(InstBit* inst) { effect(inst->op_type == TokenType::TILDE ? 1 : 2, 1); }
+    void visit(InstNot* inst) { effect(1, 1); }
+    void visit(InstInc* inst) { effect(1, 1); }
+    void visit(InstLess* inst) { effect(2, 1); }
+    void visit(InstLte* inst) { effect(2, 1); }
+    void visit(InstGreat* inst) { effect(2, 1); }
+    void visit(InstGte* inst) { effect(2, 1); }
+    void visit(InstEq* inst) { effect(2, 1); }
+    void visit(InstNeq* inst) { effect(2, 1); }
+    void visit(InstGetGlobal* inst) { effect(inst->offset, inst->type->getSize()); }
+    void visit(InstSetGlobal* inst)
+    {
+        effect(inst->offset, 0);
+        peeks = inst->type->getSize();
+    }
+    void visit(InstGetLocal* inst)
+    {
+        effect(inst->offset, inst->type->getSize());
+        frameRead = &inst->var;
+    }
+    void visit(InstSetLocal* inst)
+    {
+        effect(inst->offset, 0);
+        peeks = inst->type->getSize();
+        frameWrite = &inst->var;
+        if (inst->offset)
+            frameRead = &inst->var;
+    }
+    void visit(InstAlloc* inst) { effect(0, 1); }
+    void visit(InstFree* inst) { effect(1, 0); }
+    void visit(InstGetDeref* inst) { effect(1, inst->type->getSize()); }
+    void visit(InstSetDeref* inst)
+    {
+        effect(1, 0);
+        peeks = inst->type->getSize();
+    }
+    void visit(InstGetDerefOff* inst) { effect(2, inst->type->getSize()); }
+    void visit(InstSetDerefOff* inst)
+    {
+        effect(2, 0);
+        peeks = inst->type->getSize();
+    }
+    void visit(InstAddrLocal* inst)
+    {
+        effect(inst->offset, 1);
+        frameAddress = &inst->var;
+    }
+    void visit(InstAddrGlobal* inst) { effect(inst->offset, 1); }
+    void visit(InstLoad* inst)
+    {
+        effect(inst->base == MemBase::DEREF_OFF ? 2 : 1, 1);
+        if (inst->base == MemBase::LOCAL)
+            frameRead = &inst->var;
+    }
+    void visit(InstStore* inst)
+    {
+        effect(inst->base == MemBase::DEREF_OFF ? 2 : 1, 0);
+        peeks = 1;
+        if (inst->base == MemBase::LOCAL)
+        {
+            frameRead = &inst->var;
+            frameWrite = &inst->var;
+        }
+    }
+    void visit(InstCheckIndex* inst)
+    {
+        effect(inst->hoisted, 0);
+        peeks = !inst->hoisted;
+    }
+    void visit(InstCall* inst)
+    {
+        int size = 1;
+        for (auto& arg : inst->args)
+            size += arg->getSize();
+        effect(size, inst->ret->getSize());
+    }
+    void visit(InstPop* inst)
+    {
+        int size = 0;
+        for (auto& type : inst->types)
+            size += type->getSize();
+        effect(size, 0);
+    }
+    void visit(InstPush* inst)
+    {
+        int size = 0;
+        for (auto& type : inst->types)
+            size += type->getSize();
+        effect(0, size);
+    }
+    void visit(InstReturn* inst)
+    {
+        effect(inst->type->getSize(), 0);
+        ends = true;
+    }
+    void visit(InstLabel* inst) { label = inst; }
+    void visit(InstJump* inst)
+    {
+        jump = inst;
+        ends = true;
+        pops = inst->type == 2;
+        peeks = inst->type == 1;
+    }
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "Mir.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Checks that the MIR of a function is well formed: the CFG edges agree in both directions and with
+// the terminators, stack heights match across edges, phis have one operand per predecessor, def-use
+// lists agree and every operand dominates its use.
+class MirVerifier
+{
+private:
+    MirFunction* func;
+    std::unordered_map<MirValue*, size_t> index; // position of a value in its block, phis first
+
+public:
+    bool cont;
+
+    MirVerifier(MirFunction* func)
+        : func(func), cont(true)
+    {
+        verify();
+    }
+
+private:
+    void error(const std::string& message)
+    {
+        cont = false;
+        std::cout << "[IR Error] " << func->name << ": " << message << std::endl;
+    }
+
+    static std::string bb(MirBlock* block)
+    {
+        return "bb" + std::to_string(block->id);
+    }
+
+    static std::string val(MirValue* value)
+    {
+        return "%" + std::to_string(value->id);
+    }
+
+    bool has(std::vector<MirBlock*>& list, MirBlock* block)
+    {
+        return std::find(list.begin(), list.end(), block) != list.end();
+    }
+
+    void verify()
+    {
+        std::unordered_map<InstLabel*, MirBlock*> targets;
+        for (auto& block : func->blocks)
+        {
+            size_t i = 0;
+            for (auto& phi : block->phis)
+                index[phi] = i++;
+            for (auto& inst : block->insts)
+                index[inst] = i++;
+            for (auto& l : block->labels)
+                targets[l] = block;
+        }
+        for (auto& arg : func->args)
+            index[arg] = 0;
+
+        for (size_t i = 0; i < func->blocks.size(); i++)
+        {
+            MirBlock* block = func->blocks[i];
+            MirBlock* next = i + 1 < func->blocks.size() ? func->blocks[i + 1] : nullptr;
+            verifyEdges(block, next, targets);
+            verifyPhis(block);
+            for (auto& inst : block->insts)
+            {
+                if (inst->block != block || inst->op != MirOp::Inst)
+                    error(val(inst) + " is listed in " + bb(block) + " but is not an instruction of it.");
+                if (inst->isTerminator() && inst != block->insts.back())
+                    error(val(inst) + " ends " + bb(block) + " before its last instruction.");
+                verifyOperands(inst, block);
+            }
+        }
+    }
+
+    void verifyEdges(MirBlock* block, MirBlock* next, std::unordered_map<InstLabel*, MirBlock*>& targets)
+    {
+        for (auto& succ : block->succs)
+        {
+            if (!has(succ->preds, block))
+                error(bb(block) + " -> " + bb(succ) + " is missing from the predecessors.");
+            if (succ->entryHeight != block->exitHeight)
+                error("Stack height differs on " + bb(block) + " -> " + bb(succ) + ".");
+        }
+        for (auto& pred : block->preds)
+            if (!has(pred->succs, block))
+                error(bb(pred) + " -> " + bb(block) + " is missing from the successors.");
+        if (block != func->blocks[0] && block->preds.empty())
+            error(bb(block) + " is unreachable.");
+
+        std::vector<MirBlock*> expected;
+        MirValue* term = block->terminator();
+        InstJump* jump = term ? dynamic_cast<InstJump*>(term->inst) : nullptr;
+        if ((!term || (jump && jump->type != 0)) && next)
+            expected.push_back(next);
+        if (jump)
+        {
+            if (targets.count(jump->label) == 0)
+                error(bb(block) + " jumps to a label outside the function.");
+            else
+                expected.push_back(targets[jump->label]);
+            if (jump->type != 0 && term->operands.size() != 1)
+                error("The branch of " + bb(block) + " has no condition.");
+        }
+        if (expected != block->succs)
+            error("The successors of " + bb(block) + " do not match its terminator.");
+    }
+
+    void verifyPhis(MirBlock* block)
+    {
+        for (auto& phi : block->phis)
+        {
+            if (phi->block != block || phi->op != MirOp::Phi)
+                error(val(phi) + " is listed in " + bb(block) + " but is not a phi of it.");
+            if (phi->operands.size() != block->preds.size())
+                error(val(phi) + " has " + std::to_string(phi->operands.size()) + " operands for " +
+                      std::to_string(block->preds.size()) + " predecessors.");
+            if (phi->slot < 0 || phi->slot >= block->entryHeight)
+                error(val(phi) + " merges slot " + std::to_string(phi->slot) + " above the stack.");
+            verifyOperands(phi, block);
+        }
+    }
+
+    void verifyOperands(MirValue* value, MirBlock* block)
+    {
+        for (size_t i = 0; i < value->operands.size(); i++)
+        {
+            MirValue* op = value->operands[i];
+            if (std::find(op->users.begin(), op->users.end(), value) == op->users.end())
+                error(val(value) + " is missing from the users of " + val(op) + ".");
+            if (op->op == MirOp::Undef || op->op == MirOp::Memory)
+                continue;
+            if (!op->block || index.count(op) == 0)
+            {
+                error(val(value) + " uses " + val(op) + ", which no block holds.");
+                continue;
+            }
+
+            if (value->op == MirOp::Phi)
+            {
+                if (i < block->preds.size() && !func->dominates(op->block, block->preds[i]))
+                    error(val(op) + " does not reach the end of " + bb(block->preds[i]) + " for " + val(value) + ".");
+            }
+            else if (op->block == block ? op->op != MirOp::Arg && op->op != MirOp::Phi && index[op] >= index[value]
+                                        : !func->dominates(op->block, block))
+                error(val(op) + " does not dominate its use in " + val(value) + ".");
+        }
+
+        for (auto& user : value->users)
+            if (std::find(user->operands.begin(), user->operands.end(), value) == user->operands.end())
+                error(val(user) + " is listed as a user of " + val(value) + " without using it.");
+    }
+};
@@ -1,19 +1,28 @@
 #pragma once
 
+#include "ArrayKernels.h"
 #include "Value.hpp"
+#include <chrono>
 #include <ctime>
+#include <thread>
 
 std::vector<Data> native_print(int argc, Data* args)
 {
-    const char* str = args[0].valString;
+    const char* str = args[0].valString->chars;
+    size_t length = args[0].valString->length;
     size_t args_start = 1;
     size_t i = 0;
-    while (str[i] != 0)
+    while (i < length)
     {
-        const char& c = str[i++];
-        if (c == '%')
+        // The text up to the next '%' at once.
+        const char* percent = (const char*)memchr(str + i, '%', length - i);
+        size_t end = percent ? percent - str : length;
+        std::cout.write(str + i, end - i);
+        i = end;
+        if (percent)
         {
-            switch (str[i])
+            i++;
+            switch (i < length ? str[i] : 0)
             {
             case 'i':
                 std::cout << args[args_start].valInt;
@@ -28,7 +37,7 @@ std::vector<Data> native_print(int argc, Data* args)
                 std::cout << args[args_start].valChar;
                 break;
             case 's':
-                std::cout << args[args_start].valString;
+                std::cout << args[args_start].valString->view();
                 break;
             default:
                 std::cout << args[args_start].valChunk;
@@ -37,10 +46,6 @@ std::vector<Data> native_print(int argc, Data* args)
             args_start++;
             i++;
         }
-        else
-        {
-            putchar(c);
-        }
     }
 
     return {};
@@ -51,8 +56,7 @@ std::vector<Data> native_input(int argc, Data* args)
     std::string in;
     getline(std::cin, in);
     Data data;
-    data.valString = new char[in.size() + 1];
-    strcpy(data.valString, in.c_str());
+    data.valString = String::make(in);
     return {data};
 }
 
@@ -75,4 +79,171 @@ std::vector<Data> native_rand(int argc, Data* args)
     Data t;
     t.valFloat = (float)rand() / (float)RAND_MAX;
     return {t};
+}
+
+// Outside of a fiber there is nothing to switch to. Inside one the VM parks the fiber instead of
+// calling these.
+std::vector<Data> native_yield(int argc, Data* args)
+{
+    return {};
+}
+
+std::vector<Data> native_sleep(int argc, Data* args)
+{
+    if (args[0].valDouble > 0)
+        std::this_thread::sleep_for(std::chrono::duration<double>(args[0].valDouble));
+    return {};
+}
+
+// Array natives, all of them take a pointer to the first element and an element count.
+
+// The count comes from the script, a negative one touches no elements.
+inline size_t arrayCount(Data count)
+{
+    return count.valInt > 0 ? (size_t)count.valInt : 0;
+}
+
+std::vector<Data> native_fillInt(int argc, Data* args)
+{
+    getArrayKernels().fill32((uint32_t*)args[0].valPtr, (uint32_t)args[2].valInt, arrayCount(args[1]));
+    return {};
+}
+
+std::vector<Data> native_fillFloat(int argc, Data* args)
+{
+    uint32_t bits;
+    memcpy(&bits, &args[2].valFloat, sizeof(float));
+    getArrayKernels().fill32((uint32_t*)args[0].valPtr, bits, arrayCount(args[1]));
+    return {};
+}
+
+std::vector<Data> native_fillDouble(int argc, Data* args)
+{
+    uint64_t bits;
+    memcpy(&bits, &args[2].valDouble, sizeof(double));
+    getArrayKernels().fill64((uint64_t*)args[0].valPtr, bits, arrayCount(args[1]));
+    return {};
+}
+
+std::vector<Data> native_copyInt(int argc, Data* args)
+{
+    memmove(args[0].valPtr, args[1].valPtr, arrayCount(args[2]) * sizeof(int32_t));
+    return {};
+}
+
+std::vector<Data> native_copyFloat(int argc, Data* args)
+{
+    memmove(args[0].valPtr, args[1].valPtr, arrayCount(args[2]) * sizeof(float));
+    return {};
+}
+
+std::vector<Data> native_copyDouble(int argc, Data* args)
+{
+    memmove(args[0].valPtr, args[1].valPtr, arrayCount(args[2]) * sizeof(double));
+    return {};
+}
+
+std::vector<Data> native_sumInt(int argc, Data* args)
+{
+    Data d;
+    d.valInt = getArrayKernels().sumInt((int32_t*)args[0].valPtr, arrayCount(args[1]));
+    return {d};
+}
+
+std::vector<Data> native_sumFloat(int argc, Data* args)
+{
+    Data d;
+    d.valFloat = getArrayKernels().sumFloat((float*)args[0].valPtr, arrayCount(args[1]));
+    return {d};
+}
+
+std::vector<Data> native_sumDouble(int argc, Data* args)
+{
+    Data d;
+    d.valDouble = getArrayKernels().sumDouble((double*)args[0].valPtr, arrayCount(args[1]));
+    return {d};
+}
+
+std::vector<Data> native_minInt(int argc, Data* args)
+{
+    Data d;
+    d.valInt = getArrayKernels().minInt((int32_t*)args[0].valPtr, arrayCount(args[1]));
+    return {d};
+}
+
+std::vector<Data> native_maxInt(int argc, Data* args)
+{
+    Data d;
+    d.valInt = getArrayKernels().maxInt((int32_t*)args[0].valPtr, arrayCount(args[1]));
+    return {d};
+}
+
+std::vector<Data> native_minFloat(int argc, Data* args)
+{
+    Data d;
+    d.valFloat = getArrayKernels().minFloat((float*)args[0].valPtr, arrayCount(args[1]));
+    return {d};
+}
+
+std::vector<Data> native_maxFloat(int argc, Data* args)
+{
+    Data d;
+    d.valFloat = getArrayKernels().maxFloat((float*)args[0].valPtr, arrayCount(args[1]));
+    return {d};
+}
+
+std::vector<Data> native_minDouble(int argc, Data* args)
+{
+    Data d;
+    d.valDouble = getArrayKernels().minDouble((double*)args[0].valPtr, arrayCount(args[1]));
+    return {d};
+}
+
+std::vector<Data> native_maxDouble(int argc, Data* args)
+{
+    Data d;
+    d.valDouble = getArrayKernels().maxDouble((double*)args[0].valPtr, arrayCount(args[1]));
+    return {d};
+}
+
+std::vector<Data> native_dotInt(int argc, Data* args)
+{
+    Data d;
+    d.valInt = getArrayKernels().dotInt((int32_t*)args[0].valPtr, (int32_t*)args[1].valPtr, arrayCount(args[2]));
+    return {d};
+}
+
+std::vector<Data> native_dotFloat(int argc, Data* args)
+{
+    Data d;
+    d.valFloat = getArrayKernels().dotFloat((float*)args[0].valPtr, (float*)args[1].valPtr, arrayCount(args[2]));
+    return {d};
+}
+
+std::vector<Data> native_dotDouble(int argc, Data* args)
+{
+    Data d;
+    d.valDouble = getArrayKernels().dotDouble((double*)args[0].valPtr, (double*)args[1].valPtr, arrayCount(args[2]));
+    return {d};
+}
+
+std::vector<Data> native_compareInt(int argc, Data* args)
+{
+    Data d;
+    d.valInt = (int32_t)getArrayKernels().compareInt((int32_t*)args[0].valPtr, (int32_t*)args[1].valPtr, arrayCount(args[2]));
+    return {d};
+}
+
+std::vector<Data> native_compareFloat(int argc, Data* args)
+{
+    Data d;
+    d.valInt = (int32_t)getArrayKernels().compareFloat((float*)args[0].valPtr, (float*)args[1].valPtr, arrayCount(args[2]));
+    return {d};
+}
+
+std::vector<Data> native_compareDouble(int argc, Data* args)
+{
+    Data d;
+    d.valInt = (int32_t)getArrayKernels().compareDouble((double*)args[0].valPtr, (double*)args[1].valPtr, arrayCount(args[2]));
+    return {d};
 }
\ No newline at end of file
@@ -1,32 +1,111 @@
 #include "Parser.h"
 #include "AST.h"
 #include "Enviroment.hpp"
+#include "Fiber.h"
 #include "Natives.hpp"
 #include "Value.hpp"
 
+#include <array>
+#include <mutex>
+
+namespace
+{
+constexpr TokenSet assignmentOperators{TokenType::EQUAL, TokenType::PLUS_EQUAL, TokenType::MINUS_EQUAL, TokenType::STAR_EQUAL, TokenType::SLASH_EQUAL,
+                                       TokenType::BIT_AND_EQUAL, TokenType::BIT_OR_EQUAL, TokenType::BIT_XOR_EQUAL, TokenType::BITSHIFT_LEFT_EQUAL,
+                                       TokenType::BITSHIFT_RIGHT_EQUAL};
+constexpr TokenSet prefixOperators{TokenType::MINUS, TokenType::PLUS, TokenType::MINUS_MINUS, TokenType::PLUS_PLUS};
+constexpr TokenSet unaryOperators{TokenType::BANG, TokenType::TILDE};
+constexpr TokenSet spawnOperators{TokenType::SPAWN, TokenType::FIBER};
+constexpr TokenSet postfixOperators{TokenType::OPEN_PAREN, TokenType::OPEN_BRACKET, TokenType::DOT, TokenType::ARROW};
+
+// Binding power of the binary operators, from loosest to tightest. 0 is not a binary operator.
+const int OR_PRECEDENCE = 1;
+const int AND_PRECEDENCE = 2;
+
+constexpr std::array<uint8_t, (size_t)TokenType::EOF_TOKEN + 1> makeBinaryPrecedence()
+{
+    std::array<uint8_t, (size_t)TokenType::EOF_TOKEN + 1> table{};
+    table[(size_t)TokenType::OR] = OR_PRECEDENCE;
+    table[(size_t)TokenType::AND] = AND_PRECEDENCE;
+    table[(size_t)TokenType::BIT_OR] = 3;
+    table[(size_t)TokenType::BIT_XOR] = 4;
+    table[(size_t)TokenType::BIT_AND] = 5;
+    table[(size_t)TokenType::EQUAL_EQUAL] = table[(size_t)TokenType::BANG_EQUAL] = 6;
+    table[(size_t)TokenType::LESS] = table[(size_t)TokenType::LESS_EQUAL] = 7;
+    table[(size_t)TokenType::GREAT] = table[(size_t)TokenType::GREAT_EQUAL] = 7;
+    table[(size_t)TokenType::BITSHIFT_LEFT] = table[(size_t)TokenType::BITSHIFT_RIGHT] = 8;
+    table[(size_t)TokenType::PLUS] = table[(size_t)TokenType::MINUS] = 9;
+    table[(size_t)TokenType::STAR] = table[(size_t)TokenType::SLASH] = table[(size_t)TokenType::MODULUS] = 10;
+    return table;
+}
+
+constexpr std::array<uint8_t, (size_t)TokenType::EOF_TOKEN + 1> binaryPrecedence = makeBinaryPrecedence();
+} // namespace
+
 Parser::Parser()
-    : currentToken(0), depth(0), currentNamespace(new EnvNamespace("", nullptr)), cont(true)
+    : tokens(nullptr), currentToken(0), depth(0), currentNamespace(new EnvNamespace("", nullptr)), cont(true), nodes(0)
 {
-    std::vector<std::shared_ptr<Type>> s = {std::make_shared<TypePrimitive>(TypeTag::STRING)};
-    std::shared_ptr<TypeFunction> v2s = std::make_shared<TypeFunction>(TypeTag::NATIVE, std::make_shared<TypePrimitive>(TypeTag::VOID), s, true);
-    std::shared_ptr<TypeFunction> sr = std::make_shared<TypeFunction>(TypeTag::NATIVE, std::make_shared<TypePrimitive>(TypeTag::STRING), std::vector<std::shared_ptr<Type>>(), false);
-    std::shared_ptr<TypeFunction> dr = std::make_shared<TypeFunction>(TypeTag::NATIVE, std::make_shared<TypePrimitive>(TypeTag::DOUBLE), std::vector<std::shared_ptr<Type>>(), false);
-    std::shared_ptr<TypeFunction> ir = std::make_shared<TypeFunction>(TypeTag::NATIVE, std::make_shared<TypePrimitive>(TypeTag::INTEGER), std::vector<std::shared_ptr<Type>>(), false);
-    std::shared_ptr<TypeFunction> fr = std::make_shared<TypeFunction>(TypeTag::NATIVE, std::make_shared<TypePrimitive>(TypeTag::FLOAT), std::vector<std::shared_ptr<Type>>(), false);
+    std::vector<Type*> s = {TypeContext::primitive(TypeTag::STRING)};
+    TypeFunction* v2s = TypeContext::function(TypeTag::NATIVE, TypeContext::primitive(TypeTag::VOID), s, true);
+    TypeFunction* sr = TypeContext::function(TypeTag::NATIVE, TypeContext::primitive(TypeTag::STRING), std::vector<Type*>(), false);
+    TypeFunction* dr = TypeContext::function(TypeTag::NATIVE, TypeContext::primitive(TypeTag::DOUBLE), std::vector<Type*>(), false);
+    TypeFunction* ir = TypeContext::function(TypeTag::NATIVE, TypeContext::primitive(TypeTag::INTEGER), std::vector<Type*>(), false);
+    TypeFunction* fr = TypeContext::function(TypeTag::NATIVE, TypeContext::primitive(TypeTag::FLOAT), std::vector<Type*>(), false);
 
     currentNamespace->define("print", v2s, new NativeFunc(native_print, v2s));
     currentNamespace->define("input", sr, new NativeFunc(native_input, sr));
     currentNamespace->define("clock", dr, new NativeFunc(native_clock, dr));
     currentNamespace->define("inputInt", ir, new NativeFunc(native_inputInt, ir));
     currentNamespace->define("rand", fr, new NativeFunc(native_rand, fr));
+
+    Type* v = TypeContext::primitive(TypeTag::VOID);
+    TypeFunction* vr = TypeContext::function(TypeTag::NATIVE, v, std::vector<Type*>(), false);
+    TypeFunction* d2v = TypeContext::function(TypeTag::NATIVE, v, std::vector<Type*>{TypeContext::primitive(TypeTag::DOUBLE)}, false);
+    currentNamespace->define("yield", vr, new NativeFunc(native_yield, vr));
+    currentNamespace->define("sleep", d2v, new NativeFunc(native_sleep, d2v));
+
+    // Once per process, VMs of programs compiled before read the table while this one parses.
+    static std::once_flag blockingDefined;
+    std::call_once(blockingDefined, []() {
+        defineBlocking(native_input, WaitKind::INPUT);
+        defineBlocking(native_inputInt, WaitKind::INPUT);
+        defineBlocking(native_yield, WaitKind::NONE);
+        defineBlocking(native_sleep, WaitKind::TIME);
+    });
     srand(time(NULL));
 
+    defineArrayNatives(TypeTag::INTEGER, "Int", native_fillInt, native_copyInt, native_sumInt, native_minInt, native_maxInt, native_dotInt, native_compareInt);
+    defineArrayNatives(TypeTag::FLOAT, "Float", native_fillFloat, native_copyFloat, native_sumFloat, native_minFloat, native_maxFloat, native_dotFloat, native_compareFloat);
+    defineArrayNatives(TypeTag::DOUBLE, "Double", native_fillDouble, native_copyDouble, native_sumDouble, native_minDouble, native_maxDouble, native_dotDouble, native_compareDouble);
+
     allNamespaces.insert({"", currentNamespace});
 }
 
-StmtCompUnit* Parser::parseUnit(std::vector<Token> tokens)
+void Parser::defineArrayNatives(TypeTag elem, const std::string& suffix, NativeFn fill, NativeFn copy, NativeFn sum, NativeFn min, NativeFn max, NativeFn dot, NativeFn compare)
 {
-    this->tokens = tokens;
+    Type* e = TypeContext::primitive(elem);
+    Type* i = TypeContext::primitive(TypeTag::INTEGER);
+    Type* v = TypeContext::primitive(TypeTag::VOID);
+    Type* p = TypeContext::pointer(false, e);
+
+    TypeFunction* fillType = TypeContext::function(TypeTag::NATIVE, v, std::vector<Type*>{p, i, e}, false);
+    TypeFunction* copyType = TypeContext::function(TypeTag::NATIVE, v, std::vector<Type*>{p, p, i}, false);
+    TypeFunction* reduceType = TypeContext::function(TypeTag::NATIVE, e, std::vector<Type*>{p, i}, false);
+    TypeFunction* dotType = TypeContext::function(TypeTag::NATIVE, e, std::vector<Type*>{p, p, i}, false);
+    TypeFunction* compareType = TypeContext::function(TypeTag::NATIVE, i, std::vector<Type*>{p, p, i}, false);
+
+    currentNamespace->define("fill" + suffix, fillType, new NativeFunc(fill, fillType));
+    currentNamespace->define("copy" + suffix, copyType, new NativeFunc(copy, copyType));
+    currentNamespace->define("sum" + suffix, reduceType, new NativeFunc(sum, reduceType));
+    currentNamespace->define("min" + suffix, reduceType, new NativeFunc(min, reduceType));
+    currentNamespace->define("max" + suffix, reduceType, new NativeFunc(max, reduceType));
+    currentNamespace->define("dot" + suffix, dotType, new NativeFunc(dot, dotType));
+    currentNamespace->define("compare" + suffix, compareType, new NativeFunc(compare, compareType));
+}
+
+StmtCompUnit* Parser::parseUnit(std::vector<Token>& tokens)
+{
+    this->tokens = tokens.data();
     this->currentToken = 0;
     this->depth = 0;
 
@@ -36,7 +115,7 @@ StmtCompUnit* Parser::parseUnit(std::vector<Token> tokens)
         root.push_back(decleration());
     }
 
-    return new StmtCompUnit(root);
+    return make<StmtCompUnit>(root);
 }
 
 void Parser::parseNamespaceInside(EnvNamespace* ns, std::vector<Token>& t, int& i)
@@ -46,7 +125,7 @@ void Parser::parseNamespaceInside(EnvNamespace* ns, std::vector<Token>& t, int&
         if (t[i].type == TokenType::STRUCT && t[i + 1].type == TokenType::IDENTIFIER)
         {
             i++; // at name
-            userTypes.insert({ns->getName() + "::" + t[i].getString(), std::make_shared<TypeStruct>(t[i])});
+            userTypes.insert({ns->getName() + "::" + t[i].getString(), new TypeStruct(t[i])});
             i++; // at open brace
             while (t[i].type != TokenType::CLOSE_BRACE)
                 i++;
@@ -74,7 +153,7 @@ void Parser::parseNamespaceInside(EnvNamespace* ns, std::vector<Token>& t, int&
     }
 }
 
-void Parser::parseUserDefinedTypes(std::vector<Token> t)
+void Parser::parseUserDefinedTypes(std::vector<Token>& t)
 {
     EnvNamespace* ns = currentNamespace;
     int i = 0;
@@ -85,16 +164,16 @@ void Parser::parseUserDefinedTypes(std::vector<Token> t)
     }
 }
 
-std::shared_ptr<Type> Parser::parseTypeName()
+Type* Parser::parseTypeName()
 {
-    std::shared_ptr<Type> type;
+    Type* type;
     TypeTag tag = getDataType();
 
     if (tag == TypeTag::ERROR)
         errorAtToken("Invalid type name.");
 
     if (tag <= TypeTag::ARRAY)
-        type = std::make_shared<TypePrimitive>(tag);
+        type = TypeContext::primitive(tag);
     else if (tag == TypeTag::STRUCT)
         type = lastType;
     else
@@ -106,14 +185,16 @@ std::shared_ptr<Type> Parser::parseTypeName()
             errorAtToken("Invalid type decleration.");
         else if (tag == TypeTag::ARRAY)
         {
-            type = std::make_shared<TypeArray>(consumed().getInteger(), type);
+            type = TypeContext::array(consumed().getInteger(), type);
             advance();
         }
         else if (tag == TypeTag::POINTER)
         {
             bool is_owner = consumed().type == TokenType::BIT_AND;
-            type = std::make_shared<TypePointer>(is_owner, type);
+            type = TypeContext::pointer(is_owner, type);
         }
+        else if (tag == TypeTag::TASK)
+            type = TypeContext::task(type);
     }
 
     return type;
@@ -177,6 +258,9 @@ TypeTag Parser::getDataType()
     case TokenType::BIT_AND:
         advance();
         return TypeTag::POINTER;
+    case TokenType::TASK:
+        advance();
+        return TypeTag::TASK;
     case TokenType::OPEN_BRACKET:
         advance();
         if (peek().type == TokenType::INTEGER_LITERAL && peekNext().type == TokenType::CLOSE_BRACKET)
@@ -236,13 +320,14 @@ bool Parser::match(TokenType type)
     return false;
 }
 
-bool Parser::match(std::vector<TokenType> types)
+bool Parser::match(const TokenSet& types)
 {
-    for (auto& token : types)
+    if (types.contains(tokens[currentToken].type))
     {
-        if (match(token))
-            return true;
+        currentToken++;
+        return true;
     }
+
     return false;
 }
 
@@ -252,10 +337,10 @@ bool Parser::matchCast()
     return tokens[currentToken].type == TokenType::OPEN_PAREN && isTypeName(tokens[currentToken + 1]) && tokens[currentToken + 2].type == TokenType::CLOSE_PAREN;
 }
 
-std::shared_ptr<Type> Parser::getCast()
+Type* Parser::getCast()
 {
     advance();
-    std::shared_ptr<Type> to = this->parseTypeName();
+    Type* to = this->parseTypeName();
     consume(TokenType::CLOSE_PAREN, "Expect ')' after cast type.");
     return to;
 }
@@ -336,10 +421,10 @@ Stmt* Parser::decleration()
     }
     else
     {
-        std::shared_ptr<Type> typeName;
+        Type* typeName;
         if (peek().type == TokenType::VAR)
         {
-            typeName = std::make_shared<TypePrimitive>(TypeTag::AUTO);
+            typeName = TypeContext::primitive(TypeTag::AUTO);
             advance();
         }
         else
@@ -362,15 +447,15 @@ Stmt* Parser::structDecleration()
 {
     Token classTok = advance();
     Token name = advance();
-    std::shared_ptr<TypeStruct> type = userTypes[currentNamespace->getName() + "::" + name.getString()];
+    TypeStruct* type = userTypes[currentNamespace->getName() + "::" + name.getString()];
     consume(TokenType::OPEN_BRACE, "Expect '{' after a class decleration.");
 
-    StmtStruct* stmtClass = new StmtStruct(type, name);
+    StmtStruct* stmtClass = make<StmtStruct>(type, name);
     std::unordered_map<std::string, StmtFunc*> methodes;
 
     while (isTypeName(peek()))
     {
-        std::shared_ptr<Type> typeName = parseTypeName();
+        Type* typeName = parseTypeName();
         Token varName = advance();
         consume(TokenType::SEMI_COLON, "Expect ';' after member variable decleration.");
         stmtClass->type->addMember(typeName, varName);
@@ -400,10 +485,10 @@ Stmt* Parser::namespaceDecleration()
 
     currentNamespace = currentNamespace->closing;
 
-    return new StmtNamespace(name, stmts);
+    return make<StmtNamespace>(name, stmts);
 }
 
-Stmt* Parser::variableDecleration(std::shared_ptr<Type> type)
+Stmt* Parser::variableDecleration(Type* type)
 {
     Token varName = advance();
     Expr* init = nullptr;
@@ -412,8 +497,8 @@ Stmt* Parser::variableDecleration(std::shared_ptr<Type> type)
         if (match(TokenType::HEAP))
         {
             Token token = consumed();
-            std::shared_ptr<Type> type = parseTypeName();
-            init = new ExprHeap(type, token);
+            Type* type = parseTypeName();
+            init = make<ExprHeap>(type, token);
         }
         else
             init = parseExpression();
@@ -426,14 +511,14 @@ Stmt* Parser::variableDecleration(std::shared_ptr<Type> type)
         currentNamespace->define(varName.getString(), type, new Value(type));
     }
 
-    return new StmtVarDecleration(type, varName, init);
+    return make<StmtVarDecleration>(type, varName, init);
 }
 
-Stmt* Parser::functionDecleration(std::shared_ptr<Type> type)
+Stmt* Parser::functionDecleration(Type* type)
 {
     Token funcName = advance();
     std::vector<Token> params;
-    std::vector<std::shared_ptr<Type>> param_types;
+    std::vector<Type*> param_types;
     size_t totalSize = 0;
 
     this->depth++;
@@ -441,7 +526,7 @@ Stmt* Parser::functionDecleration(std::shared_ptr<Type> type)
 
     if (peek().type != TokenType::CLOSE_PAREN)
     {
-        std::shared_ptr<Type> type = parseTypeName();
+        Type* type = parseTypeName();
         Token name = advance();
         params.push_back(name);
         param_types.push_back(type);
@@ -450,7 +535,7 @@ Stmt* Parser::functionDecleration(std::shared_ptr<Type> type)
     while (!match(TokenType::CLOSE_PAREN))
     {
         consume(TokenType::COMMA, "Expect ',' between parameters."); // consume ','
-        std::shared_ptr<Type> type = parseTypeName();
+        Type* type = parseTypeName();
         Token name = advance();
         params.push_back(name);
         param_types.push_back(type);
@@ -460,12 +545,12 @@ Stmt* Parser::functionDecleration(std::shared_ptr<Type> type)
     consume(TokenType::OPEN_BRACE, "Expect '{' at function start."); // Opening {
     StmtBlock* body = (StmtBlock*)block();
 
-    std::shared_ptr<TypeFunction> funcType = std::make_shared<TypeFunction>(TypeTag::FUNCTION, type, param_types, false);
+    TypeFunction* funcType = TypeContext::function(TypeTag::FUNCTION, type, param_types, false);
 
     this->depth--;
     currentNamespace->define(funcName.getString(), funcType, new FuncValue(funcType));
 
-    return new StmtFunc(funcName, body, funcType, params);
+    return make<StmtFunc>(funcName, body, funcType, params);
 }
 
 Stmt* Parser::statement()
@@ -492,13 +577,13 @@ Stmt* Parser::statement()
         advance();
         Expr* ret = parseExpression();
         consume(TokenType::SEMI_COLON, "Expect ';' after a return statement.");
-        return new StmtReturn(ret);
+        return make<StmtReturn>(ret);
     }
     else
     {
         Expr* expr = parseExpression();
         consume(TokenType::SEMI_COLON, "Expect ';' after an expression statement.");
-        return new StmtExpr(expr);
+        return make<StmtExpr>(expr);
     }
 }
 
@@ -512,14 +597,14 @@ Stmt* Parser::block()
         if (isTypeName(peek()))
             stmts.push_back(variableDecleration(parseTypeName()));
         else if (match(TokenType::VAR))
-            stmts.push_back(variableDecleration(std::make_shared<TypePrimitive>(TypeTag::AUTO)));
+            stmts.push_back(variableDecleration(TypeContext::primitive(TypeTag::AUTO)));
         else
             stmts.push_back(statement());
     }
     consume(TokenType::CLOSE_BRACE, "Expect '}' after a block.");
 
     this->depth--;
-    return new StmtBlock(stmts);
+    return make<StmtBlock>(stmts);
 }
 
 Stmt* Parser::ifStatement()
@@ -533,7 +618,7 @@ Stmt* Parser::ifStatement()
     Stmt* els = nullptr;
     if (match(TokenType::ELSE))
         els = statement();
-    return new StmtIf(condition, then, els, paren);
+    return make<StmtIf>(condition, then, els, paren);
 }
 
 Stmt* Parser::forStatement()
@@ -550,7 +635,7 @@ Stmt* Parser::forStatement()
             decl = variableDecleration(parseTypeName());
         else
         {
-            decl = new StmtExpr(parseExpression());
+            decl = make<StmtExpr>(parseExpression());
             consume(TokenType::SEMI_COLON, "Expect ';' after first part of 'for' statement.");
         }
     }
@@ -562,7 +647,7 @@ Stmt* Parser::forStatement()
     }
     else
     {
-        cond = new ExprLiteral(new Value(true));
+        cond = make<ExprLiteral>(new Value(true));
     }
 
     if (peek().type != TokenType::CLOSE_PAREN)
@@ -573,7 +658,7 @@ Stmt* Parser::forStatement()
     consume(TokenType::CLOSE_PAREN, "Expect ')' after 'for' conditions.");
 
     Stmt* loop = statement();
-    return new StmtFor(decl, cond, inc, loop, paren);
+    return make<StmtFor>(decl, cond, inc, loop, paren);
 }
 
 Stmt* Parser::whileStatement()
@@ -584,7 +669,7 @@ Stmt* Parser::whileStatement()
     Expr* condition = parseExpression();
     consume(TokenType::CLOSE_PAREN, "Expect ')' after 'while' condition.");
     Stmt* loop = statement();
-    return new StmtWhile(condition, loop, paren);
+    return make<StmtWhile>(condition, loop, paren);
 }
 
 Expr* Parser::parseExpression()
@@ -594,10 +679,9 @@ Expr* Parser::parseExpression()
 
 Expr* Parser::assignment()
 {
-    Expr* expr = logic_or();
+    Expr* expr = binary(OR_PRECEDENCE);
 
-    if (match({TokenType::EQUAL, TokenType::PLUS_EQUAL, TokenType::MINUS_EQUAL, TokenType::STAR_EQUAL, TokenType::SLASH_EQUAL,
-               TokenType::BIT_AND_EQUAL, TokenType::BIT_OR_EQUAL, TokenType::BIT_XOR_EQUAL, TokenType::BITSHIFT_LEFT_EQUAL, TokenType::BITSHIFT_RIGHT_EQUAL}))
+    if (match(assignmentOperators))
     {
         Token t = consumed();
         Expr* asgn;
@@ -605,8 +689,8 @@ Expr* Parser::assignment()
         if (match(TokenType::HEAP))
         {
             Token token = consumed();
-            std::shared_ptr<Type> type = parseTypeName();
-            asgn = new ExprHeap(type, token);
+            Type* type = parseTypeName();
+            asgn = make<ExprHeap>(type, token);
         }
         else
             asgn = parseExpression();
@@ -643,29 +727,29 @@ Expr* Parser::assignment()
         }
 
         if (t.type != TokenType::EQUAL)
-            asgn = new ExprBinary(expr, asgn, t);
+            asgn = make<ExprBinary>(expr, asgn, t);
 
         if (expr->instance == ExprType::Variable)
         {
             Token name = ((ExprVariable*)expr)->name;
-            return new ExprAssignment(name, asgn);
+            return make<ExprAssignment>(name, asgn);
         }
         else if (expr->instance == ExprType::ArrGet)
         {
             ExprArrGet* e = (ExprArrGet*)expr;
-            expr = new ExprArrSet(e->callee, e->index, asgn, e->bracket);
+            expr = make<ExprArrSet>(e->callee, e->index, asgn, e->bracket);
             return expr;
         }
         else if (expr->instance == ExprType::GetDeref)
         {
             ExprGetDeref* e = (ExprGetDeref*)expr;
-            expr = new ExprSetDeref(e->callee, asgn, e->token, t);
+            expr = make<ExprSetDeref>(e->callee, asgn, e->token, t);
             return expr;
         }
         else if (expr->instance == ExprType::Get)
         {
             ExprGet* e = (ExprGet*)expr;
-            expr = new ExprSet(e->callee, asgn, e->get);
+            expr = make<ExprSet>(e->callee, asgn, e->get);
             return expr;
         }
 
@@ -675,139 +759,31 @@ Expr* Parser::assignment()
     return expr;
 }
 
-Expr* Parser::logic_or()
-{
-    Expr* left = logic_and();
-    while (match(TokenType::OR))
-    {
-        Token op = consumed();
-        Expr* right = logic_and();
-        left = new ExprLogic(left, right, op);
-    }
-    return left;
-}
-
-Expr* Parser::logic_and()
-{
-    Expr* left = bit_or();
-    while (match(TokenType::AND))
-    {
-        Token op = consumed();
-        Expr* right = bit_or();
-        left = new ExprLogic(left, right, op);
-    }
-    return left;
-}
-
-Expr* Parser::bit_or()
-{
-    Expr* left = bit_xor();
-    while (match(TokenType::BIT_OR))
-    {
-        Token op = consumed();
-        Expr* right = bit_xor();
-        left = new ExprBinary(left, right, op);
-    }
-    return left;
-}
-
-Expr* Parser::bit_xor()
-{
-    Expr* left = bit_and();
-    while (match(TokenType::BIT_XOR))
-    {
-        Token op = consumed();
-        Expr* right = bit_and();
-        left = new ExprBinary(left, right, op);
-    }
-    return left;
-}
-
-Expr* Parser::bit_and()
-{
-    Expr* left = equality();
-    while (match(TokenType::BIT_AND))
-    {
-        Token op = consumed();
-        Expr* right = equality();
-        left = new ExprBinary(left, right, op);
-    }
-    return left;
-}
-
-Expr* Parser::equality()
-{
-    Expr* left = comparison();
-    while (match(TokenType::EQUAL_EQUAL) || match(TokenType::BANG_EQUAL))
-    {
-        Token op = consumed();
-        Expr* right = comparison();
-
-        left = new ExprBinary(left, right, op);
-    }
-    return left;
-}
-
-Expr* Parser::comparison()
-{
-    Expr* left = bitshift();
-    while (match(TokenType::LESS) || match(TokenType::LESS_EQUAL) || match(TokenType::GREAT) || match(TokenType::GREAT_EQUAL))
-    {
-        Token op = consumed();
-        Expr* right = bitshift();
-
-        left = new ExprBinary(left, right, op);
-    }
-    return left;
-}
-
-Expr* Parser::bitshift()
-{
-    Expr* left = addition();
-    while (match(TokenType::BITSHIFT_LEFT) || match(TokenType::BITSHIFT_RIGHT))
-    {
-        Token op = consumed();
-        Expr* right = addition();
-        left = new ExprBinary(left, right, op);
-    }
-    return left;
-}
-
-Expr* Parser::addition()
-{
-    Expr* left = multiplication();
-    while (match(TokenType::PLUS) || match(TokenType::MINUS))
-    {
-        Token op = consumed();
-        Expr* right = multiplication();
-
-        left = new ExprBinary(left, right, op);
-    }
-
-    return left;
-}
-
-Expr* Parser::multiplication()
+Expr* Parser::binary(int precedence)
 {
     Expr* left = prefix();
-    while (match(TokenType::STAR) || match(TokenType::SLASH) || match(TokenType::MODULUS))
-    {
-        Token op = consumed();
-        Expr* right = prefix();
-
-        left = new ExprBinary(left, right, op);
+    int next = binaryPrecedence[(size_t)peek().type];
+    // All binary operators are left associative, so the right side only takes tighter ones.
+    while (next >= precedence)
+    {
+        Token op = advance();
+        Expr* right = binary(next + 1);
+        if (next <= AND_PRECEDENCE)
+            left = make<ExprLogic>(left, right, op);
+        else
+            left = make<ExprBinary>(left, right, op);
+        next = binaryPrecedence[(size_t)peek().type];
     }
-
     return left;
 }
 
 Expr* Parser::prefix()
 {
-    if (match(TokenType::MINUS) || match(TokenType::PLUS) || match(TokenType::MINUS_MINUS) || match(TokenType::PLUS_PLUS))
+    if (match(prefixOperators))
     {
         Token op = consumed();
         Expr* expr = unary();
-        return new ExprUnary(expr, op);
+        return make<ExprUnary>(expr, op);
     }
     else
         return unary();
@@ -815,41 +791,55 @@ Expr* Parser::prefix()
 
 Expr* Parser::unary()
 {
-    if (match(TokenType::BANG) || match(TokenType::TILDE))
+    if (match(unaryOperators))
     {
         Token op = consumed();
         Expr* expr = unary();
-        return new ExprUnary(expr, op);
+        return make<ExprUnary>(expr, op);
     }
     else if (match(TokenType::BIT_XOR))
     {
         Token token = consumed();
         Expr* expr = unary();
-        return new ExprGetDeref(expr, token);
+        return make<ExprGetDeref>(expr, token);
     }
     else if (match(TokenType::REF))
     {
         Token token = consumed();
         Expr* expr = unary();
-        return new ExprRef(expr, token);
+        return make<ExprRef>(expr, token);
     }
     else if (match(TokenType::TAKE))
     {
         Token token = consumed();
         Expr* expr = unary();
-        return new ExprTake(expr, token);
+        return make<ExprTake>(expr, token);
     }
     else if (match(TokenType::BIT_AND))
     {
         Token token = consumed();
         Expr* expr = unary();
-        return new ExprAddr(expr, token);
+        return make<ExprAddr>(expr, token);
+    }
+    else if (match(spawnOperators))
+    {
+        Token token = consumed();
+        Expr* expr = unary();
+        if (expr == nullptr || expr->instance != ExprType::Call)
+            return typeError(token.type == TokenType::FIBER ? "Expect a call after 'fiber'." : "Expect a call after 'spawn'.");
+        return make<ExprSpawn>((ExprCall*)expr, token);
+    }
+    else if (match(TokenType::JOIN))
+    {
+        Token token = consumed();
+        Expr* expr = unary();
+        return make<ExprJoin>(expr, token);
     }
     else if (matchCast())
     {
-        std::shared_ptr<Type> type = getCast();
+        Type* type = getCast();
         Expr* expr = unary();
-        return new ExprCast(type, expr);
+        return make<ExprCast>(type, expr);
     }
     else
         return postfix();
@@ -865,7 +855,7 @@ Expr* Parser::call()
 {
     Expr* expr = primary();
 
-    while (match({TokenType::OPEN_PAREN, TokenType::OPEN_BRACKET, TokenType::DOT, TokenType::ARROW}))
+    while (match(postfixOperators))
     {
         Token token = consumed();
         if (token.type == TokenType::OPEN_PAREN)
@@ -876,7 +866,7 @@ Expr* Parser::call()
             {
                 ExprGet* get = (ExprGet*)expr;
                 args.push_back(get->callee);
-                callee = new ExprVariable(get->get);
+                callee = make<ExprVariable>(get->get);
             }
 
             if (peek().type != TokenType::CLOSE_PAREN)
@@ -887,23 +877,23 @@ Expr* Parser::call()
                 } while (match(TokenType::COMMA));
             }
             consume(TokenType::CLOSE_PAREN, "Expect ')' after arguments.");
-            expr = new ExprCall(callee, args, token);
+            expr = make<ExprCall>(callee, args, token);
         }
         else if (token.type == TokenType::OPEN_BRACKET)
         {
             Expr* index = parseExpression();
             consume(TokenType::CLOSE_BRACKET, "Expect ']' after array indexing.");
-            expr = new ExprArrGet(expr, index, token);
+            expr = make<ExprArrGet>(expr, index, token);
         }
         else if (token.type == TokenType::DOT)
         {
             Token get = advance();
-            expr = new ExprGet(expr, get);
+            expr = make<ExprGet>(expr, get);
         }
         else if (token.type == TokenType::ARROW)
         {
             Token get = advance();
-            expr = new ExprGet(new ExprGetDeref(expr, get), get);
+            expr = make<ExprGet>(make<ExprGetDeref>(expr, get), get);
         }
     }
 
@@ -917,19 +907,19 @@ Expr* Parser::primary()
     switch (token.type)
     {
     case TokenType::TRUE:
-        return new ExprLiteral(new Value(true));
+        return make<ExprLiteral>(new Value(true));
     case TokenType::FALSE:
-        return new ExprLiteral(new Value(false));
+        return make<ExprLiteral>(new Value(false));
     case TokenType::INTEGER_LITERAL:
-        return new ExprLiteral(new Value(token.getInteger()));
+        return make<ExprLiteral>(new Value(token.getInteger()));
     case TokenType::DOUBLE_LITERAL:
-        return new ExprLiteral(new Value(token.getDouble()));
+        return make<ExprLiteral>(new Value(token.getDouble()));
     case TokenType::FLOAT_LITERAL:
-        return new ExprLiteral(new Value(token.getFloat()));
+        return make<ExprLiteral>(new Value(token.getFloat()));
     case TokenType::CHAR_LITERAL:
-        return new ExprLiteral(new Value(token.getChar()));
+        return make<ExprLiteral>(new Value(token.getChar()));
     case TokenType::STRING_LITERAL:
-        return new ExprLiteral(new Value(token.getString()));
+        return make<ExprLiteral>(new Value(token.getString()));
     case TokenType::OPEN_PAREN:
     {
         Expr* a = parseExpression();
@@ -940,7 +930,7 @@ Expr* Parser::primary()
     }
 
     case TokenType::IDENTIFIER:
-        return new ExprVariable(token);
+        return make<ExprVariable>(token);
 
     default:
         std::cout << "[Error]Invalid identifier: " << token.getString() << std::endl;
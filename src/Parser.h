@@ -2,9 +2,11 @@
 
 #include "AST.h"
 #include "Scanner.h"
+#include "TokenSet.hpp"
 #include "Value.hpp"
 
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 class Expr;
@@ -14,26 +16,36 @@ class Parser
 {
 public:
     Parser();
-    StmtCompUnit* parseUnit(std::vector<Token> tokens);
-    void parseUserDefinedTypes(std::vector<Token> tokens);
+    // The tokens are used in place, they must outlive the parsing.
+    StmtCompUnit* parseUnit(std::vector<Token>& tokens);
+    void parseUserDefinedTypes(std::vector<Token>& tokens);
     EnvNamespace* currentNamespace;
     std::unordered_map<std::string, EnvNamespace*> allNamespaces;
     int depth;
     bool cont;
+    size_t nodes; // AST nodes made so far, for -stats
 
 private:
-    std::vector<Token> tokens;
+    Token* tokens; // of the unit being parsed, ending with EOF_TOKEN
     size_t currentToken;
-    std::unordered_map<std::string, std::shared_ptr<TypeStruct>> userTypes;
+    std::unordered_map<std::string, TypeStruct*> userTypes;
 
-    std::shared_ptr<Type> lastType;
-    std::shared_ptr<Type> parseTypeName();
+    Type* lastType;
+    Type* parseTypeName();
     bool isTypeName(Token& token);
     TypeTag getDataType();
     void consume(TokenType type, const char* message);
     void consumeNext(TokenType type, const char* message);
 
+    template <typename Node, typename... Args>
+    inline Node* make(Args&&... args)
+    {
+        nodes++;
+        return new Node(std::forward<Args>(args)...);
+    }
+
 	void parseNamespaceInside(EnvNamespace* ns, std::vector<Token>& t, int& i);
+    void defineArrayNatives(TypeTag elem, const std::string& suffix, NativeFn fill, NativeFn copy, NativeFn sum, NativeFn min, NativeFn max, NativeFn dot, NativeFn compare);
 
     inline Token& advance()
     {
@@ -52,9 +64,9 @@ private:
         return this->tokens[this->currentToken + 1];
     }
     bool match(TokenType type);
-    bool match(std::vector<TokenType> types);
+    bool match(const TokenSet& types);
     bool matchCast();
-    std::shared_ptr<Type> getCast();
+    Type* getCast();
 
 	inline Expr* typeError(const char* message);
 	inline void error(const char* message);
@@ -64,8 +76,8 @@ private:
     Stmt* decleration();
     Stmt* structDecleration();
     Stmt* namespaceDecleration();
-    Stmt* variableDecleration(std::shared_ptr<Type> type);
-    Stmt* functionDecleration(std::shared_ptr<Type> type);
+    Stmt* variableDecleration(Type* type);
+    Stmt* functionDecleration(Type* type);
     Stmt* statement();
     Stmt* block();
     Stmt* ifStatement();
@@ -74,16 +86,8 @@ private:
 
     Expr* parseExpression();
     Expr* assignment();
-    Expr* logic_or();
-    Expr* logic_and();
-    Expr* bit_or();
-    Expr* bit_xor();
-    Expr* bit_and();
-    Expr* equality();
-    Expr* comparison();
-    Expr* bitshift();
-    Expr* addition();
-    Expr* multiplication();
+    // Parses the binary operators binding at least as tight as 'precedence', by climbing the table.
+    Expr* binary(int precedence);
     Expr* prefix();
     Expr* unary();
     Expr* postfix();
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "MemStats.h"
+
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Wall and CPU time of the compiler phases and the run, printed by -time-passes. CPU time is that of
+// the whole process, so it includes the background threads of the tier and the task pool. The phases
+// are also the ones -memstats counts the allocations of.
+class PassTimer
+{
+private:
+    struct Phase
+    {
+        std::string name;
+        double wall;
+        double cpu;
+    };
+
+    std::vector<Phase> phases;
+    std::chrono::steady_clock::time_point wallStart;
+    std::clock_t cpuStart;
+    std::string current;
+
+public:
+    bool enabled = false;
+
+    void start(const std::string& name)
+    {
+        MemStats::enter(name);
+        if (!enabled)
+            return;
+        current = name;
+        wallStart = std::chrono::steady_clock::now();
+        cpuStart = std::clock();
+    }
+
+    void stop()
+    {
+        MemStats::leave();
+        if (!enabled || current.empty())
+            return;
+        double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+        double cpu = 1000.0 * (std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        phases.push_back({current, wall, cpu});
+        current.clear();
+    }
+
+    void print() const
+    {
+        if (!enabled)
+            return;
+        double wall = 0, cpu = 0;
+        std::cout << "===== Pass timing =====\n";
+        std::cout << std::setw(12) << "wall ms" << std::setw(12) << "cpu ms" << "  phase\n";
+        std::cout << std::fixed << std::setprecision(3);
+        for (auto& phase : phases)
+        {
+            std::cout << std::setw(12) << phase.wall << std::setw(12) << phase.cpu << "  " << phase.name << "\n";
+            wall += phase.wall;
+            cpu += phase.cpu;
+        }
+        std::cout << std::setw(12) << wall << std::setw(12) << cpu << "  total\n";
+        std::cout << std::defaultfloat;
+    }
+};
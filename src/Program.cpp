@@ -0,0 +1,337 @@
+#include "Program.h"
+
+#include "BoundsChecker.hpp"
+#include "CBackend.h"
+#include "CodeGen.hpp"
+#include "EscapeAnalysis.hpp"
+#include "IRGen.hpp"
+#include "Jit.h"
+#include "LoopOptimizer.hpp"
+#include "MirBuilder.hpp"
+#include "MirVerifier.hpp"
+#include "Parser.h"
+#include "Scanner.h"
+#include "TreeShaker.hpp"
+#include "TypeChecker.hpp"
+#include "ValueNumbering.hpp"
+#include "Verifier.h"
+
+#include "Debug.h"
+
+#include <chrono>
+#include <deque>
+#include <memory>
+
+namespace
+{
+// What a compile makes on its way, freed on every return. The chunks the program keeps are taken
+// out of 'irChunks' before.
+struct CompileScratch
+{
+    std::vector<Stmt*> root;
+    std::vector<IRChunk*> irChunks;
+
+    ~CompileScratch()
+    {
+        for (auto& stmt : root)
+            delete stmt;
+        for (auto& irc : irChunks)
+        {
+            delete irc->chunk;
+            delete irc;
+        }
+    }
+};
+} // namespace
+
+Program::~Program()
+{
+    for (auto& chunk : chunks)
+    {
+        Chunk* tiered = chunk->tiered.load();
+        while (tiered)
+        {
+            Chunk* next = tiered->tiered.load();
+            delete tiered->jit.load();
+            delete tiered;
+            tiered = next;
+        }
+        delete chunk->jit.load();
+        delete chunk;
+    }
+}
+
+void Program::defineNative(const std::string& name, NativeFn native, TypeFunction* type)
+{
+    natives.push_back({name, native, type});
+}
+
+void Program::defineNatives(Parser& parser)
+{
+    for (auto& native : natives)
+        parser.currentNamespace->define(native.name, native.type, new NativeFunc(native.native, native.type));
+    for (auto& var : parser.currentNamespace->vars)
+    {
+        if (var.second.type->tag == TypeTag::NATIVE)
+            nativeTable[var.first] = var.second.val->data.valNative;
+    }
+}
+
+bool Program::compile(std::vector<std::string> sources, const ProgramOptions& options)
+{
+    CompileScratch scratch;
+    std::vector<Stmt*>& root = scratch.root;
+    std::vector<IRChunk*>& irChunks = scratch.irChunks;
+    // Global slots are counted by the parser's namespaces, from the natives it defines on.
+    Parser parser;
+    defineNatives(parser);
+
+    timer.enabled = options.time_passes;
+    size_t n = sources.size();
+    auto unit = [&](size_t i) { return unitName(options, i); };
+
+    // The escaped string literals of the tokens are kept by their scanner.
+    std::deque<Scanner> scanners;
+    std::vector<std::vector<Token>> tokenList;
+    // Only the scanning itself, for the tokens per second of -stats.
+    double scanSeconds = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        timer.start("scan " + unit(i));
+        auto scanStart = std::chrono::steady_clock::now();
+        Scanner& scanner = scanners.emplace_back(sources[i]);
+        tokenList.push_back(scanner.scanTokens());
+        scanSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - scanStart).count();
+        timer.stop();
+
+        if (options.debug_tokens)
+            debugTokens(tokenList[i]);
+
+        timer.start("parse types " + unit(i));
+        parser.parseUserDefinedTypes(tokenList[i]);
+        timer.stop();
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        timer.start("parse " + unit(i));
+        root.push_back(parser.parseUnit(tokenList[i]));
+        timer.stop();
+    }
+    size_t nodes = parser.nodes;
+    if (!parser.cont)
+        return false;
+
+    if (options.debug_ast_bare)
+        debugAST(root);
+
+    timer.start("type check");
+    TypeChecker typeChecker(root, parser.allNamespaces);
+    timer.stop();
+
+    if (!typeChecker.cont)
+        return false;
+
+    if (options.checked)
+    {
+        timer.start("bounds check");
+        BoundsChecker boundsChecker(root);
+        timer.stop();
+        if (!boundsChecker.cont)
+            return false;
+    }
+
+    timer.start("tree shake");
+    TreeShaker treeShaker(root, parser.allNamespaces);
+    treeShaker.shake(options.exports);
+    timer.stop();
+    if (options.debug_opt)
+        std::cout << "removed " << treeShaker.functions << " functions, " << treeShaker.globals << " globals and " << treeShaker.natives << " natives\n";
+
+    timer.start("escape analysis");
+    EscapeAnalysis escapeAnalysis(root);
+    timer.stop();
+    if (options.debug_opt)
+        std::cout << "placed " << escapeAnalysis.inFrame << " heap objects in frames, " << escapeAnalysis.onHeap << " escape\n";
+
+    if (options.debug_ast)
+        debugAST(root);
+
+    timer.start("IR generation");
+    IRGen irGen(root, parser.allNamespaces, constants);
+    irChunks = irGen.generateIR();
+    timer.stop();
+
+    std::vector<size_t> generated;
+    for (auto& irc : irChunks)
+        generated.push_back(irc->getCode().size());
+
+    for (auto& stmt : root)
+        delete stmt;
+    root.clear();
+
+    if (!irGen.cont)
+        return false;
+
+    std::unique_ptr<CBackend> backend;
+    if (!options.cPath.empty())
+        backend = std::make_unique<CBackend>(parser.allNamespaces, irChunks);
+
+    timer.start(backend ? "optimize, C generation" : "optimize");
+    for (auto& irc : irChunks)
+    {
+        LoopOptimizer licm(irc);
+        licm.optimize();
+        if (options.debug_opt && licm.loops > 0)
+            std::cout << irc->name << ": reduced " << licm.reduced << " expressions to " << licm.offsets << " running offsets, hoisted "
+                      << licm.hoisted << " instructions from " << licm.loops << " loops into " << licm.temps() << " locals\n";
+
+        ValueNumbering lvn(irc);
+        lvn.optimize();
+        if (options.debug_opt)
+            std::cout << irc->name << ": removed " << lvn.removed << " recomputations saving " << lvn.saved << " instructions with " << lvn.temps() << " locals\n";
+
+        MirBuilder builder(irc);
+        MirFunction* mir = builder.build();
+        MirVerifier verifier(mir);
+        if (options.debug_ir)
+        {
+            std::cout << irc->name << ":\n";
+            debugMir(mir, irc);
+        }
+        if (backend && builder.cont && verifier.cont)
+            backend->generateFunction(mir, irc);
+        if (builder.cont && verifier.cont)
+            mir->lower(irc);
+        delete mir;
+        if (!builder.cont || !verifier.cont)
+        {
+            timer.stop();
+            return false;
+        }
+    }
+    timer.stop();
+
+    if (options.debug_stack)
+    {
+        for (auto& irc : irChunks)
+        {
+            std::cout << irc->name << ":\n";
+            debugInstructions(irc);
+            std::cout << std::endl;
+        }
+    }
+
+    if (backend)
+    {
+        bool written = backend->cont && backend->write(options.cPath);
+        if (options.stats)
+            printStats(options, tokenList, scanSeconds, nodes, irChunks, generated);
+        return written;
+    }
+
+    // Function globals are looked up by name later, the code generator frees the values.
+    std::unordered_map<std::string, size_t> functionSlots;
+    for (auto& ns : parser.allNamespaces)
+    {
+        for (auto& var : ns.second->vars)
+        {
+            if (var.second.type->tag == TypeTag::FUNCTION)
+                functionSlots[var.second.fullName.substr(2)] = var.second.position;
+            else if (var.second.type->tag == TypeTag::STRING && var.second.val->data.valString)
+                strings.push_back(var.second.val->data.valString);
+        }
+    }
+    for (auto& val : constants.getValues())
+    {
+        if (val->type->tag == TypeTag::STRING)
+            strings.push_back(val->data.valString);
+    }
+
+    timer.start("code generation");
+    CodeGen codegen(parser.allNamespaces);
+    for (auto& irc : irChunks)
+        codegen.generateCode(irc);
+    timer.stop();
+
+    timer.start("verify");
+    size_t globalCount = parser.allNamespaces.at("")->globalSlots();
+    for (auto& irc : irChunks)
+    {
+        if (!Verifier::verify(irc->chunk, globalCount, irc->name))
+        {
+            timer.stop();
+            return false;
+        }
+    }
+    timer.stop();
+
+    if (options.stats)
+        printStats(options, tokenList, scanSeconds, nodes, irChunks, generated);
+
+    if (options.debug_code)
+    {
+        for (auto& irc : irChunks)
+        {
+            std::cout << irc->name << "@" << irc->chunk << ":\n";
+            dissambleChunk(irc->chunk);
+            std::cout << std::endl;
+        }
+    }
+
+    for (auto& irc : irChunks)
+    {
+        chunks.push_back(irc->chunk);
+        delete irc;
+    }
+    irChunks.clear();
+
+    globals = codegen.getGlobals();
+    for (auto& slot : functionSlots)
+        functions[slot.first] = globals[slot.second].valChunk;
+    return true;
+}
+
+std::string Program::unitName(const ProgramOptions& options, size_t i)
+{
+    return i < options.files.size() ? options.files[i] : "unit " + std::to_string(i);
+}
+
+void Program::printStats(const ProgramOptions& options, const std::vector<std::vector<Token>>& tokens, double scanSeconds, size_t nodes,
+                         const std::vector<IRChunk*>& irChunks, const std::vector<size_t>& generated)
+{
+    std::cout << "===== Statistics =====\n";
+    size_t total = 0;
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        std::cout << "tokens    " << unitName(options, i) << ": " << tokens[i].size() << "\n";
+        total += tokens[i].size();
+    }
+    std::cout << "tokens    total: " << total;
+    if (scanSeconds > 0)
+        std::cout << ", " << (size_t)(total / scanSeconds) << " per second";
+    std::cout << "\n";
+    std::cout << "AST nodes " << nodes << "\n";
+
+    size_t instructions = 0, bytes = 0, used = 0;
+    for (size_t i = 0; i < irChunks.size(); i++)
+    {
+        IRChunk* irc = irChunks[i];
+        std::cout << "chunk     " << irc->name << ": " << generated[i] << " IR instructions, " << irc->getCode().size() << " after optimization";
+        // The C backend stops before bytecode.
+        if (!irc->chunk->code.empty())
+            std::cout << ", " << irc->chunk->code.size() << " bytecode bytes, " << irc->chunk->constants.size() << " constants";
+        std::cout << "\n";
+        instructions += irc->getCode().size();
+        bytes += irc->chunk->code.size();
+        used += irc->chunk->constants.size();
+    }
+    std::cout << "chunks    " << irChunks.size() << ": " << instructions << " IR instructions, " << bytes << " bytecode bytes, " << used << " constants\n";
+    std::cout << "constants " << constants.size() << " in the pool, " << constants.getTextBytes() << " bytes of string text\n";
+}
+
+Chunk* Program::function(const std::string& name) const
+{
+    auto it = functions.find(name);
+    return it == functions.end() ? nullptr : it->second;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Chunk.hpp"
+#include "ConstantPool.hpp"
+#include "PassTimer.hpp"
+#include "Value.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class IRChunk;
+class Parser;
+class Token;
+
+struct ProgramOptions
+{
+    // Names of the sources, for -time-passes and -stats.
+    std::vector<std::string> files;
+    bool debug_tokens = false;
+    bool debug_ast_bare = false;
+    bool debug_ast = false;
+    bool debug_ir = false;
+    bool debug_stack = false;
+    bool debug_code = false;
+    bool debug_opt = false;
+    bool checked = false;
+    bool time_passes = false;
+    bool stats = false;
+    // Functions the host calls by name. The tree shaker keeps them along with what 'main' reaches.
+    std::vector<std::string> exports;
+    // When set, the program is written there as C and no chunks are made.
+    std::string cPath;
+};
+
+// A compiled script: its chunks and the globals they start from. It is compiled once and can be run
+// by any number of VMs, one after another or at the same time, as long as it outlives them.
+class Program
+{
+private:
+    struct HostNative
+    {
+        std::string name;
+        NativeFn native;
+        TypeFunction* type;
+    };
+
+    std::vector<HostNative> natives;
+    std::vector<Chunk*> chunks;
+    std::vector<Data> globals;
+    std::unordered_map<std::string, Chunk*> functions;
+    // Every native by name, also the ones the tree shaker removed, and the string literals. A
+    // snapshot refers to them without their addresses.
+    std::unordered_map<std::string, NativeFn> nativeTable;
+    std::vector<String*> strings;
+    // Owns the constants of the chunks, the text of their strings included.
+    ConstantPool constants;
+
+    friend class Snapshot;
+
+public:
+    // Phases of the compile, the host adds its own.
+    PassTimer timer;
+
+    ~Program();
+
+    // Makes a native visible to the scripts compiled after it, next to 'print' and the others.
+    void defineNative(const std::string& name, NativeFn native, TypeFunction* type);
+    // Compiles the sources as the units of one program, once per Program. Errors are printed, and
+    // false is returned.
+    bool compile(std::vector<std::string> sources, const ProgramOptions& options = ProgramOptions());
+
+    // The code that initializes the globals and calls 'main'.
+    inline Chunk* entry() const { return chunks.empty() ? nullptr : chunks[0]; }
+    // Returns null when there is no such function. Names in namespaces are written as 'ns::name'.
+    Chunk* function(const std::string& name) const;
+    inline const std::vector<Data>& getGlobals() const { return globals; }
+
+private:
+    // Defines the host natives on the parser and fills 'nativeTable'.
+    void defineNatives(Parser& parser);
+    static std::string unitName(const ProgramOptions& options, size_t i);
+    // Prints what -stats shows. 'generated' is the IR size of each chunk before the optimizations.
+    void printStats(const ProgramOptions& options, const std::vector<std::vector<Token>>& tokens, double scanSeconds, size_t nodes,
+                    const std::vector<IRChunk*>& irChunks, const std::vector<size_t>& generated);
+};
@@ -1,10 +1,76 @@
 #include "Scanner.h"
+#include <charconv>
 #include <cstdio>
 #include <cstring>
 #include <iomanip>
-#include <sstream>
 #include <string_view>
 
+namespace
+{
+struct Keyword
+{
+    std::string_view name;
+    TokenType type = TokenType::IDENTIFIER;
+};
+
+constexpr Keyword keywords[] = {
+    {"using", TokenType::USING}, {"namespace", TokenType::NAMESPACE}, {"struct", TokenType::STRUCT}, {"var", TokenType::VAR},
+    {"if", TokenType::IF}, {"else", TokenType::ELSE}, {"int", TokenType::INT}, {"float", TokenType::FLOAT},
+    {"double", TokenType::DOUBLE}, {"char", TokenType::CHAR}, {"string", TokenType::STRING}, {"bool", TokenType::BOOL},
+    {"void", TokenType::VOID}, {"while", TokenType::WHILE}, {"for", TokenType::FOR}, {"true", TokenType::TRUE},
+    {"false", TokenType::FALSE}, {"null", TokenType::NULL_TOKEN}, {"return", TokenType::RETURN}, {"heap", TokenType::HEAP},
+    {"ref", TokenType::REF}, {"take", TokenType::TAKE}, {"spawn", TokenType::SPAWN}, {"join", TokenType::JOIN},
+    {"task", TokenType::TASK}, {"fiber", TokenType::FIBER}};
+
+// Every keyword has at least two characters. The factors were searched for a hash without
+// collisions over the keywords, the static_assert below keeps it that way when one is added.
+const size_t KEYWORD_SLOTS = 64;
+
+constexpr size_t keywordHash(const char* str, size_t length)
+{
+    return ((uint8_t)str[0] + 55 * (uint8_t)str[1] + 49 * (uint8_t)str[length - 1] + length) % KEYWORD_SLOTS;
+}
+
+struct KeywordTable
+{
+    Keyword slots[KEYWORD_SLOTS];
+};
+
+constexpr KeywordTable makeKeywordTable()
+{
+    KeywordTable table{};
+    for (auto& keyword : keywords)
+        table.slots[keywordHash(keyword.name.data(), keyword.name.size())] = keyword;
+    return table;
+}
+
+constexpr KeywordTable keywordTable = makeKeywordTable();
+
+constexpr bool isPerfect()
+{
+    for (auto& keyword : keywords)
+    {
+        if (keywordTable.slots[keywordHash(keyword.name.data(), keyword.name.size())].name != keyword.name)
+            return false;
+    }
+    return true;
+}
+
+static_assert(isPerfect(), "Two keywords have the same hash, search new factors for keywordHash.");
+} // namespace
+
+const std::array<uint8_t, 256> Scanner::charClasses = [] {
+    std::array<uint8_t, 256> classes{};
+    for (int c = 'a'; c <= 'z'; c++)
+        classes[c] = ALPHA;
+    for (int c = 'A'; c <= 'Z'; c++)
+        classes[c] = ALPHA;
+    classes['_'] = ALPHA;
+    for (int c = '0'; c <= '9'; c++)
+        classes[c] = DIGIT;
+    return classes;
+}();
+
 Scanner::Scanner(std::string& source)
     : source(source), startPosition(0), currentPosition(0), line(1)
 {
@@ -13,6 +79,8 @@ Scanner::Scanner(std::string& source)
 std::vector<Token> Scanner::scanTokens()
 {
     std::vector<Token> tokens;
+    // Tokens average a few characters with the space around them.
+    tokens.reserve(source.size() / 4 + 1);
 
     do
     {
@@ -179,9 +247,9 @@ Token Scanner::makeToken(TokenType type)
     return Token(type, line, &source[startPosition], currentPosition - startPosition);
 }
 
-std::string Scanner::formatString(const char* str, size_t size)
+size_t Scanner::formatString(char* str, size_t size)
 {
-    std::stringstream ss;
+    size_t out = 0;
     size_t i = 0;
     while (i < size)
     {
@@ -190,31 +258,31 @@ std::string Scanner::formatString(const char* str, size_t size)
             switch (str[++i])
             {
             case 'n':
-                ss << '\n';
+                str[out++] = '\n';
                 break;
             case 't':
-                ss << '\t';
+                str[out++] = '\t';
                 break;
             case '\\':
-                ss << '\\';
+                str[out++] = '\\';
                 break;
             case 'r':
-                ss << '\r';
+                str[out++] = '\r';
                 break;
             case 'b':
-                ss << '\b';
+                str[out++] = '\b';
                 break;
             case 'a':
-                ss << '\a';
+                str[out++] = '\a';
                 break;
             case 'v':
-                ss << '\v';
+                str[out++] = '\v';
                 break;
             case '0':
-                ss << '\0';
+                str[out++] = '\0';
                 break;
             case '\'':
-                ss << '\'';
+                str[out++] = '\'';
                 break;
             default:
                 break;
@@ -223,28 +291,38 @@ std::string Scanner::formatString(const char* str, size_t size)
         }
         else
         {
-            ss << str[i++];
+            str[out++] = str[i++];
         }
     }
 
-    return ss.str();
+    return out;
 }
 
 Token Scanner::stringLiteral()
 {
+    bool escapes = false;
     while (peek() != '"' && !this->isAtEnd())
     {
-        advance();
+        escapes |= advance() == '\\';
     }
 
     if (isAtEnd())
         return errorToken("Unterminated string.");
 
     advance();
-    std::string formattedString = formatString(&source[startPosition + 1], currentPosition - startPosition - 2);
-    char* str = new char[formattedString.size() + 1];
-    formattedString.copy(str, formattedString.size());
-    return Token(TokenType::STRING_LITERAL, line, str, formattedString.size());
+    char* str = &source[startPosition + 1];
+    size_t size = currentPosition - startPosition - 2;
+    if (!escapes)
+        return Token(TokenType::STRING_LITERAL, line, str, size);
+
+    // The rest of the source bounds every escaped literal to come, so the tokens never see the arena move.
+    if (escaped.capacity() == 0)
+        escaped.reserve(source.size() - startPosition);
+    size_t offset = escaped.size();
+    escaped.insert(escaped.end(), str, str + size);
+    size = formatString(&escaped[offset], size);
+    escaped.resize(offset + size);
+    return Token(TokenType::STRING_LITERAL, line, escaped.data() + offset, size);
 }
 
 Token Scanner::charLiteral()
@@ -263,58 +341,17 @@ Token Scanner::charLiteral()
 
 Token Scanner::identifierLiteral(char start)
 {
-    std::stringstream lexeme;
-    lexeme << start;
-    while ((this->isAlpha(peek()) || this->isDigit(peek())))
+    while (this->isAlphaNumeric(peek()))
+        advance();
+
+    const char* lexeme = &source[startPosition];
+    size_t length = currentPosition - startPosition;
+    if (length >= 2)
     {
-        lexeme << advance();
+        const Keyword& keyword = keywordTable.slots[keywordHash(lexeme, length)];
+        if (keyword.name == std::string_view(lexeme, length))
+            return makeToken(keyword.type);
     }
-
-    if (lexeme.str() == "using")
-        return makeToken(TokenType::USING);
-    if (lexeme.str() == "namespace")
-        return makeToken(TokenType::NAMESPACE);
-    if (lexeme.str() == "struct")
-        return makeToken(TokenType::STRUCT);
-    if (lexeme.str() == "var")
-        return makeToken(TokenType::VAR);
-    if (lexeme.str() == "if")
-        return makeToken(TokenType::IF);
-    if (lexeme.str() == "else")
-        return makeToken(TokenType::ELSE);
-    if (lexeme.str() == "int")
-        return makeToken(TokenType::INT);
-    if (lexeme.str() == "float")
-        return makeToken(TokenType::FLOAT);
-    if (lexeme.str() == "double")
-        return makeToken(TokenType::DOUBLE);
-    if (lexeme.str() == "char")
-        return makeToken(TokenType::CHAR);
-    if (lexeme.str() == "string")
-        return makeToken(TokenType::STRING);
-    if (lexeme.str() == "bool")
-        return makeToken(TokenType::BOOL);
-    if (lexeme.str() == "void")
-        return makeToken(TokenType::VOID);
-    if (lexeme.str() == "while")
-        return makeToken(TokenType::WHILE);
-    if (lexeme.str() == "for")
-        return makeToken(TokenType::FOR);
-    if (lexeme.str() == "true")
-        return makeToken(TokenType::TRUE);
-    if (lexeme.str() == "false")
-        return makeToken(TokenType::FALSE);
-    if (lexeme.str() == "null")
-        return makeToken(TokenType::NULL_TOKEN);
-    if (lexeme.str() == "return")
-        return makeToken(TokenType::RETURN);
-    if (lexeme.str() == "heap")
-        return makeToken(TokenType::HEAP);
-    if (lexeme.str() == "ref")
-        return makeToken(TokenType::REF);
-    if (lexeme.str() == "take")
-        return makeToken(TokenType::TAKE);
-
     return makeToken(TokenType::IDENTIFIER);
 }
 
@@ -399,36 +436,32 @@ std::ostream& operator<<(std::ostream& os, const Token& token)
     return os;
 }
 
+// The lexemes are numbers the scanner matched, a value out of range is 0.
 int Token::getInteger()
 {
-    char* lexeme = new char[length + 1];
-    memcpy(lexeme, start, sizeof(char) * length);
-    lexeme[length] = 0;
-    return std::atoi(lexeme);
+    int value = 0;
+    std::from_chars(start, start + length, value);
+    return value;
 }
 
 double Token::getDouble()
 {
-    char* lexeme = new char[length + 1];
-    memcpy(lexeme, start, sizeof(char) * length);
-    lexeme[length] = 0;
-    return std::stod(lexeme);
+    double value = 0;
+    std::from_chars(start, start + length, value);
+    return value;
 }
 
+// Without the 'f'.
 float Token::getFloat()
 {
-    char* lexeme = new char[length];
-    memcpy(lexeme, start, sizeof(char) * (length - 1));
-    lexeme[length - 1] = 0;
-    return std::atof(lexeme);
+    float value = 0;
+    std::from_chars(start, start + length - 1, value);
+    return value;
 }
 
 std::string Token::getString()
 {
-    char* lexeme = new char[length + 1];
-    memcpy(lexeme, start, sizeof(char) * length);
-    lexeme[length] = 0;
-    return std::string(lexeme);
+    return std::string(start, length);
 }
 
 char Token::getChar()
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -31,6 +33,7 @@ enum class TokenType
 	TRUE, FALSE, NULL_TOKEN,
 	RETURN,
 	HEAP, REF, TAKE,
+	SPAWN, JOIN, TASK, FIBER,
 
 	// Util
 	ERROR, EOF_TOKEN
@@ -60,6 +63,8 @@ public:
 	char getChar();
 };
 
+// The tokens point into the source, and string literals with escapes into the scanner, so both must
+// outlive them. The source is only read.
 class Scanner
 {
 public:
@@ -71,11 +76,13 @@ private:
 	int startPosition; // current position of the scanner
 	int currentPosition; // current position of the scanner
 	int line; // current line of the scanner
+	std::vector<char> escaped; // string literals with their escapes replaced, never reallocated
 
 	Token scanToken(); // scans the next token on the file
 	Token makeToken(TokenType type); // creates a new token with the type
 
-	std::string formatString(const char* str, size_t size);
+	// Replaces the escapes in place, the result is never longer. Returns its length.
+	size_t formatString(char* str, size_t size);
 	Token stringLiteral(); // scans to a "
 	Token charLiteral(); // scans to a '
 	Token identifierLiteral(char start); // scans the next identifier
@@ -92,6 +99,14 @@ private:
 	char peekNext(); // return the next char
 	bool isAtEnd(); // is at the end of the file
 
-	inline bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
-	inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+	enum CharClass : uint8_t
+	{
+		ALPHA = 1, // letters and '_'
+		DIGIT = 2
+	};
+	static const std::array<uint8_t, 256> charClasses;
+
+	inline bool isAlpha(char c) { return charClasses[(uint8_t)c] & ALPHA; }
+	inline bool isDigit(char c) { return charClasses[(uint8_t)c] & DIGIT; }
+	inline bool isAlphaNumeric(char c) { return charClasses[(uint8_t)c] & (ALPHA | DIGIT); }
 };
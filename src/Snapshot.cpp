@@ -0,0 +1,458 @@
+#include "Snapshot.h"
+#include "Enviroment.hpp"
+#include "Heap.h"
+#include "Parser.h"
+#include "Verifier.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+const char MAGIC[8] = {'P', 'U', 'H', 'U', 'S', 'N', 'A', 'P'};
+const uint32_t VERSION = 2;
+
+enum class RelocKind : uint8_t
+{
+    CHUNK,
+    NATIVE,
+    STRING,
+    GLOBAL,
+    HEAP
+};
+
+struct Relocation
+{
+    uint32_t index; // word the address is written to
+    RelocKind kind;
+    uint32_t target;
+    uint64_t offset; // bytes into a global or a heap block
+};
+
+// Everything a saved word may point at.
+class Addresses
+{
+private:
+    std::unordered_map<uintptr_t, std::pair<RelocKind, uint32_t>> exact;
+    uintptr_t globalsStart;
+    uintptr_t globalsEnd;
+    std::vector<std::pair<Data*, size_t>>& blocks;
+
+public:
+    Addresses(const std::vector<Chunk*>& chunks, const std::vector<NativeFn>& natives, const std::vector<String*>& strings,
+              const std::vector<Data>& globals, std::vector<std::pair<Data*, size_t>>& blocks)
+        : globalsStart((uintptr_t)globals.data()), globalsEnd((uintptr_t)(globals.data() + globals.size())), blocks(blocks)
+    {
+        for (uint32_t i = 0; i < natives.size(); i++)
+            exact[(uintptr_t)natives[i]] = {RelocKind::NATIVE, i};
+        for (uint32_t i = 0; i < strings.size(); i++)
+            exact[(uintptr_t)strings[i]] = {RelocKind::STRING, i};
+        // Calls only hold the first chunk, but a tiered copy still stands for it.
+        for (uint32_t i = 0; i < chunks.size(); i++)
+        {
+            for (Chunk* chunk = chunks[i]; chunk; chunk = chunk->tiered.load())
+                exact[(uintptr_t)chunk] = {RelocKind::CHUNK, i};
+        }
+    }
+
+    bool find(uintptr_t word, Relocation& reloc)
+    {
+        if (word == 0)
+            return false;
+
+        auto it = exact.find(word);
+        if (it != exact.end())
+        {
+            reloc.kind = it->second.first;
+            reloc.target = it->second.second;
+            reloc.offset = 0;
+            return true;
+        }
+
+        if (word >= globalsStart && word < globalsEnd)
+        {
+            reloc.kind = RelocKind::GLOBAL;
+            reloc.target = 0;
+            reloc.offset = word - globalsStart;
+            return true;
+        }
+
+        auto block = std::upper_bound(blocks.begin(), blocks.end(), word, [](uintptr_t w, const std::pair<Data*, size_t>& b) { return w < (uintptr_t)b.first; });
+        if (block == blocks.begin())
+            return false;
+        block--;
+        uintptr_t start = (uintptr_t)block->first;
+        if (word >= start + block->second * sizeof(Data))
+            return false;
+        reloc.kind = RelocKind::HEAP;
+        reloc.target = block - blocks.begin();
+        reloc.offset = word - start;
+        return true;
+    }
+};
+
+class Writer
+{
+private:
+    std::ofstream file;
+
+public:
+    Writer(const std::string& path)
+        : file(path, std::ios::binary) {}
+
+    inline bool good() const { return file.good(); }
+
+    void bytes(const void* data, size_t size)
+    {
+        file.write((const char*)data, size);
+    }
+    void u8(uint8_t val) { bytes(&val, sizeof(val)); }
+    void u32(uint32_t val) { bytes(&val, sizeof(val)); }
+    void u64(uint64_t val) { bytes(&val, sizeof(val)); }
+    void string(const std::string& str)
+    {
+        u32(str.size());
+        bytes(str.data(), str.size());
+    }
+
+    // The raw words, then where they hold addresses.
+    void words(const Data* data, size_t count, Addresses& addresses)
+    {
+        u32(count);
+        bytes(data, count * sizeof(Data));
+        std::vector<Relocation> relocs;
+        Relocation reloc;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uintptr_t word;
+            memcpy(&word, &data[i], sizeof(word));
+            if (!addresses.find(word, reloc))
+                continue;
+            reloc.index = i;
+            relocs.push_back(reloc);
+        }
+        u32(relocs.size());
+        for (auto& r : relocs)
+        {
+            u32(r.index);
+            u8((uint8_t)r.kind);
+            u32(r.target);
+            u64(r.offset);
+        }
+    }
+};
+
+// Words read from the mapped file, written out once everything they point at exists.
+struct Words
+{
+    const uint8_t* raw;
+    uint32_t count;
+    std::vector<Relocation> relocs;
+};
+
+class Reader
+{
+private:
+    const uint8_t* pos;
+    const uint8_t* end;
+
+public:
+    bool ok;
+
+    Reader(const uint8_t* data, size_t size)
+        : pos(data), end(data + size), ok(true) {}
+
+    const uint8_t* bytes(size_t size)
+    {
+        if (!ok || (size_t)(end - pos) < size)
+        {
+            ok = false;
+            return nullptr;
+        }
+        const uint8_t* start = pos;
+        pos += size;
+        return start;
+    }
+    template <typename T>
+    T read()
+    {
+        T val = 0;
+        const uint8_t* data = bytes(sizeof(T));
+        if (data)
+            memcpy(&val, data, sizeof(T));
+        return val;
+    }
+    std::string string()
+    {
+        uint32_t size = read<uint32_t>();
+        const uint8_t* data = bytes(size);
+        return data ? std::string((const char*)data, size) : std::string();
+    }
+    Words words()
+    {
+        Words words;
+        words.count = read<uint32_t>();
+        words.raw = bytes((size_t)words.count * sizeof(Data));
+        uint32_t relocs = read<uint32_t>();
+        for (uint32_t i = 0; i < relocs && ok; i++)
+        {
+            Relocation reloc;
+            reloc.index = read<uint32_t>();
+            reloc.kind = (RelocKind)read<uint8_t>();
+            reloc.target = read<uint32_t>();
+            reloc.offset = read<uint64_t>();
+            words.relocs.push_back(reloc);
+        }
+        return words;
+    }
+};
+
+// What the relocations of a restored snapshot point at.
+struct Targets
+{
+    std::vector<Chunk*>& chunks;
+    std::vector<NativeFn>& natives;
+    std::vector<String*>& strings;
+    std::vector<Data>& globals;
+    std::vector<std::pair<Data*, size_t>>& blocks;
+
+    bool apply(Data* dest, const Words& words)
+    {
+        if (words.count > 0)
+            memcpy(dest, words.raw, words.count * sizeof(Data));
+        for (auto& reloc : words.relocs)
+        {
+            if (reloc.index >= words.count)
+                return false;
+
+            uint8_t* address = nullptr;
+            switch (reloc.kind)
+            {
+            case RelocKind::CHUNK:
+                if (reloc.target >= chunks.size())
+                    return false;
+                dest[reloc.index].valChunk = chunks[reloc.target];
+                continue;
+            case RelocKind::NATIVE:
+                if (reloc.target >= natives.size())
+                    return false;
+                dest[reloc.index].valNative = natives[reloc.target];
+                continue;
+            case RelocKind::STRING:
+                if (reloc.target >= strings.size())
+                    return false;
+                dest[reloc.index].valString = strings[reloc.target];
+                continue;
+            case RelocKind::GLOBAL:
+                if (reloc.offset >= globals.size() * sizeof(Data))
+                    return false;
+                address = (uint8_t*)globals.data();
+                break;
+            case RelocKind::HEAP:
+                if (reloc.target >= blocks.size() || reloc.offset >= blocks[reloc.target].second * sizeof(Data))
+                    return false;
+                address = (uint8_t*)blocks[reloc.target].first;
+                break;
+            default:
+                return false;
+            }
+            dest[reloc.index].valPtr = (Data*)(address + reloc.offset);
+        }
+        return true;
+    }
+};
+}
+
+bool Snapshot::save(const std::string& path, const Program& program, VM& vm, const std::string& entry)
+{
+    auto function = program.functions.find(entry);
+    if (function == program.functions.end())
+    {
+        std::cout << "[ERROR] Unknown entry function '" << entry << "'." << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> natives;
+    std::vector<NativeFn> nativeFns;
+    for (auto& native : program.nativeTable)
+    {
+        natives.push_back(native.first);
+        nativeFns.push_back(native.second);
+    }
+    std::vector<std::pair<Data*, size_t>> blocks = recordedBlocks();
+    Addresses addresses(program.chunks, nativeFns, program.strings, vm.globals, blocks);
+
+    Writer out(path);
+    out.bytes(MAGIC, sizeof(MAGIC));
+    out.u32(VERSION);
+    out.string(entry);
+
+    out.u32(natives.size());
+    for (auto& native : natives)
+        out.string(native);
+
+    out.u32(program.strings.size());
+    for (auto& str : program.strings)
+        out.string(std::string(str->view()));
+
+    std::unordered_map<Chunk*, uint32_t> chunkIndex;
+    out.u32(program.chunks.size());
+    for (uint32_t i = 0; i < program.chunks.size(); i++)
+    {
+        Chunk* chunk = program.chunks[i];
+        chunkIndex[chunk] = i;
+        out.u8(chunk->argSize);
+        out.u32(chunk->code.size());
+        out.bytes(chunk->code.data(), chunk->code.size());
+        out.words(chunk->constants.data(), chunk->constants.size(), addresses);
+    }
+
+    out.u32(program.functions.size());
+    for (auto& func : program.functions)
+    {
+        out.string(func.first);
+        out.u32(chunkIndex[func.second]);
+    }
+
+    out.words(vm.globals.data(), vm.globals.size(), addresses);
+
+    out.u32(blocks.size());
+    for (auto& block : blocks)
+        out.words(block.first, block.second, addresses);
+
+    if (!out.good())
+    {
+        std::cout << "[ERROR] Unable to write snapshot: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+Chunk* Snapshot::restore(const std::string& path, Program& program, VM& vm)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        std::cout << "[Error] Unable to open file: " << path << std::endl;
+        return nullptr;
+    }
+    void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        std::cout << "[Error] Unable to open file: " << path << std::endl;
+        return nullptr;
+    }
+
+    Chunk* entry = nullptr;
+    Reader in((const uint8_t*)mapped, info.st_size);
+    const uint8_t* magic = in.bytes(sizeof(MAGIC));
+    if (!magic || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || in.read<uint32_t>() != VERSION)
+    {
+        std::cout << "[ERROR] Not a snapshot of this version: " << path << std::endl;
+        munmap(mapped, info.st_size);
+        return nullptr;
+    }
+    std::string entryName = in.string();
+
+    // The natives are found by name, the same as a compile defines them.
+    Parser parser;
+    program.defineNatives(parser);
+
+    std::vector<NativeFn> natives;
+    uint32_t nativeCount = in.read<uint32_t>();
+    for (uint32_t i = 0; i < nativeCount && in.ok; i++)
+    {
+        std::string name = in.string();
+        auto it = program.nativeTable.find(name);
+        if (in.ok && it == program.nativeTable.end())
+        {
+            std::cout << "[ERROR] Snapshot needs the native '" << name << "'." << std::endl;
+            munmap(mapped, info.st_size);
+            return nullptr;
+        }
+        natives.push_back(in.ok ? it->second : nullptr);
+    }
+
+    uint32_t stringCount = in.read<uint32_t>();
+    for (uint32_t i = 0; i < stringCount && in.ok; i++)
+    {
+        program.strings.push_back(String::intern(in.string()));
+    }
+
+    std::vector<Words> constants;
+    uint32_t chunkCount = in.read<uint32_t>();
+    for (uint32_t i = 0; i < chunkCount && in.ok; i++)
+    {
+        Chunk* chunk = new Chunk();
+        program.chunks.push_back(chunk);
+        chunk->argSize = in.read<uint8_t>();
+        uint32_t size = in.read<uint32_t>();
+        const uint8_t* code = in.bytes(size);
+        if (code)
+            chunk->code.assign(code, code + size);
+        constants.push_back(in.words());
+    }
+
+    uint32_t functionCount = in.read<uint32_t>();
+    for (uint32_t i = 0; i < functionCount && in.ok; i++)
+    {
+        std::string name = in.string();
+        uint32_t index = in.read<uint32_t>();
+        if (index >= program.chunks.size())
+            in.ok = false;
+        else
+            program.functions[name] = program.chunks[index];
+    }
+
+    Words globals = in.words();
+
+    std::vector<Words> blockWords;
+    std::vector<std::pair<Data*, size_t>> blocks;
+    uint32_t blockCount = in.read<uint32_t>();
+    for (uint32_t i = 0; i < blockCount && in.ok; i++)
+    {
+        blockWords.push_back(in.words());
+        size_t size = blockWords.back().count;
+        Data* block = new Data[size];
+        adoptBlock(block, size);
+        blocks.push_back({block, size});
+    }
+
+    // Everything exists now, the words can point at it.
+    bool ok = in.ok;
+    if (ok)
+    {
+        vm.reset(std::vector<Data>(globals.count));
+        Targets targets{program.chunks, natives, program.strings, vm.globals, blocks};
+        ok = targets.apply(vm.globals.data(), globals);
+        for (uint32_t i = 0; ok && i < program.chunks.size(); i++)
+        {
+            program.chunks[i]->constants.resize(constants[i].count);
+            ok = targets.apply(program.chunks[i]->constants.data(), constants[i]);
+        }
+        for (uint32_t i = 0; ok && i < blocks.size(); i++)
+            ok = targets.apply(blocks[i].first, blockWords[i]);
+        program.globals = vm.globals;
+        // The code comes from a file, it runs only once the verifier accepted it. Stack sizes are
+        // counted again rather than read.
+        for (uint32_t i = 0; ok && i < program.chunks.size(); i++)
+            ok = Verifier::verify(program.chunks[i], vm.globals.size(), "chunk " + std::to_string(i));
+    }
+    munmap(mapped, info.st_size);
+
+    if (ok)
+        entry = program.function(entryName);
+    if (!entry)
+        std::cout << "[ERROR] Broken snapshot: " << path << std::endl;
+    return entry;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Program.h"
+#include "VM.h"
+
+#include <string>
+
+// Image of a program after it ran: its chunks, the globals, the heap blocks ALLOC made and the name
+// of the function to resume from. Data carries no type, so a word that holds the address of a chunk,
+// a native, a string literal, a global or a heap block is taken for a pointer to it and relocated
+// to the new copy on restore. Strings made at run time are not kept.
+class Snapshot
+{
+public:
+    // The heap has to be recorded since before the program ran, and the VM has to be idle.
+    static bool save(const std::string& path, const Program& program, VM& vm, const std::string& entry);
+    // Fills a program that was not compiled and resets the VM to the saved globals. Host natives are
+    // defined on the program before. Returns the function to resume from, or null.
+    static Chunk* restore(const std::string& path, Program& program, VM& vm);
+};
@@ -0,0 +1,94 @@
+#include "String.h"
+
+#include <cstring>
+#include <new>
+#include <unordered_map>
+
+namespace
+{
+struct ViewHash
+{
+    size_t operator()(std::string_view text) const
+    {
+        return String::hashOf(text.data(), text.size());
+    }
+};
+
+struct Table
+{
+    // Programs compile on several threads too.
+    std::mutex mutex;
+    // The keys point into the strings.
+    std::unordered_map<std::string_view, String*, ViewHash> strings;
+};
+
+// Never destroyed, interned strings stay valid until the process ends.
+Table& table()
+{
+    static Table* t = new Table();
+    return *t;
+}
+
+thread_local StringOwner* currentOwner = nullptr;
+
+String* allocate(const char* text, size_t length, uint32_t hash)
+{
+    String* str = (String*)::operator new(offsetof(String, chars) + length + 1);
+    str->length = (uint32_t)length;
+    str->hash = hash;
+    memcpy(str->chars, text, length);
+    str->chars[length] = 0;
+    return str;
+}
+} // namespace
+
+uint32_t String::hashOf(const char* text, size_t length)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+    return hash;
+}
+
+String* String::intern(const char* text, size_t length)
+{
+    Table& t = table();
+    std::lock_guard<std::mutex> lock(t.mutex);
+    auto it = t.strings.find(std::string_view(text, length));
+    if (it != t.strings.end())
+        return it->second;
+
+    String* str = allocate(text, length, hashOf(text, length));
+    t.strings.emplace(str->view(), str);
+    return str;
+}
+
+String* String::make(const char* text, size_t length)
+{
+    StringOwner* owner = currentOwner;
+    if (!owner)
+        return intern(text, length);
+
+    String* str = allocate(text, length, hashOf(text, length));
+    std::lock_guard<std::mutex> lock(owner->mutex);
+    owner->strings.push_back(str);
+    return str;
+}
+
+StringOwner::~StringOwner()
+{
+    for (String* str : strings)
+        ::operator delete(str);
+}
+
+StringOwner::Scope::Scope(StringOwner& owner)
+    : previous(currentOwner)
+{
+    currentOwner = &owner;
+}
+
+StringOwner::Scope::~Scope()
+{
+    currentOwner = previous;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// A runtime string: its length and hash in front of the text, in one block. Literals are made by
+// intern, which gives the same String for the same text and keeps it until the process ends. The
+// strings a running program makes, like the lines input() reads, are made by make and belong to
+// the StringOwner of the thread, which frees them with itself.
+struct String
+{
+    uint32_t length;
+    uint32_t hash;
+    char chars[1]; // 'length' chars, then a 0 for the C functions
+
+    static String* intern(const char* text, size_t length);
+    static String* intern(std::string_view text)
+    {
+        return intern(text.data(), text.size());
+    }
+
+    // Without an owner on the thread the text is interned instead.
+    static String* make(const char* text, size_t length);
+    static String* make(std::string_view text)
+    {
+        return make(text.data(), text.size());
+    }
+
+    inline std::string_view view() const
+    {
+        return std::string_view(chars, length);
+    }
+
+    // Interned strings are equal when their addresses are, the others are compared by their text.
+    static inline bool equal(const String* a, const String* b)
+    {
+        return a == b || (a && b && a->hash == b->hash && a->view() == b->view());
+    }
+
+    static uint32_t hashOf(const char* text, size_t length);
+
+    String() = delete;
+};
+
+// The strings made while a VM runs, its tasks make them on other threads too.
+class StringOwner
+{
+private:
+    std::mutex mutex;
+    std::vector<String*> strings;
+
+    friend struct String;
+
+public:
+    StringOwner() {}
+    StringOwner(const StringOwner&) = delete;
+    StringOwner& operator=(const StringOwner&) = delete;
+    ~StringOwner();
+
+    // Makes 'owner' take the strings made on this thread until the scope ends.
+    class Scope
+    {
+    private:
+        StringOwner* previous;
+
+    public:
+        Scope(StringOwner& owner);
+        ~Scope();
+    };
+};
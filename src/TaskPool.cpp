@@ -0,0 +1,146 @@
+#include "TaskPool.h"
+#include "VM.h"
+
+#include <algorithm>
+
+namespace
+{
+// The pool and the deque of the pool thread running this code.
+thread_local TaskPool* currentPool = nullptr;
+thread_local size_t currentIndex = 0;
+}
+
+TaskPool::TaskPool(VM* root)
+    : root(root), queued(0), stopping(false)
+{
+    // The thread that joins runs tasks as well, so the pool starts one thread less than the cores.
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < cores; i++)
+        workers.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i + 1 < cores; i++)
+        threads.emplace_back(&TaskPool::work, this, i);
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+    for (Task* task : retired)
+        delete task;
+}
+
+void TaskPool::submit(Task* task)
+{
+    Worker& worker = *workers[self()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(task);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+bool TaskPool::join(Task* task)
+{
+    size_t index = self();
+    while (!task->done.load(std::memory_order_acquire))
+    {
+        Task* other = take(index);
+        if (other)
+        {
+            run(other);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this, task]() { return task->done.load(std::memory_order_acquire) || queued > 0; });
+    }
+    return !task->failed;
+}
+
+void TaskPool::retire(Task* task)
+{
+    std::vector<Data>().swap(task->io);
+    std::lock_guard<std::mutex> lock(mutex);
+    retired.push_back(task);
+}
+
+size_t TaskPool::self()
+{
+    return currentPool == this ? currentIndex : workers.size() - 1;
+}
+
+Task* TaskPool::take(size_t index)
+{
+    if (queued == 0)
+        return nullptr;
+
+    Worker& own = *workers[index];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            Task* task = own.tasks.back();
+            own.tasks.pop_back();
+            queued--;
+            return task;
+        }
+    }
+
+    for (size_t i = 1; i < workers.size(); i++)
+    {
+        Worker& victim = *workers[(index + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            Task* task = victim.tasks.front();
+            victim.tasks.pop_front();
+            queued--;
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+void TaskPool::run(Task* task)
+{
+    {
+        VM vm(root);
+        task->failed = !vm.runTask(task);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task->done.store(true, std::memory_order_release);
+    }
+    wake.notify_all();
+}
+
+void TaskPool::work(size_t index)
+{
+    currentPool = this;
+    currentIndex = index;
+    while (true)
+    {
+        Task* task = take(index);
+        if (task)
+        {
+            run(task);
+            continue;
+        }
+
+        // Tasks still queued when the pool stops are run first, their results may never be joined
+        // but their effects on the globals are expected.
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]() { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+            return;
+    }
+}
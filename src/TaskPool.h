@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Chunk.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class VM;
+
+// A spawned call. The arguments are copied in, and the results replace them once it is done. A task
+// that is never joined is not freed, a joined one is kept by the pool until it stops so that a copy
+// of its handle can still be told apart.
+class Task
+{
+public:
+    Chunk* func;
+    std::vector<Data> io;
+    std::atomic<bool> done;
+    std::atomic<bool> joined;
+    bool failed;
+
+    Task(Chunk* func, const Data* args, uint8_t argSize)
+        : func(func), io(args, args + argSize), done(false), joined(false), failed(false) {}
+};
+
+// Work-stealing pool sized to the core count, the thread that joins a task is the last worker. Every
+// worker keeps its own deque, takes the newest task from it and steals the oldest one of another
+// worker when it is empty. Threads outside the pool share one more deque. Each task runs on a VM of
+// its own that shares the chunks and the globals of 'root'.
+class TaskPool
+{
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task*> tasks;
+    };
+
+    VM* root;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queued;
+    bool stopping;
+    std::vector<Task*> retired;
+
+public:
+    TaskPool(VM* root);
+    ~TaskPool();
+
+    void submit(Task* task);
+    // Runs other tasks until 'task' is done. Returns false when it stopped with a runtime error.
+    bool join(Task* task);
+    // Takes a joined task, its results are dropped and it is freed with the pool.
+    void retire(Task* task);
+
+private:
+    size_t self();
+    Task* take(size_t index);
+    void run(Task* task);
+    void work(size_t index);
+};
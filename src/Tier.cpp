@@ -0,0 +1,607 @@
+#include "Tier.h"
+#include "Verifier.h"
+
+#include <climits>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+struct Op
+{
+    OpCode code;
+    uint8_t a;
+    uint8_t b;
+    size_t target; // index of the op a jump lands on, ops.size() for the end of the code
+    bool live;
+};
+
+bool isJump(OpCode code)
+{
+    return code == OpCode::JUMP || code == OpCode::JUMP_NT || code == OpCode::JUMP_NT_POP || code == OpCode::LOOP;
+}
+
+// Operand bytes of an opcode, -1 for the ones the tier leaves alone.
+int operandSize(OpCode code)
+{
+    switch (code)
+    {
+    case OpCode::CONSTANT:
+    case OpCode::POPN:
+    case OpCode::PUSHN:
+    case OpCode::SET_GLOBAL:
+    case OpCode::GET_GLOBAL:
+    case OpCode::SET_LOCAL:
+    case OpCode::GET_LOCAL:
+    case OpCode::SET_GLOBAL_OFF:
+    case OpCode::GET_GLOBAL_OFF:
+    case OpCode::SET_LOCAL_OFF:
+    case OpCode::GET_LOCAL_OFF:
+    case OpCode::SET_LOCAL_POP:
+    case OpCode::ALLOC:
+    case OpCode::SET_DEREF:
+    case OpCode::GET_DEREF:
+    case OpCode::SET_DEREF_OFF:
+    case OpCode::GET_DEREF_OFF:
+    case OpCode::ADDR_LOCAL:
+    case OpCode::ADDR_GLOBAL:
+    case OpCode::ADDR_GLOBAL_OFF:
+    case OpCode::SPAWN:
+    case OpCode::JOIN:
+    case OpCode::FIBER:
+    case OpCode::RETURN:
+        return 1;
+    case OpCode::CAST:
+    case OpCode::SET_GLOBALN:
+    case OpCode::GET_GLOBALN:
+    case OpCode::SET_LOCALN:
+    case OpCode::GET_LOCALN:
+    case OpCode::SET_GLOBAL_OFFN:
+    case OpCode::GET_GLOBAL_OFFN:
+    case OpCode::SET_LOCAL_OFFN:
+    case OpCode::GET_LOCAL_OFFN:
+    case OpCode::LOAD_I8:
+    case OpCode::LOAD_I32:
+    case OpCode::STORE_I8:
+    case OpCode::STORE_I32:
+    case OpCode::CHECK_INDEX:
+    case OpCode::CHECK_LIMIT:
+    case OpCode::JUMP:
+    case OpCode::JUMP_NT_POP:
+    case OpCode::LOOP:
+    case OpCode::JUMP_NT:
+    case OpCode::IADD_LOCAL:
+    case OpCode::CALL:
+    case OpCode::NATIVE_CALL:
+        return 2;
+    case OpCode::SET_GLOBAL_POP:
+    case OpCode::ADDR_LOCAL_OFF:
+        return -1;
+    default:
+        return code > OpCode::RETURN ? -1 : 0;
+    }
+}
+
+int32_t wrap(int64_t value)
+{
+    return (int32_t)(uint32_t)value;
+}
+
+// Evaluates a cast the way VM::typeCast does.
+Data cast(Data value, TypeTag from, TypeTag to)
+{
+    double v;
+    switch (from)
+    {
+    case TypeTag::INTEGER:
+        v = value.valInt;
+        break;
+    case TypeTag::FLOAT:
+        v = value.valFloat;
+        break;
+    case TypeTag::DOUBLE:
+        v = value.valDouble;
+        break;
+    case TypeTag::BOOL:
+        v = value.valBool;
+        break;
+    default:
+        v = value.valChar;
+        break;
+    }
+
+    Data d = {0};
+    switch (to)
+    {
+    case TypeTag::INTEGER:
+        d.valInt = from == TypeTag::INTEGER ? value.valInt : (int32_t)v;
+        break;
+    case TypeTag::FLOAT:
+        d.valFloat = from == TypeTag::FLOAT ? value.valFloat : (float)v;
+        break;
+    case TypeTag::DOUBLE:
+        d.valDouble = v;
+        break;
+    case TypeTag::BOOL:
+        d.valBool = v;
+        break;
+    default:
+        d.valChar = from == TypeTag::INTEGER ? (char)value.valInt : (char)v;
+        break;
+    }
+    return d;
+}
+
+bool foldUnary(Op& op, Data& v)
+{
+    switch (op.code)
+    {
+    case OpCode::INEG:
+        v.valInt = wrap(-(int64_t)v.valInt);
+        return true;
+    case OpCode::FNEG:
+        v.valFloat *= -1;
+        return true;
+    case OpCode::DNEG:
+        v.valDouble *= -1;
+        return true;
+    case OpCode::BIT_NOT:
+        v.valInt = ~v.valInt;
+        return true;
+    case OpCode::IINC:
+    case OpCode::IDEC:
+        v.valInt = wrap((int64_t)v.valInt + (op.code == OpCode::IINC ? 1 : -1));
+        return true;
+    case OpCode::FINC:
+    case OpCode::FDEC:
+        v.valFloat += op.code == OpCode::FINC ? 1 : -1;
+        return true;
+    case OpCode::DINC:
+    case OpCode::DDEC:
+        v.valDouble += op.code == OpCode::DINC ? 1 : -1;
+        return true;
+    case OpCode::LOGIC_NOT:
+        v.valBool = !v.valBool;
+        return true;
+    case OpCode::CAST:
+    {
+        // Out of range conversions to integers are left to the machine that runs them.
+        TypeTag from = (TypeTag)op.a;
+        TypeTag to = (TypeTag)op.b;
+        if ((from == TypeTag::FLOAT || from == TypeTag::DOUBLE) && (to == TypeTag::INTEGER || to == TypeTag::CHAR))
+        {
+            double d = from == TypeTag::FLOAT ? v.valFloat : v.valDouble;
+            if (!(d > INT_MIN - 1.0 && d < INT_MAX + 1.0))
+                return false;
+        }
+        v = cast(v, from, to);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// x is below y on the stack. Arithmetic keeps the rest of x's bytes, like the interpreter.
+bool foldBinary(OpCode code, Data x, Data y, Data& out)
+{
+    out = x;
+    switch (code)
+    {
+    case OpCode::IADD:
+        out.valInt = wrap((int64_t)x.valInt + y.valInt);
+        return true;
+    case OpCode::ISUB:
+        out.valInt = wrap((int64_t)x.valInt - y.valInt);
+        return true;
+    case OpCode::IMUL:
+        out.valInt = wrap((int64_t)x.valInt * y.valInt);
+        return true;
+    case OpCode::IDIV:
+    case OpCode::MOD:
+        if (y.valInt == 0 || (x.valInt == INT_MIN && y.valInt == -1))
+            return false;
+        out.valInt = code == OpCode::IDIV ? x.valInt / y.valInt : x.valInt % y.valInt;
+        return true;
+    case OpCode::FADD:
+        out.valFloat = x.valFloat + y.valFloat;
+        return true;
+    case OpCode::FSUB:
+        out.valFloat = x.valFloat - y.valFloat;
+        return true;
+    case OpCode::FMUL:
+        out.valFloat = x.valFloat * y.valFloat;
+        return true;
+    case OpCode::FDIV:
+        out.valFloat = x.valFloat / y.valFloat;
+        return true;
+    case OpCode::DADD:
+        out.valDouble = x.valDouble + y.valDouble;
+        return true;
+    case OpCode::DSUB:
+        out.valDouble = x.valDouble - y.valDouble;
+        return true;
+    case OpCode::DMUL:
+        out.valDouble = x.valDouble * y.valDouble;
+        return true;
+    case OpCode::DDIV:
+        out.valDouble = x.valDouble / y.valDouble;
+        return true;
+    case OpCode::BIT_AND:
+        out.valInt = x.valInt & y.valInt;
+        return true;
+    case OpCode::BIT_OR:
+        out.valInt = x.valInt | y.valInt;
+        return true;
+    case OpCode::BIT_XOR:
+        out.valInt = x.valInt ^ y.valInt;
+        return true;
+    case OpCode::BITSHIFT_LEFT:
+        out.valInt = (int32_t)((uint32_t)x.valInt << (y.valInt & 31));
+        return true;
+    case OpCode::BITSHIFT_RIGHT:
+        out.valInt = x.valInt >> (y.valInt & 31);
+        return true;
+    default:
+        break;
+    }
+
+    out = {0};
+    switch (code)
+    {
+    case OpCode::ILESS:
+        out.valBool = x.valInt < y.valInt;
+        return true;
+    case OpCode::IGREAT:
+        out.valBool = x.valInt > y.valInt;
+        return true;
+    case OpCode::ILESS_EQUAL:
+        out.valBool = x.valInt <= y.valInt;
+        return true;
+    case OpCode::IGREAT_EQUAL:
+        out.valBool = x.valInt >= y.valInt;
+        return true;
+    case OpCode::IIS_EQUAL:
+        out.valBool = x.valInt == y.valInt;
+        return true;
+    case OpCode::INOT_EQUAL:
+        out.valBool = x.valInt != y.valInt;
+        return true;
+    case OpCode::DLESS:
+        out.valBool = x.valDouble < y.valDouble;
+        return true;
+    case OpCode::DGREAT:
+        out.valBool = x.valDouble > y.valDouble;
+        return true;
+    case OpCode::DLESS_EQUAL:
+        out.valBool = x.valDouble <= y.valDouble;
+        return true;
+    case OpCode::DGREAT_EQUAL:
+        out.valBool = x.valDouble >= y.valDouble;
+        return true;
+    case OpCode::DIS_EQUAL:
+        out.valBool = x.valDouble == y.valDouble;
+        return true;
+    case OpCode::DNOT_EQUAL:
+        out.valBool = x.valDouble != y.valDouble;
+        return true;
+    default:
+        return false;
+    }
+}
+
+class Optimizer
+{
+private:
+    std::vector<Op> ops;
+    std::vector<bool> targets;
+    std::vector<Data> constants;
+
+public:
+    Optimizer(const std::vector<Data>& constants)
+        : constants(constants)
+    {
+    }
+
+    bool decode(const std::vector<uint8_t>& code)
+    {
+        std::vector<size_t> index(code.size() + 1, SIZE_MAX);
+        std::vector<size_t> jumpTo;
+        size_t ip = 0;
+        while (ip < code.size())
+        {
+            OpCode op = (OpCode)code[ip];
+            int size = operandSize(op);
+            if (size < 0 || ip + 1 + size > code.size())
+                return false;
+
+            index[ip] = ops.size();
+            Op o = {op, size > 0 ? code[ip + 1] : (uint8_t)0, size > 1 ? code[ip + 2] : (uint8_t)0, 0, true};
+            ip += 1 + size;
+            if (op == OpCode::CONSTANT && o.a >= constants.size())
+                return false;
+            if (isJump(op))
+            {
+                uint16_t offset = o.a | (o.b << 8);
+                if (op == OpCode::LOOP ? offset > ip : ip + offset > code.size())
+                    return false;
+                jumpTo.push_back(op == OpCode::LOOP ? ip - offset : ip + offset);
+            }
+            ops.push_back(o);
+        }
+        index[code.size()] = ops.size();
+
+        size_t j = 0;
+        for (auto& op : ops)
+        {
+            if (!isJump(op.code))
+                continue;
+            op.target = index[jumpTo[j++]];
+            if (op.target == SIZE_MAX)
+                return false;
+        }
+        return true;
+    }
+
+    bool optimize()
+    {
+        bool any = false;
+        bool changed = true;
+        while (changed)
+        {
+            findTargets();
+            changed = removeUnreachable();
+            for (size_t i = 0; i < ops.size(); i = next(i))
+                changed |= ops[i].live && rewrite(i);
+            any |= changed;
+        }
+        return any;
+    }
+
+    void encode(Chunk* chunk)
+    {
+        std::vector<size_t> offsets(ops.size() + 1);
+        size_t pos = 0;
+        for (size_t i = 0; i < ops.size(); i++)
+        {
+            offsets[i] = pos;
+            if (ops[i].live)
+                pos += 1 + operandSize(ops[i].code);
+        }
+        offsets[ops.size()] = pos;
+
+        for (size_t i = 0; i < ops.size(); i++)
+        {
+            Op& op = ops[i];
+            if (!op.live)
+                continue;
+            if (isJump(op.code))
+            {
+                size_t after = offsets[i] + 3;
+                size_t target = offsets[resolve(op.target)];
+                uint16_t offset = op.code == OpCode::LOOP ? after - target : target - after;
+                chunk->addCode(op.code, offset & 0xff, offset >> 8);
+            }
+            else if (operandSize(op.code) == 2)
+                chunk->addCode(op.code, op.a, op.b);
+            else if (operandSize(op.code) == 1)
+                chunk->addCode(op.code, op.a);
+            else
+                chunk->addCode(op.code);
+        }
+        chunk->constants = constants;
+    }
+
+private:
+    size_t next(size_t i)
+    {
+        for (i++; i < ops.size() && !ops[i].live; i++)
+            ;
+        return i;
+    }
+
+    // First live op at or after i: where a jump to a removed op lands now.
+    size_t resolve(size_t i)
+    {
+        while (i < ops.size() && !ops[i].live)
+            i++;
+        return i;
+    }
+
+    void findTargets()
+    {
+        targets.assign(ops.size() + 1, false);
+        for (auto& op : ops)
+            if (op.live && isJump(op.code))
+                targets[resolve(op.target)] = true;
+    }
+
+    // Ops between an unconditional transfer and the next jump target never run.
+    bool removeUnreachable()
+    {
+        bool changed = false;
+        bool reachable = true;
+        for (size_t i = 0; i < ops.size(); i++)
+        {
+            if (!ops[i].live)
+                continue;
+            if (targets[i])
+                reachable = true;
+            if (!reachable)
+            {
+                ops[i].live = false;
+                changed = true;
+                continue;
+            }
+            OpCode code = ops[i].code;
+            if (code == OpCode::JUMP || code == OpCode::LOOP || code == OpCode::RETURN)
+                reachable = false;
+        }
+        return changed;
+    }
+
+    int addConstant(Data value)
+    {
+        for (size_t i = 0; i < constants.size(); i++)
+            if (memcmp(&constants[i], &value, sizeof(Data)) == 0)
+                return i;
+        if (constants.size() > UINT8_MAX)
+            return -1;
+        constants.push_back(value);
+        return constants.size() - 1;
+    }
+
+    // Tries the patterns that start at op i. Ops after the first must not be jump targets, since
+    // code jumping there would miss the ones before.
+    bool rewrite(size_t i)
+    {
+        size_t n[3];
+        size_t count = 0;
+        for (size_t j = next(i); count < 3 && j < ops.size() && !targets[j]; j = next(j))
+            n[count++] = j;
+
+        Op& op = ops[i];
+        if (op.code == OpCode::JUMP && resolve(op.target) == next(i))
+        {
+            op.live = false;
+            return true;
+        }
+        if (count == 0)
+            return false;
+        Op& b = ops[n[0]];
+
+        if (op.code == OpCode::CONSTANT)
+        {
+            Data value = constants[op.a];
+            Data folded;
+            int id;
+            if (count >= 2 && b.code == OpCode::CONSTANT && foldBinary(ops[n[1]].code, value, constants[b.a], folded) &&
+                (id = addConstant(folded)) >= 0)
+            {
+                op.a = id;
+                b.live = ops[n[1]].live = false;
+                return true;
+            }
+            if (foldUnary(b, value) && (id = addConstant(value)) >= 0)
+            {
+                op.a = id;
+                b.live = false;
+                return true;
+            }
+            if (b.code == OpCode::JUMP_NT_POP)
+            {
+                if (value.valBool)
+                    op.live = false;
+                else
+                {
+                    op.code = OpCode::JUMP;
+                    op.target = b.target;
+                }
+                b.live = false;
+                return true;
+            }
+        }
+
+        // SET_LOCAL x; POPN n -> SET_LOCAL_POP x; POPN n-1
+        if (op.code == OpCode::SET_LOCAL && b.code == OpCode::POPN && b.a > 0)
+        {
+            op.code = OpCode::SET_LOCAL_POP;
+            b.live = --b.a > 0;
+            return true;
+        }
+        if (op.code == OpCode::POPN && b.code == OpCode::POPN && op.a + b.a <= UINT8_MAX)
+        {
+            op.a += b.a;
+            b.live = false;
+            return true;
+        }
+
+        // GET_LOCAL x; CONSTANT c; IADD; SET_LOCAL_POP x -> IADD_LOCAL x c
+        if (op.code == OpCode::GET_LOCAL && count == 3 && b.code == OpCode::CONSTANT && ops[n[1]].code == OpCode::IADD &&
+            ops[n[2]].code == OpCode::SET_LOCAL_POP && ops[n[2]].a == op.a)
+        {
+            op.code = OpCode::IADD_LOCAL;
+            op.b = b.a;
+            b.live = ops[n[1]].live = ops[n[2]].live = false;
+            return true;
+        }
+        return false;
+    }
+};
+} // namespace
+
+Chunk* Tier::optimize(const Chunk* chunk)
+{
+    Optimizer optimizer(chunk->constants);
+    if (!optimizer.decode(chunk->code) || !optimizer.optimize())
+        return nullptr;
+
+    Chunk* tiered = new Chunk();
+    optimizer.encode(tiered);
+    tiered->argSize = chunk->argSize;
+    tiered->tier = chunk->tier + 1;
+    // The globals were checked on the original, the copy refers to the same ones.
+    if (!Verifier::verify(tiered, SIZE_MAX, "tiered code"))
+    {
+        delete tiered;
+        return nullptr;
+    }
+    return tiered;
+}
+
+TierQueue::TierQueue()
+    : stopping(false)
+{
+}
+
+TierQueue::~TierQueue()
+{
+    if (!worker.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+
+    // The chunks belong to the Program and outlive this VM, the ones never tiered can be claimed again.
+    for (Chunk* chunk : queue)
+        chunk->tierQueued.store(false, std::memory_order_relaxed);
+}
+
+void TierQueue::request(Chunk* chunk)
+{
+    if (chunk->tierQueued.exchange(true, std::memory_order_relaxed))
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(chunk);
+    }
+    // The thread starts with the first hot chunk, short scripts never pay for it.
+    if (!worker.joinable())
+        worker = std::thread(&TierQueue::work, this);
+    else
+        wake.notify_one();
+}
+
+void TierQueue::work()
+{
+    while (true)
+    {
+        Chunk* chunk;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (stopping)
+                return;
+            chunk = queue.front();
+            queue.pop_front();
+        }
+
+        // The code and constants of a chunk never change once it runs, so reading them here is safe.
+        Chunk* tiered = Tier::optimize(chunk);
+        if (tiered)
+            chunk->tiered.store(tiered, std::memory_order_release);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Chunk.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// A chunk is queued for the optimizing tier once it has been called or has looped back this many
+// times. Both are below the JIT thresholds, so the JIT usually compiles the optimized code.
+constexpr uint32_t TIER_HOT_CALLS = 4;
+constexpr uint32_t TIER_HOT_LOOPS = 256;
+
+// Second tier for bytecode: constant folding, branch folding on constant conditions, dead code
+// removal and superinstruction selection, with jumps relocated after the code shrinks.
+class Tier
+{
+public:
+    // Returns an optimized copy of the chunk, or null when the chunk uses an opcode the tier does
+    // not rewrite or nothing could be improved.
+    static Chunk* optimize(const Chunk* chunk);
+};
+
+// Runs the tier on a background thread. Results are published through Chunk::tiered, so frames that
+// already run the old code finish on it and later calls pick up the new code.
+class TierQueue
+{
+private:
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Chunk*> queue;
+    bool stopping;
+
+public:
+    TierQueue();
+    ~TierQueue();
+
+    // Queues the chunk, unless a queue of any VM has claimed it before.
+    void request(Chunk* chunk);
+
+private:
+    void work();
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Scanner.h"
+
+#include <cstdint>
+#include <initializer_list>
+
+// A set of token types as a bitset, built at compile time, so testing the next token against a
+// set is a shift and a mask.
+class TokenSet
+{
+private:
+    static const size_t WORDS = ((size_t)TokenType::EOF_TOKEN + 64) / 64;
+    uint64_t words[WORDS];
+
+public:
+    constexpr TokenSet(std::initializer_list<TokenType> types)
+        : words()
+    {
+        for (TokenType type : types)
+            words[(size_t)type / 64] |= (uint64_t)1 << ((size_t)type % 64);
+    }
+
+    constexpr bool contains(TokenType type) const
+    {
+        return (words[(size_t)type / 64] >> ((size_t)type % 64)) & 1;
+    }
+};
@@ -0,0 +1,351 @@
+#pragma once
+
+#include "AstVisitor.hpp"
+#include "Enviroment.hpp"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Removes the functions, globals and natives that '::main' and the exported functions can not reach
+// before any IR is generated.
+// Globals with an initializer other than a literal stay, since '_start' runs it, and so does whatever
+// they reach. The remaining globals are laid out again so the VM does not allocate the holes.
+class TreeShaker : public AstVisitor
+{
+private:
+    struct Decl
+    {
+        Stmt* stmt;
+        EnvNamespace* ns;
+    };
+
+    std::vector<Stmt*>& root;
+    std::unordered_map<std::string, EnvNamespace*>& allNamespaces;
+    std::unordered_map<std::string, Decl> decls;
+    std::unordered_set<std::string> reached;
+    std::vector<std::string> worklist;
+    std::vector<std::unordered_set<std::string>> scopes;
+    EnvNamespace* currentNamespace;
+    bool collecting;
+
+public:
+    size_t functions;
+    size_t globals;
+    size_t natives;
+
+    TreeShaker(std::vector<Stmt*>& root, std::unordered_map<std::string, EnvNamespace*>& allNamespaces)
+        : root(root), allNamespaces(allNamespaces), currentNamespace(allNamespaces[""]), collecting(true), functions(0), globals(0), natives(0)
+    {
+    }
+
+    // Exports are named as 'ns::name'.
+    void shake(const std::vector<std::string>& exports = {})
+    {
+        if (allNamespaces[""]->vars.count("main") == 0)
+            return;
+
+        for (auto& stmt : root)
+            stmt->accept(this);
+        collecting = false;
+
+        reach("::main");
+        for (auto& name : exports)
+            reach("::" + name);
+        while (!worklist.empty())
+        {
+            Decl decl = decls[worklist.back()];
+            worklist.pop_back();
+            currentNamespace = decl.ns;
+            walk(decl.stmt);
+        }
+
+        for (auto& stmt : root)
+            sweep(stmt);
+
+        std::vector<GlobalVar*> kept;
+        for (auto& ns : allNamespaces)
+        {
+            for (auto it = ns.second->vars.begin(); it != ns.second->vars.end();)
+            {
+                if (reached.count(it->second.fullName))
+                {
+                    kept.push_back(&it->second);
+                    it++;
+                    continue;
+                }
+                if (decls.count(it->second.fullName) == 0)
+                    natives++;
+                delete it->second.val;
+                it = ns.second->vars.erase(it);
+            }
+        }
+
+        std::sort(kept.begin(), kept.end(), [](GlobalVar* a, GlobalVar* b) { return a->position < b->position; });
+        size_t& slots = allNamespaces.at("")->globalSlots();
+        slots = 0;
+        for (auto& var : kept)
+        {
+            var->position = slots;
+            slots += var->type->getSize();
+        }
+    }
+
+private:
+    void reach(const std::string& fullName)
+    {
+        if (reached.insert(fullName).second && decls.count(fullName))
+            worklist.push_back(fullName);
+    }
+
+    void reference(const std::string& name)
+    {
+        for (auto& scope : scopes)
+            if (scope.count(name))
+                return;
+
+        for (EnvNamespace* ns = currentNamespace; ns; ns = ns->closing)
+        {
+            if (ns->vars.count(name))
+            {
+                reach(ns->vars[name].fullName);
+                return;
+            }
+        }
+    }
+
+    void declare(Stmt* stmt, const std::string& name, bool root)
+    {
+        std::string fullName = currentNamespace->getName() + "::" + name;
+        decls[fullName] = {stmt, currentNamespace};
+        if (root)
+            reach(fullName);
+    }
+
+    void walk(Stmt* stmt)
+    {
+        StmtFunc* func = dynamic_cast<StmtFunc*>(stmt);
+        if (func)
+        {
+            scopes.emplace_back();
+            for (auto& arg : func->args)
+                scopes.back().insert(arg.getString());
+            for (auto& s : func->body->statements)
+                s->accept(this);
+            scopes.pop_back();
+        }
+        else if (((StmtVarDecleration*)stmt)->initializer)
+            ((StmtVarDecleration*)stmt)->initializer->accept(this);
+    }
+
+    bool unreached(const std::string& name)
+    {
+        return !reached.count(currentNamespace->getName() + "::" + name);
+    }
+
+    // Deletes the unreached declarations from a compilation unit or namespace.
+    void sweep(Stmt* stmt)
+    {
+        std::vector<Stmt*>* stmts;
+        EnvNamespace* enclosing = currentNamespace;
+        if (auto unit = dynamic_cast<StmtCompUnit*>(stmt))
+        {
+            stmts = &unit->stmts;
+            currentNamespace = allNamespaces[""];
+        }
+        else if (auto ns = dynamic_cast<StmtNamespace*>(stmt))
+        {
+            stmts = &ns->stmts;
+            currentNamespace = allNamespaces[currentNamespace->getName() + "::" + ns->name];
+        }
+        else
+            return;
+
+        for (auto it = stmts->begin(); it != stmts->end();)
+        {
+            auto func = dynamic_cast<StmtFunc*>(*it);
+            auto var = dynamic_cast<StmtVarDecleration*>(*it);
+            if ((func && unreached(func->name.getString())) || (var && unreached(var->name.getString())))
+            {
+                func ? functions++ : globals++;
+                delete *it;
+                it = stmts->erase(it);
+                continue;
+            }
+            sweep(*it);
+            it++;
+        }
+        currentNamespace = enclosing;
+    }
+
+public:
+    void visit(ExprArrGet* expr)
+    {
+        expr->callee->accept(this);
+        expr->index->accept(this);
+    }
+    void visit(ExprArrSet* expr)
+    {
+        expr->callee->accept(this);
+        expr->index->accept(this);
+        expr->assignment->accept(this);
+    }
+    void visit(ExprAssignment* expr)
+    {
+        expr->assignment->accept(this);
+        reference(expr->name.getString());
+    }
+    void visit(ExprBinary* expr)
+    {
+        expr->left->accept(this);
+        expr->right->accept(this);
+    }
+    void visit(ExprCall* expr)
+    {
+        for (auto& arg : expr->args)
+            arg->accept(this);
+        expr->callee->accept(this);
+    }
+    void visit(ExprCast* expr)
+    {
+        expr->expr->accept(this);
+    }
+    void visit(ExprLiteral* expr)
+    {
+    }
+    void visit(ExprLogic* expr)
+    {
+        expr->left->accept(this);
+        expr->right->accept(this);
+    }
+    void visit(ExprUnary* expr)
+    {
+        expr->expr->accept(this);
+    }
+    void visit(ExprVariable* expr)
+    {
+        reference(expr->name.getString());
+    }
+    void visit(ExprHeap* expr)
+    {
+    }
+    void visit(ExprGetDeref* expr)
+    {
+        expr->callee->accept(this);
+    }
+    void visit(ExprSetDeref* expr)
+    {
+        expr->asgn->accept(this);
+        expr->callee->accept(this);
+    }
+    void visit(ExprRef* expr)
+    {
+        expr->callee->accept(this);
+    }
+    void visit(ExprTake* expr)
+    {
+        expr->source->accept(this);
+    }
+    void visit(ExprGet* expr)
+    {
+        expr->callee->accept(this);
+    }
+    void visit(ExprSet* expr)
+    {
+        expr->asgn->accept(this);
+        expr->callee->accept(this);
+    }
+    void visit(ExprAddr* expr)
+    {
+        expr->callee->accept(this);
+    }
+
+    void visit(ExprSpawn* expr)
+    {
+        expr->call->accept(this);
+    }
+
+    void visit(ExprJoin* expr)
+    {
+        expr->handle->accept(this);
+    }
+
+    void visit(StmtBlock* stmt)
+    {
+        scopes.emplace_back();
+        for (auto& s : stmt->statements)
+            s->accept(this);
+        scopes.pop_back();
+    }
+    void visit(StmtExpr* stmt)
+    {
+        stmt->expr->accept(this);
+    }
+    void visit(StmtFunc* stmt)
+    {
+        declare(stmt, stmt->name.getString(), false);
+    }
+    void visit(StmtVarDecleration* stmt)
+    {
+        if (collecting)
+        {
+            bool literal = !stmt->initializer || stmt->initializer->instance == ExprType::Literal;
+            declare(stmt, stmt->name.getString(), !literal);
+            return;
+        }
+
+        if (stmt->initializer)
+            stmt->initializer->accept(this);
+        scopes.back().insert(stmt->name.getString());
+    }
+    void visit(StmtReturn* stmt)
+    {
+        if (stmt->retVal)
+            stmt->retVal->accept(this);
+    }
+    void visit(StmtIf* stmt)
+    {
+        stmt->condition->accept(this);
+        stmt->then->accept(this);
+        if (stmt->els)
+            stmt->els->accept(this);
+    }
+    void visit(StmtFor* stmt)
+    {
+        scopes.emplace_back();
+        if (stmt->decl)
+            stmt->decl->accept(this);
+        if (stmt->cond)
+            stmt->cond->accept(this);
+        if (stmt->inc)
+            stmt->inc->accept(this);
+        stmt->loop->accept(this);
+        scopes.pop_back();
+    }
+    void visit(StmtWhile* stmt)
+    {
+        stmt->condition->accept(this);
+        stmt->loop->accept(this);
+    }
+    void visit(StmtStruct* stmt)
+    {
+        // Methods are not reachable by name, so they are walked as roots.
+        for (auto& m : stmt->methodes)
+            walk(m.second);
+    }
+    void visit(StmtNamespace* stmt)
+    {
+        EnvNamespace* enclosing = currentNamespace;
+        currentNamespace = allNamespaces[currentNamespace->getName() + "::" + stmt->name];
+        for (auto& s : stmt->stmts)
+            s->accept(this);
+        currentNamespace = enclosing;
+    }
+    void visit(StmtCompUnit* stmt)
+    {
+        for (auto& s : stmt->stmts)
+            s->accept(this);
+    }
+};
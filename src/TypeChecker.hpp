@@ -137,7 +137,7 @@ public:
                 error(ss.str(), expr->op);
             }
             else
-                expr->type = std::make_shared<TypePrimitive>(TypeTag::INTEGER);
+                expr->type = TypeContext::primitive(TypeTag::INTEGER);
             break;
         }
         case TokenType::LESS:
@@ -148,23 +148,23 @@ public:
         case TokenType::BANG_EQUAL:
         {
             if (expr->left->type->tag == TypeTag::INTEGER && expr->right->type->tag == TypeTag::INTEGER)
-                expr->type = std::make_shared<TypePrimitive>(TypeTag::BOOL);
+                expr->type = TypeContext::primitive(TypeTag::BOOL);
             else if (expr->left->type->tag <= TypeTag::DOUBLE && expr->right->type->tag <= TypeTag::DOUBLE)
             {
                 if (expr->left->type->tag < TypeTag::DOUBLE)
                 {
                     auto from = expr->left->type;
-                    expr->left = new ExprCast(std::make_shared<TypePrimitive>(TypeTag::DOUBLE), expr->left);
+                    expr->left = new ExprCast(TypeContext::primitive(TypeTag::DOUBLE), expr->left);
                     ((ExprCast*)expr->left)->from = from;
                 }
                 if (expr->right->type->tag < TypeTag::DOUBLE)
                 {
                     auto from = expr->right->type;
-                    expr->right = new ExprCast(std::make_shared<TypePrimitive>(TypeTag::DOUBLE), expr->right);
+                    expr->right = new ExprCast(TypeContext::primitive(TypeTag::DOUBLE), expr->right);
                     ((ExprCast*)expr->right)->from = from;
                 }
 
-                expr->type = std::make_shared<TypePrimitive>(TypeTag::BOOL);
+                expr->type = TypeContext::primitive(TypeTag::BOOL);
             }
             else
             {
@@ -296,12 +296,11 @@ public:
     {
         expr->callee->accept(this);
 
-        if (!(expr->callee->type->tag == TypeTag::POINTER && ((TypePointer*)expr->callee->type.get())->is_owner))
+        if (!(expr->callee->type->tag == TypeTag::POINTER && ((TypePointer*)expr->callee->type)->is_owner))
             error("Invalid referance.", expr->token);
         else
         {
-            expr->type = expr->callee->type;
-            ((TypePointer*)expr->type.get())->is_owner = false;
+            expr->type = TypeContext::pointer(false, expr->callee->type->intrinsicType);
         }
     }
 
@@ -309,7 +308,7 @@ public:
     {
         expr->source->accept(this);
 
-        if (!(expr->source->type->tag == TypeTag::POINTER && ((TypePointer*)expr->source->type.get())->is_owner))
+        if (!(expr->source->type->tag == TypeTag::POINTER && ((TypePointer*)expr->source->type)->is_owner))
             error("Invalid referance.", expr->token);
         else
         {
@@ -322,7 +321,7 @@ public:
         expr->callee->accept(this);
         if (expr->callee->type->tag == TypeTag::STRUCT)
         {
-            TypeStruct* type = (TypeStruct*)expr->callee->type.get();
+            TypeStruct* type = (TypeStruct*)expr->callee->type;
             std::string getName = expr->get.getString();
             if (type->members.find(getName) != type->members.end())
             {
@@ -343,7 +342,7 @@ public:
         expr->asgn->accept(this);
         if (expr->callee->type->tag == TypeTag::STRUCT)
         {
-            TypeStruct* type = (TypeStruct*)expr->callee->type.get();
+            TypeStruct* type = (TypeStruct*)expr->callee->type;
             std::string getName = expr->get.getString();
             if (type->members.find(getName) != type->members.end())
             {
@@ -366,7 +365,27 @@ public:
     void visit(ExprAddr* expr)
     {
         expr->callee->accept(this);
-        expr->type = std::make_shared<TypePointer>(false, expr->callee->type);
+        expr->type = TypeContext::pointer(false, expr->callee->type);
+    }
+
+    void visit(ExprSpawn* expr)
+    {
+        expr->call->accept(this);
+        if (expr->call->callee->type->tag != TypeTag::FUNCTION)
+            error("Only a function can be spawned.", expr->token);
+        if (expr->token.type == TokenType::FIBER)
+            expr->type = TypeContext::primitive(TypeTag::VOID);
+        else
+            expr->type = TypeContext::task(expr->call->type);
+    }
+
+    void visit(ExprJoin* expr)
+    {
+        expr->handle->accept(this);
+        if (expr->handle->type->tag != TypeTag::TASK)
+            error("Only a task can be joined.", expr->token);
+        else
+            expr->type = expr->handle->type->intrinsicType;
     }
 
     void visit(StmtBlock* stmt)
@@ -1,32 +1,114 @@
 // #define DEBUG_CODE_TRACE
 
 #include "VM.h"
+#include "Heap.h"
+#include "Verifier.h"
 
 #ifdef DEBUG_CODE_TRACE
 #include "Debug.h"
 #endif // DEBUG_CODE_TRACE
 
+namespace
+{
+// Tasks can make a chunk hot on several threads at once, only one of them compiles it.
+std::mutex jitMutex;
+// Chunks that were not verified with their program are verified by the first thread calling them.
+std::mutex verifyMutex;
+
+// Counts without a locked add, an increment lost to another task only delays compiling.
+inline uint32_t bump(std::atomic<uint32_t>& counter)
+{
+    uint32_t count = counter.load(std::memory_order_relaxed) + 1;
+    counter.store(count, std::memory_order_relaxed);
+    return count;
+}
+}
+
 VM::VM(std::vector<Data> globals)
-    : ip(0), currentChunk(nullptr), globals(globals)
+    : ip(0), currentChunk(nullptr), root(this), ownGlobals(globals), tasks(nullptr), running(nullptr), nativeDepth(0), globals(ownGlobals), jitEnabled(true), tierEnabled(true)
 {
 #ifdef DEBUG_CODE_TRACE
     std::cout << "Globals: ";
-    printStack(this->globals);
+    printStack(this->globals.data(), this->globals.size());
 #endif
     stack.reserve(128);
 }
 
+// Hot chunks are queued for the tier by the root alone, tasks still pick up what it makes.
+VM::VM(VM* parent)
+    : ip(0), currentChunk(nullptr), root(parent->root), tasks(nullptr), running(nullptr), nativeDepth(0), globals(parent->globals), jitEnabled(parent->jitEnabled), tierEnabled(false)
+{
+    stack.reserve(128);
+}
+
 VM::~VM()
 {
+    delete running;
+    if (root == this)
+        delete tasks;
 }
 
 bool VM::interpret(Chunk* entryChunk)
 {
+    StringOwner::Scope strings(root->ownStrings);
+    if (!checkCall(entryChunk, 0, -1))
+        return false;
+    reserveFrame(entryChunk, stack.size());
     this->currentChunk = entryChunk;
+    this->ip = 0;
+    // The fibers the entry code started run to their end after it.
+    while (run(SIZE_MAX))
+    {
+        if (!running || !endFiber())
+            return true;
+    }
+    return false;
+}
+
+// Fibers the call starts only run once it has returned.
+bool VM::invoke(Chunk* func, const std::vector<Data>& args, std::vector<Data>& results)
+{
+    StringOwner::Scope strings(root->ownStrings);
+    stack.assign(args.data(), args.data() + args.size());
+    Data callee;
+    callee.valChunk = func;
+    stack.append(callee);
+    if (!call(args.size(), -1))
+        return false;
+    results.assign(stack.begin(), stack.end());
+
+    while (running && endFiber())
+    {
+        if (!run(SIZE_MAX))
+            return false;
+    }
+    stack.clear();
+    return true;
+}
+
+bool VM::runTask(Task* task)
+{
+    return invoke(task->func, task->io, task->io);
+}
+
+void VM::reset(const std::vector<Data>& globals)
+{
+    this->globals = globals;
+    stack.clear();
+    frames.clear();
+    delete running;
+    running = nullptr;
+    fibers.clear();
+    currentChunk = nullptr;
+    ip = 0;
+}
+
+bool VM::run(size_t exitDepth)
+{
     while (ip < this->currentChunk->code.size())
     {
 #ifdef DEBUG_CODE_TRACE
-        printStack(this->stack);
+        printStack(this->stack.data(), this->stack.size());
         dissambleInstruction(currentChunk, this->ip);
 #endif // DEBUG_CODE_TRACE
 
@@ -318,7 +400,7 @@ bool VM::interpret(Chunk* entryChunk)
         {
             uint8_t slot = advance();
             uint8_t size = advance();
-            uint8_t pos = stack.size();
+            size_t pos = stack.size();
             stack.resize(pos + size);
             memcpy(&stack[pos], &globals[slot], size * sizeof(Data));
             break;
@@ -334,7 +416,7 @@ bool VM::interpret(Chunk* entryChunk)
         {
             uint8_t slot = advance();
             uint8_t size = advance();
-            uint8_t pos = stack.size();
+            size_t pos = stack.size();
             stack.resize(pos + size);
             memcpy(&stack[pos], &stack[slot + this->frames.back().frameStart], size * sizeof(Data));
             break;
@@ -387,7 +469,9 @@ bool VM::interpret(Chunk* entryChunk)
             uint8_t size = advance();
             int32_t offset = stack.back().valInt;
             stack.pop_back();
-            memcpy(&stack[slot + this->frames.back().frameStart + offset], &stack[stack.size() - size], size * sizeof(Data));
+            size_t pos = stack.size();
+            stack.resize(pos + size);
+            memcpy(&stack[pos], &globals[slot + offset], size * sizeof(Data));
             break;
         }
         case OpCode::SET_LOCAL_OFFN:
@@ -405,7 +489,7 @@ bool VM::interpret(Chunk* entryChunk)
             uint8_t size = advance();
             int32_t offset = stack.back().valInt;
             stack.pop_back();
-            uint8_t pos = stack.size();
+            size_t pos = stack.size();
             stack.resize(pos + size);
             memcpy(&stack[pos], &stack[slot + this->frames.back().frameStart + offset], size * sizeof(Data));
             break;
@@ -413,9 +497,8 @@ bool VM::interpret(Chunk* entryChunk)
         case OpCode::SET_GLOBAL_POP:
         {
             uint8_t slot = advance();
-            Data val = stack.back();
+            globals[slot] = stack.back();
             stack.pop_back();
-            globals.push_back(val);
             break;
         }
         case OpCode::SET_LOCAL_POP:
@@ -425,11 +508,17 @@ bool VM::interpret(Chunk* entryChunk)
             stack.pop_back();
             break;
         }
+        case OpCode::IADD_LOCAL:
+        {
+            Data& local = stack[advance() + this->frames.back().frameStart];
+            local.valInt += currentChunk->getConstant(advance()).valInt;
+            break;
+        }
         case OpCode::ALLOC:
         {
             uint8_t size = advance();
             Data data;
-            data.valPtr = new Data[size];
+            data.valPtr = heapAlloc(size);
             stack.push_back(data);
             break;
         }
@@ -437,7 +526,7 @@ bool VM::interpret(Chunk* entryChunk)
         {
             Data ptr = stack.back();
             stack.pop_back();
-            delete[] ptr.valPtr;
+            heapFree(ptr.valPtr);
             break;
         }
         case OpCode::SET_DEREF:
@@ -524,15 +613,74 @@ bool VM::interpret(Chunk* entryChunk)
             stack.push_back(addr);
             break;
         }
+        case OpCode::LOAD_I8:
+        {
+            MemBase base = (MemBase)advance();
+            uint8_t slot = advance();
+            Data val;
+            val.valPtr = nullptr;
+            memcpy(&val, elementAddress(base, slot, 1), 1);
+            stack.push_back(val);
+            break;
+        }
+        case OpCode::LOAD_I32:
+        {
+            MemBase base = (MemBase)advance();
+            uint8_t slot = advance();
+            Data val;
+            val.valPtr = nullptr;
+            memcpy(&val, elementAddress(base, slot, 4), 4);
+            stack.push_back(val);
+            break;
+        }
+        case OpCode::STORE_I8:
+        {
+            MemBase base = (MemBase)advance();
+            uint8_t slot = advance();
+            uint8_t* addr = elementAddress(base, slot, 1);
+            memcpy(addr, &stack.back(), 1);
+            break;
+        }
+        case OpCode::STORE_I32:
+        {
+            MemBase base = (MemBase)advance();
+            uint8_t slot = advance();
+            uint8_t* addr = elementAddress(base, slot, 4);
+            memcpy(addr, &stack.back(), 4);
+            break;
+        }
+        case OpCode::CHECK_INDEX:
+        {
+            uint16_t size = advance16();
+            int32_t index = stack.back().valInt;
+            if (index < 0 || index >= size)
+            {
+                std::cout << "[Runtime Error] Array index " << index << " is out of bounds for size " << size << "." << std::endl;
+                return false;
+            }
+            break;
+        }
+        case OpCode::CHECK_LIMIT:
+        {
+            uint16_t size = advance16();
+            int32_t limit = stack.back().valInt;
+            stack.pop_back();
+            if (limit > size)
+            {
+                std::cout << "[Runtime Error] Loop reaches array index " << limit - 1 << ", out of bounds for size " << size << "." << std::endl;
+                return false;
+            }
+            break;
+        }
         case OpCode::JUMP:
         {
-            uint8_t offset = advance();
+            uint16_t offset = advance16();
             this->ip += offset;
             break;
         }
         case OpCode::JUMP_NT_POP:
         {
-            uint8_t offset = advance();
+            uint16_t offset = advance16();
             if (!stack.back().valBool)
                 this->ip += offset;
             stack.pop_back();
@@ -540,13 +688,30 @@ bool VM::interpret(Chunk* entryChunk)
         }
         case OpCode::LOOP:
         {
-            uint8_t offset = advance();
+            uint16_t offset = advance16();
             this->ip -= offset;
+            if (frames.empty())
+                break;
+
+            // On-stack replacement: a hot loop continues in machine code, which also returns.
+            uint32_t loops = bump(currentChunk->loops);
+            tierUp(currentChunk, loops, TIER_HOT_LOOPS);
+            if (isCompiled(currentChunk, loops, JIT_HOT_LOOPS))
+            {
+                Frame frame = this->frames.back();
+                if (!runJit(currentChunk, frame.frameStart, this->ip))
+                    return false;
+                this->frames.pop_back();
+                this->ip = frame.ip;
+                this->currentChunk = frame.chunk;
+                if (this->frames.size() == exitDepth)
+                    return true;
+            }
             break;
         }
         case OpCode::JUMP_NT:
         {
-            uint8_t offset = advance();
+            uint16_t offset = advance16();
             if (!stack.back().valBool)
                 this->ip += offset;
             break;
@@ -554,9 +719,21 @@ bool VM::interpret(Chunk* entryChunk)
         case OpCode::CALL:
         {
             uint8_t argSize = advance();
-            Chunk* func = stack.back().valChunk;
+            uint8_t results = advance();
+            Chunk* func = stack.back().valChunk->latest();
             stack.pop_back();
+            if (!checkCall(func, argSize, results))
+                return false;
+            uint32_t calls = bump(func->calls);
+            tierUp(func, calls, TIER_HOT_CALLS);
+            if (isCompiled(func, calls, JIT_HOT_CALLS))
+            {
+                if (!runJit(func, stack.size() - argSize, 0))
+                    return false;
+                break;
+            }
             this->frames.push_back(Frame(ip, currentChunk, this->stack.size() - argSize));
+            reserveFrame(func, this->stack.size() - argSize);
             this->currentChunk = func;
             this->ip = 0;
             break;
@@ -564,12 +741,27 @@ bool VM::interpret(Chunk* entryChunk)
         case OpCode::NATIVE_CALL:
         {
             uint8_t argSize = advance();
-            NativeFn func = stack.back().valNative;
-            stack.pop_back();
-            std::vector<Data> result = func(argSize, argSize > 0 ? &stack[this->stack.size() - argSize] : nullptr);
-            this->stack.resize(this->stack.size() - argSize);
-            for(int i = 0; i < result.size(); i++)
-                stack.push_back(result[i]);
+            uint8_t results = advance();
+            if (running && exitDepth == SIZE_MAX && park(argSize))
+                break;
+            callNative(argSize, results);
+            break;
+        }
+        case OpCode::FIBER:
+        {
+            if (!startFiber(advance()))
+                return false;
+            break;
+        }
+        case OpCode::SPAWN:
+        {
+            spawn(advance());
+            break;
+        }
+        case OpCode::JOIN:
+        {
+            if (!join(advance()))
+                return false;
             break;
         }
         case OpCode::RETURN:
@@ -592,6 +784,11 @@ bool VM::interpret(Chunk* entryChunk)
 
             this->ip = frame.ip;
             this->currentChunk = frame.chunk;
+            if (this->frames.size() == exitDepth)
+                return true;
+            // Only the first frame of a fiber returns to no chunk.
+            if (!this->currentChunk && !endFiber())
+                return true;
 
             break;
         }
@@ -599,12 +796,288 @@ bool VM::interpret(Chunk* entryChunk)
     }
 
 #ifdef DEBUG_CODE_TRACE
-    printStack(this->stack);
+    printStack(this->stack.data(), this->stack.size());
 #endif // DEBUG_CODE_TRACE
 
     return true;
 }
 
+bool VM::call(uint8_t argSize, int results)
+{
+    Chunk* func = stack.back().valChunk->latest();
+    stack.pop_back();
+    if (!checkCall(func, argSize, results))
+        return false;
+    size_t frameStart = this->stack.size() - argSize;
+    uint32_t calls = bump(func->calls);
+    tierUp(func, calls, TIER_HOT_CALLS);
+    if (isCompiled(func, calls, JIT_HOT_CALLS))
+        return runJit(func, frameStart, 0);
+
+    this->frames.push_back(Frame(ip, currentChunk, frameStart));
+    reserveFrame(func, frameStart);
+    this->currentChunk = func;
+    this->ip = 0;
+    nativeDepth++;
+    bool ran = run(this->frames.size() - 1);
+    nativeDepth--;
+    return ran;
+}
+
+// Exactly 'results' slots are left, the verified code after the call counts on them.
+void VM::callNative(uint8_t argSize, uint8_t results)
+{
+    NativeFn func = stack.back().valNative;
+    stack.pop_back();
+    std::vector<Data> result = func(argSize, argSize > 0 ? &stack[this->stack.size() - argSize] : nullptr);
+    size_t base = this->stack.size() - argSize;
+    this->stack.resize(base + results);
+    if (!result.empty())
+        memcpy(&stack[base], result.data(), std::min(result.size(), (size_t)results) * sizeof(Data));
+}
+
+bool VM::checkCall(Chunk* func, uint8_t argSize, int results)
+{
+    if (!func->verified.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(verifyMutex);
+        if (!func->verified.load(std::memory_order_relaxed) && !Verifier::verify(func, globals.size(), "function"))
+            return false;
+    }
+    if (func->argSize != argSize || (results >= 0 && func->results != results))
+    {
+        std::cout << "[Runtime Error] A call passes " << (int)argSize << " slots to a function that takes " << (int)func->argSize
+                  << ", or expects " << results << " back from one that returns " << func->results << "." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void VM::spawn(uint8_t argSize)
+{
+    // The pool starts with the first task, it is only made on the root.
+    if (!root->tasks)
+        root->tasks = new TaskPool(root);
+
+    Chunk* func = stack.back().valChunk;
+    stack.pop_back();
+    Task* task = new Task(func, stack.data() + stack.size() - argSize, argSize);
+    stack.resize(stack.size() - argSize);
+
+    Data handle;
+    handle.valTask = task;
+    stack.push_back(handle);
+    root->tasks->submit(task);
+}
+
+bool VM::join(uint8_t size)
+{
+    Task* task = stack.back().valTask;
+    stack.pop_back();
+    // A handle is good for one join, copies of it stay in the script after that.
+    if (!task || !root->tasks || task->joined.exchange(true))
+    {
+        std::cout << "[Runtime Error] Joined a task handle that is null or was already joined." << std::endl;
+        return false;
+    }
+    if (!root->tasks->join(task))
+        return false;
+    if (task->io.size() < size)
+    {
+        std::cout << "[Runtime Error] A task returned " << task->io.size() << " slots, " << (int)size << " were expected." << std::endl;
+        return false;
+    }
+
+    stack.append(task->io.data(), task->io.data() + size);
+    root->tasks->retire(task);
+    return true;
+}
+
+bool VM::startFiber(uint8_t argSize)
+{
+    Chunk* func = stack.back().valChunk->latest();
+    if (!checkCall(func, argSize, -1))
+        return false;
+
+    // The code that runs now becomes the first fiber.
+    if (!running)
+        running = new Fiber();
+
+    Fiber* fiber = new Fiber();
+    fiber->chunk = func;
+    stack.pop_back();
+    fiber->stack.assign(stack.end() - argSize, stack.end());
+    stack.resize(stack.size() - argSize);
+    fiber->frames.push_back(Frame(0, nullptr, 0));
+    fibers.park(fiber);
+    return true;
+}
+
+bool VM::park(uint8_t argSize)
+{
+    WaitKind kind;
+    if (!isBlocking(stack.back().valNative, kind))
+        return false;
+
+    Fiber* fiber = running;
+    fiber->wait = kind;
+    if (kind == WaitKind::INPUT)
+    {
+        if (inputReady())
+            return false;
+        // The call runs again once there is input.
+        this->ip -= 3;
+    }
+    else
+    {
+        auto seconds = std::chrono::duration<double>(kind == WaitKind::TIME ? stack[stack.size() - 1 - argSize].valDouble : 0);
+        fiber->until = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(seconds);
+        stack.resize(stack.size() - 1 - argSize);
+    }
+
+    saveFiber(fiber);
+    fibers.park(fiber);
+    loadFiber(fibers.next());
+    return true;
+}
+
+bool VM::endFiber()
+{
+    delete running;
+    running = fibers.next();
+    if (!running)
+        return false;
+    loadFiber(running);
+    return true;
+}
+
+void VM::saveFiber(Fiber* fiber)
+{
+    fiber->stack.swap(stack);
+    fiber->frames.swap(frames);
+    fiber->chunk = currentChunk;
+    fiber->ip = ip;
+}
+
+void VM::loadFiber(Fiber* fiber)
+{
+    stack.swap(fiber->stack);
+    frames.swap(fiber->frames);
+    currentChunk = fiber->chunk;
+    ip = fiber->ip;
+    running = fiber;
+    // A new fiber only has its arguments, the others keep their room.
+    if (currentChunk && !frames.empty())
+        reserveFrame(currentChunk, frames.back().frameStart);
+}
+
+void VM::tierUp(Chunk* chunk, uint32_t count, uint32_t threshold)
+{
+    if (tierEnabled && count >= threshold && chunk->tier == 0 && !chunk->tierQueued.load(std::memory_order_relaxed))
+        tier.request(chunk);
+}
+
+bool VM::isCompiled(Chunk* chunk, uint32_t count, uint32_t threshold)
+{
+    // Compiled code would keep frames on the C stack, where a fiber can not switch and deep recursion
+    // would overflow it.
+    if (running || nativeDepth >= JIT_MAX_DEPTH)
+        return false;
+    if (chunk->jit.load(std::memory_order_acquire))
+        return true;
+    if (!jitEnabled || chunk->jitFailed || count < threshold)
+        return false;
+
+    std::lock_guard<std::mutex> lock(jitMutex);
+    if (!chunk->jit.load(std::memory_order_relaxed) && !chunk->jitFailed)
+    {
+        JitCode* code = Jit::compile(chunk);
+        chunk->jitFailed = !code;
+        chunk->jit.store(code, std::memory_order_release);
+    }
+    return chunk->jit.load(std::memory_order_relaxed);
+}
+
+// Gives the frame its room on the stack again and points the compiled code at where it is now.
+Data* VM::resume(JitFrame* regs)
+{
+    size_t top = stack.size();
+    if (top < regs->top)
+        stack.resize(regs->top);
+    regs->frame = stack.data() + regs->frameStart;
+    regs->globals = globals.data();
+    return stack.data() + top;
+}
+
+bool VM::runJit(Chunk* chunk, size_t frameStart, size_t ip)
+{
+    JitFrame regs;
+    regs.frameStart = frameStart;
+    regs.top = frameStart + chunk->maxStack;
+    JitCode* code = chunk->jit.load(std::memory_order_acquire);
+    nativeDepth++;
+    Data* sp = code->entry(this, resume(&regs), &regs, code->target(ip));
+    nativeDepth--;
+    if (!sp)
+        return false;
+    stack.resize(sp - stack.data());
+    return true;
+}
+
+Data* VM::jitCall(VM* vm, Data* sp, int sizes, JitFrame* regs)
+{
+    // Between compiled chunks the stack keeps the caller's room and only grows by the callee's.
+    uint8_t argSize = sizes & 0xff;
+    uint8_t results = sizes >> 8;
+    Chunk* func = sp[-1].valChunk->latest();
+    JitCode* code = func->jit.load(std::memory_order_acquire);
+    if (code && vm->nativeDepth < JIT_MAX_DEPTH)
+    {
+        if (!vm->checkCall(func, argSize, results))
+            return nullptr;
+        JitFrame callee;
+        callee.frameStart = sp - 1 - argSize - vm->stack.data();
+        callee.top = callee.frameStart + func->maxStack;
+        if (vm->stack.size() < callee.top)
+            vm->stack.resize(callee.top);
+        callee.frame = vm->stack.data() + callee.frameStart;
+        callee.globals = vm->globals.data();
+        vm->nativeDepth++;
+        sp = code->entry(vm, callee.frame + argSize, &callee, code->target(0));
+        vm->nativeDepth--;
+        regs->frame = vm->stack.data() + regs->frameStart;
+        regs->globals = vm->globals.data();
+        return sp;
+    }
+
+    vm->stack.resize(sp - vm->stack.data());
+    if (!vm->call(argSize, results))
+        return nullptr;
+    return vm->resume(regs);
+}
+
+Data* VM::jitNativeCall(VM* vm, Data* sp, int sizes, JitFrame* regs)
+{
+    vm->stack.resize(sp - vm->stack.data());
+    vm->callNative(sizes & 0xff, sizes >> 8);
+    return vm->resume(regs);
+}
+
+Data* VM::jitSpawn(VM* vm, Data* sp, int argSize, JitFrame* regs)
+{
+    vm->stack.resize(sp - vm->stack.data());
+    vm->spawn(argSize);
+    return vm->resume(regs);
+}
+
+Data* VM::jitJoin(VM* vm, Data* sp, int size, JitFrame* regs)
+{
+    vm->stack.resize(sp - vm->stack.data());
+    if (!vm->join(size))
+        return nullptr;
+    return vm->resume(regs);
+}
+
 void VM::typeCast(TypeTag from, TypeTag to)
 {
 #define CAST(value)          \
@@ -1,40 +1,59 @@
 #pragma once
 
 #include "Chunk.hpp"
+#include "Fiber.h"
+#include "Jit.h"
+#include "TaskPool.h"
+#include "Tier.h"
 #include "Value.hpp"
+#include "ValueStack.hpp"
 #include <vector>
 
-struct Frame
-{
-	size_t ip;
-	Chunk* chunk;
-	size_t frameStart;
-
-	Frame()
-		:ip(0), chunk(nullptr), frameStart(0)
-	{}
-
-	Frame(size_t ip, Chunk* chunk, size_t frameStart)
-		:ip(ip), chunk(chunk), frameStart(frameStart)
-	{}
-};
-
 class VM
 {
 public:
 	VM(std::vector<Data> globals);
+	// VM of a task, on a stack of its own with the globals of 'parent'.
+	VM(VM* parent);
 	~VM();
 	bool interpret(Chunk* entryChunk);
+	// Calls 'func' on an idle VM and gives back what it returns. Fibers it starts run before this
+	// returns. 'args' and 'results' may be the same vector.
+	bool invoke(Chunk* func, const std::vector<Data>& args, std::vector<Data>& results);
+	// Calls the function of the task and leaves the results in it.
+	bool runTask(Task* task);
+	// Makes the VM idle again with fresh globals, also after a runtime error. Tasks still running
+	// are left to finish.
+	void reset(const std::vector<Data>& globals);
 
-	inline const std::vector<Data>* getStack() const { return &this->stack; }
+	inline const ValueStack* getStack() const { return &this->stack; }
+
+	// Entered from compiled code for CALL and NATIVE_CALL, with the argument size in the low byte of
+	// 'sizes' and the result size above. They return the new stack top, or null after a runtime error.
+	static Data* jitCall(VM* vm, Data* sp, int sizes, JitFrame* regs);
+	static Data* jitNativeCall(VM* vm, Data* sp, int sizes, JitFrame* regs);
+	// Entered from compiled code for SPAWN and JOIN, they return like jitCall.
+	static Data* jitSpawn(VM* vm, Data* sp, int argSize, JitFrame* regs);
+	static Data* jitJoin(VM* vm, Data* sp, int size, JitFrame* regs);
 
 private:
 	Chunk* currentChunk;
 	size_t ip;
-	std::vector<Data> stack;
+	ValueStack stack;
+	VM* root; // the VM the program started on, it owns the globals, the task pool and the strings
+	std::vector<Data> ownGlobals;
+	// The strings the program makes while it runs, freed with the root. Results of 'invoke' that
+	// hold one are only valid as long as the VM.
+	StringOwner ownStrings;
+	TaskPool* tasks;
+	Fiber* running; // null until the first fiber starts
+	FiberQueue fibers;
+	size_t nativeDepth; // compiled chunks and nested runs on the C stack
 public:
-	std::vector<Data> globals;
+	std::vector<Data>& globals;
 	std::vector<Frame> frames;
+	bool jitEnabled;
+	bool tierEnabled;
 
 private:
 	inline uint8_t advance()
@@ -42,5 +61,75 @@ private:
 		return this->currentChunk->code[this->ip++];
 	}
 
+	inline uint16_t advance16()
+	{
+		uint16_t val = this->currentChunk->code[this->ip] | (this->currentChunk->code[this->ip + 1] << 8);
+		this->ip += 2;
+		return val;
+	}
+
+	// Pops the index (and the pointer for deref bases) of a packed access and returns the element address.
+	inline uint8_t* elementAddress(MemBase base, uint8_t slot, size_t width)
+	{
+		if (base == MemBase::DEREF)
+		{
+			Data ptr = stack.back();
+			stack.pop_back();
+			return (uint8_t*)ptr.valPtr;
+		}
+
+		int32_t index = stack.back().valInt;
+		stack.pop_back();
+
+		uint8_t* start;
+		if (base == MemBase::LOCAL)
+			start = (uint8_t*)&stack[slot + this->frames.back().frameStart];
+		else if (base == MemBase::GLOBAL)
+			start = (uint8_t*)&globals[slot];
+		else
+		{
+			Data ptr = stack.back();
+			stack.pop_back();
+			start = (uint8_t*)(ptr.valPtr + slot);
+		}
+
+		return start + index * width;
+	}
+
 	void typeCast(TypeTag from, TypeTag to);
+
+	// Runs until the frame at 'exitDepth' returns, or to the end of the code for the entry chunk.
+	bool run(size_t exitDepth);
+	// 'results' is what the caller expects back, -1 takes what the function returns.
+	bool call(uint8_t argSize, int results);
+	void callNative(uint8_t argSize, uint8_t results);
+	void spawn(uint8_t argSize);
+	bool join(uint8_t size);
+
+	// Verifies a chunk the first time it is called and compares it with the call. Verified code only
+	// checks the room on the stack when a frame starts.
+	bool checkCall(Chunk* func, uint8_t argSize, int results);
+	inline void reserveFrame(Chunk* func, size_t frameStart)
+	{
+		stack.reserve(frameStart + func->maxStack);
+	}
+
+	// Fibers switch only in the outermost run, where every frame of the fiber is on the VM stack.
+	bool startFiber(uint8_t argSize);
+	// Parks the running fiber on a blocking native and continues with the next one. Returns false
+	// when the native is to be called right away.
+	bool park(uint8_t argSize);
+	// Drops the running fiber, returns false when no fiber is left.
+	bool endFiber();
+	void saveFiber(Fiber* fiber);
+	void loadFiber(Fiber* fiber);
+
+	// Queues a hot chunk for the optimizing tier.
+	void tierUp(Chunk* chunk, uint32_t count, uint32_t threshold);
+	// Compiles a chunk once it is hot, returns whether it has machine code.
+	bool isCompiled(Chunk* chunk, uint32_t count, uint32_t threshold);
+	bool runJit(Chunk* chunk, size_t frameStart, size_t ip);
+	Data* resume(JitFrame* regs);
+
+	TierQueue tier;
 };
@@ -3,15 +3,18 @@
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "Scanner.h"
+#include "String.h"
 
 class IRChunk;
 class Chunk;
+class Task;
 
 enum class TypeTag
 {
@@ -24,6 +27,7 @@ enum class TypeTag
     VOID,
     ARRAY,
     POINTER,
+    TASK,
     FUNCTION,
     NATIVE,
     METHODE,
@@ -33,34 +37,69 @@ enum class TypeTag
     ERROR
 };
 
-class Type
+union Data
 {
-public:
-    TypeTag tag;
-    std::shared_ptr<Type> intrinsicType;
+    bool valBool;
+    char valChar;
+    int32_t valInt;
+    float valFloat;
+    double valDouble;
+    String* valString;
+    Chunk* valChunk;
+    std::vector<Data> (*valNative)(int, Data*);
+    Data* valPtr;
+    Task* valTask;
+};
 
-    Type(TypeTag tag, std::shared_ptr<Type> intrinsicType)
+typedef std::vector<Data> (*NativeFn)(int, Data*);
+
+// Types are made by the TypeContext, which gives equal types the same object, so they are never
+// changed once made and are compared by address. Only structs are made by the parser, one per name.
+class Type
+{
+protected:
+    Type(TypeTag tag, Type* intrinsicType)
         : tag(tag), intrinsicType(intrinsicType)
     {
     }
 
+public:
+    const TypeTag tag;
+    Type* const intrinsicType;
+
+    Type(const Type&) = delete;
+    Type& operator=(const Type&) = delete;
+    virtual ~Type() {}
+
     virtual bool isPrimitive() = 0;
     virtual size_t getSize() = 0;
     virtual void print() = 0;
     virtual std::stringstream getName() = 0;
-    virtual bool isSame(std::shared_ptr<Type> type) = 0;
+
+    inline bool isSame(const Type* type) const
+    {
+        return this == type;
+    }
+
+    // Byte width of this type when it is stored as a packed array element, 0 if it takes whole slots.
+    virtual size_t getPackedWidth()
+    {
+        return 0;
+    }
 };
 
 // TODO: remove string and make it a allias for char[]& or char[]*
 
 class TypePrimitive : public Type
 {
-public:
+    friend class TypeContext;
+
     TypePrimitive(TypeTag tag)
         : Type(tag, nullptr)
     {
     }
 
+public:
     bool isPrimitive()
     {
         return true;
@@ -71,6 +110,21 @@ public:
         return tag == TypeTag::VOID ? 0 : 1;
     }
 
+    size_t getPackedWidth()
+    {
+        switch (tag)
+        {
+        case TypeTag::BOOL:
+        case TypeTag::CHAR:
+            return 1;
+        case TypeTag::INTEGER:
+        case TypeTag::FLOAT:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
     void print()
     {
         switch (tag)
@@ -152,22 +206,20 @@ public:
         }
         return data;
     }
-
-    bool isSame(std::shared_ptr<Type> type)
-    {
-        return this->tag == type->tag && type->isPrimitive();
-    }
 };
 
 class TypePointer : public Type
 {
-public:
-    bool is_owner;
-    TypePointer(bool is_owner, std::shared_ptr<Type> intrinsicType)
+    friend class TypeContext;
+
+    TypePointer(bool is_owner, Type* intrinsicType)
         : Type(TypeTag::POINTER, intrinsicType), is_owner(is_owner)
     {
     }
 
+public:
+    const bool is_owner;
+
     bool isPrimitive()
     {
         return false;
@@ -190,26 +242,40 @@ public:
         ss << (is_owner ? "&" : "*");
         return ss;
     }
+};
 
-    bool isSame(std::shared_ptr<Type> type)
+class TypeArray : public Type
+{
+    friend class TypeContext;
+
+    // The slots, kept when the element size is final. Structs grow until their declaration is parsed.
+    size_t slots;
+    bool fixed;
+
+    TypeArray(size_t size, Type* internalType)
+        : Type(TypeTag::ARRAY, internalType), size(size), slots(0), fixed(false)
     {
-        if (this->tag == type->tag && ((TypePointer*)type.get())->is_owner == this->is_owner)
+        Type* element = internalType;
+        while (element->tag == TypeTag::ARRAY)
+            element = element->intrinsicType;
+        if (element->tag != TypeTag::STRUCT)
         {
-            return this->intrinsicType->isSame(type->intrinsicType);
+            slots = countSlots();
+            fixed = true;
         }
-        return false;
     }
-};
 
-class TypeArray : public Type
-{
-public:
-    size_t size;
-    TypeArray(size_t size, std::shared_ptr<Type> internalType)
-        : Type(TypeTag::ARRAY, internalType), size(size)
+    size_t countSlots()
     {
+        size_t width = intrinsicType->getPackedWidth();
+        if (width != 0)
+            return (size * width + sizeof(Data) - 1) / sizeof(Data);
+        return size * intrinsicType->getSize();
     }
 
+public:
+    const size_t size;
+
     bool isPrimitive()
     {
         return false;
@@ -217,7 +283,15 @@ public:
 
     size_t getSize()
     {
-        return size * intrinsicType->getSize();
+        return fixed ? slots : countSlots();
+    }
+
+    // Size of the array counted in packed elements of 'width' bytes, or in slots when width is 0.
+    size_t getPackedSize(size_t width)
+    {
+        if (width != 0)
+            return getSize() * sizeof(Data) / width;
+        return getSize();
     }
 
     void print()
@@ -232,25 +306,54 @@ public:
         ss << "[]";
         return ss;
     }
-    bool isSame(std::shared_ptr<Type> type)
+};
+
+// Handle of a spawned call, joining it gives the value of 'intrinsicType'.
+class TypeTask : public Type
+{
+    friend class TypeContext;
+
+    TypeTask(Type* resultType)
+        : Type(TypeTag::TASK, resultType)
+    {
+    }
+
+public:
+    bool isPrimitive()
     {
-        if (this->tag == type->tag && type.get()->getSize() == this->size)
-        {
-            return this->intrinsicType->isSame(type->intrinsicType);
-        }
         return false;
     }
+
+    size_t getSize()
+    {
+        return 1;
+    }
+
+    void print()
+    {
+        intrinsicType->print();
+        std::cout << " task";
+    }
+
+    std::stringstream getName()
+    {
+        auto ss = intrinsicType->getName();
+        ss << " task";
+        return ss;
+    }
 };
 
 class TypeFunction : public Type
 {
-public:
-    std::vector<std::shared_ptr<Type>> argTypes;
-    bool is_variadic = false;
+    friend class TypeContext;
 
-    TypeFunction(TypeTag funcType, std::shared_ptr<Type> retType, std::vector<std::shared_ptr<Type>> argTypes, bool is_variadic)
+    TypeFunction(TypeTag funcType, Type* retType, const std::vector<Type*>& argTypes, bool is_variadic)
         : Type(funcType, retType), argTypes(argTypes), is_variadic(is_variadic) {}
 
+public:
+    const std::vector<Type*> argTypes;
+    const bool is_variadic;
+
     bool isPrimitive()
     {
         return false;
@@ -287,32 +390,17 @@ public:
         ss << ")";
         return ss;
     }
-
-    bool isSame(std::shared_ptr<Type> type)
-    {
-        if (this->tag == type->tag)
-        {
-            bool argsSame = argTypes.size() == std::dynamic_pointer_cast<TypeFunction>(type)->argTypes.size();
-            for (int i = 0; i < argTypes.size() && argsSame; i++)
-            {
-                argsSame = argTypes[i] == std::dynamic_pointer_cast<TypeFunction>(type);
-            }
-
-            return this->intrinsicType->isSame(type->intrinsicType) && argsSame;
-        }
-        return false;
-    }
 };
 
 struct structMember
 {
-    std::shared_ptr<Type> type;
+    Type* type;
     Token name;
     size_t offset;
     
     structMember(){}
 
-    structMember(std::shared_ptr<Type> type, Token name, size_t offset)
+    structMember(Type* type, Token name, size_t offset)
         : type(type), name(name), offset(offset) {}
 };
 
@@ -351,12 +439,7 @@ public:
         return ss;
     }
 
-    bool isSame(std::shared_ptr<Type> type)
-    {
-        return type->tag == this->tag && ((TypeStruct*)type.get())->name.getString() == name.getString();
-    }
-
-    void addMember(std::shared_ptr<Type> type, Token name)
+    void addMember(Type* type, Token name)
     {
         if (members.find(name.getString()) == members.end())
         {
@@ -371,79 +454,141 @@ public:
     }
 };
 
-union Data
+// Interns the types. Every type but a struct is asked for here and made only the first time, the
+// types are never freed.
+class TypeContext
 {
-    bool valBool;
-    char valChar;
-    int32_t valInt;
-    float valFloat;
-    double valDouble;
-    char* valString;
-    Chunk* valChunk;
-    std::vector<Data> (*valNative)(int, Data*);
-    Data* valPtr;
-};
+private:
+    struct Key
+    {
+        TypeTag tag;
+        Type* intrinsic;
+        size_t size; // array length, pointer ownership or variadic
+        std::vector<Type*> args;
 
-typedef std::vector<Data> (*NativeFn)(int, Data*);
+        bool operator==(const Key& other) const
+        {
+            return tag == other.tag && intrinsic == other.intrinsic && size == other.size && args == other.args;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            size_t hash = std::hash<Type*>()(key.intrinsic) ^ ((size_t)key.tag << 1) ^ (key.size * 0x9e3779b97f4a7c15ull);
+            for (Type* arg : key.args)
+                hash = (hash ^ std::hash<Type*>()(arg)) * 0x100000001b3ull;
+            return hash;
+        }
+    };
+
+    TypePrimitive* primitives[(size_t)TypeTag::ERROR + 1];
+    std::mutex mutex;
+    std::unordered_map<Key, Type*, KeyHash> types;
+
+    TypeContext()
+    {
+        for (size_t i = 0; i <= (size_t)TypeTag::ERROR; i++)
+            primitives[i] = new TypePrimitive((TypeTag)i);
+    }
+
+    static TypeContext& get()
+    {
+        static TypeContext* context = new TypeContext();
+        return *context;
+    }
+
+    template <typename T, typename Make>
+    static T* intern(Key&& key, Make make)
+    {
+        TypeContext& context = get();
+        std::lock_guard<std::mutex> lock(context.mutex);
+        auto it = context.types.find(key);
+        if (it != context.types.end())
+            return (T*)it->second;
+        T* type = make();
+        context.types.emplace(std::move(key), type);
+        return type;
+    }
+
+public:
+    static TypePrimitive* primitive(TypeTag tag)
+    {
+        return get().primitives[(size_t)tag];
+    }
+
+    static TypePointer* pointer(bool is_owner, Type* to)
+    {
+        return intern<TypePointer>({TypeTag::POINTER, to, is_owner, {}}, [&] { return new TypePointer(is_owner, to); });
+    }
+
+    static TypeArray* array(size_t size, Type* element)
+    {
+        return intern<TypeArray>({TypeTag::ARRAY, element, size, {}}, [&] { return new TypeArray(size, element); });
+    }
+
+    static TypeTask* task(Type* result)
+    {
+        return intern<TypeTask>({TypeTag::TASK, result, 0, {}}, [&] { return new TypeTask(result); });
+    }
+
+    static TypeFunction* function(TypeTag funcType, Type* retType, const std::vector<Type*>& argTypes, bool is_variadic)
+    {
+        return intern<TypeFunction>({funcType, retType, is_variadic, argTypes}, [&] { return new TypeFunction(funcType, retType, argTypes, is_variadic); });
+    }
+};
 
 class Value
 {
 public:
-    std::shared_ptr<Type> type;
+    Type* type;
     Data data;
 
     Value()
-        : type(std::make_shared<TypePrimitive>(TypeTag::ERROR)), data({0})
+        : type(TypeContext::primitive(TypeTag::ERROR)), data({0})
     {
     }
 
-    Value(std::shared_ptr<Type> type)
+    Value(Type* type)
         : type(type), data({0})
     {
     }
 
     Value(bool value)
-        : type(std::make_shared<TypePrimitive>(TypeTag::BOOL))
+        : type(TypeContext::primitive(TypeTag::BOOL))
     {
         data.valBool = value;
     }
 
     Value(char value)
-        : type(std::make_shared<TypePrimitive>(TypeTag::CHAR))
+        : type(TypeContext::primitive(TypeTag::CHAR))
     {
         data.valChar = value;
     }
 
     Value(int32_t value)
-        : type(std::make_shared<TypePrimitive>(TypeTag::INTEGER))
+        : type(TypeContext::primitive(TypeTag::INTEGER))
     {
         data.valInt = value;
     }
 
     Value(float value)
-        : type(std::make_shared<TypePrimitive>(TypeTag::FLOAT))
+        : type(TypeContext::primitive(TypeTag::FLOAT))
     {
         data.valFloat = value;
     }
 
     Value(double value)
-        : type(std::make_shared<TypePrimitive>(TypeTag::DOUBLE))
+        : type(TypeContext::primitive(TypeTag::DOUBLE))
     {
         data.valDouble = value;
     }
 
     Value(const std::string& str)
-        : type(std::make_shared<TypePrimitive>(TypeTag::STRING))
-    {
-        data.valString = new char[str.size() + 1];
-        str.copy(data.valString, str.size(), 0);
-        data.valString[str.size()] = 0;
-    }
-
-    Value(char* str)
-        : type(std::make_shared<TypePrimitive>(TypeTag::STRING))
+        : type(TypeContext::primitive(TypeTag::STRING))
     {
-        data.valString = str;
+        data.valString = String::intern(str);
     }
 
     virtual ~Value() {}
@@ -468,7 +613,7 @@ public:
             os << val.data.valDouble << "lf";
             break;
         case TypeTag::STRING:
-            os << val.data.valString;
+            os << val.data.valString->view();
             break;
         default:
             break;
@@ -495,7 +640,7 @@ public:
         case TypeTag::DOUBLE:
             return this->data.valDouble == right.data.valDouble;
         case TypeTag::STRING:
-            return std::strcmp(this->data.valString, right.data.valString) == 0;
+            return String::equal(this->data.valString, right.data.valString);
         default:
             break;
         }
@@ -514,7 +659,7 @@ class FuncValue : public Value
 public:
     IRChunk* irChunk;
 
-    FuncValue(std::shared_ptr<TypeFunction> type)
+    FuncValue(TypeFunction* type)
         : Value(type), irChunk(nullptr)
     {
     }
@@ -533,7 +678,7 @@ class NativeFunc : public Value
 public:
     bool is_variadic;
 
-    NativeFunc(NativeFn func, std::shared_ptr<TypeFunction> type)
+    NativeFunc(NativeFn func, TypeFunction* type)
         : Value(type)
     {
         data.valNative = func;
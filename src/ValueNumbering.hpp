@@ -0,0 +1,145 @@
+#pragma once
+
+#include "IRPass.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Local value numbering on the IR of one function.
+// Inside a basic block (the code between labels and jumps) a pure expression that is computed again
+// while the locals it reads are unchanged is kept in a temporary the first time, SET_LOCAL leaving the
+// value on the stack, and the later computations read the temporary instead.
+class ValueNumbering : public IRPass
+{
+private:
+    struct Computation
+    {
+        size_t start;
+        size_t end;
+        std::vector<int> reads;
+    };
+
+public:
+    size_t removed;
+    size_t saved;
+
+    ValueNumbering(IRChunk* chunk)
+        : IRPass(chunk), removed(0), saved(0)
+    {
+    }
+
+    void optimize()
+    {
+        scanFrame();
+
+        auto& code = chunk->getCode();
+        size_t first = 0;
+        while (first < code.size())
+        {
+            size_t end = first;
+            for (; end < code.size(); end++)
+            {
+                classify(code[end]);
+                if (label || jump)
+                    break;
+            }
+            while (numberBlock(first, end))
+                ;
+            first = end + 1;
+        }
+
+        layoutTemps();
+    }
+
+private:
+    bool killed(const Computation& value, size_t from, size_t to)
+    {
+        auto& code = chunk->getCode();
+        for (size_t i = from; i < to; i++)
+        {
+            classify(code[i]);
+            for (auto& slot : value.reads)
+                if (slot >= writes.first && slot < writes.second)
+                    return true;
+        }
+        return false;
+    }
+
+    // Replaces the most profitable repeated expression in [first, end), moving 'end' along.
+    bool numberBlock(size_t first, size_t& end)
+    {
+        auto& code = chunk->getCode();
+        std::unordered_map<std::string, std::vector<Computation>> values;
+        for (size_t e = first; e < end; e++)
+        {
+            classify(code[e]);
+            size_t start;
+            if (!pure || !scalar(result) || !subtree(first, e, start) || start == e)
+                continue;
+
+            Computation value{start, e, {}};
+            std::string expr;
+            bool ok = true;
+            for (size_t i = start; i <= e; i++)
+            {
+                classify(code[i]);
+                expr += key + " ";
+                if (reads >= 0)
+                {
+                    ok &= !isAddressed(reads);
+                    value.reads.push_back(reads);
+                }
+            }
+            if (ok)
+                values[expr].push_back(value);
+        }
+
+        int best = 0;
+        std::vector<Computation> uses;
+        for (auto& entry : values)
+        {
+            auto& list = entry.second;
+            for (size_t m = 0; m + 1 < list.size(); m++)
+            {
+                std::vector<Computation> repeated = {list[m]};
+                for (size_t n = m + 1; n < list.size(); n++)
+                    if (list[n].start > list[m].end && !killed(list[m], list[m].end + 1, list[n].start))
+                        repeated.push_back(list[n]);
+
+                int length = list[m].end - list[m].start + 1;
+                int benefit = (repeated.size() - 1) * (length - 1) - 1;
+                if (benefit > best)
+                {
+                    best = benefit;
+                    uses = repeated;
+                }
+            }
+        }
+
+        if (best == 0)
+            return false;
+
+        Variable var;
+        std::string name;
+        classify(code[uses[0].end]);
+        auto type = TypeContext::primitive(result);
+        if (!newTemp(type, var, name))
+            return false;
+
+        for (size_t n = uses.size() - 1; n > 0; n--)
+        {
+            for (size_t i = uses[n].start; i <= uses[n].end; i++)
+                delete code[i];
+            code.erase(code.begin() + uses[n].start, code.begin() + uses[n].end + 1);
+            code.insert(code.begin() + uses[n].start, new InstGetLocal(name, var, type));
+            end -= uses[n].end - uses[n].start;
+        }
+        code.insert(code.begin() + uses[0].end + 1, new InstSetLocal(name, var, type));
+        end++;
+
+        removed += uses.size() - 1;
+        saved += best;
+        return true;
+    }
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Value.hpp"
+
+#include <cstring>
+#include <new>
+#include <utility>
+
+// The VM stack. Unlike a vector, push_back does not check the capacity: the VM reserves the room a
+// verified chunk needs when its frame starts, and the verifier made sure the code stays in it. Host
+// calls and natives, which the verifier does not see, use append. New slots are zeroed, as
+// uninitialized locals rely on it.
+class ValueStack
+{
+private:
+    Data* first;
+    Data* top;
+    Data* last;
+
+public:
+    ValueStack()
+        : first(nullptr), top(nullptr), last(nullptr) {}
+
+    ValueStack(const ValueStack&) = delete;
+    ValueStack& operator=(const ValueStack&) = delete;
+
+    ~ValueStack()
+    {
+        ::operator delete(first);
+    }
+
+    inline size_t size() const { return top - first; }
+    inline bool empty() const { return top == first; }
+    inline size_t capacity() const { return last - first; }
+    inline Data* data() { return first; }
+    inline Data* begin() { return first; }
+    inline Data* end() { return top; }
+    inline const Data* begin() const { return first; }
+    inline const Data* end() const { return top; }
+    inline Data& operator[](size_t i) { return first[i]; }
+    inline const Data& operator[](size_t i) const { return first[i]; }
+    inline Data& back() { return top[-1]; }
+
+    inline void push_back(Data value) { *top++ = value; }
+    inline void pop_back() { top--; }
+
+    inline void append(Data value)
+    {
+        if (top == last)
+            reserve(size() + 1);
+        *top++ = value;
+    }
+
+    void append(const Data* from, const Data* to)
+    {
+        size_t count = to - from;
+        if (count == 0)
+            return;
+        reserve(size() + count);
+        memcpy(top, from, count * sizeof(Data));
+        top += count;
+    }
+
+    // Grows by at least half, so frames reserving a little more each time stay cheap.
+    void reserve(size_t count)
+    {
+        if (count <= capacity())
+            return;
+        size_t grown = capacity() + capacity() / 2;
+        count = count > grown ? count : grown;
+        size_t used = size();
+        Data* moved = (Data*)::operator new(count * sizeof(Data));
+        if (used > 0)
+            memcpy(moved, first, used * sizeof(Data));
+        ::operator delete(first);
+        first = moved;
+        top = first + used;
+        last = first + count;
+    }
+
+    void resize(size_t count)
+    {
+        reserve(count);
+        if (first + count > top)
+            memset(top, 0, (first + count - top) * sizeof(Data));
+        top = first + count;
+    }
+
+    inline void clear() { top = first; }
+
+    void assign(const Data* from, const Data* to)
+    {
+        clear();
+        append(from, to);
+    }
+
+    void swap(ValueStack& other)
+    {
+        std::swap(first, other.first);
+        std::swap(top, other.top);
+        std::swap(last, other.last);
+    }
+};
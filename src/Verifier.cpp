@@ -0,0 +1,465 @@
+#include "Verifier.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+int operandSize(OpCode code)
+{
+    switch (code)
+    {
+    case OpCode::CONSTANT:
+    case OpCode::POPN:
+    case OpCode::PUSHN:
+    case OpCode::SET_GLOBAL:
+    case OpCode::GET_GLOBAL:
+    case OpCode::SET_LOCAL:
+    case OpCode::GET_LOCAL:
+    case OpCode::SET_GLOBAL_OFF:
+    case OpCode::GET_GLOBAL_OFF:
+    case OpCode::SET_LOCAL_OFF:
+    case OpCode::GET_LOCAL_OFF:
+    case OpCode::SET_GLOBAL_POP:
+    case OpCode::SET_LOCAL_POP:
+    case OpCode::ALLOC:
+    case OpCode::SET_DEREF:
+    case OpCode::GET_DEREF:
+    case OpCode::SET_DEREF_OFF:
+    case OpCode::GET_DEREF_OFF:
+    case OpCode::ADDR_LOCAL:
+    case OpCode::ADDR_GLOBAL:
+    case OpCode::ADDR_LOCAL_OFF:
+    case OpCode::ADDR_GLOBAL_OFF:
+    case OpCode::SPAWN:
+    case OpCode::JOIN:
+    case OpCode::FIBER:
+    case OpCode::RETURN:
+        return 1;
+    case OpCode::CAST:
+    case OpCode::SET_GLOBALN:
+    case OpCode::GET_GLOBALN:
+    case OpCode::SET_LOCALN:
+    case OpCode::GET_LOCALN:
+    case OpCode::SET_GLOBAL_OFFN:
+    case OpCode::GET_GLOBAL_OFFN:
+    case OpCode::SET_LOCAL_OFFN:
+    case OpCode::GET_LOCAL_OFFN:
+    case OpCode::IADD_LOCAL:
+    case OpCode::LOAD_I8:
+    case OpCode::LOAD_I32:
+    case OpCode::STORE_I8:
+    case OpCode::STORE_I32:
+    case OpCode::CHECK_INDEX:
+    case OpCode::CHECK_LIMIT:
+    case OpCode::JUMP:
+    case OpCode::JUMP_NT_POP:
+    case OpCode::LOOP:
+    case OpCode::JUMP_NT:
+    case OpCode::CALL:
+    case OpCode::NATIVE_CALL:
+        return 2;
+    default:
+        return code > OpCode::RETURN ? -1 : 0;
+    }
+}
+
+bool isCastable(uint8_t tag)
+{
+    switch ((TypeTag)tag)
+    {
+    case TypeTag::INTEGER:
+    case TypeTag::FLOAT:
+    case TypeTag::DOUBLE:
+    case TypeTag::BOOL:
+    case TypeTag::CHAR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+class ChunkVerifier
+{
+private:
+    Chunk* chunk;
+    const std::vector<uint8_t>& code;
+    size_t globals;
+    const std::string& name;
+    size_t ip; // start of the instruction being checked
+    bool cont;
+
+public:
+    ChunkVerifier(Chunk* chunk, size_t globals, const std::string& name)
+        : chunk(chunk), code(chunk->code), globals(globals), name(name), ip(0), cont(true)
+    {
+    }
+
+    bool verify()
+    {
+        std::vector<bool> starts(code.size() + 1, false);
+        int results = -1;
+        for (ip = 0; ip < code.size() && cont;)
+        {
+            starts[ip] = true;
+            OpCode op = (OpCode)code[ip];
+            int size = operandSize(op);
+            if (size < 0)
+                return error("unknown opcode " + std::to_string(code[ip]));
+            if (ip + 1 + size > code.size())
+                return error("operands run past the end of the code");
+            if (op == OpCode::RETURN)
+            {
+                if (results >= 0 && results != code[ip + 1])
+                    return error("returns " + std::to_string(code[ip + 1]) + " slots, an earlier RETURN " + std::to_string(results));
+                results = code[ip + 1];
+            }
+            ip += 1 + size;
+        }
+        starts[code.size()] = true;
+
+        // Depth of the stack above the frame base before each instruction, -1 until a path gets there.
+        std::vector<int> depths(code.size() + 1, -1);
+        std::vector<size_t> work;
+        size_t maxDepth = chunk->argSize;
+        depths[0] = chunk->argSize;
+        work.push_back(0);
+        while (!work.empty() && cont)
+        {
+            ip = work.back();
+            work.pop_back();
+            int depth = depths[ip];
+            if (ip == code.size())
+            {
+                if (results >= 0)
+                    return error("runs off the end of a chunk that returns");
+                continue;
+            }
+
+            int next;
+            int target = -1;
+            if (!step(depth, next, target))
+                return false;
+            maxDepth = std::max(maxDepth, (size_t)depth);
+
+            for (int to : {next, target})
+            {
+                if (to < 0)
+                    continue;
+                if ((size_t)to > code.size() || !starts[to])
+                    return error("jumps into the middle of an instruction at " + std::to_string(to));
+                if (depths[to] < 0)
+                {
+                    depths[to] = depth;
+                    work.push_back(to);
+                }
+                else if (depths[to] != depth)
+                    return error("reaches " + std::to_string(to) + " with " + std::to_string(depth) + " slots, another path with " +
+                                 std::to_string(depths[to]));
+            }
+        }
+        if (!cont)
+            return false;
+
+        chunk->maxStack = maxDepth;
+        chunk->results = results;
+        chunk->verified.store(true, std::memory_order_release);
+        return true;
+    }
+
+private:
+    bool error(const std::string& message)
+    {
+        cont = false;
+        std::cout << "[Verify Error] " << name << ", at " << ip << ": " << message << std::endl;
+        return false;
+    }
+
+    bool constant(uint8_t index)
+    {
+        return index < chunk->constants.size() || error("constant " + std::to_string(index) + " does not exist");
+    }
+
+    bool local(int depth, size_t slot, size_t size = 1)
+    {
+        return slot + size <= (size_t)depth || error("local " + std::to_string(slot) + " is above the stack");
+    }
+
+    bool global(size_t slot, size_t size = 1)
+    {
+        return globals == SIZE_MAX || slot + size <= globals || error("global " + std::to_string(slot) + " does not exist");
+    }
+
+    // Checks the operands of the instruction at ip and applies it to 'depth'. 'next' is where it
+    // continues, -1 when it does not, and 'target' the jump target.
+    bool step(int& depth, int& next, int& target)
+    {
+        OpCode op = (OpCode)code[ip];
+        uint8_t a = operandSize(op) > 0 ? code[ip + 1] : 0;
+        uint8_t b = operandSize(op) > 1 ? code[ip + 2] : 0;
+        next = ip + 1 + operandSize(op);
+
+        // Slots the instruction takes from the stack and puts back.
+        int pops = 0;
+        int pushes = 0;
+        switch (op)
+        {
+        case OpCode::NOP:
+            break;
+        case OpCode::CONSTANT:
+            pushes = 1;
+            if (!constant(a))
+                return false;
+            break;
+
+        case OpCode::IADD: case OpCode::ISUB: case OpCode::IMUL: case OpCode::IDIV: case OpCode::MOD:
+        case OpCode::FADD: case OpCode::FSUB: case OpCode::FMUL: case OpCode::FDIV:
+        case OpCode::DADD: case OpCode::DSUB: case OpCode::DMUL: case OpCode::DDIV:
+        case OpCode::BIT_AND: case OpCode::BIT_OR: case OpCode::BIT_XOR:
+        case OpCode::BITSHIFT_LEFT: case OpCode::BITSHIFT_RIGHT:
+        case OpCode::DLESS: case OpCode::DGREAT: case OpCode::ILESS: case OpCode::IGREAT:
+        case OpCode::DLESS_EQUAL: case OpCode::DGREAT_EQUAL: case OpCode::DIS_EQUAL: case OpCode::DNOT_EQUAL:
+        case OpCode::ILESS_EQUAL: case OpCode::IGREAT_EQUAL: case OpCode::IIS_EQUAL: case OpCode::INOT_EQUAL:
+            pops = 2;
+            pushes = 1;
+            break;
+        case OpCode::INEG: case OpCode::FNEG: case OpCode::DNEG: case OpCode::BIT_NOT:
+        case OpCode::IINC: case OpCode::IDEC: case OpCode::FINC: case OpCode::FDEC: case OpCode::DINC: case OpCode::DDEC:
+        case OpCode::LOGIC_NOT:
+            pops = pushes = 1;
+            break;
+        case OpCode::CAST:
+            pops = pushes = 1;
+            if (!isCastable(a) || !isCastable(b))
+                return error("casts between unknown types");
+            break;
+
+        case OpCode::POPN:
+            pops = a;
+            break;
+        case OpCode::PUSHN:
+            pushes = a;
+            break;
+        case OpCode::SET_GLOBAL:
+            pops = pushes = 1;
+            if (!global(a))
+                return false;
+            break;
+        case OpCode::GET_GLOBAL:
+            pushes = 1;
+            if (!global(a))
+                return false;
+            break;
+        case OpCode::SET_LOCAL:
+            pops = pushes = 1;
+            if (!local(depth, a))
+                return false;
+            break;
+        case OpCode::GET_LOCAL:
+            pushes = 1;
+            if (!local(depth, a))
+                return false;
+            break;
+        case OpCode::SET_GLOBALN:
+            pops = pushes = b;
+            if (!global(a, b))
+                return false;
+            break;
+        case OpCode::GET_GLOBALN:
+            pushes = b;
+            if (!global(a, b))
+                return false;
+            break;
+        case OpCode::SET_LOCALN:
+            pops = pushes = b;
+            if (!local(depth, a, b))
+                return false;
+            break;
+        case OpCode::GET_LOCALN:
+            pushes = b;
+            if (!local(depth, a, b))
+                return false;
+            break;
+        // The offsets are only known at run time, the bounds checker covers them.
+        case OpCode::SET_GLOBAL_OFF:
+            pops = 2;
+            pushes = 1;
+            if (!global(a))
+                return false;
+            break;
+        case OpCode::GET_GLOBAL_OFF:
+        case OpCode::ADDR_GLOBAL_OFF:
+            pops = pushes = 1;
+            if (!global(a))
+                return false;
+            break;
+        case OpCode::SET_LOCAL_OFF:
+            pops = 2;
+            pushes = 1;
+            if (!local(depth, a))
+                return false;
+            break;
+        case OpCode::GET_LOCAL_OFF:
+        case OpCode::ADDR_LOCAL_OFF:
+            pops = pushes = 1;
+            if (!local(depth, a))
+                return false;
+            break;
+        case OpCode::SET_GLOBAL_OFFN:
+            pops = b + 1;
+            pushes = b;
+            if (!global(a))
+                return false;
+            break;
+        case OpCode::GET_GLOBAL_OFFN:
+            pops = 1;
+            pushes = b;
+            if (!global(a))
+                return false;
+            break;
+        case OpCode::SET_LOCAL_OFFN:
+            pops = b + 1;
+            pushes = b;
+            if (!local(depth, a))
+                return false;
+            break;
+        case OpCode::GET_LOCAL_OFFN:
+            pops = 1;
+            pushes = b;
+            if (!local(depth, a))
+                return false;
+            break;
+        case OpCode::SET_GLOBAL_POP:
+            pops = 1;
+            if (!global(a))
+                return false;
+            break;
+        case OpCode::SET_LOCAL_POP:
+            pops = 1;
+            if (!local(depth, a))
+                return false;
+            break;
+        case OpCode::IADD_LOCAL:
+            if (!local(depth, a) || !constant(b))
+                return false;
+            break;
+
+        case OpCode::ALLOC:
+            pushes = 1;
+            break;
+        case OpCode::FREE:
+            pops = 1;
+            break;
+        // The value stays under the pointer.
+        case OpCode::SET_DEREF:
+            pops = 2;
+            pushes = 1;
+            break;
+        case OpCode::GET_DEREF:
+            pops = 1;
+            pushes = a;
+            break;
+        case OpCode::SET_DEREF_OFF:
+            pops = 3;
+            pushes = 1;
+            break;
+        case OpCode::GET_DEREF_OFF:
+            pops = 2;
+            pushes = a;
+            break;
+        case OpCode::ADDR_LOCAL:
+            pushes = 1;
+            if (!local(depth, a))
+                return false;
+            break;
+        case OpCode::ADDR_GLOBAL:
+            pushes = 1;
+            if (!global(a))
+                return false;
+            break;
+        case OpCode::LOAD_I8:
+        case OpCode::LOAD_I32:
+        case OpCode::STORE_I8:
+        case OpCode::STORE_I32:
+        {
+            // The index, and the pointer for DEREF_OFF, are taken. Stores keep the value below them.
+            bool store = op == OpCode::STORE_I8 || op == OpCode::STORE_I32;
+            MemBase base = (MemBase)a;
+            if (base == MemBase::LOCAL && !local(depth, b))
+                return false;
+            if (base == MemBase::GLOBAL && !global(b))
+                return false;
+            if (a > (uint8_t)MemBase::DEREF)
+                return error("unknown memory base " + std::to_string(a));
+            pops = (base == MemBase::DEREF_OFF ? 2 : 1) + store;
+            pushes = 1;
+            break;
+        }
+        case OpCode::CHECK_INDEX:
+            pops = pushes = 1;
+            break;
+        case OpCode::CHECK_LIMIT:
+            pops = 1;
+            break;
+
+        case OpCode::JUMP:
+            target = next + (a | (b << 8));
+            next = -1;
+            break;
+        case OpCode::LOOP:
+        {
+            int offset = a | (b << 8);
+            if (offset > next)
+                return error("loops back before the start of the code");
+            target = next - offset;
+            next = -1;
+            break;
+        }
+        case OpCode::JUMP_NT_POP:
+            pops = 1;
+            target = next + (a | (b << 8));
+            break;
+        case OpCode::JUMP_NT:
+            pops = pushes = 1;
+            target = next + (a | (b << 8));
+            break;
+
+        case OpCode::CALL:
+        case OpCode::NATIVE_CALL:
+            pops = a + 1;
+            pushes = b;
+            break;
+        case OpCode::SPAWN:
+            pops = a + 1;
+            pushes = 1;
+            break;
+        case OpCode::JOIN:
+            pops = 1;
+            pushes = a;
+            break;
+        case OpCode::FIBER:
+            pops = a + 1;
+            break;
+        case OpCode::RETURN:
+            pops = a;
+            next = -1;
+            break;
+        }
+
+        if (pops > depth)
+            return error("takes " + std::to_string(pops) + " slots from a stack of " + std::to_string(depth));
+        // Stays well below what a frame can address, so depths never overflow.
+        depth += pushes - pops;
+        if (depth > UINT16_MAX)
+            return error("the stack grows past " + std::to_string(UINT16_MAX) + " slots");
+        return true;
+    }
+};
+} // namespace
+
+bool Verifier::verify(Chunk* chunk, size_t globals, const std::string& name)
+{
+    ChunkVerifier verifier(chunk, globals, name);
+    return verifier.verify();
+}
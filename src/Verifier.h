@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Chunk.hpp"
+
+#include <string>
+
+// Checks a chunk once before it runs, by following every path through its code with the stack
+// depth instead of the values: each opcode is known, its operands are in the code, constants,
+// locals and globals are in range, jumps land on an instruction, the stack never goes below the
+// frame and has the same depth wherever paths meet, and all RETURNs leave the same number of slots.
+// A CALL states what it passes and expects, and the VM compares that with the callee when it is
+// entered, as the callee is only a value on the stack. An accepted chunk gets the highest depth as
+// maxStack, its result size and the verified flag.
+class Verifier
+{
+public:
+    // 'globals' is the number of global slots, SIZE_MAX when the global operands are known to be in
+    // range already. Errors are printed with the name.
+    static bool verify(Chunk* chunk, size_t globals, const std::string& name);
+};